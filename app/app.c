@@ -2086,9 +2086,15 @@ gwy_app_switch_tool(const gchar *toolname)
     }
 
     GWY_OBJECT_UNREF(current_tool);
+    /* This only measures the tool creation and showing.  The work tools do
+     * later, in response to user actions, is not recorded. */
+    gwy_func_use_record_begin("tool", toolname, GWY_RUN_INTERACTIVE);
     newtool = (GwyTool*)g_object_new(type, NULL);
     current_tool = newtool;
-    g_return_if_fail(GWY_IS_TOOL(newtool));
+    if (!GWY_IS_TOOL(newtool)) {
+        gwy_func_use_record_end(NULL);
+        g_return_if_fail(GWY_IS_TOOL(newtool));
+    }
 
     settings = gwy_app_settings_get();
     gwy_container_gis_boolean_by_name(settings, "/app/restore-tool-position",
@@ -2104,6 +2110,7 @@ gwy_app_switch_tool(const gchar *toolname)
         gwy_tool_spectra_switched(current_tool, spectra);
         gwy_tool_show(current_tool);
     }
+    gwy_func_use_record_end(NULL);
 }
 
 /**
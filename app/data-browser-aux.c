@@ -2135,6 +2135,7 @@ make_thumbnail_field(GwyDataField *dfield,
     return dfield;
 }
 
+/* Draws the data and the mask, if any, in one pass. */
 static GdkPixbuf*
 render_data_thumbnail(GwyDataField *dfield,
                       const gchar *gradname,
@@ -2142,12 +2143,15 @@ render_data_thumbnail(GwyDataField *dfield,
                       gint width,
                       gint height,
                       gdouble *pmin,
-                      gdouble *pmax)
+                      gdouble *pmax,
+                      GwyDataField *mfield,
+                      const GwyRGBA *color)
 {
-    GwyDataField *render_field;
+    GwyDataField *render_field, *mask_field = NULL, *resampled;
     GdkPixbuf *pixbuf;
     GwyGradient *gradient;
-    gdouble min, max;
+    gint mwidth = width, mheight = height;
+    gdouble min = 0.0, max = 0.0;
 
     gradient = gwy_gradients_get_gradient(gradname);
     gwy_resource_use(GWY_RESOURCE(gradient));
@@ -2157,58 +2161,58 @@ render_data_thumbnail(GwyDataField *dfield,
                             width, height);
     gwy_debug_objects_creation(G_OBJECT(pixbuf));
 
+    if (mfield) {
+        mask_field = make_thumbnail_field(mfield, &mwidth, &mheight);
+        /* The mask should always have the same dimensions as the data, but
+         * do not crash if it does not. */
+        if (mwidth != width || mheight != height) {
+            resampled = gwy_data_field_new_resampled(mask_field, width, height,
+                                                     GWY_INTERPOLATION_NNA);
+            g_object_unref(mask_field);
+            mask_field = resampled;
+        }
+    }
+
     switch (range_type) {
         case GWY_LAYER_BASIC_RANGE_FULL:
-        gwy_pixbuf_draw_data_field(pixbuf, render_field, gradient);
+        gwy_data_field_get_min_max(render_field, &min, &max);
         break;
 
         case GWY_LAYER_BASIC_RANGE_FIXED:
         min = pmin ? *pmin : gwy_data_field_get_min(render_field);
         max = pmax ? *pmax : gwy_data_field_get_max(render_field);
-        gwy_pixbuf_draw_data_field_with_range(pixbuf, render_field, gradient,
-                                              min, max);
         break;
 
         case GWY_LAYER_BASIC_RANGE_AUTO:
         gwy_data_field_get_autorange(render_field, &min, &max);
-        gwy_pixbuf_draw_data_field_with_range(pixbuf, render_field, gradient,
-                                              min, max);
         break;
 
         case GWY_LAYER_BASIC_RANGE_ADAPT:
-        gwy_pixbuf_draw_data_field_adaptive(pixbuf, render_field, gradient);
         break;
 
         default:
         g_warning("Bad range type: %d", range_type);
-        gwy_pixbuf_draw_data_field(pixbuf, render_field, gradient);
+        range_type = GWY_LAYER_BASIC_RANGE_FULL;
+        gwy_data_field_get_min_max(render_field, &min, &max);
         break;
     }
+
+    if (range_type == GWY_LAYER_BASIC_RANGE_ADAPT)
+        gwy_pixbuf_draw_data_field_adaptive_and_mask(pixbuf, render_field,
+                                                     gradient,
+                                                     mask_field, color);
+    else
+        gwy_pixbuf_draw_data_field_with_range_and_mask(pixbuf, render_field,
+                                                       gradient, min, max,
+                                                       mask_field, color);
     g_object_unref(render_field);
+    GWY_OBJECT_UNREF(mask_field);
 
     gwy_resource_release(GWY_RESOURCE(gradient));
 
     return pixbuf;
 }
 
-static GdkPixbuf*
-render_mask_thumbnail(GwyDataField *dfield,
-                      const GwyRGBA *color,
-                      gint width,
-                      gint height)
-{
-    GwyDataField *render_field;
-    GdkPixbuf *pixbuf;
-
-    render_field = make_thumbnail_field(dfield, &width, &height);
-    pixbuf = gdk_pixbuf_new(GDK_COLORSPACE_RGB, TRUE, BITS_PER_SAMPLE,
-                            width, height);
-    gwy_pixbuf_draw_data_field_as_mask(pixbuf, render_field, color);
-    g_object_unref(render_field);
-
-    return pixbuf;
-}
-
 /**
  * gwy_app_get_channel_thumbnail:
  * @data: A data container.
@@ -2231,7 +2235,7 @@ gwy_app_get_channel_thumbnail(GwyContainer *data,
     GwyDataField *dfield, *mfield = NULL, *sfield = NULL;
     GwyLayerBasicRangeType range_type = GWY_LAYER_BASIC_RANGE_FULL;
     const guchar *gradient = NULL;
-    GdkPixbuf *pixbuf, *mask;
+    GdkPixbuf *pixbuf;
     gdouble min, max;
     gboolean min_set = FALSE, max_set = FALSE;
     GwyRGBA color;
@@ -2250,10 +2254,19 @@ gwy_app_get_channel_thumbnail(GwyContainer *data,
     gwy_container_gis_string(data, gwy_app_get_data_palette_key_for_id(id),
                              &gradient);
 
+    if (mfield) {
+        quark = gwy_app_get_mask_key_for_id(id);
+        if (!gwy_rgba_get_from_container(&color, data,
+                                         g_quark_to_string(quark)))
+            gwy_rgba_get_from_container(&color, gwy_app_settings_get(),
+                                        "/mask");
+    }
+
     if (sfield)
         pixbuf = render_data_thumbnail(sfield, gradient,
                                        GWY_LAYER_BASIC_RANGE_FULL,
-                                       max_width, max_height, NULL, NULL);
+                                       max_width, max_height, NULL, NULL,
+                                       mfield, &color);
     else {
         gwy_container_gis_enum(data, gwy_app_get_data_range_type_key_for_id(id),
                                &range_type);
@@ -2270,25 +2283,8 @@ gwy_app_get_channel_thumbnail(GwyContainer *data,
         pixbuf = render_data_thumbnail(dfield, gradient, range_type,
                                        max_width, max_height,
                                        min_set ? &min : NULL,
-                                       max_set ? &max : NULL);
-    }
-
-    if (mfield) {
-        quark = gwy_app_get_mask_key_for_id(id);
-        if (!gwy_rgba_get_from_container(&color, data,
-                                         g_quark_to_string(quark)))
-            gwy_rgba_get_from_container(&color, gwy_app_settings_get(),
-                                        "/mask");
-        mask = render_mask_thumbnail(mfield, &color, max_width, max_height);
-        gdk_pixbuf_composite(mask, pixbuf,
-                             0, 0,
-                             gdk_pixbuf_get_width(pixbuf),
-                             gdk_pixbuf_get_height(pixbuf),
-                             0, 0,
-                             1.0, 1.0,
-                             GDK_INTERP_NEAREST,
-                             255);
-        g_object_unref(mask);
+                                       max_set ? &max : NULL,
+                                       mfield, &color);
     }
 
     return pixbuf;
@@ -2341,7 +2337,8 @@ gwy_app_get_volume_thumbnail(GwyContainer *data,
                              &gradient);
     pixbuf = render_data_thumbnail(dfield, gradient,
                                    GWY_LAYER_BASIC_RANGE_FULL,
-                                   max_width, max_height, NULL, NULL);
+                                   max_width, max_height, NULL, NULL,
+                                   NULL, NULL);
 
     return pixbuf;
 }
@@ -2388,7 +2385,8 @@ gwy_app_get_xyz_thumbnail(GwyContainer *data,
     gwy_preview_surface_to_datafield(surface, raster, max_width, max_height, 0);
     pixbuf = render_data_thumbnail(raster, gradient,
                                    GWY_LAYER_BASIC_RANGE_FULL,
-                                   max_width, max_height, NULL, NULL);
+                                   max_width, max_height, NULL, NULL,
+                                   NULL, NULL);
     g_object_unref(raster);
 
     return pixbuf;
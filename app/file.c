@@ -255,12 +255,14 @@ gwy_app_file_load_real(const gchar *filename_utf8,
     }
 
     _gwy_app_log_start_message_capture();
+    gwy_func_use_record_begin("file-load", name, GWY_RUN_INTERACTIVE);
     if (name)
         data = gwy_file_func_run_load(name, filename_sys,
                                       GWY_RUN_INTERACTIVE, &err);
     else
         data = gwy_file_load_with_func(filename_sys, GWY_RUN_INTERACTIVE,
                                        &name, &err);
+    gwy_func_use_record_end(name);
 
     if (data) {
         gwy_data_validate(data,
@@ -481,6 +483,7 @@ gwy_app_file_write(GwyContainer *data,
         free_utf8 = TRUE;
     }
 
+    gwy_func_use_record_begin("file-save", name, GWY_RUN_INTERACTIVE);
     if (name) {
         saveok = gwy_file_func_get_operations(name);
         if (saveok & GWY_FILE_OPERATION_SAVE
@@ -497,6 +500,7 @@ gwy_app_file_write(GwyContainer *data,
     else
         saveok = gwy_file_save_with_func(data, filename_sys,
                                          GWY_RUN_INTERACTIVE, &name, &err);
+    gwy_func_use_record_end(name);
 
     switch (saveok) {
         case GWY_FILE_OPERATION_SAVE:
@@ -20,7 +20,13 @@
  */
 
 #include "config.h"
+#include <stdio.h>
 #include <string.h>
+#include <time.h>
+#ifdef HAVE_SYS_RESOURCE_H
+#include <sys/time.h>
+#include <sys/resource.h>
+#endif
 #include <libgwyddion/gwymacros.h>
 #include <libgwyddion/gwyutils.h>
 #include <app/gwyapp.h>
@@ -40,7 +46,24 @@ struct _GwyFunctionUse {
     GArray *funcs;
 };
 
+typedef struct {
+    guint record;
+    GTimer *timer;
+    gdouble cpu_start;
+    gint64 memory_base;
+    gint64 memory_max;
+} GwyFuncUseFrame;
+
+static gdouble  get_cpu_time       (void);
+static gboolean get_memory_usage   (gint64 *rss,
+                                    gint64 *peak);
+static gboolean reset_memory_peak  (void);
+static void     update_memory_peaks(void);
+
 static GwyFunctionUse *process_use_info  = NULL;
+static GArray *records = NULL;
+static GArray *frames = NULL;
+static gint memory_peak_resettable = -1;
 
 /**
  * gwy_func_use_info_compare:
@@ -359,10 +382,422 @@ gwy_app_process_func_save_use(void)
     g_free(filename);
 }
 
+/**
+ * gwy_func_use_record_begin:
+ * @type: Function type, for instance "proc", "volume", "tool" or "file-load".
+ * @name: Function name.  It can be %NULL if the name becomes known only when
+ *        the function finishes.
+ * @mode: The mode the function is run in.
+ *
+ * Starts recording resource usage of a function invocation.
+ *
+ * Each call must be paired with gwy_func_use_record_end(), called when the
+ * function finishes.  Records can nest, for instance when a function invokes
+ * other functions.
+ *
+ * The wall time of interactive invocations includes the time the user spent
+ * in the function dialog.  For tools, only switching to the tool is
+ * recorded, not the work they do later.  The CPU time is the processor time
+ * of the entire program, summed over all threads.
+ *
+ * Since: 2.47
+ **/
+void
+gwy_func_use_record_begin(const gchar *type,
+                          const gchar *name,
+                          GwyRunType mode)
+{
+    GwyFuncUseRecord record;
+    GwyFuncUseFrame frame;
+    GTimeVal t;
+    gint64 rss, peak;
+
+    g_return_if_fail(type);
+
+    if (!records) {
+        records = g_array_new(FALSE, FALSE, sizeof(GwyFuncUseRecord));
+        frames = g_array_new(FALSE, FALSE, sizeof(GwyFuncUseFrame));
+    }
+
+    g_get_current_time(&t);
+    gwy_clear(&record, 1);
+    record.type = g_quark_to_string(g_quark_from_string(type));
+    if (name)
+        record.name = g_quark_to_string(g_quark_from_string(name));
+    record.mode = mode;
+    record.start = t.tv_sec + 1e-6*t.tv_usec;
+    record.wall_time = -1.0;
+    record.cpu_time = -1.0;
+    record.peak_memory = -1;
+    g_array_append_val(records, record);
+
+    /* The outer frames must remember the peak before we reset it. */
+    update_memory_peaks();
+    frame.record = records->len-1;
+    frame.memory_base = frame.memory_max = -1;
+    if (get_memory_usage(&rss, &peak)) {
+        if (rss >= 0 && reset_memory_peak())
+            frame.memory_base = frame.memory_max = rss;
+        else
+            frame.memory_base = frame.memory_max = peak;
+    }
+    frame.cpu_start = get_cpu_time();
+    frame.timer = g_timer_new();
+    g_array_append_val(frames, frame);
+}
+
+/**
+ * gwy_func_use_record_end:
+ * @name: Function name if it was not known when the record was started,
+ *        otherwise %NULL.
+ *
+ * Finishes recording resource usage of a function invocation.
+ *
+ * Returns: The finished record.  It is owned by the application and valid
+ *          until the next record is started.
+ *
+ * Since: 2.47
+ **/
+const GwyFuncUseRecord*
+gwy_func_use_record_end(const gchar *name)
+{
+    GwyFuncUseRecord *record;
+    GwyFuncUseFrame *frame;
+    gdouble cpu_end;
+
+    g_return_val_if_fail(frames && frames->len, NULL);
+
+    cpu_end = get_cpu_time();
+    update_memory_peaks();
+    frame = &g_array_index(frames, GwyFuncUseFrame, frames->len-1);
+    record = &g_array_index(records, GwyFuncUseRecord, frame->record);
+    if (name)
+        record->name = g_quark_to_string(g_quark_from_string(name));
+    record->wall_time = g_timer_elapsed(frame->timer, NULL);
+    if (frame->cpu_start >= 0.0 && cpu_end >= 0.0)
+        record->cpu_time = cpu_end - frame->cpu_start;
+    if (frame->memory_base >= 0)
+        record->peak_memory = MAX(frame->memory_max - frame->memory_base, 0);
+    g_timer_destroy(frame->timer);
+    g_array_set_size(frames, frames->len-1);
+    /* Let the outer frames continue measuring from the current usage. */
+    if (frames->len && memory_peak_resettable == TRUE)
+        reset_memory_peak();
+
+    return record;
+}
+
+/**
+ * gwy_func_use_current_record:
+ *
+ * Finds which function invocation is being recorded.
+ *
+ * Returns: The index of the record of the innermost running function, or -1
+ *          if no function is running.
+ *
+ * Since: 2.47
+ **/
+gint
+gwy_func_use_current_record(void)
+{
+    if (!frames || !frames->len)
+        return -1;
+
+    return g_array_index(frames, GwyFuncUseFrame, frames->len-1).record;
+}
+
+/**
+ * gwy_func_use_get_n_records:
+ *
+ * Gets the number of recorded function invocations.
+ *
+ * Returns: The number of records, including unfinished.
+ *
+ * Since: 2.47
+ **/
+guint
+gwy_func_use_get_n_records(void)
+{
+    return records ? records->len : 0;
+}
+
+/**
+ * gwy_func_use_get_record:
+ * @i: Record index.
+ *
+ * Gets one recorded function invocation.
+ *
+ * Records are kept for the entire session and their indices do not change.
+ * The record of a running function has negative wall time.  Negative CPU
+ * time or memory mean they could not be measured.
+ *
+ * Returns: The record.  It is owned by the application and valid until the
+ *          next record is started.
+ *
+ * Since: 2.47
+ **/
+const GwyFuncUseRecord*
+gwy_func_use_get_record(guint i)
+{
+    g_return_val_if_fail(records && i < records->len, NULL);
+    return &g_array_index(records, GwyFuncUseRecord, i);
+}
+
+static const gchar*
+run_mode_name(GwyRunType mode)
+{
+    if (mode & GWY_RUN_INTERACTIVE)
+        return "interactive";
+    if (mode & GWY_RUN_IMMEDIATE)
+        return "immediate";
+    if (mode & GWY_RUN_NONINTERACTIVE)
+        return "noninteractive";
+    return "";
+}
+
+static gchar*
+format_start_time(gdouble start)
+{
+    GTimeVal t;
+
+    t.tv_sec = (glong)start;
+    t.tv_usec = (glong)(1e6*(start - t.tv_sec));
+    return g_time_val_to_iso8601(&t);
+}
+
+/**
+ * gwy_func_use_records_to_csv:
+ *
+ * Formats all function invocation records as comma-separated values.
+ *
+ * The columns are type, name, mode, start time, wall time and CPU time (in
+ * seconds) and peak memory (in bytes).  Quantities that could not be
+ * measured are empty.
+ *
+ * Returns: A newly allocated string.
+ *
+ * Since: 2.47
+ **/
+gchar*
+gwy_func_use_records_to_csv(void)
+{
+    GString *str = g_string_new(NULL);
+    gchar buf[G_ASCII_DTOSTR_BUF_SIZE];
+    const GwyFuncUseRecord *record;
+    gchar *start;
+    guint i;
+
+    g_string_append(str, "type,name,mode,start,wall_time,cpu_time,"
+                    "peak_memory\n");
+    for (i = 0; i < gwy_func_use_get_n_records(); i++) {
+        record = gwy_func_use_get_record(i);
+        start = format_start_time(record->start);
+        g_string_append_printf(str, "%s,%s,%s,%s,",
+                               record->type,
+                               record->name ? record->name : "",
+                               run_mode_name(record->mode),
+                               start);
+        g_free(start);
+        if (record->wall_time >= 0.0)
+            g_string_append(str, g_ascii_formatd(buf, sizeof(buf), "%.6f",
+                                                 record->wall_time));
+        g_string_append_c(str, ',');
+        if (record->cpu_time >= 0.0)
+            g_string_append(str, g_ascii_formatd(buf, sizeof(buf), "%.6f",
+                                                 record->cpu_time));
+        g_string_append_c(str, ',');
+        if (record->peak_memory >= 0)
+            g_string_append_printf(str, "%" G_GINT64_FORMAT,
+                                   record->peak_memory);
+        g_string_append_c(str, '\n');
+    }
+
+    return g_string_free(str, FALSE);
+}
+
+/**
+ * gwy_func_use_records_to_json:
+ *
+ * Formats all function invocation records as JSON.
+ *
+ * The result is an array of objects with the same fields as the columns of
+ * gwy_func_use_records_to_csv().  Quantities that could not be measured are
+ * null.
+ *
+ * Returns: A newly allocated string.
+ *
+ * Since: 2.47
+ **/
+gchar*
+gwy_func_use_records_to_json(void)
+{
+    GString *str = g_string_new(NULL);
+    gchar buf[G_ASCII_DTOSTR_BUF_SIZE];
+    const GwyFuncUseRecord *record;
+    gchar *start;
+    guint i;
+
+    g_string_append_c(str, '[');
+    for (i = 0; i < gwy_func_use_get_n_records(); i++) {
+        record = gwy_func_use_get_record(i);
+        start = format_start_time(record->start);
+        g_string_append_printf(str, "%s\n  {\"type\": \"%s\", \"name\": ",
+                               i ? "," : "", record->type);
+        if (record->name)
+            g_string_append_printf(str, "\"%s\"", record->name);
+        else
+            g_string_append(str, "null");
+        g_string_append_printf(str, ", \"mode\": \"%s\", \"start\": \"%s\"",
+                               run_mode_name(record->mode), start);
+        g_free(start);
+        g_string_append(str, ", \"wall_time\": ");
+        if (record->wall_time >= 0.0)
+            g_string_append(str, g_ascii_formatd(buf, sizeof(buf), "%.6f",
+                                                 record->wall_time));
+        else
+            g_string_append(str, "null");
+        g_string_append(str, ", \"cpu_time\": ");
+        if (record->cpu_time >= 0.0)
+            g_string_append(str, g_ascii_formatd(buf, sizeof(buf), "%.6f",
+                                                 record->cpu_time));
+        else
+            g_string_append(str, "null");
+        g_string_append(str, ", \"peak_memory\": ");
+        if (record->peak_memory >= 0)
+            g_string_append_printf(str, "%" G_GINT64_FORMAT,
+                                   record->peak_memory);
+        else
+            g_string_append(str, "null");
+        g_string_append_c(str, '}');
+    }
+    g_string_append(str, "\n]\n");
+
+    return g_string_free(str, FALSE);
+}
+
+/* Processor time used by the program, in seconds, or -1 if unknown. */
+static gdouble
+get_cpu_time(void)
+{
+#ifdef HAVE_SYS_RESOURCE_H
+    struct rusage usage;
+
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+        return (usage.ru_utime.tv_sec + 1e-6*usage.ru_utime.tv_usec
+                + usage.ru_stime.tv_sec + 1e-6*usage.ru_stime.tv_usec);
+    }
+    return -1.0;
+#else
+    clock_t t = clock();
+
+    return (t == (clock_t)-1) ? -1.0 : (gdouble)t/CLOCKS_PER_SEC;
+#endif
+}
+
+/* Resident set size and its high-water mark, in bytes.  Either can be -1 if
+ * unknown. */
+static gboolean
+get_memory_usage(gint64 *rss, gint64 *peak)
+{
+    gchar *buffer = NULL, *p, *line;
+
+    *rss = *peak = -1;
+    if (g_file_get_contents("/proc/self/status", &buffer, NULL, NULL)) {
+        p = buffer;
+        while ((line = gwy_str_next_line(&p))) {
+            if (g_str_has_prefix(line, "VmRSS:"))
+                *rss = 1024*g_ascii_strtoll(line + 6, NULL, 10);
+            else if (g_str_has_prefix(line, "VmHWM:"))
+                *peak = 1024*g_ascii_strtoll(line + 6, NULL, 10);
+        }
+        g_free(buffer);
+    }
+#ifdef HAVE_SYS_RESOURCE_H
+    if (*peak < 0) {
+        struct rusage usage;
+
+        if (getrusage(RUSAGE_SELF, &usage) == 0) {
+#ifdef __APPLE__
+            *peak = usage.ru_maxrss;
+#else
+            *peak = 1024*(gint64)usage.ru_maxrss;
+#endif
+        }
+    }
+#endif
+
+    return *peak >= 0;
+}
+
+/* Resets the high-water mark to the current resident set size.  This is
+ * only possible on Linux.  Elsewhere only the growth of the high-water mark
+ * is seen, which underestimates the memory used by functions running after
+ * some more memory-hungry function. */
+static gboolean
+reset_memory_peak(void)
+{
+    FILE *fh;
+
+    if (!memory_peak_resettable)
+        return FALSE;
+
+    if ((fh = fopen("/proc/self/clear_refs", "w"))) {
+        memory_peak_resettable = (fputs("5", fh) >= 0);
+        if (fclose(fh) != 0)
+            memory_peak_resettable = FALSE;
+    }
+    else
+        memory_peak_resettable = FALSE;
+
+    return memory_peak_resettable;
+}
+
+static void
+update_memory_peaks(void)
+{
+    GwyFuncUseFrame *frame;
+    gint64 rss, peak;
+    guint i;
+
+    if (!frames || !frames->len || !get_memory_usage(&rss, &peak))
+        return;
+
+    for (i = 0; i < frames->len; i++) {
+        frame = &g_array_index(frames, GwyFuncUseFrame, i);
+        if (frame->memory_base >= 0)
+            frame->memory_max = MAX(frame->memory_max, peak);
+    }
+}
+
 /**
  * SECTION:funcuse
  * @title: funcuse
  * @short_description: Gather function use statistics
+ *
+ * Apart from the long-term statistics of which data processing functions are
+ * used most, the application records the resource usage of all module
+ * function invocations in the current session: wall time, processor time and
+ * peak memory use.  They can be viewed in data logs and exported with
+ * gwy_func_use_records_to_csv() or gwy_func_use_records_to_json().
+ **/
+
+/**
+ * GwyFuncUseRecord:
+ * @type: Function type, for instance "proc" or "file-load".
+ * @name: Function name.  It may be %NULL if the function failed before its
+ *        name was known.
+ * @mode: The mode the function was run in.
+ * @start: Start time, in seconds since the Epoch.
+ * @wall_time: Duration of the invocation, in seconds.  Negative if the
+ *             function is still running.
+ * @cpu_time: Processor time used by the program during the invocation, in
+ *            seconds.  Negative if unknown.
+ * @peak_memory: Peak resident memory used during the invocation above the
+ *               resident memory at its start, in bytes.  Negative if unknown.
+ *
+ * Record of resource usage of one module function invocation.
+ *
+ * Since: 2.47
  **/
 
 /* vim: set cin et ts=4 sw=4 cino=>1s,e0,n0,f0,{0,}0,^0,\:1s,=0,g1s,h0,t0,+1s,c3,(0,u0 : */
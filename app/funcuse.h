@@ -23,11 +23,22 @@
 #define __GWY_APP_FUNCUSE_H__
 
 #include <glib.h>
+#include <libgwymodule/gwymoduleenums.h>
 
 G_BEGIN_DECLS
 
 typedef struct _GwyFunctionUse GwyFunctionUse;
 
+typedef struct {
+    const gchar *type;
+    const gchar *name;
+    GwyRunType mode;
+    gdouble start;
+    gdouble wall_time;
+    gdouble cpu_time;
+    gint64 peak_memory;
+} GwyFuncUseRecord;
+
 GwyFunctionUse* gwy_func_use_new             (void);
 void            gwy_func_use_free            (GwyFunctionUse *functions);
 void            gwy_func_use_add             (GwyFunctionUse *functions,
@@ -42,6 +53,16 @@ gchar*          gwy_func_use_get_filename    (const gchar *type);
 GwyFunctionUse* gwy_app_process_func_get_use (void);
 void            gwy_app_process_func_save_use(void);
 
+void                    gwy_func_use_record_begin   (const gchar *type,
+                                                     const gchar *name,
+                                                     GwyRunType mode);
+const GwyFuncUseRecord* gwy_func_use_record_end     (const gchar *name);
+gint                    gwy_func_use_current_record (void);
+guint                   gwy_func_use_get_n_records  (void);
+const GwyFuncUseRecord* gwy_func_use_get_record     (guint i);
+gchar*                  gwy_func_use_records_to_csv (void);
+gchar*                  gwy_func_use_records_to_json(void);
+
 G_END_DECLS
 
 #endif /* __GWY_APP_FUNCUSE_H__ */
@@ -0,0 +1,1045 @@
+/*
+ *  @(#) $Id$
+ *  Copyright (C) 2016 David Necas (Yeti).
+ *  E-mail: yeti@gwyddion.net.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * Headless batch processing of data files.
+ *
+ * Each file is loaded, the given sequence of process functions is run on its
+ * channels with the settings stored in the settings file (possibly
+ * overriden on the command line) and the result is saved or exported to the
+ * output directory.
+ *
+ * With more than one job the program spawns itself as worker processes.
+ * Workers get the same command line and hence the same file list.  The
+ * master sends them file indices on standard input, one per line, and reads
+ * one result line per processed file from their standard output.  Modules may
+ * print to standard output too, so workers keep the original standard output
+ * for results only and redirect file descriptor 1 to standard error.  Module
+ * functions use the global data browser state so processes, not threads, are
+ * the unit of parallelism.
+ */
+
+#include "config.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib/gstdio.h>
+#include <gtk/gtk.h>
+#include <libgwyddion/gwyddion.h>
+#include <libprocess/gwyprocess.h>
+#include <libdraw/gwydraw.h>
+#include <libgwydgets/gwydgets.h>
+#include <libgwymodule/gwymodule.h>
+#include <app/gwyapp.h>
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#ifdef G_OS_WIN32
+#include <io.h>
+#define new_channel_for_fd g_io_channel_win32_new_fd
+#else
+#define new_channel_for_fd g_io_channel_unix_new
+#endif
+
+#define PROGRAM_NAME "gwyddion-batch"
+
+/* Being compatible with various version of GLib requires creativity... */
+#if (!GLIB_CHECK_VERSION(2, 26, 0))
+#define GStatBuf struct stat
+#endif
+
+typedef enum {
+    FILE_PENDING = 0,
+    FILE_RUNNING,
+    FILE_OK,
+    FILE_FAILED,
+} FileStatus;
+
+typedef struct {
+    gchar **process;
+    gchar **set;
+    gchar *settings;
+    gchar *output_dir;
+    gchar *format;
+    gchar *summary;
+    gint channel;
+    gint jobs;
+    gboolean list;
+    gboolean quiet;
+    gboolean worker;
+} Options;
+
+typedef struct {
+    const gchar *filename;
+    gchar *outname;
+    FileStatus status;
+    gdouble load_time;
+    gdouble process_time;
+    gdouble save_time;
+    gdouble total_time;
+    gdouble cpu_time;
+    gint64 peak_memory;
+    gchar *message;
+} FileResult;
+
+typedef struct _Batch Batch;
+
+typedef struct {
+    Batch *batch;
+    GIOChannel *in;
+    GIOChannel *out;
+    guint watch_id;
+    gint current;
+} Worker;
+
+struct _Batch {
+    const Options *options;
+    FileResult *results;
+    guint nfiles;
+    guint next;
+    guint ndone;
+    guint nworkers;
+    Worker *workers;
+    GMainLoop *loop;
+};
+
+static const GOptionEntry entries[] = {
+    {
+        "process", 'p', 0, G_OPTION_ARG_STRING_ARRAY, NULL,
+        "Process function to run, can be given several times", "NAME",
+    },
+    {
+        "set", 's', 0, G_OPTION_ARG_STRING_ARRAY, NULL,
+        "Override a setting, e.g. /module/level/mode=1", "KEY=VALUE",
+    },
+    {
+        "settings", 0, 0, G_OPTION_ARG_FILENAME, NULL,
+        "Read settings from FILE instead of the user settings", "FILE",
+    },
+    {
+        "output-dir", 'o', 0, G_OPTION_ARG_FILENAME, NULL,
+        "Directory to write the results to", "DIR",
+    },
+    {
+        "format", 'f', 0, G_OPTION_ARG_STRING, NULL,
+        "Output file name extension determining the format (default gwy)",
+        "EXT",
+    },
+    {
+        "channel", 'c', 0, G_OPTION_ARG_INT, NULL,
+        "Process only channel ID (default all channels)", "ID",
+    },
+    {
+        "jobs", 'j', 0, G_OPTION_ARG_INT, NULL,
+        "Number of worker processes (default 1)", "N",
+    },
+    {
+        "summary", 0, 0, G_OPTION_ARG_FILENAME, NULL,
+        "Write per-file timing as CSV to FILE", "FILE",
+    },
+    {
+        "list", 'l', 0, G_OPTION_ARG_NONE, NULL,
+        "List process functions that can run non-interactively and exit", NULL,
+    },
+    {
+        "quiet", 'q', 0, G_OPTION_ARG_NONE, NULL,
+        "Do not print progress to standard error", NULL,
+    },
+    {
+        "worker", 0, G_OPTION_FLAG_HIDDEN, G_OPTION_ARG_NONE, NULL,
+        NULL, NULL,
+    },
+    { NULL, 0, 0, 0, NULL, NULL, NULL, },
+};
+
+static void
+die(const gchar *reason, ...)
+{
+    va_list ap;
+
+    va_start(ap, reason);
+    fprintf(stderr, "%s: Aborting. %s\n",
+            PROGRAM_NAME, g_strdup_vprintf(reason, ap));
+    va_end(ap);
+    exit(EXIT_FAILURE);
+}
+
+static void
+parse_options(Options *options, int *argc, char ***argv)
+{
+    GOptionEntry myentries[G_N_ELEMENTS(entries)];
+    GOptionContext *context;
+    GError *error = NULL;
+
+    memcpy(myentries, entries, sizeof(entries));
+    myentries[0].arg_data = &options->process;
+    myentries[1].arg_data = &options->set;
+    myentries[2].arg_data = &options->settings;
+    myentries[3].arg_data = &options->output_dir;
+    myentries[4].arg_data = &options->format;
+    myentries[5].arg_data = &options->channel;
+    myentries[6].arg_data = &options->jobs;
+    myentries[7].arg_data = &options->summary;
+    myentries[8].arg_data = &options->list;
+    myentries[9].arg_data = &options->quiet;
+    myentries[10].arg_data = &options->worker;
+
+    context = g_option_context_new("FILE... - process data files in batch");
+    g_option_context_add_main_entries(context, myentries, NULL);
+    if (!g_option_context_parse(context, argc, argv, &error))
+        die("%s", error->message);
+    g_option_context_free(context);
+
+    if (options->list)
+        return;
+    if (!options->process || !options->process[0])
+        die("No process function given.");
+    if (!options->output_dir)
+        die("No output directory given.");
+    if (*argc < 2)
+        die("No input files given.");
+    if (options->jobs <= 0)
+        die("The number of jobs must be positive.");
+    if (!options->format)
+        options->format = "gwy";
+}
+
+static void
+load_modules(void)
+{
+    static const gchar *const module_types[] = {
+        "file", "layer", "process", NULL
+    };
+    GPtrArray *module_dirs;
+    const gchar *q;
+    gchar *p;
+    guint i;
+
+    module_dirs = g_ptr_array_new();
+
+    p = gwy_find_self_dir("modules");
+    for (i = 0; module_types[i]; i++) {
+        g_ptr_array_add(module_dirs,
+                        g_build_filename(p, module_types[i], NULL));
+    }
+    g_free(p);
+
+    q = gwy_get_user_dir();
+    for (i = 0; module_types[i]; i++) {
+        g_ptr_array_add(module_dirs,
+                        g_build_filename(q, module_types[i], NULL));
+    }
+
+    g_ptr_array_add(module_dirs, NULL);
+    gwy_module_register_modules((const gchar**)module_dirs->pdata);
+
+    for (i = 0; module_dirs->pdata[i]; i++)
+        g_free(module_dirs->pdata[i]);
+    g_ptr_array_free(module_dirs, TRUE);
+}
+
+/* Prefer running with the last used settings, which is what we are asked
+ * to do.  Functions without parameters may offer only non-interactive runs. */
+static GwyRunType
+get_run_mode(const gchar *name)
+{
+    GwyRunType run = gwy_process_func_get_run_types(name);
+
+    if (run & GWY_RUN_IMMEDIATE)
+        return GWY_RUN_IMMEDIATE;
+    if (run & GWY_RUN_NONINTERACTIVE)
+        return GWY_RUN_NONINTERACTIVE;
+    return 0;
+}
+
+static void
+print_function(gpointer hkey, G_GNUC_UNUSED gpointer user_data)
+{
+    const gchar *name = (const gchar*)hkey;
+    const gchar *path;
+
+    if (!get_run_mode(name))
+        return;
+
+    path = gwy_process_func_get_menu_path(name);
+    printf("%-24s %s\n", name, path ? path : "");
+}
+
+static void
+check_functions(const Options *options)
+{
+    guint i;
+
+    for (i = 0; options->process[i]; i++) {
+        if (!gwy_process_func_exists(options->process[i]))
+            die("No such process function '%s'.", options->process[i]);
+        if (!get_run_mode(options->process[i]))
+            die("Process function '%s' cannot run non-interactively.",
+                options->process[i]);
+    }
+}
+
+/* Uses the type of the existing value if there is any, otherwise guesses it
+ * from the string. */
+static void
+set_setting(GwyContainer *settings, const gchar *assignment)
+{
+    const gchar *value;
+    gchar *key, *end;
+    GQuark quark;
+    GType type = 0;
+    gdouble d;
+    glong i;
+
+    if (!(value = strchr(assignment, '=')) || value == assignment
+        || assignment[0] != GWY_CONTAINER_PATHSEP)
+        die("Setting '%s' is not in the form /KEY=VALUE.", assignment);
+
+    key = g_strndup(assignment, value - assignment);
+    value++;
+    quark = g_quark_from_string(key);
+    if (gwy_container_contains(settings, quark))
+        type = gwy_container_value_type(settings, quark);
+
+    if (type == G_TYPE_STRING)
+        gwy_container_set_string(settings, quark, g_strdup(value));
+    else if (type == G_TYPE_BOOLEAN
+             || (!type && (gwy_strequal(value, "True")
+                           || gwy_strequal(value, "False")))) {
+        if (!gwy_strequal(value, "True") && !gwy_strequal(value, "False")
+            && !gwy_strequal(value, "1") && !gwy_strequal(value, "0"))
+            die("Setting %s requires a boolean value.", key);
+        gwy_container_set_boolean(settings, quark,
+                                  gwy_strequal(value, "True")
+                                  || gwy_strequal(value, "1"));
+    }
+    else if (type == G_TYPE_DOUBLE) {
+        d = g_ascii_strtod(value, &end);
+        if (end == value || *end)
+            die("Setting %s requires a number.", key);
+        gwy_container_set_double(settings, quark, d);
+    }
+    else if (type == G_TYPE_INT || type == G_TYPE_INT64
+             || type == G_TYPE_UCHAR) {
+        i = strtol(value, &end, 10);
+        if (end == value || *end)
+            die("Setting %s requires an integer.", key);
+        if (type == G_TYPE_INT64)
+            gwy_container_set_int64(settings, quark, i);
+        else if (type == G_TYPE_UCHAR)
+            gwy_container_set_uchar(settings, quark, i);
+        else
+            gwy_container_set_int32(settings, quark, i);
+    }
+    else if (type)
+        die("Setting %s cannot be changed from the command line.", key);
+    else {
+        i = strtol(value, &end, 10);
+        if (end != value && !*end)
+            gwy_container_set_int32(settings, quark, i);
+        else {
+            d = g_ascii_strtod(value, &end);
+            if (end != value && !*end)
+                gwy_container_set_double(settings, quark, d);
+            else
+                gwy_container_set_string(settings, quark, g_strdup(value));
+        }
+    }
+    g_free(key);
+}
+
+static void
+init_gwyddion(const Options *options)
+{
+    GwyContainer *settings;
+    GError *error = NULL;
+    gchar *settings_file;
+    guint i;
+
+    gwy_widgets_type_init();
+    gwy_undo_set_enabled(FALSE);
+    gwy_app_data_browser_set_gui_enabled(FALSE);
+    gwy_app_wait_set_enabled(FALSE);
+    gwy_resource_class_load(g_type_class_peek(GWY_TYPE_GRADIENT));
+    gwy_resource_class_load(g_type_class_peek(GWY_TYPE_GRAIN_VALUE));
+    gwy_resource_class_load(g_type_class_peek(GWY_TYPE_CALIBRATION));
+
+    if (options->settings)
+        settings_file = g_strdup(options->settings);
+    else
+        settings_file = gwy_app_settings_get_settings_filename();
+    if (!gwy_app_settings_load(settings_file, &error)) {
+        if (options->settings)
+            die("Cannot load settings %s: %s", settings_file, error->message);
+        g_clear_error(&error);
+    }
+    g_free(settings_file);
+
+    settings = gwy_app_settings_get();
+    for (i = 0; options->set && options->set[i]; i++)
+        set_setting(settings, options->set[i]);
+
+    load_modules();
+}
+
+static gchar*
+make_output_name(const Options *options, const gchar *filename)
+{
+    gchar *basename, *dot, *outname, *path;
+
+    basename = g_path_get_basename(filename);
+    if ((dot = strrchr(basename, '.')) && dot != basename)
+        *dot = '\0';
+    outname = g_strconcat(basename, ".", options->format, NULL);
+    path = g_build_filename(options->output_dir, outname, NULL);
+    g_free(outname);
+    g_free(basename);
+
+    return path;
+}
+
+static gchar*
+make_absolute_filename(const gchar *filename)
+{
+    gchar *cwd, *path;
+
+    if (g_path_is_absolute(filename))
+        return g_strdup(filename);
+
+    cwd = g_get_current_dir();
+    path = g_build_filename(cwd, filename, NULL);
+    g_free(cwd);
+
+    return path;
+}
+
+/* Compares file identity where the system has it, otherwise just absolute
+ * names. */
+static gboolean
+is_same_file(const gchar *filename1, const gchar *filename2)
+{
+    gchar *abs1, *abs2;
+    gboolean same;
+
+#ifndef G_OS_WIN32
+    {
+        GStatBuf st1, st2;
+
+        if (g_stat(filename1, &st1) == 0 && g_stat(filename2, &st2) == 0)
+            return st1.st_dev == st2.st_dev && st1.st_ino == st2.st_ino;
+    }
+#endif
+
+    abs1 = make_absolute_filename(filename1);
+    abs2 = make_absolute_filename(filename2);
+    same = gwy_strequal(abs1, abs2);
+    g_free(abs1);
+    g_free(abs2);
+
+    return same;
+}
+
+/* All output files go to one directory so inputs with the same base name
+ * would overwrite each other's results, and workers would race writing them.
+ * Writing over the inputs themselves is refused too. */
+static void
+check_output_names(const Batch *batch)
+{
+    const FileResult *result, *other;
+    GHashTable *outnames;
+    guint i, j;
+
+    outnames = g_hash_table_new(g_str_hash, g_str_equal);
+    for (i = 0; i < batch->nfiles; i++) {
+        result = batch->results + i;
+        if ((other = g_hash_table_lookup(outnames, result->outname)))
+            die("Files %s and %s would be both saved as %s.",
+                other->filename, result->filename, result->outname);
+        g_hash_table_insert(outnames, result->outname, (gpointer)result);
+
+        if (!g_file_test(result->outname, G_FILE_TEST_EXISTS))
+            continue;
+        for (j = 0; j < batch->nfiles; j++) {
+            if (is_same_file(result->outname, batch->results[j].filename))
+                die("Saving the result of %s would overwrite input file %s.",
+                    result->filename, batch->results[j].filename);
+        }
+    }
+    g_hash_table_destroy(outnames);
+}
+
+static gboolean
+run_functions(const Options *options, GwyContainer *data, gint id,
+              gdouble *process_time, gchar **message)
+{
+    const GwyFuncUseRecord *record;
+    const gchar *name;
+    guint i, sens;
+
+    for (i = 0; (name = options->process[i]); i++) {
+        sens = gwy_process_func_get_sensitivity_mask(name);
+        if ((sens & GWY_MENU_FLAG_DATA_MASK)
+            && !gwy_container_contains(data,
+                                       gwy_app_get_mask_key_for_id(id))) {
+            *message = g_strdup_printf("Function %s requires a mask, "
+                                       "channel %d has none.", name, id);
+            return FALSE;
+        }
+
+        gwy_app_data_browser_select_data_field(data, id);
+        gwy_func_use_record_begin("proc", name, get_run_mode(name));
+        gwy_process_func_run(name, data, get_run_mode(name));
+        record = gwy_func_use_record_end(NULL);
+        *process_time += record->wall_time;
+    }
+
+    return TRUE;
+}
+
+static void
+process_file(const Options *options, FileResult *result)
+{
+    const GwyFuncUseRecord *record;
+    GwyContainer *data;
+    GError *error = NULL;
+    gint *ids;
+    gint i;
+
+    result->status = FILE_FAILED;
+    gwy_func_use_record_begin("batch-file", NULL, GWY_RUN_NONINTERACTIVE);
+
+    gwy_func_use_record_begin("file-load", NULL, GWY_RUN_NONINTERACTIVE);
+    data = gwy_file_load(result->filename, GWY_RUN_NONINTERACTIVE, &error);
+    record = gwy_func_use_record_end(NULL);
+    result->load_time = record->wall_time;
+    if (!data) {
+        if (error)
+            result->message = g_strdup(error->message);
+        else
+            result->message = g_strdup("Loading was cancelled.");
+        g_clear_error(&error);
+        goto end;
+    }
+
+    gwy_app_data_browser_add(data);
+    ids = gwy_app_data_browser_get_data_ids(data);
+    if (ids[0] == -1)
+        result->message = g_strdup("File contains no channels.");
+    for (i = 0; ids[i] != -1; i++) {
+        if (options->channel >= 0 && ids[i] != options->channel)
+            continue;
+        if (!run_functions(options, data, ids[i],
+                           &result->process_time, &result->message))
+            break;
+    }
+    if (options->channel >= 0 && ids[0] != -1 && !result->message) {
+        for (i = 0; ids[i] != -1 && ids[i] != options->channel; i++)
+            ;
+        if (ids[i] == -1)
+            result->message = g_strdup_printf("File has no channel %d.",
+                                              options->channel);
+    }
+
+    if (!result->message) {
+        /* Export formats take the current channel. */
+        gwy_app_data_browser_select_data_field(data,
+                                               options->channel >= 0
+                                               ? options->channel
+                                               : ids[0]);
+        gwy_func_use_record_begin("file-save", NULL, GWY_RUN_NONINTERACTIVE);
+        if (gwy_file_save(data, result->outname, GWY_RUN_NONINTERACTIVE,
+                          &error))
+            result->status = FILE_OK;
+        else if (error)
+            result->message = g_strdup(error->message);
+        else
+            result->message = g_strdup("Saving was cancelled.");
+        g_clear_error(&error);
+        record = gwy_func_use_record_end(NULL);
+        result->save_time = record->wall_time;
+    }
+
+    g_free(ids);
+    gwy_app_data_browser_remove(data);
+    g_object_unref(data);
+
+end:
+    record = gwy_func_use_record_end(NULL);
+    result->total_time = record->wall_time;
+    result->cpu_time = record->cpu_time;
+    result->peak_memory = record->peak_memory;
+}
+
+/* Workers read file indices from stdin and write results to the original
+ * stdout.  Messages cannot contain the field and line separators. */
+static void
+run_worker(const Options *options, FileResult *results, guint nfiles)
+{
+    FileResult *result;
+    gchar buf[G_ASCII_DTOSTR_BUF_SIZE];
+    gdouble times[5];
+    gchar line[64];
+    FILE *out;
+    gchar *p;
+    gulong i;
+    guint j;
+    gint fd;
+
+    fflush(stdout);
+    if ((fd = dup(fileno(stdout))) < 0
+        || dup2(fileno(stderr), fileno(stdout)) < 0
+        || !(out = fdopen(fd, "w")))
+        die("Cannot redirect standard output.");
+
+    while (fgets(line, sizeof(line), stdin)) {
+        i = strtoul(line, NULL, 10);
+        if (i >= nfiles)
+            die("Worker got invalid file index %lu.", i);
+
+        result = results + i;
+        process_file(options, result);
+        if (result->message) {
+            for (p = result->message; *p; p++) {
+                if (*p == '\t' || *p == '\n' || *p == '\r')
+                    *p = ' ';
+            }
+        }
+        times[0] = result->load_time;
+        times[1] = result->process_time;
+        times[2] = result->save_time;
+        times[3] = result->total_time;
+        times[4] = result->cpu_time;
+        fprintf(out, "%lu\t%d", i, result->status);
+        for (j = 0; j < G_N_ELEMENTS(times); j++)
+            fprintf(out, "\t%s",
+                    g_ascii_formatd(buf, sizeof(buf), "%.6f", times[j]));
+        fprintf(out, "\t%" G_GINT64_FORMAT "\t%s\n",
+                result->peak_memory, result->message ? result->message : "");
+        fflush(out);
+    }
+    fclose(out);
+}
+
+static void
+report_progress(const Batch *batch, const FileResult *result)
+{
+    if (batch->options->quiet)
+        return;
+
+    if (result->status == FILE_OK)
+        fprintf(stderr, "[%u/%u] %s: %.3f s\n",
+                batch->ndone, batch->nfiles, result->filename,
+                result->total_time);
+    else
+        fprintf(stderr, "[%u/%u] %s: FAILED: %s\n",
+                batch->ndone, batch->nfiles, result->filename,
+                result->message ? result->message : "Unknown error.");
+}
+
+/* Only the result of the file the worker is processing is accepted. */
+static gboolean
+parse_result(Worker *worker, const gchar *line)
+{
+    Batch *batch = worker->batch;
+    FileResult *result;
+    gchar **fields;
+    gchar *end;
+    gulong i;
+
+    fields = g_strsplit(line, "\t", 9);
+    if (g_strv_length(fields) != 9
+        || (i = strtoul(fields[0], &end, 10)) >= batch->nfiles
+        || end == fields[0] || *end
+        || worker->current < 0 || i != (gulong)worker->current) {
+        g_warning("Malformed worker result line: %s", line);
+        g_strfreev(fields);
+        return FALSE;
+    }
+
+    result = batch->results + i;
+    result->status = atoi(fields[1]);
+    result->load_time = g_ascii_strtod(fields[2], NULL);
+    result->process_time = g_ascii_strtod(fields[3], NULL);
+    result->save_time = g_ascii_strtod(fields[4], NULL);
+    result->total_time = g_ascii_strtod(fields[5], NULL);
+    result->cpu_time = g_ascii_strtod(fields[6], NULL);
+    result->peak_memory = g_ascii_strtoll(fields[7], NULL, 10);
+    g_strchomp(fields[8]);
+    if (*fields[8])
+        result->message = g_strdup(fields[8]);
+    g_strfreev(fields);
+
+    return TRUE;
+}
+
+static void
+worker_feed(Worker *worker)
+{
+    Batch *batch = worker->batch;
+    gchar *line;
+
+    worker->current = -1;
+    if (batch->next < batch->nfiles) {
+        worker->current = batch->next++;
+        batch->results[worker->current].status = FILE_RUNNING;
+        line = g_strdup_printf("%d\n", worker->current);
+        g_io_channel_write_chars(worker->in, line, -1, NULL, NULL);
+        g_io_channel_flush(worker->in, NULL);
+        g_free(line);
+    }
+    else if (worker->in) {
+        /* End of input makes the worker quit. */
+        g_io_channel_shutdown(worker->in, TRUE, NULL);
+        g_io_channel_unref(worker->in);
+        worker->in = NULL;
+    }
+}
+
+static void
+worker_finished(Worker *worker)
+{
+    Batch *batch = worker->batch;
+    FileResult *result;
+    guint i;
+
+    if (worker->current >= 0) {
+        result = batch->results + worker->current;
+        result->status = FILE_FAILED;
+        result->message = g_strdup("Worker process terminated.");
+        batch->ndone++;
+        report_progress(batch, result);
+        worker->current = -1;
+    }
+    if (worker->in) {
+        g_io_channel_shutdown(worker->in, FALSE, NULL);
+        g_io_channel_unref(worker->in);
+        worker->in = NULL;
+    }
+    g_io_channel_unref(worker->out);
+    worker->out = NULL;
+    worker->watch_id = 0;
+
+    for (i = 0; i < batch->nworkers; i++) {
+        if (batch->workers[i].out)
+            return;
+    }
+    g_main_loop_quit(batch->loop);
+}
+
+/* Fails the current file of a worker which produced garbage and makes the
+ * worker quit by closing its input.  The remaining files are left to other
+ * workers. */
+static void
+worker_abandon(Worker *worker)
+{
+    Batch *batch = worker->batch;
+    FileResult *result;
+
+    result = batch->results + worker->current;
+    result->status = FILE_FAILED;
+    g_free(result->message);
+    result->message = g_strdup("Malformed output from worker process.");
+    batch->ndone++;
+    report_progress(batch, result);
+    worker->current = -1;
+    if (worker->in) {
+        g_io_channel_shutdown(worker->in, TRUE, NULL);
+        g_io_channel_unref(worker->in);
+        worker->in = NULL;
+    }
+}
+
+static gboolean
+worker_output(G_GNUC_UNUSED GIOChannel *channel, GIOCondition condition,
+              gpointer user_data)
+{
+    Worker *worker = (Worker*)user_data;
+    Batch *batch = worker->batch;
+    GIOStatus status;
+    gchar *line;
+
+    if (condition & G_IO_IN) {
+        while ((status = g_io_channel_read_line(worker->out, &line,
+                                                NULL, NULL, NULL))
+               == G_IO_STATUS_NORMAL) {
+            if (parse_result(worker, line)) {
+                batch->ndone++;
+                report_progress(batch, batch->results + worker->current);
+                worker_feed(worker);
+            }
+            else if (worker->current >= 0)
+                worker_abandon(worker);
+            g_free(line);
+            if (!(g_io_channel_get_buffer_condition(worker->out) & G_IO_IN))
+                break;
+        }
+        if (status == G_IO_STATUS_EOF || status == G_IO_STATUS_ERROR) {
+            worker_finished(worker);
+            return FALSE;
+        }
+        return TRUE;
+    }
+
+    worker_finished(worker);
+    return FALSE;
+}
+
+static void
+run_workers(Batch *batch, gchar **argv)
+{
+    const Options *options = batch->options;
+    Worker *worker;
+    GError *error = NULL;
+    gchar **wargv;
+    gint infd, outfd;
+    guint i, argc;
+
+    argc = g_strv_length(argv);
+    wargv = g_new0(gchar*, argc + 2);
+    wargv[0] = argv[0];
+    wargv[1] = "--worker";
+    for (i = 1; i < argc; i++)
+        wargv[i+1] = argv[i];
+
+    batch->nworkers = MIN((guint)options->jobs, batch->nfiles);
+    batch->workers = g_new0(Worker, batch->nworkers);
+    batch->loop = g_main_loop_new(NULL, FALSE);
+    for (i = 0; i < batch->nworkers; i++) {
+        worker = batch->workers + i;
+        worker->batch = batch;
+        worker->current = -1;
+        if (!g_spawn_async_with_pipes(NULL, wargv, NULL, G_SPAWN_SEARCH_PATH,
+                                      NULL, NULL, NULL,
+                                      &infd, &outfd, NULL, &error))
+            die("Cannot run worker process: %s", error->message);
+
+        worker->in = new_channel_for_fd(infd);
+        worker->out = new_channel_for_fd(outfd);
+        g_io_channel_set_close_on_unref(worker->in, TRUE);
+        g_io_channel_set_close_on_unref(worker->out, TRUE);
+        /* File names and messages need not be valid UTF-8. */
+        g_io_channel_set_encoding(worker->in, NULL, NULL);
+        g_io_channel_set_encoding(worker->out, NULL, NULL);
+        worker->watch_id = g_io_add_watch(worker->out,
+                                          G_IO_IN | G_IO_HUP | G_IO_ERR,
+                                          worker_output, worker);
+        worker_feed(worker);
+    }
+    g_free(wargv);
+
+    g_main_loop_run(batch->loop);
+    g_main_loop_unref(batch->loop);
+    g_free(batch->workers);
+
+    /* Files left over when all workers died. */
+    for (i = 0; i < batch->nfiles; i++) {
+        if (batch->results[i].status == FILE_PENDING
+            || batch->results[i].status == FILE_RUNNING) {
+            batch->results[i].status = FILE_FAILED;
+            batch->results[i].message = g_strdup("Not processed.");
+        }
+    }
+}
+
+static void
+run_serially(Batch *batch)
+{
+    guint i;
+
+    for (i = 0; i < batch->nfiles; i++) {
+        process_file(batch->options, batch->results + i);
+        batch->ndone++;
+        report_progress(batch, batch->results + i);
+    }
+}
+
+static gint
+compare_total_time(gconstpointer a, gconstpointer b)
+{
+    const FileResult *ra = *(const FileResult**)a;
+    const FileResult *rb = *(const FileResult**)b;
+
+    if (ra->total_time > rb->total_time)
+        return -1;
+    if (ra->total_time < rb->total_time)
+        return 1;
+    return 0;
+}
+
+static void
+write_csv_string(FILE *fh, const gchar *s)
+{
+    fputc('"', fh);
+    for ( ; s && *s; s++) {
+        if (*s == '"')
+            fputc('"', fh);
+        fputc(*s, fh);
+    }
+    fputc('"', fh);
+}
+
+static void
+write_summary(const Batch *batch, const gchar *filename)
+{
+    const FileResult *result;
+    gchar buf[G_ASCII_DTOSTR_BUF_SIZE];
+    gdouble times[5];
+    FILE *fh;
+    guint i, j;
+
+    if (!(fh = g_fopen(filename, "w")))
+        die("Cannot open '%s' for writing.", filename);
+
+    fprintf(fh, "file,status,load,process,save,total,cpu,peak_memory,"
+            "message\n");
+    for (i = 0; i < batch->nfiles; i++) {
+        result = batch->results + i;
+        times[0] = result->load_time;
+        times[1] = result->process_time;
+        times[2] = result->save_time;
+        times[3] = result->total_time;
+        times[4] = result->cpu_time;
+        write_csv_string(fh, result->filename);
+        fprintf(fh, ",%s", result->status == FILE_OK ? "ok" : "failed");
+        for (j = 0; j < G_N_ELEMENTS(times); j++)
+            fprintf(fh, ",%s", g_ascii_formatd(buf, sizeof(buf), "%.6f",
+                                               times[j]));
+        if (result->peak_memory >= 0)
+            fprintf(fh, ",%" G_GINT64_FORMAT ",", result->peak_memory);
+        else
+            fprintf(fh, ",,");
+        write_csv_string(fh, result->message);
+        fputc('\n', fh);
+    }
+    fclose(fh);
+}
+
+static void
+print_statistics(const Batch *batch, gdouble elapsed)
+{
+    const FileResult *result;
+    GPtrArray *sorted;
+    gdouble load = 0.0, process = 0.0, save = 0.0, total = 0.0;
+    guint i, nok = 0;
+
+    sorted = g_ptr_array_new();
+    for (i = 0; i < batch->nfiles; i++) {
+        result = batch->results + i;
+        if (result->status == FILE_OK)
+            nok++;
+        load += result->load_time;
+        process += result->process_time;
+        save += result->save_time;
+        total += result->total_time;
+        g_ptr_array_add(sorted, (gpointer)result);
+    }
+    g_ptr_array_sort(sorted, compare_total_time);
+
+    fprintf(stderr, "Processed %u files, %u failed, in %.3f s "
+            "with %d jobs.\n",
+            batch->nfiles, batch->nfiles - nok, elapsed,
+            batch->options->jobs);
+    fprintf(stderr, "Time per file: load %.3f s, process %.3f s, "
+            "save %.3f s, total %.3f s.\n",
+            load/batch->nfiles, process/batch->nfiles, save/batch->nfiles,
+            total/batch->nfiles);
+    fprintf(stderr, "Slowest files:\n");
+    for (i = 0; i < MIN(sorted->len, 5); i++) {
+        result = (const FileResult*)g_ptr_array_index(sorted, i);
+        fprintf(stderr, "  %.3f s %s\n", result->total_time, result->filename);
+    }
+    g_ptr_array_free(sorted, TRUE);
+}
+
+int
+main(int argc, char *argv[])
+{
+    Options options = {
+        NULL, NULL, NULL, NULL, NULL, NULL, -1, 1, FALSE, FALSE, FALSE,
+    };
+    Batch batch;
+    GTimer *timer;
+    gchar **orig_argv;
+    guint i, nok = 0;
+
+    orig_argv = g_strdupv(argv);
+    gtk_parse_args(&argc, &argv);
+    parse_options(&options, &argc, &argv);
+
+    if (!options.list && !options.worker
+        && g_mkdir_with_parents(options.output_dir, 0755) != 0)
+        die("Cannot create output directory %s.", options.output_dir);
+
+    gwy_clear(&batch, 1);
+    batch.options = &options;
+    batch.nfiles = argc - 1;
+    batch.results = g_new0(FileResult, batch.nfiles);
+    for (i = 0; i < batch.nfiles; i++) {
+        batch.results[i].filename = argv[i+1];
+        if (!options.list)
+            batch.results[i].outname = make_output_name(&options, argv[i+1]);
+    }
+    if (!options.list && !options.worker)
+        check_output_names(&batch);
+
+    /* The master checks the functions even if it only distributes work, to
+     * fail early instead of in each worker. */
+    init_gwyddion(&options);
+    if (options.list) {
+        gwy_process_func_foreach(print_function, NULL);
+        return 0;
+    }
+    check_functions(&options);
+
+    /* Processes share the processors.  Running several threads in each one
+     * would only oversubscribe them. */
+    gwy_threads_set_enabled(options.jobs == 1 || batch.nfiles == 1);
+
+    if (options.worker) {
+        run_worker(&options, batch.results, batch.nfiles);
+        return 0;
+    }
+
+    timer = g_timer_new();
+    if (options.jobs == 1 || batch.nfiles == 1)
+        run_serially(&batch);
+    else
+        run_workers(&batch, orig_argv);
+
+    for (i = 0; i < batch.nfiles; i++) {
+        if (batch.results[i].status == FILE_OK)
+            nok++;
+    }
+    if (options.summary)
+        write_summary(&batch, options.summary);
+    if (!options.quiet)
+        print_statistics(&batch, g_timer_elapsed(timer, NULL));
+
+    g_timer_destroy(timer);
+    g_strfreev(orig_argv);
+
+    return nok == batch.nfiles ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* vim: set cin et ts=4 sw=4 cino=>1s,e0,n0,f0,{0,}0,^0,\:1s,=0,g1s,h0,t0,+1s,c3,(0,u0 : */
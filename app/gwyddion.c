@@ -27,8 +27,10 @@
 #include <libgwyddion/gwymacros.h>
 #include <libgwyddion/gwyversion.h>
 #include <libgwyddion/gwydebugobjects.h>
+#include <libgwyddion/gwythreads.h>
 #include <libprocess/gwygrainvalue.h>
 #include <libprocess/gwycalibration.h>
+#include <libprocess/brick.h>
 #include <libgwymodule/gwymoduleloader.h>
 #include <libgwymodule/gwymodule-file.h>
 #include <libgwydgets/gwydgets.h>
@@ -51,6 +53,7 @@
 typedef struct {
     gboolean no_splash;
     gboolean debug_objects;
+    gboolean debug_memory;
     gboolean startup_time;
     gboolean check;
     gboolean disable_gl;
@@ -118,6 +121,10 @@ main(int argc, char *argv[])
     gwy_osx_set_locale();
 
     gwy_debug_objects_enable(app_options.debug_objects);
+    gwy_debug_objects_enable_accounting(app_options.debug_memory);
+    gwy_threads_set_enabled(TRUE);
+    /* Keep huge volume data in scratch files instead of memory. */
+    gwy_brick_set_scratch_threshold((gsize)1 << 30);
     /* TODO: handle failure */
     gwy_app_settings_create_config_dir(NULL);
     debug_time(timer, "init");
@@ -260,6 +267,8 @@ main(int argc, char *argv[])
     debug_time(timer, "save funcuse");
     gwy_app_settings_free();
     /*gwy_resource_classes_finalize();*/
+    gwy_debug_objects_dump_accounting(stderr, 20);
+    gwy_debug_objects_enable_accounting(FALSE);
     gwy_debug_objects_dump_to_file(stderr, 0);
     gwy_debug_objects_clear();
     debug_time(timer, "dump debug-objects");
@@ -328,6 +337,10 @@ process_preinit_options(int *argc,
                 options->debug_objects = TRUE;
                 continue;
             }
+            if (gwy_strequal((*argv)[i], "--debug-memory")) {
+                options->debug_memory = TRUE;
+                continue;
+            }
             if (gwy_strequal((*argv)[i], "--startup-time")) {
                 options->startup_time = TRUE;
                 continue;
@@ -386,6 +399,7 @@ print_help(void)
 "     --log-to-console       Print messages to console\n"
 "     --no-log-to-console    Do not print messages to console.\n"
 "     --debug-objects        Catch leaking objects (devel only).\n"
+"     --debug-memory         Account memory held by data objects (devel only).\n"
 "     --startup-time         Measure time of startup tasks.\n"
         );
     puts(
@@ -33,6 +33,9 @@ enum {
     LOG_FUNCNAME,
     LOG_PARAMETERS,
     LOG_TIME,
+    LOG_DURATION,
+    LOG_CPU_TIME,
+    LOG_MEMORY,
 };
 
 typedef enum {
@@ -52,8 +55,10 @@ typedef struct {
     GtkWidget *window;
     GtkWidget *treeview;
     GtkWidget *save;
+    GtkWidget *timing;
     GtkWidget *clear;
     GtkWidget *close;
+    guint timing_id;
 } LogBrowser;
 
 static void           data_log_add_valist          (GwyContainer *data,
@@ -79,6 +84,19 @@ static void           log_cell_renderer            (GtkTreeViewColumn *column,
                                                     GtkTreeIter *iter,
                                                     gpointer userdata);
 static void           gwy_log_export               (LogBrowser *browser);
+static void           gwy_log_export_timing_menu   (LogBrowser *browser);
+static void           gwy_log_export_timing        (GtkWidget *item,
+                                                    LogBrowser *browser);
+static gboolean       log_update_timing            (gpointer user_data);
+static void           set_log_record               (GwyStringList *slog,
+                                                    guint i,
+                                                    gint record);
+static void           copy_log_records             (GwyStringList *source,
+                                                    GwyStringList *dest);
+static const GwyFuncUseRecord* find_log_record     (GwyStringList *slog,
+                                                    guint i);
+static void           truncate_log_records         (GwyStringList *slog);
+static void           free_log_records             (gpointer p);
 static void           gwy_log_clear                (LogBrowser *browser);
 static void           log_changed                  (GwyStringList *slog,
                                                     LogBrowser *browser);
@@ -98,6 +116,8 @@ static const gchar*   current_function_name_by_type(const gchar *type);
 
 static gboolean log_disabled = FALSE;
 
+static const gchar log_records_key[] = "gwy-app-log-records";
+
 /**
  * gwy_app_channel_log_add:
  * @data: A data container.
@@ -353,8 +373,10 @@ data_log_add_valist(GwyContainer *data,
     }
 
     if (!targetlog) {
-        if (sourcelog)
+        if (sourcelog) {
             targetlog = gwy_string_list_duplicate(sourcelog);
+            copy_log_records(sourcelog, targetlog);
+        }
         else {
             if (!function)
                 return;
@@ -378,6 +400,11 @@ data_log_add_valist(GwyContainer *data,
     if (!str)
         str = g_string_new(NULL);
     g_string_printf(str, "%s(%s)@%s", function, args, optime);
+    /* Remember which function invocation created the entry to show its
+     * resource usage. */
+    if (gwy_func_use_current_record() >= 0)
+        set_log_record(targetlog, gwy_string_list_get_length(targetlog),
+                       gwy_func_use_current_record());
     gwy_string_list_append_take(targetlog, g_string_free(str, FALSE));
     g_free(args);
     g_free(optime);
@@ -593,6 +620,12 @@ log_browser_new(GwyContainer *data,
                              G_CALLBACK(gwy_log_export), browser);
     gtk_widget_set_sensitive(browser->save, n != 0);
 
+    browser->timing = gwy_stock_like_button_new(_("Export _Timing"),
+                                                GTK_STOCK_SAVE_AS);
+    gtk_box_pack_start(GTK_BOX(hbox), browser->timing, TRUE, TRUE, 0);
+    g_signal_connect_swapped(browser->timing, "clicked",
+                             G_CALLBACK(gwy_log_export_timing_menu), browser);
+
     browser->clear = gwy_stock_like_button_new(_("Clea_r"), GTK_STOCK_CLEAR);
     gtk_box_pack_start(GTK_BOX(hbox), browser->clear, TRUE, TRUE, 0);
     g_signal_connect_swapped(browser->clear, "clicked",
@@ -618,6 +651,9 @@ log_browser_construct(LogBrowser *browser)
         { N_("Function"),   LOG_FUNCNAME,   },
         { N_("Parameters"), LOG_PARAMETERS, },
         { N_("Time"),       LOG_TIME,       },
+        { N_("Duration"),   LOG_DURATION,   },
+        { N_("CPU Time"),   LOG_CPU_TIME,   },
+        { N_("Memory"),     LOG_MEMORY,     },
     };
 
     GtkTreeView *treeview;
@@ -648,6 +684,10 @@ log_browser_construct(LogBrowser *browser)
                          "ellipsize-set", TRUE,
                          NULL);
         }
+        else if (columns[i].id == LOG_DURATION
+                 || columns[i].id == LOG_CPU_TIME
+                 || columns[i].id == LOG_MEMORY)
+            g_object_set(renderer, "xalign", 1.0, NULL);
     }
 
     selection = gtk_tree_view_get_selection(treeview);
@@ -663,6 +703,7 @@ log_cell_renderer(G_GNUC_UNUSED GtkTreeViewColumn *column,
 {
     LogBrowser *browser = (LogBrowser*)userdata;
     GString *buf = browser->buf;
+    const GwyFuncUseRecord *record;
     const gchar *s, *t;
     guint i;
     gulong id;
@@ -671,6 +712,9 @@ log_cell_renderer(G_GNUC_UNUSED GtkTreeViewColumn *column,
     gtk_tree_model_get(model, iter, 0, &i, -1);
     s = gwy_string_list_get(browser->log, i);
     g_return_if_fail(s);
+    record = NULL;
+    if (id == LOG_DURATION || id == LOG_CPU_TIME || id == LOG_MEMORY)
+        record = find_log_record(browser->log, i);
 
     g_string_truncate(buf, 0);
     switch (id) {
@@ -704,6 +748,21 @@ log_cell_renderer(G_GNUC_UNUSED GtkTreeViewColumn *column,
         g_string_append(buf, t+1);
         break;
 
+        case LOG_DURATION:
+        if (record && record->wall_time >= 0.0)
+            g_string_printf(buf, "%.3f s", record->wall_time);
+        break;
+
+        case LOG_CPU_TIME:
+        if (record && record->wall_time >= 0.0 && record->cpu_time >= 0.0)
+            g_string_printf(buf, "%.3f s", record->cpu_time);
+        break;
+
+        case LOG_MEMORY:
+        if (record && record->wall_time >= 0.0 && record->peak_memory >= 0)
+            g_string_printf(buf, "%.1f MiB", record->peak_memory/1048576.0);
+        break;
+
         default:
         g_return_if_reached();
         break;
@@ -737,6 +796,138 @@ gwy_log_export(LogBrowser *browser)
     g_free(str_to_save);
 }
 
+static void
+gwy_log_export_timing_menu(LogBrowser *browser)
+{
+    static const gchar *formats[] = { N_("As _CSV"), N_("As _JSON") };
+    GtkWidget *menu, *item;
+    guint i;
+
+    menu = gtk_menu_new();
+    for (i = 0; i < G_N_ELEMENTS(formats); i++) {
+        item = gtk_menu_item_new_with_mnemonic(_(formats[i]));
+        g_object_set_data(G_OBJECT(item), "json", GUINT_TO_POINTER(i));
+        gtk_menu_shell_append(GTK_MENU_SHELL(menu), item);
+        g_signal_connect(item, "activate",
+                         G_CALLBACK(gwy_log_export_timing), browser);
+    }
+    gtk_widget_show_all(menu);
+    g_signal_connect(menu, "selection-done",
+                     G_CALLBACK(gtk_widget_destroy), NULL);
+    gtk_menu_popup(GTK_MENU(menu), NULL, NULL, NULL, NULL,
+                   0, gtk_get_current_event_time());
+}
+
+/* Exports timing of all functions run in this session, not just those in
+ * the log. */
+static void
+gwy_log_export_timing(GtkWidget *item, LogBrowser *browser)
+{
+    gchar *str_to_save;
+
+    if (GPOINTER_TO_UINT(g_object_get_data(G_OBJECT(item), "json")))
+        str_to_save = gwy_func_use_records_to_json();
+    else
+        str_to_save = gwy_func_use_records_to_csv();
+
+    gwy_save_auxiliary_data(_("Export Operation Timing"),
+                            GTK_WINDOW(browser->window),
+                            -1,
+                            str_to_save);
+
+    g_free(str_to_save);
+}
+
+/* Function use records of log entries are kept in an array of record
+ * indices parallel to the entries, attached to the log.  Entries with no
+ * record have -1 there and the array may be shorter than the log.  Identical
+ * entries are thus never confused. */
+static void
+set_log_record(GwyStringList *slog, guint i, gint record)
+{
+    GArray *records;
+    gint none = -1;
+
+    records = (GArray*)g_object_get_data(G_OBJECT(slog), log_records_key);
+    if (!records) {
+        records = g_array_new(FALSE, FALSE, sizeof(gint));
+        g_object_set_data_full(G_OBJECT(slog), log_records_key, records,
+                               free_log_records);
+        g_signal_connect(slog, "value-changed",
+                         G_CALLBACK(truncate_log_records), NULL);
+    }
+    while (records->len <= i)
+        g_array_append_val(records, none);
+    g_array_index(records, gint, i) = record;
+}
+
+static void
+copy_log_records(GwyStringList *source, GwyStringList *dest)
+{
+    GArray *records;
+    guint i;
+
+    records = (GArray*)g_object_get_data(G_OBJECT(source), log_records_key);
+    if (!records)
+        return;
+
+    for (i = records->len; i; i--) {
+        if (g_array_index(records, gint, i-1) >= 0)
+            set_log_record(dest, i-1, g_array_index(records, gint, i-1));
+    }
+}
+
+static const GwyFuncUseRecord*
+find_log_record(GwyStringList *slog, guint i)
+{
+    GArray *records;
+
+    records = (GArray*)g_object_get_data(G_OBJECT(slog), log_records_key);
+    if (!records || i >= records->len
+        || g_array_index(records, gint, i) < 0)
+        return NULL;
+    return gwy_func_use_get_record(g_array_index(records, gint, i));
+}
+
+/* Undo can truncate the log and clear can empty it.  Forget the records of
+ * removed entries so that they are not assigned to new ones. */
+static void
+truncate_log_records(GwyStringList *slog)
+{
+    GArray *records;
+    guint n;
+
+    records = (GArray*)g_object_get_data(G_OBJECT(slog), log_records_key);
+    n = gwy_string_list_get_length(slog);
+    if (records && records->len > n)
+        g_array_set_size(records, n);
+}
+
+static void
+free_log_records(gpointer p)
+{
+    g_array_free((GArray*)p, TRUE);
+}
+
+/* Entries are added while the function is still running.  Redraw the log
+ * until the last one gets its resource usage. */
+static gboolean
+log_update_timing(gpointer user_data)
+{
+    LogBrowser *browser = (LogBrowser*)user_data;
+    const GwyFuncUseRecord *record = NULL;
+    guint n = gwy_string_list_get_length(browser->log);
+
+    gtk_widget_queue_draw(browser->treeview);
+    if (n)
+        record = find_log_record(browser->log, n-1);
+    if (record && record->wall_time < 0.0)
+        return TRUE;
+
+    browser->timing_id = 0;
+    return FALSE;
+}
+
 static void
 gwy_log_clear(LogBrowser *browser)
 {
@@ -757,11 +948,15 @@ log_changed(GwyStringList *slog, LogBrowser *browser)
     // In all cases simple gwy_null_store_set_n_rows() does the right thing.
     gwy_null_store_set_n_rows(store, n);
     gtk_widget_set_sensitive(browser->save, n != 0);
+    if (!browser->timing_id)
+        browser->timing_id = g_timeout_add(500, log_update_timing, browser);
 }
 
 static void
 gwy_log_destroy(LogBrowser *browser)
 {
+    if (browser->timing_id)
+        g_source_remove(browser->timing_id);
     GWY_SIGNAL_HANDLER_DISCONNECT(browser->log, browser->changed_id);
     g_object_set_data(G_OBJECT(browser->log), "log-browser", NULL);
     g_object_weak_unref(G_OBJECT(browser->log),
@@ -774,6 +969,8 @@ gwy_log_destroy(LogBrowser *browser)
 static void
 gwy_log_data_finalized(LogBrowser *browser)
 {
+    if (browser->timing_id)
+        g_source_remove(browser->timing_id);
     browser->changed_id = 0;
     g_signal_handler_disconnect(browser->window, browser->destroy_id);
     gtk_widget_destroy(browser->window);
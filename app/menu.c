@@ -815,7 +815,9 @@ gwy_app_run_process_func_in_mode(const gchar *name,
     g_return_if_fail(data
                      || !(gwy_process_func_get_sensitivity_mask(name)
                           & GWY_MENU_FLAG_DATA));
+    gwy_func_use_record_begin("proc", name, run);
     gwy_process_func_run(name, data, run);
+    gwy_func_use_record_end(NULL);
     gwy_app_update_last_process_func(name);
     gwy_app_sensitivity_set_state(GWY_MENU_FLAG_LAST_PROC,
                                   GWY_MENU_FLAG_LAST_PROC);
@@ -884,7 +886,9 @@ gwy_app_run_graph_func(const gchar *name)
     gwy_app_data_browser_get_current(GWY_APP_GRAPH, &graph, 0);
     g_return_if_fail(graph);
     g_return_if_fail(GWY_IS_GRAPH(graph));
+    gwy_func_use_record_begin("graph", name, GWY_RUN_INTERACTIVE);
     gwy_graph_func_run(name, graph);
+    gwy_func_use_record_end(NULL);
 }
 
 /**
@@ -942,7 +946,9 @@ gwy_app_run_volume_func_in_mode(const gchar *name,
     g_return_if_fail(data
                      || !(gwy_volume_func_get_sensitivity_mask(name)
                           & GWY_MENU_FLAG_DATA));
+    gwy_func_use_record_begin("volume", name, run);
     gwy_volume_func_run(name, data, run);
+    gwy_func_use_record_end(NULL);
 }
 
 /**
@@ -1000,7 +1006,9 @@ gwy_app_run_xyz_func_in_mode(const gchar *name,
     g_return_if_fail(data
                      || !(gwy_xyz_func_get_sensitivity_mask(name)
                           & GWY_MENU_FLAG_DATA));
+    gwy_func_use_record_begin("xyz", name, run);
     gwy_xyz_func_run(name, data, run);
+    gwy_func_use_record_end(NULL);
 }
 
 static void
@@ -35,6 +35,7 @@ static gchar *message_prefix = NULL;
 static gboolean cancelled = FALSE;
 static GTimer *timer = NULL;
 static gdouble last_update_time = 0.0;
+static gboolean wait_disabled = FALSE;
 
 /**
  * gwy_app_wait_start:
@@ -53,6 +54,9 @@ void
 gwy_app_wait_start(GtkWindow *window,
                    const gchar *message)
 {
+    if (wait_disabled)
+        return;
+
     if (window && !GTK_IS_WINDOW(window))
         g_warning("Widget is not a window");
 
@@ -84,6 +88,9 @@ gwy_app_wait_start(GtkWindow *window,
 void
 gwy_app_wait_finish(void)
 {
+    if (wait_disabled)
+        return;
+
     if (cancelled) {
         cancelled = FALSE;
         return;
@@ -153,6 +160,9 @@ gwy_app_wait_create_dialog(GtkWindow *window,
 gboolean
 gwy_app_wait_set_message(const gchar *message)
 {
+    if (wait_disabled)
+        return TRUE;
+
     g_return_val_if_fail(dialog, FALSE);
 
     while (gtk_events_pending())
@@ -193,6 +203,9 @@ gwy_app_wait_set_message(const gchar *message)
 gboolean
 gwy_app_wait_set_message_prefix(const gchar *prefix)
 {
+    if (wait_disabled)
+        return TRUE;
+
     g_return_val_if_fail(dialog, FALSE);
 
     if (cancelled)
@@ -230,6 +243,9 @@ gwy_app_wait_set_fraction(gdouble fraction)
     gchar buf[8];
     gdouble t;
 
+    if (wait_disabled)
+        return TRUE;
+
     g_return_val_if_fail(dialog, FALSE);
 
     t = g_timer_elapsed(timer, NULL);
@@ -282,6 +298,9 @@ gwy_app_wait_cursor_start(GtkWindow *window)
     GdkWindow *wait_window;
     GtkWidget *widget;
 
+    if (wait_disabled)
+        return;
+
     g_return_if_fail(GTK_IS_WINDOW(window));
     widget = GTK_WIDGET(window);
 
@@ -321,6 +340,9 @@ gwy_app_wait_cursor_finish(GtkWindow *window)
     GdkWindow *wait_window;
     GtkWidget *widget;
 
+    if (wait_disabled)
+        return;
+
     g_return_if_fail(GTK_IS_WINDOW(window));
     widget = GTK_WIDGET(window);
 
@@ -337,6 +359,50 @@ gwy_app_wait_cursor_finish(GtkWindow *window)
         gtk_main_iteration_do(FALSE);
 }
 
+/**
+ * gwy_app_wait_set_enabled:
+ * @setting: %TRUE to enable showing of progress dialogs and wait cursors,
+ *           %FALSE to disable it.
+ *
+ * Globally enables or disables the waiting functions.
+ *
+ * When waiting is disabled, gwy_app_wait_start(), gwy_app_wait_finish() and
+ * the wait cursor functions do nothing, and the functions setting the
+ * progress and messages just return %TRUE, i.e. the computation can never be
+ * cancelled.  Non-GUI applications that run module functions must disable
+ * waiting because the progress dialog is a Gtk+ widget.
+ *
+ * Waiting should be disabled before any module function is called, not while
+ * a progress dialog is shown.
+ *
+ * Since: 2.47
+ **/
+void
+gwy_app_wait_set_enabled(gboolean setting)
+{
+    if (dialog && !setting) {
+        g_warning("Disabling waiting while a progress dialog is shown.");
+        return;
+    }
+    wait_disabled = !setting;
+}
+
+/**
+ * gwy_app_wait_get_enabled:
+ *
+ * Reports whether the waiting functions are enabled.
+ *
+ * Returns: %TRUE if the waiting functions show progress dialogs and wait
+ *          cursors, %FALSE if they are no-ops.
+ *
+ * Since: 2.47
+ **/
+gboolean
+gwy_app_wait_get_enabled(void)
+{
+    return !wait_disabled;
+}
+
 /************************** Documentation ****************************/
 
 /**
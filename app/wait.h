@@ -35,6 +35,8 @@ gboolean gwy_app_wait_set_message_prefix (const gchar *prefix);
 
 void     gwy_app_wait_cursor_start       (GtkWindow *window);
 void     gwy_app_wait_cursor_finish      (GtkWindow *window);
+void     gwy_app_wait_set_enabled        (gboolean setting);
+gboolean gwy_app_wait_get_enabled        (void);
 
 G_END_DECLS
 
@@ -23,9 +23,273 @@
 #include <libgwyddion/gwymacros.h>
 #include <libgwyddion/gwymath.h>
 #include <libprocess/stats.h>
+#include "libgwyddion/gwyomp.h"
 #include "gwypixfield.h"
 
-static gint* calc_cdh(GwyDataField *dfield, gint *cdh_size);
+/* Number of pixels mapped to palette indices at once.  The index buffer
+ * stays in L1 cache and the mapping loops are simple enough to be
+ * vectorised. */
+enum { PIXEL_BLOCK = 256 };
+
+typedef struct {
+    const gdouble *data;
+    guint rgb[3];
+    gdouble cor;
+} MaskBlend;
+
+static gint* calc_cdh           (GwyDataField *dfield,
+                                 gint *cdh_size);
+static void  draw_field_linear  (GdkPixbuf *pixbuf,
+                                 GwyDataField *data_field,
+                                 GwyGradient *gradient,
+                                 gdouble minimum,
+                                 gdouble maximum,
+                                 GwyDataField *mask,
+                                 const GwyRGBA *color);
+static void  draw_field_adaptive(GdkPixbuf *pixbuf,
+                                 GwyDataField *data_field,
+                                 GwyGradient *gradient,
+                                 GwyDataField *mask,
+                                 const GwyRGBA *color);
+
+/* Maps a block of values linearly to palette indices.  The clamping is done
+ * in floating point before the conversion, which is branch-free and also
+ * takes care of NaNs and infinities. */
+static inline void
+map_block_linear(const gdouble *d, guint n,
+                 gdouble min, gdouble cor, gdouble m,
+                 gint *idx)
+{
+    guint k;
+
+    for (k = 0; k < n; k++) {
+        gdouble v = (d[k] - min)*cor + 0.5;
+
+        v = (v >= 0.0) ? v : 0.0;
+        v = (v <= m) ? v : m;
+        idx[k] = (gint)v;
+    }
+}
+
+static inline void
+map_block_adaptive(const gdouble *d, guint n,
+                   gdouble min, gdouble q, gdouble m,
+                   const gint *cdh, gdouble cor,
+                   gint *idx)
+{
+    guint k;
+
+    for (k = 0; k < n; k++) {
+        gdouble v = (d[k] - min)*q;
+        gint h;
+
+        v = (v >= 0.0) ? v : 0.0;
+        v = (v <= m) ? v : m;
+        h = (gint)v;
+        v -= h;
+        idx[k] = (gint)((cdh[h]*(1.0 - v) + cdh[h+1]*v)*cor + 0.5);
+    }
+}
+
+/* Writes a block of palette indices as packed pixels.  Pixbufs with alpha
+ * channel are filled as opaque. */
+static inline void
+put_block_pixels(guchar *line, const guchar *samples,
+                 const gint *idx, guint n, guint nchannels)
+{
+    const guchar *s;
+    guint k;
+
+    /* Simply index to the guchar samples, it's faster and no one can tell
+     * the difference... */
+    if (nchannels == 4) {
+        for (k = 0; k < n; k++) {
+            s = samples + 4*idx[k];
+            line[0] = s[0];
+            line[1] = s[1];
+            line[2] = s[2];
+            line[3] = 0xff;
+            line += 4;
+        }
+    }
+    else {
+        for (k = 0; k < n; k++) {
+            s = samples + 4*idx[k];
+            line[0] = s[0];
+            line[1] = s[1];
+            line[2] = s[2];
+            line += 3;
+        }
+    }
+}
+
+/* Blends a block of mask values over already drawn pixels.  Colour
+ * channels are blended, the alpha channel is kept intact. */
+static inline void
+blend_block_mask(guchar *line, const gdouble *m, guint n, guint nchannels,
+                 const MaskBlend *blend)
+{
+    const guint *rgb = blend->rgb;
+    gdouble cor = blend->cor;
+    guint k;
+
+    for (k = 0; k < n; k++, line += nchannels) {
+        gdouble val = m[k];
+        guint a, b;
+
+        if (!(val > 0.0))
+            continue;
+
+        val = (val <= 1.0) ? val : 1.0;
+        a = (guint)(cor*val);
+        b = 255 - a;
+        line[0] = (a*rgb[0] + b*line[0] + 127)/255;
+        line[1] = (a*rgb[1] + b*line[1] + 127)/255;
+        line[2] = (a*rgb[2] + b*line[2] + 127)/255;
+    }
+}
+
+/* Sets up mask blending.  Returns %FALSE if there is no mask or it does not
+ * match the image. */
+static gboolean
+setup_mask_blend(MaskBlend *blend, GwyDataField *mask, const GwyRGBA *color,
+                 gint xres, gint yres)
+{
+    gwy_clear(blend, 1);
+    if (!mask)
+        return FALSE;
+
+    g_return_val_if_fail(GWY_IS_DATA_FIELD(mask), FALSE);
+    g_return_val_if_fail(color, FALSE);
+    g_return_val_if_fail(gwy_data_field_get_xres(mask) == xres, FALSE);
+    g_return_val_if_fail(gwy_data_field_get_yres(mask) == yres, FALSE);
+
+    blend->data = gwy_data_field_get_data_const(mask);
+    blend->rgb[0] = (guchar)floor(255.99999*color->r);
+    blend->rgb[1] = (guchar)floor(255.99999*color->g);
+    blend->rgb[2] = (guchar)floor(255.99999*color->b);
+    blend->cor = 255*color->a + 0.99999;
+
+    return TRUE;
+}
+
+static void
+draw_field_linear(GdkPixbuf *pixbuf,
+                  GwyDataField *data_field,
+                  GwyGradient *gradient,
+                  gdouble minimum,
+                  gdouble maximum,
+                  GwyDataField *mask,
+                  const GwyRGBA *color)
+{
+    gint xres, yres, i, palsize, rowstride, nchannels;
+    guchar *pixels;
+    const guchar *samples;
+    gdouble cor, m;
+    const gdouble *data;
+    MaskBlend blend;
+
+    xres = gwy_data_field_get_xres(data_field);
+    yres = gwy_data_field_get_yres(data_field);
+    data = gwy_data_field_get_data_const(data_field);
+
+    g_return_if_fail(xres == gdk_pixbuf_get_width(pixbuf));
+    g_return_if_fail(yres == gdk_pixbuf_get_height(pixbuf));
+    setup_mask_blend(&blend, mask, color, xres, yres);
+
+    pixels = gdk_pixbuf_get_pixels(pixbuf);
+    rowstride = gdk_pixbuf_get_rowstride(pixbuf);
+    nchannels = gdk_pixbuf_get_n_channels(pixbuf);
+    samples = gwy_gradient_get_samples(gradient, &palsize);
+    cor = (palsize-1.0)/(maximum-minimum);
+    m = palsize-1.0;
+
+#ifdef _OPENMP
+#pragma omp parallel for if(gwy_omp_use_threads(xres*yres)) \
+            private(i) \
+            shared(xres,yres,data,pixels,rowstride,nchannels,samples, \
+                   minimum,cor,m,blend)
+#endif
+    for (i = 0; i < yres; i++) {
+        const gdouble *row = data + i*xres;
+        guchar *line = pixels + i*rowstride;
+        gint idx[PIXEL_BLOCK];
+        guint j, n;
+
+        for (j = 0; j < xres; j += n) {
+            n = MIN(xres - j, PIXEL_BLOCK);
+            map_block_linear(row + j, n, minimum, cor, m, idx);
+            put_block_pixels(line + j*nchannels, samples, idx, n, nchannels);
+            if (blend.data)
+                blend_block_mask(line + j*nchannels, blend.data + i*xres + j,
+                                 n, nchannels, &blend);
+        }
+    }
+}
+
+static void
+draw_field_adaptive(GdkPixbuf *pixbuf,
+                    GwyDataField *data_field,
+                    GwyGradient *gradient,
+                    GwyDataField *mask,
+                    const GwyRGBA *color)
+{
+    const gdouble *data;
+    gdouble min, max, cor, q, m;
+    guchar *pixels;
+    const guchar *samples;
+    gint xres, yres, i, rowstride, nchannels, palsize, cdh_size;
+    gint *cdh;
+    MaskBlend blend;
+
+    gwy_data_field_get_min_max(data_field, &min, &max);
+    if (min == max) {
+        draw_field_linear(pixbuf, data_field, gradient, min, G_MAXDOUBLE,
+                          mask, color);
+        return;
+    }
+
+    xres = gwy_data_field_get_xres(data_field);
+    yres = gwy_data_field_get_yres(data_field);
+    g_return_if_fail(xres == gdk_pixbuf_get_width(pixbuf));
+    g_return_if_fail(yres == gdk_pixbuf_get_height(pixbuf));
+    setup_mask_blend(&blend, mask, color, xres, yres);
+
+    cdh = calc_cdh(data_field, &cdh_size);
+    q = (cdh_size - 1.0)/(max - min);
+    data = gwy_data_field_get_data_const(data_field);
+
+    pixels = gdk_pixbuf_get_pixels(pixbuf);
+    rowstride = gdk_pixbuf_get_rowstride(pixbuf);
+    nchannels = gdk_pixbuf_get_n_channels(pixbuf);
+    samples = gwy_gradient_get_samples(gradient, &palsize);
+    cor = (palsize - 1.0)/cdh[cdh_size-1];
+    m = cdh_size - 1.000001;
+
+#ifdef _OPENMP
+#pragma omp parallel for if(gwy_omp_use_threads(xres*yres)) \
+            private(i) \
+            shared(xres,yres,data,pixels,rowstride,nchannels,samples, \
+                   min,q,m,cdh,cor,blend)
+#endif
+    for (i = 0; i < yres; i++) {
+        const gdouble *row = data + i*xres;
+        guchar *line = pixels + i*rowstride;
+        gint idx[PIXEL_BLOCK];
+        guint j, n;
+
+        for (j = 0; j < xres; j += n) {
+            n = MIN(xres - j, PIXEL_BLOCK);
+            map_block_adaptive(row + j, n, min, q, m, cdh, cor, idx);
+            put_block_pixels(line + j*nchannels, samples, idx, n, nchannels);
+            if (blend.data)
+                blend_block_mask(line + j*nchannels, blend.data + i*xres + j,
+                                 n, nchannels, &blend);
+        }
+    }
+
+    g_free(cdh);
+}
 
 /**
  * gwy_pixbuf_draw_data_field_with_range:
@@ -40,6 +304,9 @@ static gint* calc_cdh(GwyDataField *dfield, gint *cdh_size);
  * @minimum and all smaller values are mapped to start of @gradient, @maximum
  * and all greater values to its end, values between are mapped linearly to
  * @gradient.
+ *
+ * Since 2.47, the pixbuf can also have an alpha channel.  It is filled as
+ * fully opaque.
  **/
 void
 gwy_pixbuf_draw_data_field_with_range(GdkPixbuf *pixbuf,
@@ -48,44 +315,14 @@ gwy_pixbuf_draw_data_field_with_range(GdkPixbuf *pixbuf,
                                       gdouble minimum,
                                       gdouble maximum)
 {
-    int xres, yres, i, j, palsize, rowstride, dval;
-    guchar *pixels, *line;
-    const guchar *samples, *s;
-    gdouble cor;
-    const gdouble *row, *data;
-
     g_return_if_fail(GDK_IS_PIXBUF(pixbuf));
     g_return_if_fail(GWY_IS_DATA_FIELD(data_field));
     g_return_if_fail(GWY_IS_GRADIENT(gradient));
     if (minimum == maximum)
         maximum = G_MAXDOUBLE;
 
-    xres = gwy_data_field_get_xres(data_field);
-    yres = gwy_data_field_get_yres(data_field);
-    data = gwy_data_field_get_data_const(data_field);
-
-    g_return_if_fail(xres == gdk_pixbuf_get_width(pixbuf));
-    g_return_if_fail(yres == gdk_pixbuf_get_height(pixbuf));
-
-    pixels = gdk_pixbuf_get_pixels(pixbuf);
-    rowstride = gdk_pixbuf_get_rowstride(pixbuf);
-    samples = gwy_gradient_get_samples(gradient, &palsize);
-    cor = (palsize-1.0)/(maximum-minimum);
-
-    for (i = 0; i < yres; i++) {
-        line = pixels + i*rowstride;
-        row = data + i*xres;
-        for (j = 0; j < xres; j++) {
-            dval = (gint)((*(row++) - minimum)*cor + 0.5);
-            dval = GWY_CLAMP(dval, 0, palsize-1);
-            /* simply index to the guchar samples, it's faster and no one
-             * can tell the difference... */
-            s = samples + 4*dval;
-            *(line++) = *(s++);
-            *(line++) = *(s++);
-            *(line++) = *s;
-        }
-    }
+    draw_field_linear(pixbuf, data_field, gradient, minimum, maximum,
+                      NULL, NULL);
 }
 
 /**
@@ -98,52 +335,27 @@ gwy_pixbuf_draw_data_field_with_range(GdkPixbuf *pixbuf,
  *
  * Minimum data value is mapped to start of @gradient, maximum value to its
  * end, values between are mapped linearly to @gradient.
+ *
+ * Since 2.47, the pixbuf can also have an alpha channel.  It is filled as
+ * fully opaque.
  **/
 void
 gwy_pixbuf_draw_data_field(GdkPixbuf *pixbuf,
                            GwyDataField *data_field,
                            GwyGradient *gradient)
 {
-    int xres, yres, i, j, palsize, rowstride, dval;
-    guchar *pixels, *line;
-    const guchar *samples, *s;
-    gdouble maximum, minimum, cor;
-    const gdouble *row, *data;
+    gdouble maximum, minimum;
 
     g_return_if_fail(GDK_IS_PIXBUF(pixbuf));
     g_return_if_fail(GWY_IS_DATA_FIELD(data_field));
     g_return_if_fail(GWY_IS_GRADIENT(gradient));
 
-    xres = gwy_data_field_get_xres(data_field);
-    yres = gwy_data_field_get_yres(data_field);
-    data = gwy_data_field_get_data_const(data_field);
-
-    g_return_if_fail(xres == gdk_pixbuf_get_width(pixbuf));
-    g_return_if_fail(yres == gdk_pixbuf_get_height(pixbuf));
-
     gwy_data_field_get_min_max(data_field, &minimum, &maximum);
     if (minimum == maximum)
         maximum = G_MAXDOUBLE;
 
-    pixels = gdk_pixbuf_get_pixels(pixbuf);
-    rowstride = gdk_pixbuf_get_rowstride(pixbuf);
-    samples = gwy_gradient_get_samples(gradient, &palsize);
-    cor = (palsize-1.0)/(maximum-minimum);
-
-    for (i = 0; i < yres; i++) {
-        line = pixels + i*rowstride;
-        row = data + i*xres;
-        for (j = 0; j < xres; j++) {
-            dval = (gint)((*(row++) - minimum)*cor + 0.5);
-            /* simply index to the guchar samples, it's faster and no one
-             * can tell the difference... */
-            dval = GWY_CLAMP(dval, 0, palsize-1);
-            s = samples + 4*dval;
-            *(line++) = *(s++);
-            *(line++) = *(s++);
-            *(line++) = *s;
-        }
-    }
+    draw_field_linear(pixbuf, data_field, gradient, minimum, maximum,
+                      NULL, NULL);
 }
 
 /**
@@ -157,57 +369,91 @@ gwy_pixbuf_draw_data_field(GdkPixbuf *pixbuf,
  * The mapping from data field (minimum, maximum) range to gradient is
  * nonlinear, deformed using inverse function to height density cummulative
  * distribution.
+ *
+ * Since 2.47, the pixbuf can also have an alpha channel.  It is filled as
+ * fully opaque.
  **/
 void
 gwy_pixbuf_draw_data_field_adaptive(GdkPixbuf *pixbuf,
                                     GwyDataField *data_field,
                                     GwyGradient *gradient)
 {
-    const gdouble *data, *row;
-    gdouble min, max, cor, q, v, m;
-    guchar *pixels, *line;
-    const guchar *samples, *s;
-    gint xres, yres, i, j, h, rowstride, palsize, cdh_size;
-    gint *cdh;
-
-    gwy_data_field_get_min_max(data_field, &min, &max);
-    if (min == max) {
-        gwy_pixbuf_draw_data_field(pixbuf, data_field, gradient);
-        return;
-    }
+    g_return_if_fail(GDK_IS_PIXBUF(pixbuf));
+    g_return_if_fail(GWY_IS_DATA_FIELD(data_field));
+    g_return_if_fail(GWY_IS_GRADIENT(gradient));
 
-    xres = gwy_data_field_get_xres(data_field);
-    yres = gwy_data_field_get_yres(data_field);
-    g_return_if_fail(xres == gdk_pixbuf_get_width(pixbuf));
-    g_return_if_fail(yres == gdk_pixbuf_get_height(pixbuf));
+    draw_field_adaptive(pixbuf, data_field, gradient, NULL, NULL);
+}
 
-    cdh = calc_cdh(data_field, &cdh_size);
-    q = (cdh_size - 1.0)/(max - min);
-    data = gwy_data_field_get_data_const(data_field);
+/**
+ * gwy_pixbuf_draw_data_field_with_range_and_mask:
+ * @pixbuf: A Gdk pixbuf to draw to.
+ * @data_field: A data field to draw.
+ * @gradient: A color gradient to draw with.
+ * @minimum: The value corresponding to gradient start.
+ * @maximum: The value corresponding to gradient end.
+ * @mask: A data field to draw as a mask over the image.  It must have the
+ *        same dimensions as @data_field.  It can be %NULL.
+ * @color: The mask color.
+ *
+ * Paints a data field to a pixbuf with an explicite color gradient range and
+ * a mask over it.
+ *
+ * The result is the same as gwy_pixbuf_draw_data_field_with_range() followed
+ * by gwy_pixbuf_composite_data_field_as_mask().  However, both are done in a
+ * single pass over the pixbuf.
+ *
+ * Since: 2.47
+ **/
+void
+gwy_pixbuf_draw_data_field_with_range_and_mask(GdkPixbuf *pixbuf,
+                                               GwyDataField *data_field,
+                                               GwyGradient *gradient,
+                                               gdouble minimum,
+                                               gdouble maximum,
+                                               GwyDataField *mask,
+                                               const GwyRGBA *color)
+{
+    g_return_if_fail(GDK_IS_PIXBUF(pixbuf));
+    g_return_if_fail(GWY_IS_DATA_FIELD(data_field));
+    g_return_if_fail(GWY_IS_GRADIENT(gradient));
+    if (minimum == maximum)
+        maximum = G_MAXDOUBLE;
 
-    pixels = gdk_pixbuf_get_pixels(pixbuf);
-    rowstride = gdk_pixbuf_get_rowstride(pixbuf);
-    samples = gwy_gradient_get_samples(gradient, &palsize);
-    cor = (palsize - 1.0)/cdh[cdh_size-1];
+    draw_field_linear(pixbuf, data_field, gradient, minimum, maximum,
+                      mask, color);
+}
 
-    m = cdh_size - 1.000001;
-    for (i = 0; i < yres; i++) {
-        line = pixels + i*rowstride;
-        row = data + i*xres;
-        for (j = 0; j < xres; j++) {
-            v = (row[j] - min)*q;
-            v = GWY_CLAMP(v, 0.0, m);
-            h = (gint)v;
-            v -= h;
-            h = (gint)((cdh[h]*(1.0 - v) + cdh[h+1]*v)*cor + 0.5);
-            s = samples + 4*h;
-            *(line++) = *(s++);
-            *(line++) = *(s++);
-            *(line++) = *s;
-        }
-    }
+/**
+ * gwy_pixbuf_draw_data_field_adaptive_and_mask:
+ * @pixbuf: A Gdk pixbuf to draw to.
+ * @data_field: A data field to draw.
+ * @gradient: A color gradient to draw with.
+ * @mask: A data field to draw as a mask over the image.  It must have the
+ *        same dimensions as @data_field.  It can be %NULL.
+ * @color: The mask color.
+ *
+ * Paints a data field to a pixbuf with a color gradient adaptively and
+ * a mask over it.
+ *
+ * The result is the same as gwy_pixbuf_draw_data_field_adaptive() followed
+ * by gwy_pixbuf_composite_data_field_as_mask().  However, both are done in a
+ * single pass over the pixbuf.
+ *
+ * Since: 2.47
+ **/
+void
+gwy_pixbuf_draw_data_field_adaptive_and_mask(GdkPixbuf *pixbuf,
+                                             GwyDataField *data_field,
+                                             GwyGradient *gradient,
+                                             GwyDataField *mask,
+                                             const GwyRGBA *color)
+{
+    g_return_if_fail(GDK_IS_PIXBUF(pixbuf));
+    g_return_if_fail(GWY_IS_DATA_FIELD(data_field));
+    g_return_if_fail(GWY_IS_GRADIENT(gradient));
 
-    g_free(cdh);
+    draw_field_adaptive(pixbuf, data_field, gradient, mask, color);
 }
 
 /**
@@ -259,33 +505,26 @@ gwy_draw_data_field_map_adaptive(GwyDataField *data_field,
     g_free(cdh);
 }
 
+/* The cumulative histogram is constructed from the value histogram cached in
+ * the data field so redrawing with a different gradient does not need to
+ * touch the data at all. */
 static gint*
 calc_cdh(GwyDataField *dfield, gint *cdh_size)
 {
-    const gdouble *data;
-    gdouble q, min, max;
+    const guint *bins;
+    guint nbins;
     gint i, n, xres, yres;
     gint *cdh;
 
     xres = gwy_data_field_get_xres(dfield);
     yres = gwy_data_field_get_yres(dfield);
-    gwy_data_field_get_min_max(dfield, &min, &max);
+    bins = gwy_data_field_get_value_histogram(dfield, &nbins, NULL, NULL);
 
-    n = GWY_ROUND(pow(xres*yres, 2.0/3.0));
-    data = gwy_data_field_get_data_const(dfield);
-    q = (n - 1.0)/(max - min);
+    n = nbins + 1;
     cdh = g_new(gint, n);
-
     cdh[0] = 0;
     for (i = 1; i < n; i++)
-        cdh[i] = xres*yres/(2*n);
-    for (i = 0; i < xres*yres; i++) {
-        gint h = (gint)((data[i] - min)*q + 1);
-        cdh[GWY_CLAMP(h, 0, n-1)]++;
-    }
-    for (i = 1; i < n; i++)
-        cdh[i] += cdh[i-1];
-    cdh[0] = 0;
+        cdh[i] = cdh[i-1] + xres*yres/(2*n) + bins[i-1];
 
     *cdh_size = n;
 
@@ -309,10 +548,10 @@ gwy_pixbuf_draw_data_field_as_mask(GdkPixbuf *pixbuf,
                                    GwyDataField *data_field,
                                    const GwyRGBA *color)
 {
-    int xres, yres, i, j, rowstride;
-    guchar *pixels, *line;
+    gint xres, yres, i, rowstride;
+    guchar *pixels;
     guint32 pixel;
-    const gdouble *row, *data;
+    const gdouble *data;
     gdouble cor;
 
     g_return_if_fail(GDK_IS_PIXBUF(pixbuf));
@@ -339,18 +578,77 @@ gwy_pixbuf_draw_data_field_as_mask(GdkPixbuf *pixbuf,
     cor = 255*color->a + 0.99999;
     gwy_debug("cor = %g", cor);
 
+#ifdef _OPENMP
+#pragma omp parallel for if(gwy_omp_use_threads(xres*yres)) \
+            private(i) \
+            shared(xres,yres,data,pixels,rowstride,cor)
+#endif
     for (i = 0; i < yres; i++) {
-        line = pixels + i*rowstride + 3;
-        row = data + i*xres;
-        for (j = 0; j < xres; j++, row++) {
-            gdouble val = GWY_CLAMP(*row, 0.0, 1.0);
+        guchar *line = pixels + i*rowstride + 3;
+        const gdouble *row = data + i*xres;
+        gint j;
 
-            *line = (guchar)(cor*val);
-            line += 4;
+        for (j = 0; j < xres; j++) {
+            gdouble val = row[j];
+
+            val = (val >= 0.0) ? val : 0.0;
+            val = (val <= 1.0) ? val : 1.0;
+            line[4*j] = (guchar)(cor*val);
         }
     }
 }
 
+/**
+ * gwy_pixbuf_composite_data_field_as_mask:
+ * @pixbuf: A Gdk pixbuf with already drawn image to composite the mask over.
+ * @data_field: A data field to draw.
+ * @color: A color to use.
+ *
+ * Composites a data field as a single-color mask with varying opacity over
+ * a pixbuf.
+ *
+ * The result is the same as drawing the data field to a separate pixbuf with
+ * gwy_pixbuf_draw_data_field_as_mask() and compositing it over @pixbuf using
+ * gdk_pixbuf_composite() with nearest neighbour interpolation, except for
+ * rounding errors.  However, everything is done in a single pass and no
+ * temporary pixbuf is needed.  The alpha channel of @pixbuf, if present, is
+ * kept intact.
+ *
+ * Since: 2.47
+ **/
+void
+gwy_pixbuf_composite_data_field_as_mask(GdkPixbuf *pixbuf,
+                                        GwyDataField *data_field,
+                                        const GwyRGBA *color)
+{
+    gint xres, yres, i, rowstride, nchannels;
+    guchar *pixels;
+    MaskBlend blend;
+
+    g_return_if_fail(GDK_IS_PIXBUF(pixbuf));
+    g_return_if_fail(GWY_IS_DATA_FIELD(data_field));
+    g_return_if_fail(color);
+
+    xres = gdk_pixbuf_get_width(pixbuf);
+    yres = gdk_pixbuf_get_height(pixbuf);
+    if (!setup_mask_blend(&blend, data_field, color, xres, yres))
+        return;
+
+    pixels = gdk_pixbuf_get_pixels(pixbuf);
+    rowstride = gdk_pixbuf_get_rowstride(pixbuf);
+    nchannels = gdk_pixbuf_get_n_channels(pixbuf);
+
+#ifdef _OPENMP
+#pragma omp parallel for if(gwy_omp_use_threads(xres*yres)) \
+            private(i) \
+            shared(xres,yres,pixels,rowstride,nchannels,blend)
+#endif
+    for (i = 0; i < yres; i++) {
+        blend_block_mask(pixels + i*rowstride, blend.data + i*xres, xres,
+                         nchannels, &blend);
+    }
+}
+
 /************************** Documentation ****************************/
 
 /**
@@ -365,7 +663,15 @@ gwy_pixbuf_draw_data_field_as_mask(GdkPixbuf *pixbuf,
  * gwy_pixbuf_draw_data_field_adaptive() offer other false color mapping
  * possibilities.  A bit different is
  * gwy_pixbuf_draw_data_field_as_mask() which represents the values as
- * opacities of a signle color.
+ * opacities of a signle color.  If the mask is to be composited over an image
+ * of the same size, gwy_pixbuf_composite_data_field_as_mask() does it
+ * directly.  Functions gwy_pixbuf_draw_data_field_with_range_and_mask() and
+ * gwy_pixbuf_draw_data_field_adaptive_and_mask() draw the image and the mask
+ * over it in one pass.
+ *
+ * The drawing functions process the data in blocks and split the work among
+ * threads for large data fields if multithread processing is enabled, see
+ * gwy_threads_set_enabled().
  **/
 
 /* vim: set cin et ts=4 sw=4 cino=>1s,e0,n0,f0,{0,}0,^0,\:1s,=0,g1s,h0,t0,+1s,c3,(0,u0 : */
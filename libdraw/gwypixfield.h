@@ -26,23 +26,38 @@
 #include <libprocess/datafield.h>
 #include <libdraw/gwygradient.h>
 
-void gwy_pixbuf_draw_data_field           (GdkPixbuf *pixbuf,
-                                           GwyDataField *data_field,
-                                           GwyGradient *gradient);
-void gwy_pixbuf_draw_data_field_with_range(GdkPixbuf *pixbuf,
-                                           GwyDataField *data_field,
-                                           GwyGradient *gradient,
-                                           gdouble minimum,
-                                           gdouble maximum);
-void gwy_pixbuf_draw_data_field_adaptive  (GdkPixbuf *pixbuf,
-                                           GwyDataField *data_field,
-                                           GwyGradient *gradient);
-void gwy_draw_data_field_map_adaptive     (GwyDataField *data_field,
-                                           const gdouble *z,
-                                           gdouble *mapped,
-                                           guint n);
-void gwy_pixbuf_draw_data_field_as_mask   (GdkPixbuf *pixbuf,
-                                           GwyDataField *data_field,
-                                           const GwyRGBA *color);
+void gwy_pixbuf_draw_data_field             (GdkPixbuf *pixbuf,
+                                             GwyDataField *data_field,
+                                             GwyGradient *gradient);
+void gwy_pixbuf_draw_data_field_with_range  (GdkPixbuf *pixbuf,
+                                             GwyDataField *data_field,
+                                             GwyGradient *gradient,
+                                             gdouble minimum,
+                                             gdouble maximum);
+void gwy_pixbuf_draw_data_field_adaptive    (GdkPixbuf *pixbuf,
+                                             GwyDataField *data_field,
+                                             GwyGradient *gradient);
+void gwy_draw_data_field_map_adaptive       (GwyDataField *data_field,
+                                             const gdouble *z,
+                                             gdouble *mapped,
+                                             guint n);
+void gwy_pixbuf_draw_data_field_as_mask     (GdkPixbuf *pixbuf,
+                                             GwyDataField *data_field,
+                                             const GwyRGBA *color);
+void gwy_pixbuf_composite_data_field_as_mask(GdkPixbuf *pixbuf,
+                                             GwyDataField *data_field,
+                                             const GwyRGBA *color);
+void gwy_pixbuf_draw_data_field_with_range_and_mask(GdkPixbuf *pixbuf,
+                                                    GwyDataField *data_field,
+                                                    GwyGradient *gradient,
+                                                    gdouble minimum,
+                                                    gdouble maximum,
+                                                    GwyDataField *mask,
+                                                    const GwyRGBA *color);
+void gwy_pixbuf_draw_data_field_adaptive_and_mask(GdkPixbuf *pixbuf,
+                                                  GwyDataField *data_field,
+                                                  GwyGradient *gradient,
+                                                  GwyDataField *mask,
+                                                  const GwyRGBA *color);
 
 #endif /*__GWY_PIXFIELD__*/
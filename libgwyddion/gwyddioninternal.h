@@ -68,6 +68,10 @@ void _gwy_nlfit_preset_class_setup_presets(void);
 G_GNUC_INTERNAL
 void _gwy_fd_curve_preset_class_setup_presets(void);
 
+G_GNUC_INTERNAL
+gboolean _gwy_math_nlfit_set_threadsafe(GwyNLFitter *nlfit,
+                                        gboolean threadsafe);
+
 G_END_DECLS
 
 #endif /* __GWY_INTERNAL_H__ */
@@ -22,6 +22,7 @@
 #include "config.h"
 #include <libgwyddion/gwyutils.h>
 #include <libgwyddion/gwymacros.h>
+#include <libgwyddion/gwycontainer.h>
 #include <libgwyddion/gwydebugobjects.h>
 
 typedef struct {
@@ -33,11 +34,37 @@ typedef struct {
     const gchar *details;
 } DebugObjectInfo;
 
+typedef struct {
+    GObject *object;
+    GType type;
+    gsize size;
+} AccountedObject;
+
+typedef struct {
+    GType type;
+    guint64 bytes;
+    guint64 peak;
+    guint count;
+} AccountedType;
+
+static void account_object_finalized(gpointer data,
+                                     GObject *exobject);
+static void account_container_finalized(gpointer data,
+                                        GObject *exobject);
+
 static gboolean debug_objects_enabled = FALSE;
 static GTimer *debug_objects_timer = NULL;
 static GList *debug_objects = NULL;
 static gsize id = 0;
 
+G_LOCK_DEFINE_STATIC(accounting);
+static gboolean accounting_enabled = FALSE;
+static GHashTable *accounted_objects = NULL;
+static GHashTable *accounted_types = NULL;
+static GHashTable *accounted_containers = NULL;
+static guint64 accounted_bytes = 0;
+static guint64 accounted_peak = 0;
+
 /**
  * gwy_debug_objects_enable:
  * @enable: Whether object creation/destruction debugger should be enabled.
@@ -86,6 +113,16 @@ gwy_debug_objects_creation_detailed(GObject *object,
 {
     DebugObjectInfo *info;
 
+    if (G_UNLIKELY(accounting_enabled) && GWY_IS_CONTAINER(object)) {
+        G_LOCK(accounting);
+        if (accounting_enabled
+            && !g_hash_table_lookup(accounted_containers, object)) {
+            g_hash_table_insert(accounted_containers, object, object);
+            g_object_weak_ref(object, &account_container_finalized, NULL);
+        }
+        G_UNLOCK(accounting);
+    }
+
     if (!G_UNLIKELY(debug_objects_enabled))
         return;
 
@@ -176,6 +213,379 @@ gwy_debug_objects_clear(void)
     debug_objects_timer = NULL;
 }
 
+static AccountedType*
+get_accounted_type(GType type)
+{
+    AccountedType *atype;
+
+    atype = g_hash_table_lookup(accounted_types, GSIZE_TO_POINTER(type));
+    if (!atype) {
+        atype = g_slice_new0(AccountedType);
+        atype->type = type;
+        g_hash_table_insert(accounted_types, GSIZE_TO_POINTER(type), atype);
+    }
+    return atype;
+}
+
+/* Must be called with the accounting lock held. */
+static void
+account_size_change(AccountedObject *aobject, gsize size)
+{
+    AccountedType *atype = get_accounted_type(aobject->type);
+
+    atype->bytes -= aobject->size;
+    accounted_bytes -= aobject->size;
+    aobject->size = size;
+    atype->bytes += size;
+    accounted_bytes += size;
+    atype->peak = MAX(atype->peak, atype->bytes);
+    accounted_peak = MAX(accounted_peak, accounted_bytes);
+}
+
+static void
+account_object_finalized(G_GNUC_UNUSED gpointer data, GObject *exobject)
+{
+    AccountedObject *aobject;
+
+    G_LOCK(accounting);
+    if (accounted_objects
+        && (aobject = g_hash_table_lookup(accounted_objects, exobject))) {
+        account_size_change(aobject, 0);
+        get_accounted_type(aobject->type)->count--;
+        g_hash_table_remove(accounted_objects, exobject);
+    }
+    G_UNLOCK(accounting);
+}
+
+static void
+account_container_finalized(G_GNUC_UNUSED gpointer data, GObject *exobject)
+{
+    G_LOCK(accounting);
+    if (accounted_containers)
+        g_hash_table_remove(accounted_containers, exobject);
+    G_UNLOCK(accounting);
+}
+
+static void
+accounted_object_free(gpointer p)
+{
+    g_slice_free(AccountedObject, p);
+}
+
+static void
+accounted_type_free(gpointer p)
+{
+    g_slice_free(AccountedType, p);
+}
+
+static void
+unwatch_object(gpointer key, G_GNUC_UNUSED gpointer value, gpointer data)
+{
+    g_object_weak_unref((GObject*)key, (GWeakNotify)data, NULL);
+}
+
+/**
+ * gwy_debug_objects_enable_accounting:
+ * @enable: Whether memory accounting of data objects should be enabled.
+ *
+ * Enables or disables the memory accounting of data objects.
+ *
+ * Only objects whose size is set with gwy_debug_objects_set_size() while the
+ * accounting is enabled are accounted.  Since data objects set their size
+ * when their data are allocated, the accounting should be enabled before
+ * any data are created to get meaningful results.
+ *
+ * Disabling the accounting forgets all accounted objects, high-water marks
+ * included.  When accounting is disabled gwy_debug_objects_set_size() only
+ * checks a flag and returns.
+ *
+ * Since: 2.47
+ **/
+void
+gwy_debug_objects_enable_accounting(gboolean enable)
+{
+    G_LOCK(accounting);
+    if (!enable == !accounting_enabled) {
+        G_UNLOCK(accounting);
+        return;
+    }
+
+    accounting_enabled = enable;
+    if (enable) {
+        accounted_objects = g_hash_table_new_full(NULL, NULL,
+                                                  NULL, accounted_object_free);
+        accounted_types = g_hash_table_new_full(NULL, NULL,
+                                                NULL, accounted_type_free);
+        accounted_containers = g_hash_table_new(NULL, NULL);
+    }
+    else {
+        g_hash_table_foreach(accounted_objects, unwatch_object,
+                             &account_object_finalized);
+        g_hash_table_foreach(accounted_containers, unwatch_object,
+                             &account_container_finalized);
+        g_hash_table_destroy(accounted_objects);
+        g_hash_table_destroy(accounted_types);
+        g_hash_table_destroy(accounted_containers);
+        accounted_objects = accounted_types = accounted_containers = NULL;
+        accounted_bytes = accounted_peak = 0;
+    }
+    G_UNLOCK(accounting);
+}
+
+/**
+ * gwy_debug_objects_get_accounting:
+ *
+ * Reports whether the memory accounting of data objects is enabled.
+ *
+ * Returns: %TRUE if accounting is enabled, %FALSE if it is disabled.
+ *
+ * Since: 2.47
+ **/
+gboolean
+gwy_debug_objects_get_accounting(void)
+{
+    return accounting_enabled;
+}
+
+/**
+ * gwy_debug_objects_set_size:
+ * @object: A data object.
+ * @size: Number of bytes of data the object currently holds.
+ *
+ * Notes the current data size of an object for memory accounting.
+ *
+ * Object implementations call this function whenever they (re)allocate their
+ * data.  The object is accounted under its type from the first call until it
+ * is finalized.  Only the large data buffers are supposed to be included in
+ * @size, not the object structure itself or other small auxiliary data.
+ *
+ * The function does nothing unless accounting has been enabled with
+ * gwy_debug_objects_enable_accounting().
+ *
+ * Since: 2.47
+ **/
+void
+gwy_debug_objects_set_size(GObject *object,
+                           gsize size)
+{
+    AccountedObject *aobject;
+
+    if (G_LIKELY(!accounting_enabled))
+        return;
+
+    G_LOCK(accounting);
+    if (!accounting_enabled) {
+        G_UNLOCK(accounting);
+        return;
+    }
+    if (!(aobject = g_hash_table_lookup(accounted_objects, object))) {
+        aobject = g_slice_new0(AccountedObject);
+        aobject->object = object;
+        aobject->type = G_TYPE_FROM_INSTANCE(object);
+        g_hash_table_insert(accounted_objects, object, aobject);
+        get_accounted_type(aobject->type)->count++;
+        g_object_weak_ref(object, &account_object_finalized, NULL);
+    }
+    account_size_change(aobject, size);
+    G_UNLOCK(accounting);
+}
+
+/**
+ * gwy_debug_objects_get_bytes:
+ * @type: Object type to get the number of bytes for.  Pass zero to obtain
+ *        the total for all types.
+ * @peak: Location to store the high-water mark to, or %NULL.
+ *
+ * Obtains the number of bytes held by accounted objects of given type.
+ *
+ * Only objects of exactly @type are included, not its subtypes.
+ *
+ * Returns: The number of bytes currently held by live objects.  Zero is
+ *          returned if accounting is disabled.
+ *
+ * Since: 2.47
+ **/
+guint64
+gwy_debug_objects_get_bytes(GType type,
+                            guint64 *peak)
+{
+    AccountedType *atype;
+    guint64 bytes = 0;
+
+    if (peak)
+        *peak = 0;
+
+    G_LOCK(accounting);
+    if (!accounting_enabled) {
+        G_UNLOCK(accounting);
+        return 0;
+    }
+
+    if (!type) {
+        bytes = accounted_bytes;
+        if (peak)
+            *peak = accounted_peak;
+    }
+    else if ((atype = g_hash_table_lookup(accounted_types,
+                                          GSIZE_TO_POINTER(type)))) {
+        bytes = atype->bytes;
+        if (peak)
+            *peak = atype->peak;
+    }
+    G_UNLOCK(accounting);
+
+    return bytes;
+}
+
+typedef struct {
+    guint64 bytes;
+    guint count;
+    GHashTable *owners;
+    GObject *container;
+} ContainerSum;
+
+static void
+sum_container_item(gpointer hkey, gpointer hvalue, gpointer user_data)
+{
+    GValue *value = (GValue*)hvalue;
+    ContainerSum *csum = (ContainerSum*)user_data;
+    AccountedObject *aobject;
+    GObject *object;
+    const gchar *key;
+
+    if (!G_VALUE_HOLDS_OBJECT(value)
+        || !(object = g_value_get_object(value))
+        || !(aobject = g_hash_table_lookup(accounted_objects, object)))
+        return;
+
+    csum->bytes += aobject->size;
+    csum->count++;
+    if (!g_hash_table_lookup(csum->owners, object)) {
+        key = g_quark_to_string(GPOINTER_TO_UINT(hkey));
+        g_hash_table_insert(csum->owners, object,
+                            g_strdup_printf("%p %s", csum->container, key));
+    }
+}
+
+static void
+gather_values(G_GNUC_UNUSED gpointer key, gpointer value, gpointer user_data)
+{
+    g_ptr_array_add((GPtrArray*)user_data, value);
+}
+
+static gint
+compare_accounted_types(gconstpointer a, gconstpointer b)
+{
+    const AccountedType *ta = *(const AccountedType**)a;
+    const AccountedType *tb = *(const AccountedType**)b;
+
+    if (ta->peak > tb->peak)
+        return -1;
+    if (ta->peak < tb->peak)
+        return 1;
+    return 0;
+}
+
+static gint
+compare_accounted_objects(gconstpointer a, gconstpointer b)
+{
+    const AccountedObject *oa = *(const AccountedObject**)a;
+    const AccountedObject *ob = *(const AccountedObject**)b;
+
+    if (oa->size > ob->size)
+        return -1;
+    if (oa->size < ob->size)
+        return 1;
+    return 0;
+}
+
+static inline gdouble
+to_mib(guint64 bytes)
+{
+    return bytes/1048576.0;
+}
+
+/**
+ * gwy_debug_objects_dump_accounting:
+ * @filehandle: A filehandle open for writing.
+ * @nlargest: Maximum number of largest live objects to list.
+ *
+ * Dumps memory accounting of data objects to a file.
+ *
+ * The dump starts with the total number of bytes held by accounted objects
+ * and its high-water mark.  It is followed by the number of live objects,
+ * bytes and high-water mark for each object type, the number of objects and
+ * bytes held by each live #GwyContainer and finally the @nlargest largest
+ * live objects, including the container and key they were found under.
+ *
+ * Objects present in several containers are counted in each of them.
+ *
+ * Since: 2.47
+ **/
+void
+gwy_debug_objects_dump_accounting(FILE *filehandle,
+                                  guint nlargest)
+{
+    GHashTable *owners;
+    GPtrArray *items;
+    AccountedType *atype;
+    AccountedObject *aobject;
+    ContainerSum csum;
+    const gchar *owner;
+    guint i;
+
+    G_LOCK(accounting);
+    if (!accounting_enabled) {
+        G_UNLOCK(accounting);
+        return;
+    }
+
+    gwy_fprintf(filehandle, "TOTAL %.3f MiB (peak %.3f MiB)\n",
+                to_mib(accounted_bytes), to_mib(accounted_peak));
+
+    items = g_ptr_array_new();
+    g_hash_table_foreach(accounted_types, gather_values, items);
+    g_ptr_array_sort(items, compare_accounted_types);
+    for (i = 0; i < items->len; i++) {
+        atype = (AccountedType*)g_ptr_array_index(items, i);
+        gwy_fprintf(filehandle, "TYPE %s %u %.3f MiB (peak %.3f MiB)\n",
+                    g_type_name(atype->type), atype->count,
+                    to_mib(atype->bytes), to_mib(atype->peak));
+    }
+
+    owners = g_hash_table_new_full(NULL, NULL, NULL, g_free);
+    g_ptr_array_set_size(items, 0);
+    g_hash_table_foreach(accounted_containers, gather_values, items);
+    for (i = 0; i < items->len; i++) {
+        gwy_clear(&csum, 1);
+        csum.owners = owners;
+        csum.container = (GObject*)g_ptr_array_index(items, i);
+        gwy_container_foreach(GWY_CONTAINER(csum.container), NULL,
+                              sum_container_item, &csum);
+        if (!csum.count)
+            continue;
+        gwy_fprintf(filehandle, "CONTAINER %p %u %.3f MiB\n",
+                    csum.container, csum.count, to_mib(csum.bytes));
+    }
+
+    g_ptr_array_set_size(items, 0);
+    g_hash_table_foreach(accounted_objects, gather_values, items);
+    g_ptr_array_sort(items, compare_accounted_objects);
+    for (i = 0; i < MIN(nlargest, items->len); i++) {
+        aobject = (AccountedObject*)g_ptr_array_index(items, i);
+        gwy_fprintf(filehandle, "OBJECT %s %p %.3f MiB",
+                    g_type_name(aobject->type), aobject->object,
+                    to_mib(aobject->size));
+        if ((owner = g_hash_table_lookup(owners, aobject->object)))
+            gwy_fprintf(filehandle, " in %s", owner);
+        gwy_fprintf(filehandle, "\n");
+    }
+
+    g_ptr_array_free(items, TRUE);
+    g_hash_table_destroy(owners);
+    G_UNLOCK(accounting);
+}
+
 /************************** Documentation ****************************/
 
 /**
@@ -193,6 +603,15 @@ gwy_debug_objects_clear(void)
  * call gwy_debug_objects_creation() so to debug their lifetime rules, just
  * enable it.
  *
+ * Memory accounting, enabled with gwy_debug_objects_enable_accounting(),
+ * keeps track of the number of bytes held by data objects such as data fields,
+ * lines, bricks, surfaces and graph models.  It records high-water marks of
+ * the total and per-type number of bytes and
+ * gwy_debug_objects_dump_accounting() can list the largest live objects and
+ * the containers holding them, which helps finding what consumes memory in
+ * long sessions.  Accounting is independent of the object
+ * creation/destruction debugger.
+ *
  * Future changes: This functionality will be removed in 3.0.  Use RefDbg.
  **/
 
@@ -35,12 +35,20 @@ typedef enum {
 #define gwy_debug_objects_creation(o) \
     gwy_debug_objects_creation_detailed((o), __FILE__ ":" G_STRINGIFY(__LINE__))
 
-void gwy_debug_objects_creation_detailed (GObject *object,
-                                          const gchar *details);
-void gwy_debug_objects_enable            (gboolean enable);
-void gwy_debug_objects_dump_to_file      (FILE *filehandle,
-                                          GwyDebugObjectsDumpFlags flags);
-void gwy_debug_objects_clear             (void);
+void     gwy_debug_objects_creation_detailed (GObject *object,
+                                              const gchar *details);
+void     gwy_debug_objects_enable            (gboolean enable);
+void     gwy_debug_objects_dump_to_file      (FILE *filehandle,
+                                              GwyDebugObjectsDumpFlags flags);
+void     gwy_debug_objects_clear             (void);
+void     gwy_debug_objects_enable_accounting (gboolean enable);
+gboolean gwy_debug_objects_get_accounting    (void);
+void     gwy_debug_objects_set_size          (GObject *object,
+                                              gsize size);
+guint64  gwy_debug_objects_get_bytes         (GType type,
+                                              guint64 *peak);
+void     gwy_debug_objects_dump_accounting   (FILE *filehandle,
+                                              guint nlargest);
 
 G_END_DECLS
 
@@ -26,9 +26,13 @@
 #include <libgwyddion/gwymacros.h>
 #include <libgwyddion/gwymath.h>
 #include <libgwyddion/gwyexpr.h>
+#include "libgwyddion/gwyomp.h"
 
 #define GWY_EXPR_SCOPE_GLOBAL 0
 
+/* Number of items processed at once by the vector interpreter. */
+#define GWY_EXPR_BLOCK_SIZE 256
+
 /* things that can appear on code stack */
 typedef enum {
     /* negative values are reserved for variables */
@@ -302,6 +306,197 @@ gwy_expr_stack_interpret(GwyExpr *expr)
     }
 }
 
+/* Operand on the stack of vectors.  It is either a scalar (@vec is %NULL) or
+ * a vector, which can be one of the stack slots or directly the input data.
+ * So pushing constants and variables does not copy anything and operations
+ * on them are fused with the push. */
+typedef struct {
+    const gdouble *vec;
+    gdouble value;
+} GwyExprOperand;
+
+#define BLOCK_UNARY(expression) \
+    do { \
+        if (a->vec) { \
+            for (k = 0; k < n; k++) { \
+                x = a->vec[k]; \
+                r[k] = (expression); \
+            } \
+            a->vec = r; \
+        } \
+        else { \
+            x = a->value; \
+            a->value = (expression); \
+        } \
+    } while (0)
+
+#define BLOCK_BINARY(expression) \
+    do { \
+        if (a->vec && b->vec) { \
+            for (k = 0; k < n; k++) { \
+                x = a->vec[k]; \
+                y = b->vec[k]; \
+                r[k] = (expression); \
+            } \
+        } \
+        else if (a->vec) { \
+            y = b->value; \
+            for (k = 0; k < n; k++) { \
+                x = a->vec[k]; \
+                r[k] = (expression); \
+            } \
+        } \
+        else if (b->vec) { \
+            x = a->value; \
+            for (k = 0; k < n; k++) { \
+                y = b->vec[k]; \
+                r[k] = (expression); \
+            } \
+        } \
+        else { \
+            x = a->value; \
+            y = b->value; \
+            b->value = (expression); \
+            break; \
+        } \
+        b->vec = r; \
+    } while (0)
+
+/* Applies a unary function to operand @a, storing vector results to @r. */
+static void
+gwy_expr_block_unary(GwyExprOpCode type,
+                     GwyExprOperand *a,
+                     gdouble *r,
+                     guint n)
+{
+    gdouble x;
+    guint k;
+
+    switch (type) {
+        case GWY_EXPR_CODE_NEGATE: BLOCK_UNARY(-x); break;
+        case GWY_EXPR_CODE_ABS: BLOCK_UNARY(fabs(x)); break;
+        case GWY_EXPR_CODE_FLOOR: BLOCK_UNARY(floor(x)); break;
+        case GWY_EXPR_CODE_CEIL: BLOCK_UNARY(ceil(x)); break;
+        case GWY_EXPR_CODE_SQRT: BLOCK_UNARY(sqrt(x)); break;
+        case GWY_EXPR_CODE_CBRT: BLOCK_UNARY(cbrt(x)); break;
+        case GWY_EXPR_CODE_SIN: BLOCK_UNARY(sin(x)); break;
+        case GWY_EXPR_CODE_COS: BLOCK_UNARY(cos(x)); break;
+        case GWY_EXPR_CODE_TAN: BLOCK_UNARY(tan(x)); break;
+        case GWY_EXPR_CODE_ASIN: BLOCK_UNARY(asin(x)); break;
+        case GWY_EXPR_CODE_ACOS: BLOCK_UNARY(acos(x)); break;
+        case GWY_EXPR_CODE_ATAN: BLOCK_UNARY(atan(x)); break;
+        case GWY_EXPR_CODE_EXP: BLOCK_UNARY(exp(x)); break;
+        case GWY_EXPR_CODE_LN: BLOCK_UNARY(log(x)); break;
+        case GWY_EXPR_CODE_LOG: BLOCK_UNARY(log(x)); break;
+        case GWY_EXPR_CODE_POW10: BLOCK_UNARY(pow10(x)); break;
+        case GWY_EXPR_CODE_LOG10: BLOCK_UNARY(log10(x)); break;
+        case GWY_EXPR_CODE_COSH: BLOCK_UNARY(cosh(x)); break;
+        case GWY_EXPR_CODE_SINH: BLOCK_UNARY(sinh(x)); break;
+        case GWY_EXPR_CODE_TANH: BLOCK_UNARY(tanh(x)); break;
+        case GWY_EXPR_CODE_ACOSH: BLOCK_UNARY(acosh(x)); break;
+        case GWY_EXPR_CODE_ASINH: BLOCK_UNARY(asinh(x)); break;
+        case GWY_EXPR_CODE_ATANH: BLOCK_UNARY(atanh(x)); break;
+        default:
+        g_assert_not_reached();
+        break;
+    }
+}
+
+/* Applies a binary function to operands @a (top) and @b, replacing @b with
+ * the result and storing vector results to @r.  The argument order is the
+ * same as in the scalar functions in call_table[]. */
+static void
+gwy_expr_block_binary(GwyExprOpCode type,
+                      const GwyExprOperand *a,
+                      GwyExprOperand *b,
+                      gdouble *r,
+                      guint n)
+{
+    gdouble x, y;
+    guint k;
+
+    switch (type) {
+        case GWY_EXPR_CODE_ADD: BLOCK_BINARY(x + y); break;
+        case GWY_EXPR_CODE_SUBTRACT: BLOCK_BINARY(x - y); break;
+        case GWY_EXPR_CODE_MULTIPLY: BLOCK_BINARY(x * y); break;
+        case GWY_EXPR_CODE_DIVIDE: BLOCK_BINARY(x / y); break;
+        case GWY_EXPR_CODE_MODULO: BLOCK_BINARY(fmod(x, y)); break;
+        case GWY_EXPR_CODE_POWER: BLOCK_BINARY(pow(x, y)); break;
+        case GWY_EXPR_CODE_POW: BLOCK_BINARY(pow(x, y)); break;
+        case GWY_EXPR_CODE_MIN: BLOCK_BINARY(MIN(x, y)); break;
+        case GWY_EXPR_CODE_MAX: BLOCK_BINARY(MAX(x, y)); break;
+        case GWY_EXPR_CODE_FMOD: BLOCK_BINARY(fmod(x, y)); break;
+        case GWY_EXPR_CODE_HYPOT: BLOCK_BINARY(hypot(x, y)); break;
+        case GWY_EXPR_CODE_ATAN2: BLOCK_BINARY(atan2(x, y)); break;
+        default:
+        g_assert_not_reached();
+        break;
+    }
+}
+
+#undef BLOCK_UNARY
+#undef BLOCK_BINARY
+
+/**
+ * gwy_expr_stack_interpret_block:
+ * @expr: An expression.
+ * @n: Block length, at most %GWY_EXPR_BLOCK_SIZE.
+ * @data: An array of arrays of length @n, already offset to the block start.
+ * @operands: Operand stack with at least @expr->slen items.
+ * @slots: Scratch space for @expr->slen vectors of %GWY_EXPR_BLOCK_SIZE
+ *         items.
+ * @result: An array of length @n to store computation results to.
+ *
+ * Runs code in @expr->input on a block of data, each operation is performed
+ * on the entire block at once.
+ *
+ * It does not modify @expr and can be thus run in parallel on different
+ * blocks.
+ **/
+static void
+gwy_expr_stack_interpret_block(const GwyExpr *expr,
+                               guint n,
+                               const gdouble **data,
+                               GwyExprOperand *operands,
+                               gdouble *slots,
+                               gdouble *result)
+{
+    GwyExprOperand *sp = operands - 1;
+    guint i, k;
+
+    for (i = 0; i < expr->in; i++) {
+        const GwyExprCode *code = expr->input + i;
+
+        if (code->type == GWY_EXPR_CODE_CONSTANT) {
+            sp++;
+            sp->vec = NULL;
+            sp->value = code->value;
+        }
+        else if ((gint)code->type < 0) {
+            sp++;
+            sp->vec = data[-(gint)code->type];
+        }
+        else if (call_table[code->type].in_values == 2) {
+            sp--;
+            gwy_expr_block_binary(code->type, sp + 1, sp,
+                                  slots + (sp - operands)*GWY_EXPR_BLOCK_SIZE,
+                                  n);
+        }
+        else {
+            gwy_expr_block_unary(code->type, sp,
+                                 slots + (sp - operands)*GWY_EXPR_BLOCK_SIZE,
+                                 n);
+        }
+    }
+
+    if (!operands[0].vec) {
+        for (k = 0; k < n; k++)
+            result[k] = operands[0].value;
+    }
+    else if (operands[0].vec != result)
+        memmove(result, operands[0].vec, n*sizeof(gdouble));
+}
+
 /**
  * gwy_expr_stack_interpret_vectors:
  * @expr: An expression.
@@ -313,29 +508,47 @@ gwy_expr_stack_interpret(GwyExpr *expr)
  *
  * Performs actual vectorized stack interpretation.
  *
+ * The data are processed in blocks of %GWY_EXPR_BLOCK_SIZE items, possibly
+ * in parallel.
+ *
  * No checking is done, use gwy_expr_stack_check_executability() beforehand.
  **/
-static inline void
+static void
 gwy_expr_stack_interpret_vectors(GwyExpr *expr,
                                  guint n,
                                  const gdouble **data,
                                  gdouble *result)
 {
-    guint i, j;
-
-    for (j = 0; j < n; j++) {
-        expr->sp = expr->stack - 1;
-        for (i = 0; i < expr->in; i++) {
-            const GwyExprCode *code = expr->input + i;
-
-            if (code->type == GWY_EXPR_CODE_CONSTANT)
-                *(++expr->sp) = code->value;
-            else if ((gint)code->type > 0)
-                call_table[code->type].function(&expr->sp);
-            else
-                *(++expr->sp) = data[-(gint)code->type][j];
+    guint nblocks = (n + GWY_EXPR_BLOCK_SIZE-1)/GWY_EXPR_BLOCK_SIZE;
+    guint nvars = expr->identifiers ? expr->identifiers->len : 1;
+
+#ifdef _OPENMP
+#pragma omp parallel if(gwy_omp_use_threads((gsize)n*expr->in)) \
+            default(none) \
+            shared(expr,n,data,result,nblocks,nvars)
+#endif
+    {
+        guint ifrom = gwy_omp_chunk_start(nblocks);
+        guint ito = gwy_omp_chunk_end(nblocks);
+        GwyExprOperand *operands = g_new(GwyExprOperand, expr->slen);
+        gdouble *slots = g_new(gdouble, expr->slen*GWY_EXPR_BLOCK_SIZE);
+        const gdouble **blockdata = g_new0(const gdouble*, nvars);
+        guint ib, v, from;
+
+        for (ib = ifrom; ib < ito; ib++) {
+            from = ib*GWY_EXPR_BLOCK_SIZE;
+            /* Unused variables may have NULL data. */
+            for (v = 1; v < nvars; v++)
+                blockdata[v] = data[v] ? data[v] + from : NULL;
+            gwy_expr_stack_interpret_block(expr,
+                                           MIN(n - from, GWY_EXPR_BLOCK_SIZE),
+                                           blockdata, operands, slots,
+                                           result + from);
         }
-        result[j] = expr->stack[0];
+
+        g_free(blockdata);
+        g_free(slots);
+        g_free(operands);
     }
 }
 
@@ -25,6 +25,8 @@
 #include <libgwyddion/gwymacros.h>
 #include <libgwyddion/gwymath.h>
 #include <libgwyddion/gwynlfit.h>
+#include "gwyddioninternal.h"
+#include "libgwyddion/gwyomp.h"
 
 /* Side step constant for numerical differentiation in gwy_math_nlfit_derive()
  */
@@ -35,6 +37,19 @@
  */
 #define EPS 1e-16
 
+/* Number of data points evaluated at once by vector functions. */
+#define NLFIT_BLOCK_SIZE 256
+
+/* Parallel evaluation sums the residua and normal equations over chunks of
+ * data in a fixed order.  The chunk size depends only on the number of data,
+ * so the results do not depend on the number of threads. */
+#define NLFIT_CHUNK_SIZE (4*NLFIT_BLOCK_SIZE)
+#define NLFIT_MAX_CHUNKS 256
+
+/* Rough cost of one function evaluation in elementary operations, for the
+ * decision whether to run in parallel. */
+#define NLFIT_FUNC_COST 32
+
 /* Lower symmetric part indexing */
 /* i (row) MUST be greater or equal than j (column) */
 #define SLi(a, i, j) a[(i)*((i) + 1)/2 + (j)]
@@ -45,8 +60,32 @@ typedef struct {
     GwySetMessageFunc set_message;
     GwyNLFitIdxFunc func_idx;
     GwyNLFitIdxDiffFunc diff_idx;
+    GwyNLFitIdxVecFunc func_vec;
+    gboolean threadsafe;
 } GwyNLFitterPrivate;
 
+/* Everything that does not change during one fit. */
+typedef struct {
+    GwyNLFitFunc func;
+    GwyNLFitDerFunc diff;
+    GwyNLFitIdxFunc func_idx;
+    GwyNLFitIdxDiffFunc diff_idx;
+    GwyNLFitIdxVecFunc func_vec;
+    gboolean parallel;
+    guint ndata;
+    const gdouble *x;
+    const gdouble *y;
+    const gdouble *w;
+    guint nparam;
+    const gboolean *fixed_param;
+    const gboolean *fixed;
+    const gint *link_map;
+    const guint *var_param_id;
+    guint n_var_param;
+    guint covar_size;
+    gpointer user_data;
+} GwyNLFitState;
+
 static void                gwy_math_nlfit_init    (GwyNLFitter *nlfit);
 static gdouble             gwy_math_nlfit_fit_real(GwyNLFitter *nlfit,
                                                    guint ndata,
@@ -58,22 +97,22 @@ static gdouble             gwy_math_nlfit_fit_real(GwyNLFitter *nlfit,
                                                    const gboolean *fixed_param,
                                                    const gint *link_map,
                                                    gpointer user_data);
-static gdouble             gwy_math_nlfit_residua (GwyNLFitFunc func,
-                                                   GwyNLFitIdxFunc func_idx,
-                                                   guint ndata,
-                                                   const gdouble *x,
-                                                   const gdouble *y,
-                                                   const gdouble *weight,
-                                                   guint nparam,
+static gdouble             gwy_math_nlfit_residua (const GwyNLFitState *state,
                                                    const gdouble *param,
-                                                   gpointer user_data,
                                                    gdouble *resid,
                                                    gboolean *success);
+static gboolean            gwy_math_nlfit_normal  (const GwyNLFitState *state,
+                                                   const gdouble *param,
+                                                   const gdouble *resid,
+                                                   gdouble *a,
+                                                   gdouble *v);
 static GwyNLFitterPrivate* find_private_data      (GwyNLFitter *fitter,
                                                    gboolean do_create);
 static void                free_private_data      (GwyNLFitter *fitter);
 
+/* Fitters can be created and used in several threads at once. */
 static GList *private_fitter_data = NULL;
+G_LOCK_DEFINE_STATIC(private_fitter_data);
 
 /**
  * gwy_math_nlfit_new:
@@ -143,6 +182,55 @@ gwy_math_nlfit_new_idx(GwyNLFitIdxFunc func, GwyNLFitIdxDiffFunc diff)
     return nlfit;
 }
 
+/**
+ * gwy_math_nlfit_new_idx_vec:
+ * @func: The fitted function.
+ *
+ * Creates a new Marquardt-Levenberg nonlinear fitter for opaque indexed data
+ * evaluating the function on blocks of data.
+ *
+ * The fitter is used exactly as fitters created with gwy_math_nlfit_new_idx(),
+ * i.e. with gwy_math_nlfit_fit_idx() and gwy_math_nlfit_fit_idx_full().  The
+ * difference is that @func is called for contiguous ranges of data indices
+ * instead of individual points.  This saves the per-point call overhead and
+ * allows splitting the evaluation of residua and Jacobian among several
+ * threads.  Derivatives are always computed numerically, one parameter
+ * (Jacobian column) for an entire block at a time.
+ *
+ * Since @func can be called from several threads at once, it must be
+ * reentrant.
+ *
+ * Returns: The newly created fitter.
+ *
+ * Since: 2.47
+ **/
+GwyNLFitter*
+gwy_math_nlfit_new_idx_vec(GwyNLFitIdxVecFunc func)
+{
+    GwyNLFitterPrivate *priv;
+    GwyNLFitter *nlfit;
+
+    nlfit = g_new0(GwyNLFitter, 1);
+    gwy_math_nlfit_init(nlfit);
+    priv = find_private_data(nlfit, TRUE);
+    priv->func_vec = func;
+
+    return nlfit;
+}
+
+/* Marks the fitting function and derivatives as reentrant, permitting
+ * parallel evaluation for all fitter types.  Returns the previous setting. */
+gboolean
+_gwy_math_nlfit_set_threadsafe(GwyNLFitter *nlfit,
+                               gboolean threadsafe)
+{
+    GwyNLFitterPrivate *priv = find_private_data(nlfit, TRUE);
+    gboolean old = priv->threadsafe;
+
+    priv->threadsafe = threadsafe;
+    return old;
+}
+
 static void
 gwy_math_nlfit_init(GwyNLFitter *nlfit)
 {
@@ -329,21 +417,22 @@ gwy_math_nlfit_fit_real(GwyNLFitter *nlfit,
                         gpointer user_data)
 {
     GwyNLFitterPrivate *priv;
+    GwyNLFitState state;
     GwySetFractionFunc set_fraction = NULL;
     GwySetMessageFunc set_message = NULL;
     GwyNLFitFunc func;
     GwyNLFitDerFunc diff;
     GwyNLFitIdxFunc func_idx;
-    GwyNLFitIdxDiffFunc diff_idx;
+    GwyNLFitIdxVecFunc func_vec;
     gdouble mlambda = 1e-4;
     gdouble sumr1, sumr = G_MAXDOUBLE;
-    gdouble *der = NULL, *v = NULL, *xr = NULL, *w = NULL,
+    gdouble *v = NULL, *xr = NULL, *w = NULL,
             *saveparam = NULL, *origparam = NULL, *resid = NULL,
             *a = NULL, *save_a = NULL;
     guint *var_param_id = NULL, *lmap = NULL;
     gboolean *fixed = NULL;
     guint covar_size;
-    guint i, j, k;
+    guint i, j;
     guint n_var_param;
     guint miter = 0;
     gboolean step1 = TRUE;
@@ -358,7 +447,7 @@ gwy_math_nlfit_fit_real(GwyNLFitter *nlfit,
     func = nlfit->fmarq;
     diff = nlfit->dmarq;
     func_idx = priv->func_idx;
-    diff_idx = priv->diff_idx;
+    func_vec = priv->func_vec;
 
     GWY_FREE(nlfit->covar);
     nlfit->dispersion = -1.0;
@@ -366,8 +455,10 @@ gwy_math_nlfit_fit_real(GwyNLFitter *nlfit,
     if (ndata < nparam)
         return -1.0;
 
-    g_return_val_if_fail((x && y && func && diff) || func_idx, -1.0);
-    g_return_val_if_fail(!func_idx || (!x && !y && !weight && !func), -1.0);
+    g_return_val_if_fail((x && y && func && diff) || func_idx || func_vec,
+                         -1.0);
+    g_return_val_if_fail(!(func_idx || func_vec)
+                         || (!x && !y && !weight && !func), -1.0);
 
     if (set_message)
         set_message(_("Initial residua evaluation..."));
@@ -397,10 +488,24 @@ gwy_math_nlfit_fit_real(GwyNLFitter *nlfit,
             param[i] = param[link_map[i]];
     }
 
+    gwy_clear(&state, 1);
+    state.func = func;
+    state.diff = diff;
+    state.func_idx = func_idx;
+    state.diff_idx = priv->diff_idx;
+    state.func_vec = func_vec;
+    state.parallel = func_vec || priv->threadsafe;
+    state.ndata = ndata;
+    state.x = x;
+    state.y = y;
+    state.w = w;
+    state.nparam = nparam;
+    state.fixed_param = fixed_param;
+    state.link_map = link_map;
+    state.user_data = user_data;
+
     resid = g_new(gdouble, ndata);
-    sumr1 = gwy_math_nlfit_residua(func, func_idx, ndata, x, y, w,
-                                   nparam, param, user_data, resid,
-                                   &nlfit->eval);
+    sumr1 = gwy_math_nlfit_residua(&state, param, resid, &nlfit->eval);
     sumr = sumr1;
 
     if (!nlfit->eval) {
@@ -456,8 +561,11 @@ gwy_math_nlfit_fit_real(GwyNLFitter *nlfit,
     }
 
     covar_size = n_var_param*(n_var_param + 1)/2;
+    state.fixed = fixed;
+    state.var_param_id = var_param_id;
+    state.n_var_param = n_var_param;
+    state.covar_size = covar_size;
 
-    der = g_new(gdouble, nparam);  /* because diff() computes all */
     v = g_new(gdouble, n_var_param);
     xr = g_new(gdouble, n_var_param);
     saveparam = g_new(gdouble, nparam);
@@ -474,59 +582,8 @@ gwy_math_nlfit_fit_real(GwyNLFitter *nlfit,
             mlambda *= nlfit->mdec;
             sumr = sumr1;
 
-            gwy_clear(a, covar_size);
-            gwy_clear(v, n_var_param);
-
             /* J'J and J'r computation */
-            for (i = 0; i < ndata; i++) {
-                if (diff_idx) {
-                    diff_idx(i, param, fixed_param, func_idx, user_data, der,
-                             &nlfit->eval);
-                }
-                else if (diff) {
-                    diff(x[i], nparam, param, fixed, func, user_data, der,
-                         &nlfit->eval);
-                }
-                else {
-                    gwy_math_nlfit_diff_idx(i, nparam, param, fixed,
-                                            func_idx, user_data, der,
-                                            &nlfit->eval);
-                }
-
-                if (!nlfit->eval)
-                    break;
-
-                /* This should be done only for the real-function interface;
-                 * but that is also the only case when @w can be non-NULL. */
-                if (w) {
-                    for (j = 0; j < nparam; j++)
-                        der[j] *= w[i];
-                }
-
-                /* acummulate derivatives by slave parameters in master */
-                for (j = 0; j < nparam; j++) {
-                    if (link_map[j] != j)
-                        der[link_map[j]] += der[j];
-                }
-
-                for (j = 0; j < nparam; j++) {
-                    guint jid, diag;
-
-                    /* Only variable master parameters matter */
-                    if ((jid = var_param_id[j]) == G_MAXUINT || link_map[j] != j)
-                        continue;
-                    diag = jid*(jid + 1)/2;
-
-                    /* for J'r */
-                    v[jid] += der[j] * resid[i];
-                    for (k = 0; k <= j; k++) {   /* for J'J */
-                        gint kid = var_param_id[k];
-
-                        if (kid != G_MAXUINT)
-                            a[diag + kid] += der[j] * der[k];
-                    }
-                }
-            }
+            nlfit->eval = gwy_math_nlfit_normal(&state, param, resid, a, v);
             if (nlfit->eval) {
                 gwy_assign(save_a, a, covar_size);
                 gwy_assign(saveparam, param, nparam);
@@ -585,10 +642,12 @@ gwy_math_nlfit_fit_real(GwyNLFitter *nlfit,
         if (count == n_var_param)
             break;
 
-        /* See what the new residua is */
-        sumr1 = gwy_math_nlfit_residua(func, func_idx, ndata, x, y, weight,
-                                       nparam, param, user_data, resid,
-                                       &nlfit->eval);
+        /* See what the new residua is.  Unlike the initial evaluation and
+         * derivatives, it has always used the weights themselves, not their
+         * square roots.  Keep it for compatibility. */
+        state.w = weight;
+        sumr1 = gwy_math_nlfit_residua(&state, param, resid, &nlfit->eval);
+        state.w = w;
         /* Catch failed evaluation even if it's not reported. */
         if (gwy_isinf(sumr1) || gwy_isnan(sumr1)) {
             nlfit->eval = FALSE;
@@ -678,7 +737,6 @@ fail:
     g_free(saveparam);
     g_free(xr);
     g_free(v);
-    g_free(der);
     g_free(fixed);
     g_free(var_param_id);
     g_free(resid);
@@ -837,36 +895,39 @@ gwy_math_nlfit_diff_idx(guint i,
     }
 }
 
+/* Evaluates residua in data range [ifrom, ito). */
 static gdouble
-gwy_math_nlfit_residua(GwyNLFitFunc func,
-                       GwyNLFitIdxFunc func_idx,
-                       guint ndata,
-                       const gdouble *x,
-                       const gdouble *y,
-                       const gdouble *weight,
-                       guint nparam,
-                       const gdouble *param,
-                       gpointer user_data,
-                       gdouble *resid,
-                       gboolean *success)
+gwy_math_nlfit_residua_range(const GwyNLFitState *state,
+                             const gdouble *param,
+                             guint ifrom,
+                             guint ito,
+                             gdouble *resid,
+                             gboolean *success)
 {
     gdouble s = 0.0;
     gboolean ok = TRUE;
-    guint i;
-
-    g_return_val_if_fail(func || func_idx, -1.0);
+    guint i, n;
 
-    if (func_idx) {
-        for (i = 0; i < ndata && ok; i++) {
-            resid[i] = func_idx(i, param, user_data, &ok);
+    if (state->func_vec) {
+        for (i = ifrom; i < ito && ok; i += n) {
+            n = MIN(ito - i, NLFIT_BLOCK_SIZE);
+            state->func_vec(i, n, param, state->user_data, resid + i, &ok);
+        }
+        for (i = ifrom; i < ito && ok; i++)
+            s += resid[i] * resid[i];
+    }
+    else if (state->func_idx) {
+        for (i = ifrom; i < ito && ok; i++) {
+            resid[i] = state->func_idx(i, param, state->user_data, &ok);
             s += resid[i] * resid[i];
         }
     }
     else {
-        for (i = 0; i < ndata && ok; i++) {
-            resid[i] = func(x[i], nparam, param, user_data, &ok) - y[i];
-            if (weight)
-                resid[i] *= weight[i];
+        for (i = ifrom; i < ito && ok; i++) {
+            resid[i] = state->func(state->x[i], state->nparam, param,
+                                   state->user_data, &ok) - state->y[i];
+            if (state->w)
+                resid[i] *= state->w[i];
             s += resid[i] * resid[i];
         }
     }
@@ -875,6 +936,276 @@ gwy_math_nlfit_residua(GwyNLFitFunc func,
     return s;
 }
 
+/* Returns the size of data chunks for parallel evaluation, a multiple of
+ * NLFIT_BLOCK_SIZE. */
+static guint
+gwy_math_nlfit_chunk_size(guint ndata)
+{
+    guint size = (ndata + NLFIT_MAX_CHUNKS-1)/NLFIT_MAX_CHUNKS;
+
+    size = MAX(size, NLFIT_CHUNK_SIZE);
+    return (size + NLFIT_BLOCK_SIZE-1)/NLFIT_BLOCK_SIZE*NLFIT_BLOCK_SIZE;
+}
+
+static gdouble
+gwy_math_nlfit_residua(const GwyNLFitState *state,
+                       const gdouble *param,
+                       gdouble *resid,
+                       gboolean *success)
+{
+    gdouble s = 0.0;
+    gdouble *sums;
+    gboolean ok = TRUE;
+    guint ndata = state->ndata, csize, nchunks, c;
+
+    if (!state->parallel)
+        return gwy_math_nlfit_residua_range(state, param, 0, ndata,
+                                            resid, success);
+
+    csize = gwy_math_nlfit_chunk_size(ndata);
+    nchunks = (ndata + csize-1)/csize;
+    sums = g_new0(gdouble, nchunks);
+
+#ifdef _OPENMP
+#pragma omp parallel if(gwy_omp_use_threads((gsize)ndata*NLFIT_FUNC_COST)) \
+            default(none) \
+            shared(state,param,resid,ndata,csize,nchunks,sums) \
+            reduction(&&:ok)
+#endif
+    {
+        guint cfrom = gwy_omp_chunk_start(nchunks);
+        guint cto = gwy_omp_chunk_end(nchunks);
+        guint i;
+
+        for (i = cfrom; i < cto && ok; i++) {
+            sums[i] = gwy_math_nlfit_residua_range(state, param,
+                                                   i*csize,
+                                                   MIN((i + 1)*csize, ndata),
+                                                   resid, &ok);
+        }
+    }
+
+    for (c = 0; c < nchunks; c++)
+        s += sums[c];
+    g_free(sums);
+    *success = ok;
+
+    return s;
+}
+
+/* Adds one data point with derivatives @der (modified) and residuum @r to
+ * the normal equations. */
+static void
+gwy_math_nlfit_add_point(const GwyNLFitState *state,
+                         gdouble *der,
+                         gdouble r,
+                         gdouble *a,
+                         gdouble *v)
+{
+    const gint *link_map = state->link_map;
+    const guint *var_param_id = state->var_param_id;
+    guint j, k, nparam = state->nparam;
+
+    /* acummulate derivatives by slave parameters in master */
+    for (j = 0; j < nparam; j++) {
+        if (link_map[j] != j)
+            der[link_map[j]] += der[j];
+    }
+
+    for (j = 0; j < nparam; j++) {
+        guint jid, diag;
+
+        /* Only variable master parameters matter */
+        if ((jid = var_param_id[j]) == G_MAXUINT || link_map[j] != j)
+            continue;
+        diag = jid*(jid + 1)/2;
+
+        /* for J'r */
+        v[jid] += der[j] * r;
+        for (k = 0; k <= j; k++) {   /* for J'J */
+            guint kid = var_param_id[k];
+
+            if (kid != G_MAXUINT)
+                a[diag + kid] += der[j] * der[k];
+        }
+    }
+}
+
+/* Computes numerically the Jacobian columns for block of @n data points
+ * starting from @from.  Column j is stored at @jac + j*NLFIT_BLOCK_SIZE. */
+static gboolean
+gwy_math_nlfit_jacobian_block(const GwyNLFitState *state,
+                              const gdouble *param,
+                              guint from,
+                              guint n,
+                              gdouble *jac,
+                              gdouble *left)
+{
+    const gboolean *fixed = state->fixed;
+    gdouble *param_tmp, *right;
+    gdouble hj;
+    gboolean ok = TRUE;
+    guint j, k, nparam = state->nparam;
+
+    param_tmp = g_newa(gdouble, nparam);
+    gwy_assign(param_tmp, param, nparam);
+
+    for (j = 0; j < nparam; j++) {
+        right = jac + j*NLFIT_BLOCK_SIZE;
+        if (fixed && fixed[j]) {
+            gwy_clear(right, n);
+            continue;
+        }
+
+        hj = (fabs(param_tmp[j]) + FitSqrtMachEps) * FitSqrtMachEps;
+        param_tmp[j] -= hj;
+        state->func_vec(from, n, param_tmp, state->user_data, left, &ok);
+        if (!ok)
+            return FALSE;
+
+        param_tmp[j] += 2 * hj;
+        state->func_vec(from, n, param_tmp, state->user_data, right, &ok);
+        if (!ok)
+            return FALSE;
+
+        for (k = 0; k < n; k++)
+            right[k] = (right[k] - left[k])/2/hj;
+        param_tmp[j] = param[j];
+    }
+
+    return TRUE;
+}
+
+/* Accumulates J'J and J'r for data range [ifrom, ito). */
+static gboolean
+gwy_math_nlfit_normal_range(const GwyNLFitState *state,
+                            const gdouble *param,
+                            const gdouble *resid,
+                            guint ifrom,
+                            guint ito,
+                            gdouble *a,
+                            gdouble *v)
+{
+    guint nparam = state->nparam;
+    gdouble *der, *jac = NULL, *left = NULL;
+    gboolean ok = TRUE;
+    guint i, j, k, n;
+
+    /* because diff() computes all */
+    der = g_new(gdouble, nparam);
+    if (state->func_vec) {
+        jac = g_new(gdouble, nparam*NLFIT_BLOCK_SIZE);
+        left = g_new(gdouble, NLFIT_BLOCK_SIZE);
+        for (i = ifrom; i < ito && ok; i += n) {
+            n = MIN(ito - i, NLFIT_BLOCK_SIZE);
+            if (!(ok = gwy_math_nlfit_jacobian_block(state, param, i, n,
+                                                     jac, left)))
+                break;
+            for (k = 0; k < n; k++) {
+                for (j = 0; j < nparam; j++)
+                    der[j] = jac[j*NLFIT_BLOCK_SIZE + k];
+                gwy_math_nlfit_add_point(state, der, resid[i + k], a, v);
+            }
+        }
+        g_free(left);
+        g_free(jac);
+        g_free(der);
+        return ok;
+    }
+
+    for (i = ifrom; i < ito; i++) {
+        if (state->diff_idx) {
+            state->diff_idx(i, param, state->fixed_param, state->func_idx,
+                            state->user_data, der, &ok);
+        }
+        else if (state->diff) {
+            state->diff(state->x[i], nparam, param, state->fixed, state->func,
+                        state->user_data, der, &ok);
+        }
+        else {
+            gwy_math_nlfit_diff_idx(i, nparam, param, state->fixed,
+                                    state->func_idx, state->user_data, der,
+                                    &ok);
+        }
+
+        if (!ok)
+            break;
+
+        /* This should be done only for the real-function interface;
+         * but that is also the only case when @w can be non-NULL. */
+        if (state->w) {
+            for (j = 0; j < nparam; j++)
+                der[j] *= state->w[i];
+        }
+        gwy_math_nlfit_add_point(state, der, resid[i], a, v);
+    }
+    g_free(der);
+
+    return ok;
+}
+
+/* Calculates the normal equations matrix J'J and right hand side J'r,
+ * possibly in parallel. */
+static gboolean
+gwy_math_nlfit_normal(const GwyNLFitState *state,
+                      const gdouble *param,
+                      const gdouble *resid,
+                      gdouble *a,
+                      gdouble *v)
+{
+    guint ndata = state->ndata;
+    guint covar_size = state->covar_size, nv = state->n_var_param;
+    gdouble *asums, *vsums;
+    gboolean ok = TRUE;
+    guint csize, nchunks, c, i;
+
+    gwy_clear(a, covar_size);
+    gwy_clear(v, nv);
+
+    if (!state->parallel)
+        return gwy_math_nlfit_normal_range(state, param, resid, 0, ndata,
+                                           a, v);
+
+    /* Each chunk has its own J'J and J'r, summed in order at the end. */
+    csize = gwy_math_nlfit_chunk_size(ndata);
+    nchunks = (ndata + csize-1)/csize;
+    asums = g_new0(gdouble, nchunks*covar_size);
+    vsums = g_new0(gdouble, nchunks*nv);
+
+#ifdef _OPENMP
+#pragma omp parallel if(gwy_omp_use_threads((gsize)ndata*state->nparam \
+                                             *NLFIT_FUNC_COST)) \
+            default(none) \
+            shared(state,param,resid,ndata,covar_size,nv,csize,nchunks, \
+                   asums,vsums) \
+            reduction(&&:ok)
+#endif
+    {
+        guint cfrom = gwy_omp_chunk_start(nchunks);
+        guint cto = gwy_omp_chunk_end(nchunks);
+        guint k;
+
+        for (k = cfrom; k < cto && ok; k++) {
+            ok = gwy_math_nlfit_normal_range(state, param, resid,
+                                             k*csize,
+                                             MIN((k + 1)*csize, ndata),
+                                             asums + k*covar_size,
+                                             vsums + k*nv);
+        }
+    }
+
+    for (c = 0; c < nchunks; c++) {
+        for (i = 0; i < covar_size; i++)
+            a[i] += asums[c*covar_size + i];
+        for (i = 0; i < nv; i++)
+            v[i] += vsums[c*nv + i];
+    }
+    g_free(vsums);
+    g_free(asums);
+
+    return ok;
+}
+
 /**
  * gwy_math_nlfit_get_max_iterations:
  * @nlfit: A Marquardt-Levenberg nonlinear fitter.
@@ -1025,21 +1356,23 @@ gwy_math_nlfit_set_callbacks(GwyNLFitter *fitter,
 static GwyNLFitterPrivate*
 find_private_data(GwyNLFitter *fitter, gboolean do_create)
 {
-    GwyNLFitterPrivate *priv;
+    GwyNLFitterPrivate *priv = NULL;
     GList *l;
 
-    for (l = private_fitter_data; l; l = g_list_next(private_fitter_data)) {
-        priv = (GwyNLFitterPrivate*)l->data;
-        if (priv->fitter == fitter)
-            return priv;
+    G_LOCK(private_fitter_data);
+    for (l = private_fitter_data; l; l = g_list_next(l)) {
+        if (((GwyNLFitterPrivate*)l->data)->fitter == fitter) {
+            priv = (GwyNLFitterPrivate*)l->data;
+            break;
+        }
     }
+    if (!priv && do_create) {
+        priv = g_new0(GwyNLFitterPrivate, 1);
+        priv->fitter = fitter;
+        private_fitter_data = g_list_prepend(private_fitter_data, priv);
+    }
+    G_UNLOCK(private_fitter_data);
 
-    if (!do_create)
-        return NULL;
-
-    priv = g_new0(GwyNLFitterPrivate, 1);
-    priv->fitter = fitter;
-    private_fitter_data = g_list_prepend(private_fitter_data, priv);
     return priv;
 }
 
@@ -1049,14 +1382,16 @@ free_private_data(GwyNLFitter *fitter)
     GwyNLFitterPrivate *priv;
     GList *l;
 
-    for (l = private_fitter_data; l; l = g_list_next(private_fitter_data)) {
+    G_LOCK(private_fitter_data);
+    for (l = private_fitter_data; l; l = g_list_next(l)) {
         priv = (GwyNLFitterPrivate*)l->data;
         if (priv->fitter == fitter) {
             private_fitter_data = g_list_delete_link(private_fitter_data, l);
             g_free(priv);
-            return;
+            break;
         }
     }
+    G_UNLOCK(private_fitter_data);
 }
 
 /************************** Documentation ****************************/
@@ -1165,6 +1500,25 @@ free_private_data(GwyNLFitter *fitter)
  * Since: 2.46
  **/
 
+/**
+ * GwyNLFitIdxVecFunc:
+ * @from: Index of the first data point to evaluate.
+ * @n: Number of consecutive data points to evaluate.
+ * @param: Parameters.
+ * @user_data: User data as passed to gwy_math_nlfit_fit_idx().
+ * @resid: Array of length @n to store the differences between the function
+ *         values and data to.
+ * @success: Set to %TRUE if succeeds, %FALSE on failure.
+ *
+ * Fitting function type for opaque indexed data evaluated on blocks of data.
+ *
+ * It is the block counterpart of #GwyNLFitIdxFunc, filling @resid[k] with
+ * what #GwyNLFitIdxFunc would return for index @from+k.  The function
+ * must take care of weighting the same way.
+ *
+ * Since: 2.47
+ **/
+
 /**
  * GwyNLFitter:
  * @fmarq: Evaluates the fitted function.
@@ -56,6 +56,13 @@ typedef  void (*GwyNLFitIdxDiffFunc)(guint i,
                                      gdouble *der,
                                      gboolean *success);
 
+typedef  void (*GwyNLFitIdxVecFunc)(guint from,
+                                    guint n,
+                                    const gdouble *param,
+                                    gpointer user_data,
+                                    gdouble *resid,
+                                    gboolean *success);
+
 typedef struct _GwyNLFitter GwyNLFitter;
 
 struct _GwyNLFitter {
@@ -76,6 +83,7 @@ GwyNLFitter*    gwy_math_nlfit_new               (GwyNLFitFunc func,
                                                   GwyNLFitDerFunc diff);
 GwyNLFitter*    gwy_math_nlfit_new_idx           (GwyNLFitIdxFunc func,
                                                   GwyNLFitIdxDiffFunc diff);
+GwyNLFitter*    gwy_math_nlfit_new_idx_vec       (GwyNLFitIdxVecFunc func);
 void            gwy_math_nlfit_free              (GwyNLFitter *nlfit);
 gdouble         gwy_math_nlfit_fit               (GwyNLFitter *nlfit,
                                                   gint ndata,
@@ -1963,7 +1963,7 @@ gwy_nlfit_preset_fit(GwyNLFitPreset *preset,
                      const gboolean *fixed_param)
 {
     gdouble *weight = NULL;
-    gboolean ok;
+    gboolean ok, threadsafe;
     gint i;
 
     g_return_val_if_fail(GWY_IS_NLFIT_PRESET(preset), NULL);
@@ -1978,6 +1978,9 @@ gwy_nlfit_preset_fit(GwyNLFitPreset *preset,
                                     preset->builtin->derive
                                     ? preset->builtin->derive
                                     : gwy_math_nlfit_derive);
+    /* Built-in functions are reentrant so the fitter can use threads.  Do
+     * not change the setting permanently for fitters passed by the caller. */
+    threadsafe = _gwy_math_nlfit_set_threadsafe(fitter, TRUE);
 
     /*load default weights for given function type*/
     if (preset->builtin->set_default_weights) {
@@ -1989,6 +1992,7 @@ gwy_nlfit_preset_fit(GwyNLFitPreset *preset,
     ok = gwy_math_nlfit_fit_full(fitter, n_dat, x, y, weight,
                                  preset->builtin->nparams, param,
                                  fixed_param, NULL, preset) >= 0.0;
+    _gwy_math_nlfit_set_threadsafe(fitter, threadsafe);
 
     if (ok && err && fitter->covar) {
     /* FIXME: builtin */
@@ -0,0 +1,128 @@
+/*
+ *  @(#) $Id$
+ *  Copyright (C) 2016 David Necas (Yeti), Petr Klapetek.
+ *  E-mail: yeti@gwyddion.net, klapetek@gwyddion.net.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301, USA.
+ */
+
+/*< private_header >*/
+
+/*
+ * Helpers for OpenMP-parallelised code.  All pragmas must be guarded by
+ * #ifdef _OPENMP so that the code compiles without warnings when OpenMP is
+ * not available.  The typical pattern is
+ *
+ * #ifdef _OPENMP
+ * #pragma omp parallel if(gwy_omp_use_threads(n)) default(none) \
+ *             shared(...)
+ * #endif
+ *     {
+ *         guint ifrom = gwy_omp_chunk_start(n), ito = gwy_omp_chunk_end(n);
+ *         ...
+ *     }
+ */
+
+#ifndef __GWY_OMP_H__
+#define __GWY_OMP_H__
+
+#include <glib.h>
+#include <libgwyddion/gwythreads.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+G_BEGIN_DECLS
+
+/* Rough number of elementary operations below which running the work in
+ * parallel does not pay off. */
+#define GWY_OMP_MIN_WORK 80000
+
+static inline gboolean
+gwy_omp_use_threads(gsize work)
+{
+#ifdef _OPENMP
+    return work >= GWY_OMP_MIN_WORK && gwy_threads_are_enabled();
+#else
+    return FALSE;
+#endif
+}
+
+static inline guint
+gwy_omp_num_threads(void)
+{
+#ifdef _OPENMP
+    return omp_get_num_threads();
+#else
+    return 1;
+#endif
+}
+
+static inline guint
+gwy_omp_thread_num(void)
+{
+#ifdef _OPENMP
+    return omp_get_thread_num();
+#else
+    return 0;
+#endif
+}
+
+/* Maximum number of threads a parallel region can have, for allocation of
+ * per-thread buffers outside the region. */
+static inline guint
+gwy_omp_max_threads(void)
+{
+#ifdef _OPENMP
+    return gwy_threads_are_enabled() ? omp_get_max_threads() : 1;
+#else
+    return 1;
+#endif
+}
+
+/* Split range [0, n) evenly among the threads of the current team. */
+static inline guint
+gwy_omp_chunk_start(guint n)
+{
+#ifdef _OPENMP
+    guint nthreads = omp_get_num_threads();
+    guint tid = omp_get_thread_num();
+
+    return (guint)((guint64)n*tid/nthreads);
+#else
+    return 0;
+#endif
+}
+
+static inline guint
+gwy_omp_chunk_end(guint n)
+{
+#ifdef _OPENMP
+    guint nthreads = omp_get_num_threads();
+    guint tid = omp_get_thread_num();
+
+    return (guint)((guint64)n*(tid + 1)/nthreads);
+#else
+    return n;
+#endif
+}
+
+G_END_DECLS
+
+#endif /* __GWY_OMP_H__ */
+
+/* vim: set cin et ts=4 sw=4 cino=>1s,e0,n0,f0,{0,}0,^0,\:1s,=0,g1s,h0,t0,+1s,c3,(0,u0 : */
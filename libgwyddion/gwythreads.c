@@ -0,0 +1,92 @@
+/*
+ *  @(#) $Id$
+ *  Copyright (C) 2016 David Necas (Yeti), Petr Klapetek.
+ *  E-mail: yeti@gwyddion.net, klapetek@gwyddion.net.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301, USA.
+ */
+
+#include "config.h"
+#include <libgwyddion/gwymacros.h>
+#include <libgwyddion/gwythreads.h>
+
+static gboolean threads_enabled = FALSE;
+
+/**
+ * gwy_threads_are_enabled:
+ *
+ * Obtains the state of internal multithread processing.
+ *
+ * Returns: %TRUE if multithread processing is enabled; %FALSE otherwise
+ *          (including the case when Gwyddion was not built with
+ *          multithread processing support).
+ *
+ * Since: 2.47
+ **/
+gboolean
+gwy_threads_are_enabled(void)
+{
+    return threads_enabled;
+}
+
+/**
+ * gwy_threads_set_enabled:
+ * @setting: %TRUE to enable multithread processing; %FALSE to disable it.
+ *
+ * Enables or disables internal multithread processing.
+ *
+ * Multithread processing is disabled by default.  Programs which want to
+ * utilise all processor cores for data processing should enable it
+ * explicitly.  Programs which run their own worker threads and call the
+ * library from them usually should not as it would result in
+ * oversubscription.
+ *
+ * The setting is not meant to be changed while any data processing is in
+ * progress.  Enabling it has no effect if Gwyddion was not built with
+ * multithread processing support.
+ *
+ * Since: 2.47
+ **/
+void
+gwy_threads_set_enabled(gboolean setting)
+{
+#ifdef _OPENMP
+    threads_enabled = !!setting;
+#else
+    if (setting)
+        gwy_debug("Built without OpenMP, ignoring request to enable threads.");
+#endif
+}
+
+/************************** Documentation ****************************/
+
+/**
+ * SECTION:gwythreads
+ * @title: gwythreads
+ * @short_description: Multithread processing control
+ *
+ * Some data processing functions can split the work among several threads
+ * when Gwyddion is built with OpenMP support.  Whether they actually do it is
+ * controlled globally by gwy_threads_set_enabled().  Even when enabled,
+ * parallelisation is only used when the amount of work is large enough to
+ * outweigh the overhead; small data are always processed in the calling
+ * thread.
+ *
+ * The results do not depend on whether multithread processing is enabled,
+ * except for rounding errors in some summations.
+ **/
+
+/* vim: set cin et ts=4 sw=4 cino=>1s,e0,n0,f0,{0,}0,^0,\:1s,=0,g1s,h0,t0,+1s,c3,(0,u0 : */
@@ -91,7 +91,8 @@ enum {
 };
 
 enum {
-    GWY_3D_SHAPE = 0,
+    GWY_3D_SHAPE_AFM     = 0,
+    GWY_3D_SHAPE_REDUCED = 1,
     GWY_3D_N_LISTS
 };
 
@@ -139,6 +140,7 @@ typedef struct {
     gulong mask_id;
     gulong mask_item_id;
     gboolean need_update_list;
+    gboolean need_update_reduced;
     gboolean button;
     gboolean has_moved;
 } Gwy3DViewPrivate;
@@ -196,13 +198,19 @@ static void     gwy_3d_calculate_pixel_sizes     (GwyDataField *dfield,
                                                   GLfloat *dx,
                                                   GLfloat *dy);
 static Gwy3DVector* gwy_3d_make_normals          (GwyDataField *dfield,
+                                                  GLfloat dx,
+                                                  GLfloat dy,
                                                   Gwy3DVector *normals);
 static gboolean gwy_3d_view_motion_notify        (GtkWidget *widget,
                                                   GdkEventMotion *event);
 static void     gwy_3d_make_list                 (Gwy3DView *gwy3D,
                                                   GwyDataField *dfield,
                                                   GwyDataField *mask,
-                                                  GwyPixmapLayer **ovlays);
+                                                  GwyPixmapLayer **ovlays,
+                                                  guint shape);
+static gboolean gwy_3d_view_reduced_res          (Gwy3DView *gwy3dview,
+                                                  gint *rxres,
+                                                  gint *ryres);
 static void     gwy_3d_draw_axes                 (Gwy3DView *gwy3dview,
                                                   gint width,
                                                   gint height);
@@ -298,8 +306,8 @@ gwy_3d_view_class_init(Gwy3DViewClass *klass)
      *
      * The :reduced-size is the size of downsampled data in quick preview.
      *
-     * Note since 2.44 the reduced size has no influence because the 3D view
-     * does not downsample anything.
+     * Note between versions 2.44 and 2.46 the reduced size had no influence
+     * because the 3D view did not downsample anything.
      **/
     g_object_class_install_property
         (gobject_class,
@@ -1187,6 +1195,7 @@ gwy_3d_view_update_lists(Gwy3DView *gwy3dview)
 
     gwy_debug("");
     priv->need_update_list = TRUE;
+    priv->need_update_reduced = TRUE;
     gwy_3d_view_queue_draw(gwy3dview);
 }
 
@@ -1230,9 +1239,10 @@ gwy_3d_view_set_movement_type(Gwy3DView *gwy3dview,
  *
  * Sets the reduced data size of a 3D view.
  *
- * Data larger than reduced size may be shown downsampled during transforms and
- * other changes to speed up the rendering.  Final, full-size rendering is then
- * performed after a timeout.
+ * Data larger than reduced size are shown downsampled while the user rotates,
+ * scales or otherwise transforms the view with mouse to speed up the
+ * rendering.  Full-size rendering is performed when the mouse button is
+ * released.
  *
  * In case of the original data are not square, the @reduced_size is the
  * greater size of the downsampled data, the other dimension is proportional
@@ -1242,8 +1252,8 @@ gwy_3d_view_set_movement_type(Gwy3DView *gwy3dview,
  * is pending and the view is shown in reduced size.  It only affects future
  * downsampling.
  *
- * Note since 2.44 the reduced size has no influence because the 3D view
- * does not downsample anything.
+ * Note between versions 2.44 and 2.46 the reduced size had no influence
+ * because the 3D view did not downsample anything.
  **/
 void
 gwy_3d_view_set_reduced_size(Gwy3DView *gwy3dview,
@@ -1256,6 +1266,7 @@ gwy_3d_view_set_reduced_size(Gwy3DView *gwy3dview,
         return;
 
     gwy3dview->reduced_size = reduced_size;
+    GWY_3D_VIEW_GET_PRIVATE(gwy3dview)->need_update_reduced = TRUE;
     g_object_notify(G_OBJECT(gwy3dview), "reduced-size");
 }
 
@@ -1268,9 +1279,6 @@ gwy_3d_view_set_reduced_size(Gwy3DView *gwy3dview,
  * See gwy_3d_view_set_reduced_size() for details.
  *
  * Returns: The reduced data size.
- *
- * Note since 2.44 the reduced size has no influence because the 3D view does
- * not downsample anything.
  **/
 guint
 gwy_3d_view_get_reduced_size(Gwy3DView *gwy3dview)
@@ -1510,11 +1518,15 @@ static gboolean
 gwy_3d_view_configure(GtkWidget *widget,
                       GdkEventConfigure *event)
 {
+    Gwy3DViewPrivate *priv;
+
     if (GTK_WIDGET_CLASS(gwy_3d_view_parent_class)->configure_event)
         GTK_WIDGET_CLASS(gwy_3d_view_parent_class)->configure_event(widget,
                                                                     event);
 
-    GWY_3D_VIEW_GET_PRIVATE(GWY_3D_VIEW(widget))->need_update_list = TRUE;
+    priv = GWY_3D_VIEW_GET_PRIVATE(GWY_3D_VIEW(widget));
+    priv->need_update_list = TRUE;
+    priv->need_update_reduced = TRUE;
 
     return FALSE;
 }
@@ -1614,9 +1626,17 @@ gwy_3d_view_expose(GtkWidget *widget,
     if (priv->need_update_list) {
         gwy_3d_make_list(gwy3dview,
                          gwy3dview->data_field, priv->mask_field,
-                         gwy3dview->ovlays);
+                         gwy3dview->ovlays, GWY_3D_SHAPE_AFM);
         priv->need_update_list = FALSE;
     }
+    /* The reduced list is only built when it is actually needed. */
+    if (gwy3dview->shape_current == GWY_3D_SHAPE_REDUCED
+        && priv->need_update_reduced) {
+        gwy_3d_make_list(gwy3dview,
+                         gwy3dview->data_field, priv->mask_field,
+                         gwy3dview->ovlays, GWY_3D_SHAPE_REDUCED);
+        priv->need_update_reduced = FALSE;
+    }
 
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
@@ -1744,7 +1764,11 @@ gwy_3d_view_button_release(GtkWidget *widget,
 
     gwy_debug("%d %d", priv->button, priv->has_moved);
     priv->button = FALSE;
-    if (priv->has_moved && gwy3dview->movement == GWY_3D_MOVEMENT_LIGHT)
+    if (gwy3dview->shape_current != GWY_3D_SHAPE_AFM) {
+        gwy3dview->shape_current = GWY_3D_SHAPE_AFM;
+        gwy_3d_view_queue_draw(gwy3dview);
+    }
+    else if (priv->has_moved && gwy3dview->movement == GWY_3D_MOVEMENT_LIGHT)
         gwy_3d_view_queue_draw(gwy3dview);
 
     return FALSE;
@@ -1773,6 +1797,11 @@ gwy_3d_view_motion_notify(GtkWidget *widget,
 
     if (mods & GDK_BUTTON1_MASK) {
         gwy_debug("with movement %d", gwy3dview->movement);
+        /* Switch to the reduced shape for the duration of the drag. */
+        if (gwy3dview->movement != GWY_3D_MOVEMENT_NONE
+            && gwy3dview->shape_current == GWY_3D_SHAPE_AFM
+            && gwy_3d_view_reduced_res(gwy3dview, NULL, NULL))
+            gwy3dview->shape_current = GWY_3D_SHAPE_REDUCED;
         switch (gwy3dview->movement) {
             case GWY_3D_MOVEMENT_NONE:
             break;
@@ -1852,6 +1881,8 @@ gwy_3d_calculate_pixel_sizes(GwyDataField *dfield,
 /**
  * gwy_3d_make_normals:
  * @dfield: A data field.
+ * @dx: Vertex step in x direction.
+ * @dy: Vertex step in y direction.
  * @normals: Array of normals to fill.  It must have the same number of
  *           elements as @dfield.
  *
@@ -1861,12 +1892,14 @@ gwy_3d_calculate_pixel_sizes(GwyDataField *dfield,
  **/
 static Gwy3DVector*
 gwy_3d_make_normals(GwyDataField *dfield,
+                    GLfloat dx,
+                    GLfloat dy,
                     Gwy3DVector *normals)
 {
    typedef struct { Gwy3DVector A, B; } RectangleNorm;
    const gdouble *data;
    gint i, j, xres, yres;
-   GLfloat dx, dy, dx2, dy2;
+   GLfloat dx2, dy2;
    RectangleNorm * norms;
 
    g_return_val_if_fail(normals, NULL);
@@ -1874,7 +1907,6 @@ gwy_3d_make_normals(GwyDataField *dfield,
    xres = gwy_data_field_get_xres(dfield);
    yres = gwy_data_field_get_yres(dfield);
    data = gwy_data_field_get_data_const(dfield);
-   gwy_3d_calculate_pixel_sizes(dfield, &dx, &dy);
    dx2 = dx*dx;
    dy2 = dy*dy;
 
@@ -2012,15 +2044,49 @@ gwy_3d_make_normals(GwyDataField *dfield,
   glVertex3d((i)*dx, (j)*dy, z);                     \
   } while (0)
 
+/* Finds the resolution of the reduced shape.  Returns %FALSE if the data are
+ * not larger than the reduced size and no reduced shape should be used. */
+static gboolean
+gwy_3d_view_reduced_res(Gwy3DView *gwy3dview,
+                        gint *rxres,
+                        gint *ryres)
+{
+    gint xres, yres, size = gwy3dview->reduced_size;
+
+    if (!gwy3dview->data_field)
+        return FALSE;
+
+    xres = gwy_data_field_get_xres(gwy3dview->data_field);
+    yres = gwy_data_field_get_yres(gwy3dview->data_field);
+    if (MAX(xres, yres) <= size)
+        return FALSE;
+
+    if (xres >= yres) {
+        yres = MAX(GWY_ROUND((gdouble)yres*size/xres), 2);
+        xres = size;
+    }
+    else {
+        xres = MAX(GWY_ROUND((gdouble)xres*size/yres), 2);
+        yres = size;
+    }
+    if (rxres)
+        *rxres = xres;
+    if (ryres)
+        *ryres = yres;
+
+    return TRUE;
+}
+
 static void
 gwy_3d_make_list(Gwy3DView *gwy3dview,
                  GwyDataField *dfield,
                  GwyDataField *mask_field,
-                 GwyPixmapLayer** ovlays)
+                 GwyPixmapLayer** ovlays,
+                 guint shape)
 {
-    gint i, j, xres, yres, rowstride;
+    gint i, j, xres, yres, rxres, ryres, rowstride;
     gdouble data_min, data_max, res;
-    GLfloat dx, dy;
+    GLfloat dx, dy, xoff, yoff;
     Gwy3DVector *normals;
     const gdouble *data;
     const gdouble *mask = NULL;
@@ -2030,22 +2096,51 @@ gwy_3d_make_list(Gwy3DView *gwy3dview,
 
     g_return_if_fail(GWY_IS_DATA_FIELD(dfield));
 
+    /* The geometry is always given by the full data, so that the reduced
+     * shape occupies exactly the same space. */
     xres = gwy_data_field_get_xres(dfield);
     yres = gwy_data_field_get_yres(dfield);
     gwy_data_field_get_min_max(dfield, &data_min, &data_max);
+    gwy_3d_calculate_pixel_sizes(dfield, &dx, &dy);
+    res = MAX(xres*dx, yres*dy);
+    xoff = -xres*dx/res;
+    yoff = -yres*dy/res;
+
+    if (shape == GWY_3D_SHAPE_REDUCED
+        && gwy_3d_view_reduced_res(gwy3dview, &rxres, &ryres)) {
+        dx *= (xres - 1.0)/(rxres - 1.0);
+        dy *= (yres - 1.0)/(ryres - 1.0);
+        xres = rxres;
+        yres = ryres;
+        dfield = gwy_data_field_new_resampled(dfield, xres, yres,
+                                              GWY_INTERPOLATION_LINEAR);
+        if (GWY_IS_DATA_FIELD(mask_field))
+            mask_field = gwy_data_field_new_resampled(mask_field, xres, yres,
+                                                      GWY_INTERPOLATION_ROUND);
+        else
+            mask_field = NULL;
+    }
+    else {
+        g_object_ref(dfield);
+        if (GWY_IS_DATA_FIELD(mask_field))
+            g_object_ref(mask_field);
+        else
+            mask_field = NULL;
+    }
 
     data = gwy_data_field_get_data_const(dfield);
-    if (GWY_IS_DATA_FIELD(mask_field))
+    if (mask_field)
         mask = gwy_data_field_get_data_const(mask_field);
 
     normals = g_new(Gwy3DVector, xres * yres);
-    if (!gwy_3d_make_normals(dfield, normals)) {
+    if (!gwy_3d_make_normals(dfield, dx, dy, normals)) {
         /*TODO solve not enough memory problem*/
+        g_free(normals);
+        GWY_OBJECT_UNREF(mask_field);
+        g_object_unref(dfield);
         g_return_if_reached();
     }
 
-    gwy_3d_calculate_pixel_sizes(dfield, &dx, &dy);
-    res = MAX(xres*dx, yres*dy);
     if (gwy3dview->ovlays) {
         GdkPixbuf* lpb;
         gint l;
@@ -2074,16 +2169,19 @@ gwy_3d_make_list(Gwy3DView *gwy3dview,
 
         gwy_resource_use(GWY_RESOURCE(grad));
         pixbuf = gdk_pixbuf_new(GDK_COLORSPACE_RGB, 0, 8, xres, yres);
-        gwy_pixbuf_draw_data_field(pixbuf, dfield, grad);
+        /* Resampling changes the range, use the full data range to keep the
+         * colours of the reduced shape. */
+        gwy_pixbuf_draw_data_field_with_range(pixbuf, dfield, grad,
+                                              data_min, data_max);
         gwy_resource_release(GWY_RESOURCE(grad));
     };
 
     colors = gdk_pixbuf_get_pixels(pixbuf);
     rowstride = gdk_pixbuf_get_rowstride(pixbuf);
 
-    glNewList(gwy3dview->shape_list_base + GWY_3D_SHAPE, GL_COMPILE);
+    glNewList(gwy3dview->shape_list_base + shape, GL_COMPILE);
     glPushMatrix();
-    glTranslatef(-xres*dx/res, -yres*dy/res, GWY_3D_Z_DISPLACEMENT);
+    glTranslatef(xoff, yoff, GWY_3D_Z_DISPLACEMENT);
     glScalef(2.0/res, 2.0/res, GWY_3D_Z_TRANSFORMATION/(data_max - data_min));
     glTranslatef(0.0, 0.0, -data_min);
     /* zdifr = 1.0/(data_max - data_min); */
@@ -2133,6 +2231,8 @@ gwy_3d_make_list(Gwy3DView *gwy3dview,
     glEndList();
 
     g_object_unref(pixbuf);
+    g_object_unref(dfield);
+    GWY_OBJECT_UNREF(mask_field);
 }
 
 /*
@@ -2469,6 +2569,7 @@ gwy_3d_draw_light_position(Gwy3DView *widget)
 static void
 gwy_3d_view_realize_gl(Gwy3DView *gwy3dview)
 {
+    Gwy3DViewPrivate *priv;
     GdkGLContext *glcontext;
     GdkGLDrawable *gldrawable;
 
@@ -2509,7 +2610,9 @@ gwy_3d_view_realize_gl(Gwy3DView *gwy3dview)
     /* Shape display lists */
     gwy_3d_view_assign_lists(gwy3dview);
     //gwy_3d_make_list(gwy3dview, gwy3dview->data_field, mask, gwy3dview->ovlays);
-    GWY_3D_VIEW_GET_PRIVATE(gwy3dview)->need_update_list = TRUE;
+    priv = GWY_3D_VIEW_GET_PRIVATE(gwy3dview);
+    priv->need_update_list = TRUE;
+    priv->need_update_reduced = TRUE;
 
     gdk_gl_drawable_gl_end(gldrawable);
     /*** OpenGL END ***/
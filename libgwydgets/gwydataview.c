@@ -59,6 +59,8 @@ typedef struct _GwyDataViewPrivate GwyDataViewPrivate;
 struct _GwyDataViewPrivate {
     gdouble xoffset;
     gdouble yoffset;
+    /* Only the dirty area was invalidated, expecting partial repaint. */
+    gboolean area_invalidated;
 };
 
 static void     gwy_data_view_destroy              (GtkObject *object);
@@ -79,10 +81,28 @@ static void     gwy_data_view_size_allocate        (GtkWidget *widget,
                                                     GtkAllocation *allocation);
 static void     simple_gdk_pixbuf_composite        (GdkPixbuf *source,
                                                     GdkPixbuf *dest);
+static void     composite_area                     (GdkPixbuf *bpixbuf,
+                                                    GdkPixbuf *apixbuf,
+                                                    GdkPixbuf *dest,
+                                                    const GdkRectangle *area);
 static void     simple_gdk_pixbuf_scale_or_copy    (GdkPixbuf *source,
                                                     GdkPixbuf *dest);
 static void     gwy_data_view_make_pixmap          (GwyDataView *data_view);
 static void     gwy_data_view_paint                (GwyDataView *data_view);
+static gboolean gwy_data_view_paint_area           (GwyDataView *data_view,
+                                                    const GdkRectangle *area);
+static void     gwy_data_view_composite            (GwyDataView *data_view,
+                                                    GdkPixbuf *bpixbuf,
+                                                    GdkPixbuf *apixbuf);
+static gboolean gwy_data_view_get_dirty_area       (GwyDataView *data_view,
+                                                    GdkRectangle *area);
+static void     gwy_data_view_scale_area           (GwyDataView *data_view,
+                                                    const GdkRectangle *area,
+                                                    GdkRectangle *scaled);
+static void     gwy_data_view_update               (GwyDataView *data_view);
+static void     gwy_data_view_pixmap_layer_updated (GwyDataView *data_view);
+static void     gwy_data_view_update_real          (GwyDataView *data_view,
+                                                    gboolean use_area);
 static gboolean gwy_data_view_expose               (GtkWidget *widget,
                                                     GdkEventExpose *event);
 static gboolean gwy_data_view_button_press         (GtkWidget *widget,
@@ -620,6 +640,65 @@ simple_gdk_pixbuf_composite(GdkPixbuf *source, GdkPixbuf *dest)
                          GDK_INTERP_TILES, 0xff);
 }
 
+static gboolean
+pixbufs_can_composite_directly(GdkPixbuf *bpixbuf,
+                               GdkPixbuf *apixbuf,
+                               GdkPixbuf *dest)
+{
+    gint width = gdk_pixbuf_get_width(dest);
+    gint height = gdk_pixbuf_get_height(dest);
+
+    return (gdk_pixbuf_get_width(bpixbuf) == width
+            && gdk_pixbuf_get_height(bpixbuf) == height
+            && gdk_pixbuf_get_width(apixbuf) == width
+            && gdk_pixbuf_get_height(apixbuf) == height
+            && gdk_pixbuf_get_has_alpha(apixbuf)
+            && gdk_pixbuf_get_n_channels(apixbuf) == 4
+            && gdk_pixbuf_get_bits_per_sample(apixbuf) == BITS_PER_SAMPLE
+            && gdk_pixbuf_get_bits_per_sample(bpixbuf) == BITS_PER_SAMPLE
+            && gdk_pixbuf_get_bits_per_sample(dest) == BITS_PER_SAMPLE);
+}
+
+/* Composites the alpha layer pixbuf @apixbuf over the base layer pixbuf
+ * @bpixbuf into @dest in a single pass over @area, instead of copying
+ * @bpixbuf to @dest and compositing @apixbuf over it in another pass.  All
+ * three pixbufs must have the same size. */
+static void
+composite_area(GdkPixbuf *bpixbuf,
+               GdkPixbuf *apixbuf,
+               GdkPixbuf *dest,
+               const GdkRectangle *area)
+{
+    const guchar *bpixels, *apixels, *b, *a;
+    guchar *dpixels, *d;
+    gint brs, ars, drs, bnc, dnc, i, j;
+    guint alpha, beta;
+
+    bpixels = gdk_pixbuf_get_pixels(bpixbuf);
+    apixels = gdk_pixbuf_get_pixels(apixbuf);
+    dpixels = gdk_pixbuf_get_pixels(dest);
+    brs = gdk_pixbuf_get_rowstride(bpixbuf);
+    ars = gdk_pixbuf_get_rowstride(apixbuf);
+    drs = gdk_pixbuf_get_rowstride(dest);
+    bnc = gdk_pixbuf_get_n_channels(bpixbuf);
+    dnc = gdk_pixbuf_get_n_channels(dest);
+
+    for (i = area->y; i < area->y + area->height; i++) {
+        b = bpixels + i*brs + area->x*bnc;
+        a = apixels + i*ars + area->x*4;
+        d = dpixels + i*drs + area->x*dnc;
+        for (j = area->width; j; j--, b += bnc, a += 4, d += dnc) {
+            alpha = a[3];
+            beta = 255 - alpha;
+            d[0] = (alpha*a[0] + beta*b[0] + 127)/255;
+            d[1] = (alpha*a[1] + beta*b[1] + 127)/255;
+            d[2] = (alpha*a[2] + beta*b[2] + 127)/255;
+            if (dnc == 4)
+                d[3] = 0xff;
+        }
+    }
+}
+
 /* paint pixmap layers */
 static void
 gwy_data_view_paint(GwyDataView *data_view)
@@ -637,10 +716,31 @@ gwy_data_view_paint(GwyDataView *data_view)
     else
         apixbuf = NULL;
 
+    gwy_data_view_composite(data_view, bpixbuf, apixbuf);
+}
+
+static void
+gwy_data_view_composite(GwyDataView *data_view,
+                        GdkPixbuf *bpixbuf,
+                        GdkPixbuf *apixbuf)
+{
+    GdkRectangle area;
+
     if (bpixbuf) {
         if (apixbuf) {
-            simple_gdk_pixbuf_scale_or_copy(bpixbuf, data_view->base_pixbuf);
-            simple_gdk_pixbuf_composite(apixbuf, data_view->base_pixbuf);
+            if (pixbufs_can_composite_directly(bpixbuf, apixbuf,
+                                               data_view->base_pixbuf)) {
+                area.x = area.y = 0;
+                area.width = gdk_pixbuf_get_width(data_view->base_pixbuf);
+                area.height = gdk_pixbuf_get_height(data_view->base_pixbuf);
+                composite_area(bpixbuf, apixbuf, data_view->base_pixbuf,
+                               &area);
+            }
+            else {
+                simple_gdk_pixbuf_scale_or_copy(bpixbuf,
+                                                data_view->base_pixbuf);
+                simple_gdk_pixbuf_composite(apixbuf, data_view->base_pixbuf);
+            }
             simple_gdk_pixbuf_scale_or_copy(data_view->base_pixbuf,
                                             data_view->pixbuf);
         }
@@ -654,16 +754,170 @@ gwy_data_view_paint(GwyDataView *data_view)
     }
 }
 
+static gboolean
+add_layer_dirty_area(GwyPixmapLayer *layer,
+                     GdkRectangle *area,
+                     gboolean *found)
+{
+    GdkRectangle rect;
+
+    if (!gwy_pixmap_layer_get_dirty_area(layer, &rect.x, &rect.y,
+                                         &rect.width, &rect.height))
+        return FALSE;
+
+    if (*found)
+        gdk_rectangle_union(area, &rect, area);
+    else
+        *area = rect;
+    *found = TRUE;
+
+    return TRUE;
+}
+
+/* Finds the union of dirty areas of pixmap layers that want repaint.
+ * Returns %FALSE if the entire view has to be repainted. */
+static gboolean
+gwy_data_view_get_dirty_area(GwyDataView *data_view,
+                             GdkRectangle *area)
+{
+    GwyPixmapLayer *layer;
+    gboolean found = FALSE;
+
+    if (data_view->layers_changed
+        || !data_view->pixbuf
+        || !data_view->base_pixbuf)
+        return FALSE;
+
+    layer = data_view->base_layer;
+    if (layer
+        && gwy_pixmap_layer_wants_repaint(layer)
+        && !add_layer_dirty_area(layer, area, &found))
+        return FALSE;
+
+    layer = data_view->alpha_layer;
+    if (layer
+        && gwy_pixmap_layer_wants_repaint(layer)
+        && !add_layer_dirty_area(layer, area, &found))
+        return FALSE;
+
+    return found;
+}
+
+/* Transforms a data area to the corresponding area of the scaled pixbuf.
+ * Interpolation makes each data pixel influence also the neighbour screen
+ * pixels so we have to add some margin. */
+static void
+gwy_data_view_scale_area(GwyDataView *data_view,
+                         const GdkRectangle *area,
+                         GdkRectangle *scaled)
+{
+    gdouble sx, sy;
+    gint w, h, mx, my, xe, ye;
+
+    w = gdk_pixbuf_get_width(data_view->pixbuf);
+    h = gdk_pixbuf_get_height(data_view->pixbuf);
+    sx = (gdouble)w/data_view->xres;
+    sy = (gdouble)h/data_view->yres;
+    mx = (gint)ceil(sx) + 1;
+    my = (gint)ceil(sy) + 1;
+
+    scaled->x = MAX((gint)floor(area->x*sx) - mx, 0);
+    scaled->y = MAX((gint)floor(area->y*sy) - my, 0);
+    xe = MIN((gint)ceil((area->x + area->width)*sx) + mx, w);
+    ye = MIN((gint)ceil((area->y + area->height)*sy) + my, h);
+    scaled->width = MAX(xe - scaled->x, 0);
+    scaled->height = MAX(ye - scaled->y, 0);
+}
+
+/* Paints pixmap layers and updates only the dirty area of the view pixbufs
+ * if the layers managed to repaint only the area.  Returns %FALSE if
+ * everything had to be repainted. */
+static gboolean
+gwy_data_view_paint_area(GwyDataView *data_view,
+                         const GdkRectangle *dirty)
+{
+    GwyPixmapLayer *blayer, *alayer;
+    GdkPixbuf *apixbuf, *bpixbuf, *source;
+    GdkRectangle area, scaled;
+    gboolean bwants, awants, found = FALSE;
+    gint w, h;
+
+    gwy_debug("dirty = %dx%d at (%d,%d)",
+              dirty->width, dirty->height, dirty->x, dirty->y);
+    g_return_val_if_fail(GWY_IS_DATA_VIEW_LAYER(data_view->base_layer),
+                         FALSE);
+
+    blayer = data_view->base_layer;
+    alayer = data_view->alpha_layer;
+    bwants = gwy_pixmap_layer_wants_repaint(blayer);
+    awants = alayer && gwy_pixmap_layer_wants_repaint(alayer);
+    bpixbuf = gwy_pixmap_layer_paint(blayer);
+    apixbuf = alayer ? gwy_pixmap_layer_paint(alayer) : NULL;
+
+    /* The layers may have decided to repaint everything after all. */
+    if (!bpixbuf
+        || gdk_pixbuf_get_width(bpixbuf) != data_view->xres
+        || gdk_pixbuf_get_height(bpixbuf) != data_view->yres
+        || (apixbuf
+            && (gdk_pixbuf_get_width(apixbuf) != data_view->xres
+                || gdk_pixbuf_get_height(apixbuf) != data_view->yres))
+        || (bwants && !add_layer_dirty_area(blayer, &area, &found))
+        || (awants && !add_layer_dirty_area(alayer, &area, &found))) {
+        gwy_data_view_composite(data_view, bpixbuf, apixbuf);
+        return FALSE;
+    }
+
+    if (!found || !area.width || !area.height)
+        return TRUE;
+
+    source = bpixbuf;
+    if (apixbuf) {
+        if (pixbufs_can_composite_directly(bpixbuf, apixbuf,
+                                           data_view->base_pixbuf))
+            composite_area(bpixbuf, apixbuf, data_view->base_pixbuf, &area);
+        else {
+            gdk_pixbuf_copy_area(bpixbuf,
+                                 area.x, area.y, area.width, area.height,
+                                 data_view->base_pixbuf, area.x, area.y);
+            gdk_pixbuf_composite(apixbuf, data_view->base_pixbuf,
+                                 area.x, area.y, area.width, area.height,
+                                 0.0, 0.0, 1.0, 1.0, GDK_INTERP_TILES, 0xff);
+        }
+        source = data_view->base_pixbuf;
+    }
+
+    w = gdk_pixbuf_get_width(data_view->pixbuf);
+    h = gdk_pixbuf_get_height(data_view->pixbuf);
+    gwy_data_view_scale_area(data_view, &area, &scaled);
+    if (!scaled.width || !scaled.height)
+        return TRUE;
+
+    if (w == data_view->xres && h == data_view->yres)
+        gdk_pixbuf_copy_area(source,
+                             scaled.x, scaled.y, scaled.width, scaled.height,
+                             data_view->pixbuf, scaled.x, scaled.y);
+    else
+        gdk_pixbuf_scale(source, data_view->pixbuf,
+                         scaled.x, scaled.y, scaled.width, scaled.height,
+                         0.0, 0.0,
+                         (gdouble)w/data_view->xres, (gdouble)h/data_view->yres,
+                         GDK_INTERP_TILES);
+
+    return TRUE;
+}
+
 static gboolean
 gwy_data_view_expose(GtkWidget *widget,
                      GdkEventExpose *event)
 {
     GwyDataView *data_view;
+    GwyDataViewPrivate *priv;
     gint xs, ys, xe, ye, w, h;
-    GdkRectangle rect;
-    gboolean emit_redrawn = FALSE;
+    GdkRectangle rect, area;
+    gboolean emit_redrawn = FALSE, painted_all;
 
     data_view = GWY_DATA_VIEW(widget);
+    priv = GWY_DATA_VIEW_GET_PRIVATE(data_view);
 
     if (!data_view->xres || !data_view->yres)
         return FALSE;
@@ -697,9 +951,19 @@ gwy_data_view_expose(GtkWidget *widget,
             && gwy_pixmap_layer_wants_repaint(data_view->base_layer))
         || (data_view->alpha_layer
             && gwy_pixmap_layer_wants_repaint(data_view->alpha_layer))) {
-        gwy_data_view_paint(data_view);
+        if (gwy_data_view_get_dirty_area(data_view, &area))
+            painted_all = !gwy_data_view_paint_area(data_view, &area);
+        else {
+            gwy_data_view_paint(data_view);
+            painted_all = TRUE;
+        }
         emit_redrawn = TRUE;
         data_view->layers_changed = FALSE;
+        /* We invalidated only the dirty area but had to repaint everything
+         * anyway. */
+        if (painted_all && priv->area_invalidated)
+            gdk_window_invalidate_rect(widget->window, NULL, TRUE);
+        priv->area_invalidated = FALSE;
     }
 
     gdk_draw_pixbuf(widget->window,
@@ -788,10 +1052,26 @@ gwy_data_view_key_release(GtkWidget *widget,
 
 static void
 gwy_data_view_update(GwyDataView *data_view)
+{
+    gwy_data_view_update_real(data_view, FALSE);
+}
+
+/* Pixmap layer updates may affect only part of the data, vector layer and
+ * other updates are always treated as affecting everything. */
+static void
+gwy_data_view_pixmap_layer_updated(GwyDataView *data_view)
+{
+    gwy_data_view_update_real(data_view, TRUE);
+}
+
+static void
+gwy_data_view_update_real(GwyDataView *data_view,
+                          gboolean use_area)
 {
     GwyDataViewPrivate *priv;
     GtkWidget *widget;
     GwyDataField *data_field;
+    GdkRectangle area, rect;
     const gchar *key;
     gint pxres, pyres;
     gboolean need_resize = FALSE;
@@ -849,7 +1129,17 @@ gwy_data_view_update(GwyDataView *data_view)
             data_view->xmeasure = data_view->xreal/pxres;
             data_view->ymeasure = data_view->yreal/pyres;
         }
-        gdk_window_invalidate_rect(widget->window, NULL, TRUE);
+        if (use_area && gwy_data_view_get_dirty_area(data_view, &area)) {
+            gwy_data_view_scale_area(data_view, &area, &rect);
+            rect.x += data_view->xoff;
+            rect.y += data_view->yoff;
+            gdk_window_invalidate_rect(widget->window, &rect, TRUE);
+            priv->area_invalidated = TRUE;
+        }
+        else {
+            gdk_window_invalidate_rect(widget->window, NULL, TRUE);
+            priv->area_invalidated = FALSE;
+        }
     }
 }
 
@@ -933,7 +1223,12 @@ gwy_data_view_set_layer(GwyDataView *data_view,
         g_object_ref(layer);
         gtk_object_sink(GTK_OBJECT(layer));
         layer->parent = (GtkWidget*)data_view;
-        if (hid)
+        if (hid && GWY_IS_PIXMAP_LAYER(layer))
+            *hid = g_signal_connect_swapped
+                              (layer, "updated",
+                               G_CALLBACK(gwy_data_view_pixmap_layer_updated),
+                               data_view);
+        else if (hid)
             *hid = g_signal_connect_swapped(layer, "updated",
                                             G_CALLBACK(gwy_data_view_update),
                                             data_view);
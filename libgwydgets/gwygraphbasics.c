@@ -24,6 +24,11 @@
 #include <libgwyddion/gwymacros.h>
 #include <libgwyddion/gwymath.h>
 #include <libgwydgets/gwygraphbasics.h>
+#include "gwygraphinternal.h"
+
+/* Use the pixel column envelope when there are at least this many points per
+ * pixel column on average. */
+#define ENVELOPE_MIN_RATIO 4
 
 static const GwyRGBA nice_colors[] = {
     { 0.000, 0.000, 0.000, 1.000 },    /* Black */
@@ -291,6 +296,90 @@ gwy_graph_draw_curve_segment(const GdkPoint *points,
     }
 }
 
+static inline gboolean
+point_is_drawable(const GdkPoint *point,
+                  const GwyGraphActiveAreaSpecs *specs)
+{
+    return (point->x >= -3*specs->width
+            && point->x <= 4*specs->width
+            && point->y >= -3*specs->height
+            && point->y <= 4*specs->height);
+}
+
+/* Reduces each run of points with the same x pixel coordinate to its first,
+ * minimum, maximum and last point (in the original order).  The polyline
+ * through the reduced points covers exactly the same pixels.  Works in
+ * place, returns the new number of points. */
+static guint
+decimate_segment(GdkPoint *points, guint n)
+{
+    guint i, j, k, t, u, m, imin, imax;
+    guint keep[4];
+
+    for (i = j = 0; i < n; i = k) {
+        imin = imax = i;
+        for (k = i+1; k < n && points[k].x == points[i].x; k++) {
+            if (points[k].y < points[imin].y)
+                imin = k;
+            if (points[k].y > points[imax].y)
+                imax = k;
+        }
+
+        keep[0] = i;
+        keep[1] = MIN(imin, imax);
+        keep[2] = MAX(imin, imax);
+        keep[3] = k-1;
+        for (t = m = 0; t < 4; t++) {
+            u = keep[t];
+            if (!m || u != keep[m-1])
+                keep[m++] = u;
+        }
+        /* Indices are nondecreasing and j <= i so we never overwrite an
+         * unprocessed point. */
+        for (t = 0; t < m; t++)
+            points[j++] = points[keep[t]];
+    }
+
+    return j;
+}
+
+static GwyGraphCurveEnvelope*
+make_curve_envelope(GwyGraphActiveAreaSpecs *specs,
+                    GwyGraphCurveModel *gcmodel)
+{
+    GwyGraphCurveEnvelope *envelope;
+    GArray *seglen;
+    GdkPoint *points;
+    guint i, n, start, len;
+
+    points = g_new(GdkPoint, gcmodel->n);
+    seglen = g_array_new(FALSE, FALSE, sizeof(guint));
+    for (i = n = start = 0; i < gcmodel->n; i++) {
+        points[n].x = x_data_to_pixel(specs, gcmodel->xdata[i]);
+        points[n].y = y_data_to_pixel(specs, gcmodel->ydata[i]);
+        if (point_is_drawable(points + n, specs))
+            n++;
+        else if (n > start) {
+            len = decimate_segment(points + start, n - start);
+            g_array_append_val(seglen, len);
+            n = start = start + len;
+        }
+    }
+    if (n > start) {
+        len = decimate_segment(points + start, n - start);
+        g_array_append_val(seglen, len);
+        n = start + len;
+    }
+
+    envelope = g_new(GwyGraphCurveEnvelope, 1);
+    envelope->specs = *specs;
+    envelope->nsegments = seglen->len;
+    envelope->seglen = (guint*)g_array_free(seglen, FALSE);
+    envelope->points = g_renew(GdkPoint, points, MAX(n, 1));
+
+    return envelope;
+}
+
 /**
  * gwy_graph_draw_curve:
  * @drawable: A drawable.
@@ -307,6 +396,7 @@ gwy_graph_draw_curve(GdkDrawable *drawable,
                      GwyGraphActiveAreaSpecs *specs,
                      GwyGraphCurveModel *gcmodel)
 {
+    GwyGraphCurveEnvelope *envelope;
     GdkPoint *points;
     gint i, n, symbol_size, line_width;
 
@@ -322,16 +412,34 @@ gwy_graph_draw_curve(GdkDrawable *drawable,
         return;
 
     gwy_rgba_set_gdk_gc_fg(&gcmodel->color, gc);
+
+    /* Plain solid lines with many more points than pixel columns are drawn
+     * using the pixel column envelope, which looks exactly the same. */
+    if (!symbol_size
+        && gcmodel->line_style == GDK_LINE_SOLID
+        && gcmodel->n > ENVELOPE_MIN_RATIO*MAX(specs->width, 1)) {
+        if (!(envelope = _gwy_graph_curve_model_get_envelope(gcmodel, specs))) {
+            envelope = make_curve_envelope(specs, gcmodel);
+            _gwy_graph_curve_model_set_envelope(gcmodel, envelope);
+        }
+        points = envelope->points;
+        for (i = 0; i < (gint)envelope->nsegments; i++) {
+            gwy_graph_draw_curve_segment(points, envelope->seglen[i],
+                                         drawable, gc,
+                                         gcmodel->line_style, line_width,
+                                         gcmodel->point_type, 0);
+            points += envelope->seglen[i];
+        }
+        return;
+    }
+
     points = g_new(GdkPoint, gcmodel->n);
 
     for (i = n = 0; i < gcmodel->n; i++) {
         points[n].x = x_data_to_pixel(specs, gcmodel->xdata[i]);
         points[n].y = y_data_to_pixel(specs, gcmodel->ydata[i]);
         /* Split the line into segments that do not stick out of the area */
-        if (points[n].x >= -3*specs->width
-            && points[n].x <= 4*specs->width
-            && points[n].y >= -3*specs->height
-            && points[n].y <= 4*specs->height)
+        if (point_is_drawable(points + n, specs))
             n++;
         else if (n) {
             gwy_graph_draw_curve_segment(points, n, drawable, gc,
@@ -30,9 +30,14 @@
 #include <libprocess/dataline.h>
 #include <libgwydgets/gwygraphcurvemodel.h>
 #include <libgwydgets/gwydgettypes.h>
+#include "gwygraphinternal.h"
 
 #define GWY_GRAPH_CURVE_MODEL_TYPE_NAME "GwyGraphCurveModel"
 
+#define GWY_GRAPH_CURVE_MODEL_GET_PRIVATE(o) \
+   (G_TYPE_INSTANCE_GET_PRIVATE((o), GWY_TYPE_GRAPH_CURVE_MODEL, \
+                                GwyGraphCurveModelPrivate))
+
 /* Cache operations */
 #define CVAL(cmodel, b)  ((cmodel)->cache[GWY_GRAPH_CURVE_MODEL_CACHE_##b])
 #define CBIT(b)          (1 << GWY_GRAPH_CURVE_MODEL_CACHE_##b)
@@ -62,6 +67,10 @@ typedef enum {
     GWY_GRAPH_CURVE_MODEL_CACHE2_LAST,
 } GwyGraphCurveModelCached;
 
+typedef struct {
+    GwyGraphCurveEnvelope *envelope;
+} GwyGraphCurveModelPrivate;
+
 static void        gwy_graph_curve_model_finalize         (GObject *object);
 static void        gwy_graph_curve_model_serializable_init(GwySerializableIface *iface);
 static GByteArray* gwy_graph_curve_model_serialize        (GObject *object,
@@ -83,6 +92,7 @@ static void        gwy_graph_curve_model_get_property     (GObject*object,
                                                            GParamSpec *pspec);
 static void        gwy_graph_curve_model_data_changed     (GwyGraphCurveModel *gcmodel);
 static void        free_calibration                       (GwyGraphCurveModel *gcmodel);
+static void        free_envelope                          (GwyGraphCurveModel *gcmodel);
 
 enum {
     DATA_CHANGED,
@@ -128,6 +138,8 @@ gwy_graph_curve_model_class_init(GwyGraphCurveModelClass *klass)
     gobject_class->set_property = gwy_graph_curve_model_set_property;
     gobject_class->get_property = gwy_graph_curve_model_get_property;
 
+    g_type_class_add_private(klass, sizeof(GwyGraphCurveModelPrivate));
+
     /**
      * GwyGraphCurveModel::data-changed:
      * @gwygraphcurvemodel: The #GwyGraphCurveModel which received the signal.
@@ -388,6 +400,7 @@ gwy_graph_curve_model_finalize(GObject *object)
     g_free(gcmodel->xdata);
     g_free(gcmodel->ydata);
     g_free(gcmodel->cache2);
+    free_envelope(gcmodel);
     G_OBJECT_CLASS(gwy_graph_curve_model_parent_class)->finalize(object);
 }
 
@@ -1285,9 +1298,69 @@ static void
 gwy_graph_curve_model_data_changed(GwyGraphCurveModel *gcmodel)
 {
     gcmodel->cached = 0;
+    free_envelope(gcmodel);
     g_signal_emit(gcmodel, graph_curve_model_signals[DATA_CHANGED], 0);
 }
 
+static void
+free_envelope(GwyGraphCurveModel *gcmodel)
+{
+    GwyGraphCurveModelPrivate *priv;
+    GwyGraphCurveEnvelope *envelope;
+
+    priv = GWY_GRAPH_CURVE_MODEL_GET_PRIVATE(gcmodel);
+    envelope = priv->envelope;
+    if (!envelope)
+        return;
+
+    g_free(envelope->seglen);
+    g_free(envelope->points);
+    g_free(envelope);
+    priv->envelope = NULL;
+}
+
+static gboolean
+area_specs_equal(const GwyGraphActiveAreaSpecs *a,
+                 const GwyGraphActiveAreaSpecs *b)
+{
+    return (a->xmin == b->xmin && a->ymin == b->ymin
+            && a->width == b->width && a->height == b->height
+            && a->real_xmin == b->real_xmin && a->real_ymin == b->real_ymin
+            && a->real_width == b->real_width
+            && a->real_height == b->real_height
+            && a->log_x == b->log_x && a->log_y == b->log_y);
+}
+
+/* Returns the cached drawing envelope if it was created for identical area
+ * specs.  Any zoom or resize thus automatically invalidates it. */
+GwyGraphCurveEnvelope*
+_gwy_graph_curve_model_get_envelope(GwyGraphCurveModel *gcmodel,
+                                    const GwyGraphActiveAreaSpecs *specs)
+{
+    GwyGraphCurveModelPrivate *priv;
+    GwyGraphCurveEnvelope *envelope;
+
+    priv = GWY_GRAPH_CURVE_MODEL_GET_PRIVATE(gcmodel);
+    envelope = priv->envelope;
+    if (envelope && area_specs_equal(&envelope->specs, specs))
+        return envelope;
+    return NULL;
+}
+
+/* Takes ownership of @envelope. */
+void
+_gwy_graph_curve_model_set_envelope(GwyGraphCurveModel *gcmodel,
+                                    GwyGraphCurveEnvelope *envelope)
+{
+    GwyGraphCurveModelPrivate *priv;
+
+    priv = GWY_GRAPH_CURVE_MODEL_GET_PRIVATE(gcmodel);
+    if (envelope == priv->envelope)
+        return;
+    free_envelope(gcmodel);
+    priv->envelope = envelope;
+}
+
 /**
  * gwy_graph_curve_model_get_calibration_data:
  * @gcmodel: A graph curve model.
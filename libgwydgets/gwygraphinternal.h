@@ -0,0 +1,51 @@
+/*
+ *  @(#) $Id$
+ *  Copyright (C) 2016 David Necas (Yeti).
+ *  E-mail: yeti@gwyddion.net.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GWY_GRAPH_INTERNAL_H__
+#define __GWY_GRAPH_INTERNAL_H__
+
+#include <libgwydgets/gwygraphbasics.h>
+#include <libgwydgets/gwygraphcurvemodel.h>
+
+G_BEGIN_DECLS
+
+/* Decimated pixel representation of a curve, valid for specific area specs.
+ * The points of all segments are stored consecutively in @points. */
+typedef struct {
+    GwyGraphActiveAreaSpecs specs;
+    guint nsegments;
+    guint *seglen;
+    GdkPoint *points;
+} GwyGraphCurveEnvelope;
+
+G_GNUC_INTERNAL
+GwyGraphCurveEnvelope* _gwy_graph_curve_model_get_envelope(GwyGraphCurveModel *gcmodel,
+                                                           const GwyGraphActiveAreaSpecs *specs);
+
+G_GNUC_INTERNAL
+void                   _gwy_graph_curve_model_set_envelope(GwyGraphCurveModel *gcmodel,
+                                                           GwyGraphCurveEnvelope *envelope);
+
+G_END_DECLS
+
+#endif /* __GWY_GRAPH_INTERNAL_H__ */
+
+/* vim: set cin et ts=4 sw=4 cino=>1s,e0,n0,f0,{0,}0,^0,\:1s,=0,g1s,h0,t0,+1s,c3,(0,u0 : */
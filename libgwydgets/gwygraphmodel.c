@@ -107,6 +107,7 @@ static gboolean    curve_is_equispaced               (const GwyGraphCurveModel *
 static gchar*      ascii_name                        (const gchar *s);
 static void        gwy_graph_model_release_curve     (GwyGraphModel *gmodel,
                                                       guint i);
+static void        account_data                      (GwyGraphModel *gmodel);
 static void        gwy_graph_model_curve_data_changed(GwyGraphCurveModel *cmodel,
                                                       GwyGraphModel *gmodel);
 static void        gwy_graph_model_curve_notify      (GwyGraphCurveModel *cmodel,
@@ -1234,6 +1235,7 @@ gwy_graph_model_add_curve(GwyGraphModel *gmodel,
                            G_CALLBACK(gwy_graph_model_curve_notify),
                            gmodel);
     g_array_append_val(gmodel->curveaux, aux);
+    account_data(gmodel);
 
     /* In principle, this can change gmodel->curves->len, so we have to save
      * the index in idx. */
@@ -1272,6 +1274,7 @@ gwy_graph_model_remove_all_curves(GwyGraphModel *gmodel)
         gwy_graph_model_release_curve(gmodel, i);
     g_ptr_array_set_size(gmodel->curves, 0);
     g_array_set_size(gmodel->curveaux, 0);
+    account_data(gmodel);
     g_object_notify(G_OBJECT(gmodel), "n-curves");
 }
 
@@ -1365,8 +1368,10 @@ gwy_graph_model_remove_curve_by_description(GwyGraphModel *gmodel,
     }
     g_ptr_array_free(newcurves, TRUE);
     g_array_free(newaux, TRUE);
-    if (i)
+    if (i) {
+        account_data(gmodel);
         g_object_notify(G_OBJECT(gmodel), "n-curves");
+    }
 
     return i;
 }
@@ -1388,6 +1393,7 @@ gwy_graph_model_remove_curve(GwyGraphModel *gmodel,
     gwy_graph_model_release_curve(gmodel, cindex);
     g_ptr_array_remove_index(gmodel->curves, cindex);
     g_array_remove_index(gmodel->curveaux, cindex);
+    account_data(gmodel);
     g_object_notify(G_OBJECT(gmodel), "n-curves");
 }
 
@@ -2374,6 +2380,24 @@ gwy_graph_model_release_curve(GwyGraphModel *gmodel,
     g_ptr_array_index(gmodel->curves, i) = NULL;
 }
 
+/* The curve data are accounted as held by the graph model. */
+static void
+account_data(GwyGraphModel *gmodel)
+{
+    GwyGraphCurveModel *cmodel;
+    gsize size = 0;
+    guint i;
+
+    if (!gwy_debug_objects_get_accounting())
+        return;
+
+    for (i = 0; i < gmodel->curves->len; i++) {
+        cmodel = g_ptr_array_index(gmodel->curves, i);
+        size += 2*cmodel->n*sizeof(gdouble);
+    }
+    gwy_debug_objects_set_size(G_OBJECT(gmodel), size);
+}
+
 static void
 gwy_graph_model_curve_data_changed(GwyGraphCurveModel *cmodel,
                                    GwyGraphModel *gmodel)
@@ -2384,6 +2408,7 @@ gwy_graph_model_curve_data_changed(GwyGraphCurveModel *cmodel,
      * quite fast. */
     i = gwy_graph_model_get_curve_index(gmodel, cmodel);
     g_return_if_fail(i > -1);
+    account_data(gmodel);
     g_signal_emit(gmodel, graph_model_signals[CURVE_DATA_CHANGED], 0, i);
 }
 
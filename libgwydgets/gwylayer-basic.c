@@ -32,6 +32,9 @@
     g_signal_connect_object(obj, signal, G_CALLBACK(cb), data, \
                             G_CONNECT_SWAPPED | G_CONNECT_AFTER)
 
+#define GWY_LAYER_BASIC_GET_PRIVATE(o) \
+   (G_TYPE_INSTANCE_GET_PRIVATE((o), GWY_TYPE_LAYER_BASIC, GwyLayerBasicPrivate))
+
 enum {
     PRESENTATION_SWITCHED,
     LAST_SIGNAL
@@ -46,6 +49,16 @@ enum {
     PROP_MIN_MAX_KEY
 };
 
+typedef struct _GwyLayerBasicPrivate GwyLayerBasicPrivate;
+
+/* The linear colour mapping range used for the last full repaint, if any.
+ * Partial repaints are only possible while it does not change. */
+struct _GwyLayerBasicPrivate {
+    gboolean linear_range;
+    gdouble min;
+    gdouble max;
+};
+
 static void gwy_layer_basic_destroy              (GtkObject *object);
 static void gwy_layer_basic_set_property         (GObject *object,
                                                   guint prop_id,
@@ -56,6 +69,14 @@ static void gwy_layer_basic_get_property         (GObject *object,
                                                   GValue *value,
                                                   GParamSpec *pspec);
 static GdkPixbuf* gwy_layer_basic_paint          (GwyPixmapLayer *layer);
+static gboolean gwy_layer_basic_paint_area       (GwyPixmapLayer *layer,
+                                                  gint col,
+                                                  gint row,
+                                                  gint width,
+                                                  gint height);
+static gboolean gwy_layer_basic_get_linear_range (GwyLayerBasic *basic_layer,
+                                                  gdouble *min,
+                                                  gdouble *max);
 static void gwy_layer_basic_plugged              (GwyDataViewLayer *layer);
 static void gwy_layer_basic_unplugged            (GwyDataViewLayer *layer);
 static void gwy_layer_basic_gradient_connect     (GwyLayerBasic *layer);
@@ -104,6 +125,9 @@ gwy_layer_basic_class_init(GwyLayerBasicClass *klass)
     layer_class->unplugged = gwy_layer_basic_unplugged;
 
     pixmap_class->paint = gwy_layer_basic_paint;
+    pixmap_class->paint_area = gwy_layer_basic_paint_area;
+
+    g_type_class_add_private(klass, sizeof(GwyLayerBasicPrivate));
 
     /**
      * GwyLayerBasic:gradient-key:
@@ -321,12 +345,14 @@ static GdkPixbuf*
 gwy_layer_basic_paint(GwyPixmapLayer *layer)
 {
     GwyLayerBasic *basic_layer;
+    GwyLayerBasicPrivate *priv;
     GwyDataField *data_field;
     GwyLayerBasicRangeType range_type;
     GwyContainer *data;
     gdouble min, max;
 
     basic_layer = GWY_LAYER_BASIC(layer);
+    priv = GWY_LAYER_BASIC_GET_PRIVATE(basic_layer);
     data = GWY_DATA_VIEW_LAYER(layer)->data;
 
     data_field = GWY_DATA_FIELD(layer->data_field);
@@ -365,9 +391,67 @@ gwy_layer_basic_paint(GwyPixmapLayer *layer)
         }
     }
 
+    priv->linear_range = gwy_layer_basic_get_linear_range(basic_layer,
+                                                          &priv->min,
+                                                          &priv->max);
+
     return layer->pixbuf;
 }
 
+static gboolean
+gwy_layer_basic_paint_area(GwyPixmapLayer *layer,
+                           gint col, gint row,
+                           gint width, gint height)
+{
+    GwyLayerBasic *basic_layer;
+    GwyLayerBasicPrivate *priv;
+    GwyDataField *data_field, *area;
+    GdkPixbuf *pixbuf;
+    gdouble min, max;
+
+    basic_layer = GWY_LAYER_BASIC(layer);
+    priv = GWY_LAYER_BASIC_GET_PRIVATE(basic_layer);
+    data_field = GWY_DATA_FIELD(layer->data_field);
+
+    /* If the data change has modified the colour mapping, for instance by
+     * extending the data range, everything has to be repainted. */
+    if (!priv->linear_range
+        || !gwy_layer_basic_get_linear_range(basic_layer, &min, &max)
+        || min != priv->min
+        || max != priv->max
+        || gdk_pixbuf_get_width(layer->pixbuf) != data_field->xres
+        || gdk_pixbuf_get_height(layer->pixbuf) != data_field->yres)
+        return FALSE;
+
+    if (!width || !height)
+        return TRUE;
+
+    area = gwy_data_field_area_extract(data_field, col, row, width, height);
+    pixbuf = gdk_pixbuf_new_subpixbuf(layer->pixbuf, col, row, width, height);
+    gwy_pixbuf_draw_data_field_with_range(pixbuf, area, basic_layer->gradient,
+                                          min, max);
+    g_object_unref(pixbuf);
+    g_object_unref(area);
+
+    return TRUE;
+}
+
+/* Gets the range of linear colour mapping, returning %FALSE if the mapping is
+ * not linear or does not correspond to the data field. */
+static gboolean
+gwy_layer_basic_get_linear_range(GwyLayerBasic *basic_layer,
+                                 gdouble *min,
+                                 gdouble *max)
+{
+    if (basic_layer->show_field
+        || (gwy_layer_basic_get_range_type(basic_layer)
+            == GWY_LAYER_BASIC_RANGE_ADAPT))
+        return FALSE;
+
+    gwy_layer_basic_get_range(basic_layer, min, max);
+    return TRUE;
+}
+
 static void
 gwy_layer_basic_gradient_connect(GwyLayerBasic *basic_layer)
 {
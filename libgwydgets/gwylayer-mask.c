@@ -43,6 +43,11 @@ static void       gwy_layer_mask_get_property    (GObject *object,
                                                   GValue *value,
                                                   GParamSpec *pspec);
 static GdkPixbuf* gwy_layer_mask_paint           (GwyPixmapLayer *layer);
+static gboolean   gwy_layer_mask_paint_area      (GwyPixmapLayer *layer,
+                                                  gint col,
+                                                  gint row,
+                                                  gint width,
+                                                  gint height);
 static void       gwy_layer_mask_plugged         (GwyDataViewLayer *layer);
 static void       gwy_layer_mask_unplugged       (GwyDataViewLayer *layer);
 static void       gwy_layer_mask_connect_color   (GwyLayerMask *mask_layer);
@@ -65,6 +70,7 @@ gwy_layer_mask_class_init(GwyLayerMaskClass *klass)
     layer_class->unplugged = gwy_layer_mask_unplugged;
 
     pixmap_class->paint = gwy_layer_mask_paint;
+    pixmap_class->paint_area = gwy_layer_mask_paint_area;
 
     /**
      * GwyLayerMask:color-key:
@@ -167,6 +173,38 @@ gwy_layer_mask_paint(GwyPixmapLayer *layer)
     return layer->pixbuf;
 }
 
+static gboolean
+gwy_layer_mask_paint_area(GwyPixmapLayer *layer,
+                          gint col, gint row,
+                          gint width, gint height)
+{
+    GwyDataField *data_field, *area;
+    GwyLayerMask *mask_layer;
+    GdkPixbuf *pixbuf;
+    GwyRGBA color = { 0, 0, 0, 0 };
+
+    mask_layer = GWY_LAYER_MASK(layer);
+    data_field = GWY_DATA_FIELD(layer->data_field);
+    if (gdk_pixbuf_get_width(layer->pixbuf) != data_field->xres
+        || gdk_pixbuf_get_height(layer->pixbuf) != data_field->yres)
+        return FALSE;
+
+    if (!width || !height)
+        return TRUE;
+
+    if (mask_layer->color_key)
+        gwy_rgba_get_from_container(&color,
+                                    GWY_DATA_VIEW_LAYER(mask_layer)->data,
+                                    g_quark_to_string(mask_layer->color_key));
+    area = gwy_data_field_area_extract(data_field, col, row, width, height);
+    pixbuf = gdk_pixbuf_new_subpixbuf(layer->pixbuf, col, row, width, height);
+    gwy_pixbuf_draw_data_field_as_mask(pixbuf, area, &color);
+    g_object_unref(pixbuf);
+    g_object_unref(area);
+
+    return TRUE;
+}
+
 /**
  * gwy_layer_mask_get_color:
  * @mask_layer: A mask layer.
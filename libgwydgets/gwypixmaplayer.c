@@ -28,6 +28,10 @@
 
 #define BITS_PER_SAMPLE 8
 
+#define GWY_PIXMAP_LAYER_GET_PRIVATE(o) \
+   (G_TYPE_INSTANCE_GET_PRIVATE((o), GWY_TYPE_PIXMAP_LAYER, \
+                                GwyPixmapLayerPrivate))
+
 #define connect_swapped_after(obj, signal, cb, data) \
     g_signal_connect_object(obj, signal, G_CALLBACK(cb), data, \
                             G_CONNECT_SWAPPED | G_CONNECT_AFTER)
@@ -37,6 +41,21 @@ enum {
     PROP_DATA_KEY
 };
 
+typedef struct _GwyPixmapLayerPrivate GwyPixmapLayerPrivate;
+
+/* The dirty area is kept as a bounding box [xmin,xmax)×[ymin,ymax).  When
+ * has_area is FALSE the entire layer is dirty. */
+struct _GwyPixmapLayerPrivate {
+    gulong data_changed_area_id;
+    gboolean has_area;
+    gboolean area_pending;
+    gboolean area_updating;
+    gint xmin;
+    gint ymin;
+    gint xmax;
+    gint ymax;
+};
+
 static void gwy_pixmap_layer_set_property       (GObject *object,
                                                  guint prop_id,
                                                  const GValue *value,
@@ -50,6 +69,12 @@ static void gwy_pixmap_layer_plugged            (GwyDataViewLayer *layer);
 static void gwy_pixmap_layer_unplugged          (GwyDataViewLayer *layer);
 static void gwy_pixmap_layer_item_changed       (GwyPixmapLayer *pixmap_layer);
 static void gwy_pixmap_layer_data_changed       (GwyPixmapLayer *pixmap_layer);
+static void gwy_pixmap_layer_data_changed_area  (GwyPixmapLayer *pixmap_layer,
+                                                 gint col,
+                                                 gint row,
+                                                 gint width,
+                                                 gint height);
+static void gwy_pixmap_layer_updated            (GwyDataViewLayer *layer);
 static void gwy_pixmap_layer_container_connect  (GwyPixmapLayer *pixmap_layer,
                                                  const gchar *data_key_string);
 static void gwy_pixmap_layer_data_field_connect (GwyPixmapLayer *pixmap_layer);
@@ -70,6 +95,9 @@ gwy_pixmap_layer_class_init(GwyPixmapLayerClass *klass)
 
     layer_class->plugged = gwy_pixmap_layer_plugged;
     layer_class->unplugged = gwy_pixmap_layer_unplugged;
+    layer_class->updated = gwy_pixmap_layer_updated;
+
+    g_type_class_add_private(klass, sizeof(GwyPixmapLayerPrivate));
 
     /**
      * GwyPixmapLayer:data-key:
@@ -152,6 +180,11 @@ gwy_pixmap_layer_get_property(GObject*object,
  * to repaint the pixbuf, it simply returns the current one.  To enforce
  * update, emit "data-changed" signal on corresponding data field.
  *
+ * If only a part of the data field has changed, as announced with
+ * gwy_data_field_data_changed_area(), and the layer class implements
+ * area painting, only this part of the pixbuf is repainted.  Use
+ * gwy_pixmap_layer_get_dirty_area() to find out which part it was.
+ *
  * Returns: The pixbuf.  It should not be modified or freed.  If the data field
  *          to draw is not present in the container, %NULL is returned.
  **/
@@ -159,11 +192,14 @@ GdkPixbuf*
 gwy_pixmap_layer_paint(GwyPixmapLayer *pixmap_layer)
 {
     GwyPixmapLayerClass *layer_class = GWY_PIXMAP_LAYER_GET_CLASS(pixmap_layer);
+    GwyPixmapLayerPrivate *priv;
     GdkPixbuf *pixbuf = NULL;
 
     g_return_val_if_fail(GWY_IS_PIXMAP_LAYER(pixmap_layer), NULL);
     g_return_val_if_fail(layer_class->paint, NULL);
 
+    priv = GWY_PIXMAP_LAYER_GET_PRIVATE(pixmap_layer);
+
     if (!pixmap_layer->data_field
         || !GWY_IS_DATA_FIELD(pixmap_layer->data_field)) {
         if (!pixmap_layer->data_key)
@@ -173,8 +209,18 @@ gwy_pixmap_layer_paint(GwyPixmapLayer *pixmap_layer)
          * and let GwyDataView deal with it. */
     }
     else {
-        if (pixmap_layer->wants_repaint)
-            layer_class->paint(pixmap_layer);
+        if (pixmap_layer->wants_repaint) {
+            if (!priv->has_area
+                || !pixmap_layer->pixbuf
+                || !layer_class->paint_area
+                || !layer_class->paint_area(pixmap_layer,
+                                            priv->xmin, priv->ymin,
+                                            priv->xmax - priv->xmin,
+                                            priv->ymax - priv->ymin)) {
+                priv->has_area = FALSE;
+                layer_class->paint(pixmap_layer);
+            }
+        }
         pixbuf = pixmap_layer->pixbuf;
     }
     pixmap_layer->wants_repaint = FALSE;
@@ -198,6 +244,54 @@ gwy_pixmap_layer_wants_repaint(GwyPixmapLayer *pixmap_layer)
     return pixmap_layer->wants_repaint;
 }
 
+/**
+ * gwy_pixmap_layer_get_dirty_area:
+ * @pixmap_layer: A pixmap data view layer.
+ * @col: Location to store the upper-left column of the area, or %NULL.
+ * @row: Location to store the upper-left row of the area, or %NULL.
+ * @width: Location to store the width of the area, or %NULL.
+ * @height: Location to store the height of the area, or %NULL.
+ *
+ * Obtains the part of a pixmap layer affected by the last update.
+ *
+ * If the layer wants repaint, the area is the part that needs to be
+ * repainted.  After gwy_pixmap_layer_paint() it is the part that was actually
+ * repainted.  In both cases %FALSE is returned if it is the entire layer.
+ *
+ * This method is intended for #GwyDataView implementation.
+ *
+ * Returns: %TRUE if only a part of the layer is affected and the area was
+ *          filled, %FALSE if the entire layer is affected.
+ *
+ * Since: 2.47
+ **/
+gboolean
+gwy_pixmap_layer_get_dirty_area(GwyPixmapLayer *pixmap_layer,
+                                gint *col,
+                                gint *row,
+                                gint *width,
+                                gint *height)
+{
+    GwyPixmapLayerPrivate *priv;
+
+    g_return_val_if_fail(GWY_IS_PIXMAP_LAYER(pixmap_layer), FALSE);
+
+    priv = GWY_PIXMAP_LAYER_GET_PRIVATE(pixmap_layer);
+    if (!priv->has_area)
+        return FALSE;
+
+    if (col)
+        *col = priv->xmin;
+    if (row)
+        *row = priv->ymin;
+    if (width)
+        *width = priv->xmax - priv->xmin;
+    if (height)
+        *height = priv->ymax - priv->ymin;
+
+    return TRUE;
+}
+
 /**
  * gwy_pixmap_layer_data_field_connect:
  * @pixmap_layer: A pixmap layer.
@@ -207,6 +301,7 @@ gwy_pixmap_layer_wants_repaint(GwyPixmapLayer *pixmap_layer)
 static void
 gwy_pixmap_layer_data_field_connect(GwyPixmapLayer *pixmap_layer)
 {
+    GwyPixmapLayerPrivate *priv;
     GwyDataViewLayer *layer;
 
     g_return_if_fail(!pixmap_layer->data_field);
@@ -225,6 +320,12 @@ gwy_pixmap_layer_data_field_connect(GwyPixmapLayer *pixmap_layer)
                                    "data-changed",
                                    G_CALLBACK(gwy_pixmap_layer_data_changed),
                                    layer);
+    priv = GWY_PIXMAP_LAYER_GET_PRIVATE(pixmap_layer);
+    priv->data_changed_area_id
+        = g_signal_connect_swapped(pixmap_layer->data_field,
+                                   "data-changed-area",
+                                   G_CALLBACK(gwy_pixmap_layer_data_changed_area),
+                                   layer);
 }
 
 /**
@@ -236,8 +337,12 @@ gwy_pixmap_layer_data_field_connect(GwyPixmapLayer *pixmap_layer)
 static void
 gwy_pixmap_layer_data_field_disconnect(GwyPixmapLayer *pixmap_layer)
 {
+    GwyPixmapLayerPrivate *priv = GWY_PIXMAP_LAYER_GET_PRIVATE(pixmap_layer);
+
     GWY_SIGNAL_HANDLER_DISCONNECT(pixmap_layer->data_field,
                                   pixmap_layer->data_changed_id);
+    GWY_SIGNAL_HANDLER_DISCONNECT(pixmap_layer->data_field,
+                                  priv->data_changed_area_id);
     GWY_OBJECT_UNREF(pixmap_layer->data_field);
 }
 
@@ -292,8 +397,57 @@ gwy_pixmap_layer_item_changed(GwyPixmapLayer *pixmap_layer)
 static void
 gwy_pixmap_layer_data_changed(GwyPixmapLayer *pixmap_layer)
 {
+    GwyPixmapLayerPrivate *priv = GWY_PIXMAP_LAYER_GET_PRIVATE(pixmap_layer);
+
+    /* If ::data-changed-area preceded, the dirty area is already set and we
+     * must not let the ::updated handler reset it. */
+    if (priv->area_pending) {
+        priv->area_pending = FALSE;
+        priv->area_updating = TRUE;
+    }
     pixmap_layer->wants_repaint = TRUE;
     gwy_data_view_layer_updated(GWY_DATA_VIEW_LAYER(pixmap_layer));
+    priv->area_updating = FALSE;
+}
+
+static void
+gwy_pixmap_layer_data_changed_area(GwyPixmapLayer *pixmap_layer,
+                                   gint col, gint row,
+                                   gint width, gint height)
+{
+    GwyPixmapLayerPrivate *priv = GWY_PIXMAP_LAYER_GET_PRIVATE(pixmap_layer);
+
+    priv->area_pending = TRUE;
+    /* The entire layer is already waiting for repaint. */
+    if (pixmap_layer->wants_repaint && !priv->has_area)
+        return;
+
+    /* Extend the area if it has not been repainted yet, otherwise start
+     * a new one. */
+    if (pixmap_layer->wants_repaint) {
+        priv->xmin = MIN(priv->xmin, col);
+        priv->ymin = MIN(priv->ymin, row);
+        priv->xmax = MAX(priv->xmax, col + width);
+        priv->ymax = MAX(priv->ymax, row + height);
+    }
+    else {
+        priv->xmin = col;
+        priv->ymin = row;
+        priv->xmax = col + width;
+        priv->ymax = row + height;
+    }
+    priv->has_area = TRUE;
+}
+
+/* Any update other than from ::data-changed-area means everything has to be
+ * repainted (gradient, colour, range, ... changes). */
+static void
+gwy_pixmap_layer_updated(GwyDataViewLayer *layer)
+{
+    GwyPixmapLayerPrivate *priv = GWY_PIXMAP_LAYER_GET_PRIVATE(layer);
+
+    if (!priv->area_updating)
+        priv->has_area = FALSE;
 }
 
 /**
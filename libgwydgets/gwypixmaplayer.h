@@ -58,8 +58,12 @@ struct _GwyPixmapLayerClass {
     GwyDataViewLayerClass parent_class;
 
     GdkPixbuf* (*paint)(GwyPixmapLayer *layer);
+    gboolean (*paint_area)(GwyPixmapLayer *layer,
+                           gint col,
+                           gint row,
+                           gint width,
+                           gint height);
 
-    void (*reserved1)(void);
     void (*reserved2)(void);
 };
 
@@ -71,6 +75,11 @@ void             gwy_pixmap_layer_set_data_key  (GwyPixmapLayer *pixmap_layer,
 const gchar*     gwy_pixmap_layer_get_data_key  (GwyPixmapLayer *pixmap_layer);
 void             gwy_pixmap_layer_make_pixbuf   (GwyPixmapLayer *pixmap_layer,
                                                  gboolean has_alpha);
+gboolean         gwy_pixmap_layer_get_dirty_area(GwyPixmapLayer *pixmap_layer,
+                                                 gint *col,
+                                                 gint *row,
+                                                 gint *width,
+                                                 gint *height);
 
 G_END_DECLS
 
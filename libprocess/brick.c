@@ -24,18 +24,51 @@
 
 #include "config.h"
 #include <string.h>
+#include <errno.h>
+#include <glib/gstdio.h>
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#ifdef HAVE_SYS_MMAN_H
+#include <fcntl.h>
+#include <sys/mman.h>
+#endif
 
 #include <libgwyddion/gwymacros.h>
 #include <libgwyddion/gwymath.h>
 #include <libgwyddion/gwydebugobjects.h>
+#include <libgwyddion/gwyomp.h>
 #include <libprocess/brick.h>
 #include <libprocess/interpolation.h>
 #include <stdlib.h>
 
 #define GWY_BRICK_TYPE_NAME "GwyBrick"
 
+enum {
+    /* Row segment length for z-line statistics. */
+    STATS_BLOCK = 256,
+};
+
+typedef enum {
+    BRICK_STORAGE_MEMORY  = 0,
+    BRICK_STORAGE_SCRATCH = 1,
+} BrickStorageType;
+
+typedef struct {
+    BrickStorageType type;
+    gdouble *data;
+    /* Scratch file mapping. */
+    gpointer map;
+    gsize mapsize;
+} BrickStorage;
+
 typedef struct {
     GwyDataLine *zcalibration;
+    BrickStorage storage;
+    /* Transposed copy of the data, with z varying fastest. */
+    BrickStorage zmajor;
 } GwyBrickPrivate;
 
 enum {
@@ -54,8 +87,33 @@ static GObject*    gwy_brick_deserialize      (const guchar *buffer,
 static GObject*    gwy_brick_duplicate_real   (GObject *object);
 static void        gwy_brick_clone_real       (GObject *source,
                                                GObject *copy);
+static void        alloc_data                 (GwyBrick *brick,
+                                               gboolean nullme,
+                                               gboolean mapped);
+static void        free_data                  (GwyBrick *brick);
+static void        account_data               (GwyBrick *brick);
+static gboolean    storage_alloc              (BrickStorage *storage,
+                                               gsize n,
+                                               gboolean nullme,
+                                               gboolean mapped);
+static gboolean    storage_adopt              (BrickStorage *storage,
+                                               gsize n,
+                                               gdouble *data);
+static gboolean    storage_try_scratch        (BrickStorage *storage,
+                                               gsize n,
+                                               gboolean mapped);
+static void        storage_free               (BrickStorage *storage);
+static void        transpose_blocked          (const gdouble *src,
+                                               gdouble *dest,
+                                               gsize nrows,
+                                               gsize ncols);
+static gboolean    storage_map_scratch        (BrickStorage *storage,
+                                               gsize n,
+                                               GError **error);
 
 static guint brick_signals[LAST_SIGNAL] = { 0 };
+static gsize scratch_threshold = 0;
+static gchar *scratch_dir = NULL;
 
 G_DEFINE_TYPE_EXTENDED
     (GwyBrick, gwy_brick, G_TYPE_OBJECT, 0,
@@ -115,14 +173,193 @@ static void
 gwy_brick_finalize(GObject *object)
 {
     GwyBrick *brick = (GwyBrick*)object;
+    GwyBrickPrivate *priv = brick->priv;
 
     GWY_OBJECT_UNREF(brick->si_unit_x);
     GWY_OBJECT_UNREF(brick->si_unit_y);
-    g_free(brick->data);
+    /* Not gwy_brick_invalidate() which would account the freed data of an
+     * object being finalized. */
+    storage_free(&priv->zmajor);
+    free_data(brick);
 
     G_OBJECT_CLASS(gwy_brick_parent_class)->finalize(object);
 }
 
+static void
+alloc_data(GwyBrick *brick, gboolean nullme, gboolean mapped)
+{
+    GwyBrickPrivate *priv = brick->priv;
+    gsize n = (gsize)brick->xres * brick->yres * brick->zres;
+
+    storage_alloc(&priv->storage, n, nullme, mapped);
+    brick->data = priv->storage.data;
+    account_data(brick);
+}
+
+static void
+free_data(GwyBrick *brick)
+{
+    GwyBrickPrivate *priv = brick->priv;
+
+    /* Memory-backed data may have been replaced by the caller. */
+    if (priv->storage.type == BRICK_STORAGE_MEMORY)
+        priv->storage.data = brick->data;
+    storage_free(&priv->storage);
+    brick->data = NULL;
+}
+
+/* Only data in memory are accounted.  The kernel pages data in mapped files
+ * in and out as needed. */
+static void
+account_data(GwyBrick *brick)
+{
+    GwyBrickPrivate *priv = brick->priv;
+    gsize size = 0, n = (gsize)brick->xres * brick->yres * brick->zres;
+
+    if (brick->data && priv->storage.type == BRICK_STORAGE_MEMORY)
+        size += n*sizeof(gdouble);
+    if (priv->zmajor.data && priv->zmajor.type == BRICK_STORAGE_MEMORY)
+        size += n*sizeof(gdouble);
+    gwy_debug_objects_set_size(G_OBJECT(brick), size);
+}
+
+/* Allocates storage for @n values, in a scratch file if requested or if the
+ * data is larger than the scratch threshold.  Falls back to memory if the
+ * scratch file cannot be created. */
+static gboolean
+storage_alloc(BrickStorage *storage, gsize n, gboolean nullme, gboolean mapped)
+{
+    if (storage_try_scratch(storage, n, mapped))
+        return TRUE;
+
+    storage->type = BRICK_STORAGE_MEMORY;
+    storage->data = nullme ? g_new0(gdouble, n) : g_new(gdouble, n);
+    return FALSE;
+}
+
+/* Takes over already filled memory @data with @n values, moving them to a
+ * scratch file if they are larger than the scratch threshold. */
+static gboolean
+storage_adopt(BrickStorage *storage, gsize n, gdouble *data)
+{
+    if (storage_try_scratch(storage, n, FALSE)) {
+        memcpy(storage->data, data, n*sizeof(gdouble));
+        g_free(data);
+        return TRUE;
+    }
+
+    storage->type = BRICK_STORAGE_MEMORY;
+    storage->data = data;
+    return FALSE;
+}
+
+/* Creates a scratch file if @mapped or the data is larger than the scratch
+ * threshold.  Failure is reported, except when scratch files are not supported
+ * at all. */
+static gboolean
+storage_try_scratch(BrickStorage *storage, gsize n, gboolean mapped)
+{
+    GError *error = NULL;
+
+    if (!mapped
+        && !(scratch_threshold && n*sizeof(gdouble) >= scratch_threshold))
+        return FALSE;
+
+    if (storage_map_scratch(storage, n, &error))
+        return TRUE;
+    if (!g_error_matches(error, G_FILE_ERROR, G_FILE_ERROR_NOSYS))
+        g_warning("Cannot create scratch file for volume data: %s",
+                  error->message);
+    g_clear_error(&error);
+    return FALSE;
+}
+
+static void
+storage_free(BrickStorage *storage)
+{
+    if (storage->type == BRICK_STORAGE_MEMORY)
+        g_free(storage->data);
+#ifdef HAVE_SYS_MMAN_H
+    else if (storage->type == BRICK_STORAGE_SCRATCH)
+        munmap(storage->map, storage->mapsize);
+#endif
+
+    gwy_clear(storage, 1);
+}
+
+/* The scratch file is unlinked immediately so it disappears when unmapped,
+ * even if we crash.  The kernel writes the pages back to it and drops them
+ * as needed, keeping only recently used parts of the data in memory.  */
+static gboolean
+storage_map_scratch(BrickStorage *storage, gsize n, GError **error)
+{
+#ifdef HAVE_SYS_MMAN_H
+    gsize size = MAX(n, 1)*sizeof(gdouble);
+    const gchar *dir;
+    gchar *filename;
+    gpointer map;
+    gint fd, errcode;
+
+    dir = gwy_brick_get_scratch_dir();
+    if (g_mkdir_with_parents(dir, 0700) != 0) {
+        errcode = errno;
+        g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(errcode),
+                    _("Cannot create directory %s: %s."),
+                    dir, g_strerror(errcode));
+        return FALSE;
+    }
+
+    filename = g_build_filename(dir, "gwybrickXXXXXX", NULL);
+    fd = g_mkstemp(filename);
+    if (fd < 0) {
+        errcode = errno;
+        g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(errcode),
+                    _("Cannot create a temporary file: %s."),
+                    g_strerror(errcode));
+        g_free(filename);
+        return FALSE;
+    }
+    g_unlink(filename);
+    g_free(filename);
+
+    /* Reserve the disk space now.  Running out of it later while writing to
+     * the mapped memory would kill us with SIGBUS. */
+#ifdef HAVE_POSIX_FALLOCATE
+    errcode = posix_fallocate(fd, 0, size);
+#else
+    errcode = ftruncate(fd, size) == 0 ? 0 : errno;
+#endif
+    if (errcode) {
+        g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(errcode),
+                    _("Cannot create a temporary file: %s."),
+                    g_strerror(errcode));
+        close(fd);
+        return FALSE;
+    }
+
+    map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    errcode = errno;
+    close(fd);
+    if (map == MAP_FAILED) {
+        g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(errcode),
+                    _("Cannot map a temporary file to memory: %s."),
+                    g_strerror(errcode));
+        return FALSE;
+    }
+
+    storage->type = BRICK_STORAGE_SCRATCH;
+    storage->map = map;
+    storage->mapsize = size;
+    storage->data = (gdouble*)map;
+    return TRUE;
+#else
+    g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_NOSYS,
+                _("Memory-mapped scratch files are not supported "
+                  "on this platform."));
+    return FALSE;
+#endif
+}
+
 /**
  * gwy_brick_new:
  * @xres: X resolution, i.e., the number of samples in x direction
@@ -155,14 +392,181 @@ gwy_brick_new(gint xres, gint yres, gint zres, gdouble xreal, gdouble yreal, gdo
     brick->yreal = yreal;
     brick->zreal = zreal;
 
-    if (nullme)
-        brick->data = g_new0(gdouble, brick->xres * brick->yres * brick->zres);
-    else
-        brick->data = g_new(gdouble, brick->xres * brick->yres * brick->zres);
+    alloc_data(brick, nullme, FALSE);
 
     return brick;
 }
 
+/**
+ * gwy_brick_new_mapped:
+ * @xres: X resolution, i.e., the number of samples in x direction
+ * @yres: Y resolution, i.e., the number of samples in y direction
+ * @zres: Z resolution, i.e., the number of samples in z direction
+ * @xreal: Real physical dimension in x direction.
+ * @yreal: Real physical dimension in y direction.
+ * @zreal: Real physical dimension in z direction.
+ * @error: Return location for a #GError.
+ *
+ * Creates a new data brick with data stored in a memory-mapped scratch file.
+ *
+ * The data are accessed exactly as data of any other brick.  However, only
+ * the recently used parts are kept in memory; the rest is written to the
+ * scratch file by the operating system.  Scratch files are created in the
+ * directory given by gwy_brick_get_scratch_dir().  This allows working with volume data
+ * larger than the available memory, albeit slowly when they are accessed
+ * in a scattered manner.  Bricks created from a mapped brick using
+ * gwy_brick_new_alike() or gwy_brick_duplicate() are also mapped.
+ *
+ * The data are initialised to zeroes.
+ *
+ * Returns: A newly created data brick, or %NULL if the scratch file cannot be
+ *          created (or memory-mapping is not supported at all).
+ *
+ * Since: 2.47
+ **/
+GwyBrick*
+gwy_brick_new_mapped(gint xres, gint yres, gint zres,
+                     gdouble xreal, gdouble yreal, gdouble zreal,
+                     GError **error)
+{
+    GwyBrick *brick;
+    GwyBrickPrivate *priv;
+
+    g_return_val_if_fail(xres > 0 && yres > 0 && zres > 0, NULL);
+
+    brick = g_object_new(GWY_TYPE_BRICK, NULL);
+    priv = brick->priv;
+    if (!storage_map_scratch(&priv->storage, (gsize)xres*yres*zres, error)) {
+        g_object_unref(brick);
+        return NULL;
+    }
+
+    brick->xres = xres;
+    brick->yres = yres;
+    brick->zres = zres;
+    brick->xreal = xreal;
+    brick->yreal = yreal;
+    brick->zreal = zreal;
+    brick->data = priv->storage.data;
+    account_data(brick);
+
+    return brick;
+}
+
+/**
+ * gwy_brick_is_mapped:
+ * @brick: A data brick.
+ *
+ * Reports whether a data brick is stored in a memory-mapped file.
+ *
+ * This is the case for bricks created with gwy_brick_new_mapped() and for
+ * bricks larger than the scratch file threshold set with
+ * gwy_brick_set_scratch_threshold().
+ *
+ * Returns: %TRUE if the brick data are memory-mapped, %FALSE if they are
+ *          ordinary memory.
+ *
+ * Since: 2.47
+ **/
+gboolean
+gwy_brick_is_mapped(GwyBrick *brick)
+{
+    GwyBrickPrivate *priv;
+
+    g_return_val_if_fail(GWY_IS_BRICK(brick), FALSE);
+    priv = brick->priv;
+    return priv->storage.type != BRICK_STORAGE_MEMORY;
+}
+
+/**
+ * gwy_brick_set_scratch_threshold:
+ * @size: Data size in bytes from which bricks are stored in scratch files.
+ *        Zero disables the automatic use of scratch files.
+ *
+ * Sets the size from which newly created data bricks are automatically backed
+ * by memory-mapped scratch files.
+ *
+ * The threshold applies to all functions creating or resizing bricks, for
+ * instance gwy_brick_new(), gwy_brick_new_part() or gwy_brick_resample().
+ * See gwy_brick_new_mapped() for details of memory-mapped bricks.
+ *
+ * Scratch files are not used automatically by default.  The setting is
+ * global and not meant to be changed while any data processing is in
+ * progress.  On systems without memory-mapped file support it has no effect
+ * and bricks are always allocated in memory.
+ *
+ * Since: 2.47
+ **/
+void
+gwy_brick_set_scratch_threshold(gsize size)
+{
+    scratch_threshold = size;
+}
+
+/**
+ * gwy_brick_get_scratch_threshold:
+ *
+ * Gets the size from which newly created data bricks are automatically backed
+ * by memory-mapped scratch files.
+ *
+ * Returns: The size in bytes, zero if scratch files are not used
+ *          automatically.
+ *
+ * Since: 2.47
+ **/
+gsize
+gwy_brick_get_scratch_threshold(void)
+{
+    return scratch_threshold;
+}
+
+/**
+ * gwy_brick_set_scratch_dir:
+ * @dirname: Directory to create scratch files in, or %NULL for the default.
+ *
+ * Sets the directory where memory-mapped scratch files of data bricks are
+ * created.
+ *
+ * The directory should be on a disk with enough free space for the volume
+ * data.  In particular, the system temporary directory is often a memory-based
+ * file system, which would defeat the purpose of scratch files.  The default
+ * is a subdirectory of the user cache directory.  The directory is created
+ * when needed.
+ *
+ * The setting is global and not meant to be changed while any data processing
+ * is in progress.
+ *
+ * Since: 2.47
+ **/
+void
+gwy_brick_set_scratch_dir(const gchar *dirname)
+{
+    gchar *old = scratch_dir;
+
+    scratch_dir = g_strdup(dirname);
+    g_free(old);
+}
+
+/**
+ * gwy_brick_get_scratch_dir:
+ *
+ * Gets the directory where memory-mapped scratch files of data bricks are
+ * created.
+ *
+ * Returns: The directory name, owned by the library.  If it was not set with
+ *          gwy_brick_set_scratch_dir() the default is returned.
+ *
+ * Since: 2.47
+ **/
+const gchar*
+gwy_brick_get_scratch_dir(void)
+{
+    if (!scratch_dir)
+        scratch_dir = g_build_filename(g_get_user_cache_dir(), "gwyddion",
+                                       NULL);
+    return scratch_dir;
+}
+
 /**
  * gwy_brick_new_alike:
  * @model: A data brick to take resolutions and units from.
@@ -197,10 +601,7 @@ gwy_brick_new_alike(GwyBrick *model,
     brick->xoff = model->xoff;
     brick->yoff = model->yoff;
     brick->zoff = model->zoff;
-    if (nullme)
-        brick->data = g_new0(gdouble, brick->xres * brick->yres * brick->zres);
-    else
-        brick->data = g_new(gdouble, brick->xres * brick->yres * brick->zres);
+    alloc_data(brick, nullme, gwy_brick_is_mapped(model));
 
     if (model->si_unit_x)
         brick->si_unit_x = gwy_si_unit_duplicate(model->si_unit_x);
@@ -502,7 +903,7 @@ gwy_brick_deserialize(const guchar *buffer,
 
     /* don't allocate large amount of memory just to immediately free it */
     brick = gwy_brick_new(1, 1, 1, xreal, yres, zreal, FALSE);
-    g_free(brick->data);
+    free_data(brick);
     brick->xres = xres;
     brick->yres = yres;
     brick->zres = zres;
@@ -515,7 +916,10 @@ gwy_brick_deserialize(const guchar *buffer,
     brick->yoff = yoff;
     brick->zoff = zoff;
 
-    brick->data = data;
+    priv = brick->priv;
+    storage_adopt(&priv->storage, datasize, data);
+    brick->data = priv->storage.data;
+    account_data(brick);
     if (si_unit_x) {
         GWY_OBJECT_UNREF(brick->si_unit_x);
         brick->si_unit_x = si_unit_x;
@@ -533,7 +937,6 @@ gwy_brick_deserialize(const guchar *buffer,
         brick->si_unit_w = si_unit_w;
     }
     if (num_items > 0) {
-        priv = (GwyBrickPrivate *)brick->priv;
         priv->zcalibration = calibrations[0];
         g_object_ref(priv->zcalibration);
     }
@@ -569,15 +972,18 @@ gwy_brick_clone_real(GObject *source, GObject *copy)
 
     brick = GWY_BRICK(source);
     clone = GWY_BRICK(copy);
+    gwy_brick_invalidate(clone);
 
     if (clone->xres != brick->xres
         || clone->yres != brick->yres
         || clone->zres != brick->zres) {
+        gboolean mapped = gwy_brick_is_mapped(clone);
+
+        free_data(clone);
         clone->xres = brick->xres;
         clone->yres = brick->yres;
         clone->zres = brick->zres;
-        clone->data = g_renew(gdouble, clone->data,
-                              clone->xres * clone->yres * clone->zres);
+        alloc_data(clone, FALSE, mapped);
     }
     clone->xreal = brick->xreal;
     clone->yreal = brick->yreal;
@@ -645,9 +1051,42 @@ gwy_brick_clone_real(GObject *source, GObject *copy)
 void
 gwy_brick_data_changed(GwyBrick *brick)
 {
+    gwy_brick_invalidate(brick);
     g_signal_emit(brick, brick_signals[DATA_CHANGED], 0);
 }
 
+/**
+ * gwy_brick_invalidate:
+ * @brick: A data brick.
+ *
+ * Invalidates cached data brick information.
+ *
+ * This function is called automatically by functions modifying the data,
+ * by gwy_brick_get_data() and by gwy_brick_data_changed().  You only need to
+ * call it explicitly when you modify the data through a buffer obtained
+ * earlier, after other brick functions were used in the meantime, in
+ * particular gwy_brick_get_data_zmajor().  This also applies to writing
+ * directly to the public @data member of #GwyBrick.
+ *
+ * Since invalidation frees the z-contiguous copy of the data created by
+ * gwy_brick_get_data_zmajor(), it can also be used to release the memory
+ * once it is no longer needed.
+ *
+ * Since: 2.47
+ **/
+void
+gwy_brick_invalidate(GwyBrick *brick)
+{
+    GwyBrickPrivate *priv;
+
+    g_return_if_fail(GWY_IS_BRICK(brick));
+    priv = brick->priv;
+    if (priv->zmajor.data) {
+        storage_free(&priv->zmajor);
+        account_data(brick);
+    }
+}
+
 /**
  * gwy_brick_resample:
  * @brick: A data brick.
@@ -671,25 +1110,43 @@ gwy_brick_resample(GwyBrick *brick,
                    gint zres,
                    GwyInterpolationType interpolation)
 {
+    GwyBrickPrivate *priv;
+    BrickStorage storage;
     gdouble *bdata;
     gint row, col, lev;
     gdouble xratio, yratio, zratio;
+    gboolean mapped;
 
     g_return_if_fail(GWY_IS_BRICK(brick));
     if ((xres == brick->xres) && (yres == brick->yres) && (zres == brick->zres))
         return;
     g_return_if_fail(xres > 1 && yres > 1 && zres > 1);
 
+    gwy_brick_invalidate(brick);
+    priv = brick->priv;
+    mapped = gwy_brick_is_mapped(brick);
     if (interpolation == GWY_INTERPOLATION_NONE) {
+        if (mapped) {
+            free_data(brick);
+            brick->xres = xres;
+            brick->yres = yres;
+            brick->zres = zres;
+            alloc_data(brick, FALSE, TRUE);
+            return;
+        }
         brick->xres = xres;
         brick->yres = yres;
         brick->zres = zres;
 
         brick->data = g_renew(gdouble, brick->data, brick->xres * brick->yres * brick->zres);
+        priv->storage.data = brick->data;
+        account_data(brick);
         return;
     }
 
-    bdata = g_new(gdouble, xres * yres * zres);
+    gwy_clear(&storage, 1);
+    storage_alloc(&storage, (gsize)xres*yres*zres, FALSE, mapped);
+    bdata = storage.data;
 
     xratio = (gdouble)brick->xres/xres;
     yratio = (gdouble)brick->yres/yres;
@@ -709,11 +1166,13 @@ gwy_brick_resample(GwyBrick *brick,
 
     }
 
-    g_free(brick->data);
+    free_data(brick);
+    priv->storage = storage;
     brick->data = bdata;
     brick->xres = xres;
     brick->yres = yres;
     brick->zres = zres;
+    account_data(brick);
 
 }
 
@@ -824,7 +1283,9 @@ gwy_brick_get_dval_real(GwyBrick *a, gdouble x, gdouble y, gdouble z, gint inter
  * gwy_brick_resample().
  *
  * This function invalidates any cached information, use
- * gwy_brick_get_data_const() if you are not going to change the data.
+ * gwy_brick_get_data_const() if you are not going to change the data.  If you
+ * keep the buffer and write to it later, or modify the public @data member
+ * directly, call gwy_brick_invalidate() after the modification.
  *
  * Returns: The data as an array of doubles of length @xres*@yres*@zres.
  *
@@ -834,6 +1295,7 @@ gdouble*
 gwy_brick_get_data(GwyBrick *brick)
 {
     g_return_val_if_fail(GWY_IS_BRICK(brick), NULL);
+    gwy_brick_invalidate(brick);
     return brick->data;
 }
 
@@ -860,6 +1322,91 @@ gwy_brick_get_data_const(GwyBrick *brick)
     return (const gdouble*)brick->data;
 }
 
+/**
+ * gwy_brick_get_data_zmajor:
+ * @brick: A data brick.
+ *
+ * Gets the data of a data brick transposed to z-contiguous order, read-only.
+ *
+ * In the returned buffer the value at position (@col, @row, @lev) is at
+ * index (@row*@xres + @col)*@zres + @lev.  So each z-line (spectrum, curve)
+ * forms a contiguous block, which is much more efficient for processing the
+ * data curve by curve than the normal layout in which consecutive z-line
+ * values are @xres*@yres apart.
+ *
+ * The transposed data are created on demand and kept until the brick data
+ * change.  Functions extracting z-lines, such as gwy_brick_extract_line(),
+ * use them automatically when available.  Since they are a complete copy of
+ * the data, they are worth creating only when many or all z-lines are going
+ * to be processed.  Large bricks are transposed into scratch files according
+ * to gwy_brick_set_scratch_threshold().
+ *
+ * The returned buffer is valid until the data are modified, i.e. until
+ * gwy_brick_get_data(), gwy_brick_invalidate() or another function changing
+ * the data is called.
+ *
+ * The transposed copy doubles the memory occupied by the brick.  When the
+ * brick is not a temporary object, call gwy_brick_invalidate() to free the
+ * copy once the processing is finished.
+ *
+ * Returns: The data as an array of doubles of length @xres*@yres*@zres.
+ *
+ * Since: 2.47
+ **/
+const gdouble*
+gwy_brick_get_data_zmajor(GwyBrick *brick)
+{
+    GwyBrickPrivate *priv;
+
+    g_return_val_if_fail(GWY_IS_BRICK(brick), NULL);
+    priv = brick->priv;
+    if (!priv->zmajor.data) {
+        storage_alloc(&priv->zmajor,
+                      (gsize)brick->xres * brick->yres * brick->zres,
+                      FALSE, FALSE);
+        transpose_blocked(brick->data, priv->zmajor.data,
+                          brick->zres, (gsize)brick->xres * brick->yres);
+        account_data(brick);
+    }
+    return (const gdouble*)priv->zmajor.data;
+}
+
+/* Transposes a row-major @nrows×@ncols matrix.  Working in small square
+ * blocks keeps both reading and writing within a few cache lines and pages,
+ * whereas a plain transpose has one of them strided by a large amount. */
+static void
+transpose_blocked(const gdouble *src, gdouble *dest, gsize nrows, gsize ncols)
+{
+    enum { BLOCK = 32 };
+    gsize ncolblocks = (ncols + BLOCK-1)/BLOCK;
+
+#ifdef _OPENMP
+#pragma omp parallel if(gwy_omp_use_threads(nrows*ncols)) \
+            default(none) \
+            shared(src,dest,nrows,ncols,ncolblocks)
+#endif
+    {
+        gsize cbfrom = gwy_omp_chunk_start(ncolblocks);
+        gsize cbto = gwy_omp_chunk_end(ncolblocks);
+        gsize cb, r0, c0, r, c, rend, cend;
+
+        for (cb = cbfrom; cb < cbto; cb++) {
+            c0 = cb*BLOCK;
+            cend = MIN(c0 + BLOCK, ncols);
+            for (r0 = 0; r0 < nrows; r0 += BLOCK) {
+                rend = MIN(r0 + BLOCK, nrows);
+                for (c = c0; c < cend; c++) {
+                    const gdouble *s = src + r0*ncols + c;
+                    gdouble *d = dest + c*nrows;
+
+                    for (r = r0; r < rend; r++, s += ncols)
+                        d[r] = *s;
+                }
+            }
+        }
+    }
+}
+
 /**
  * gwy_brick_get_xres:
  * @brick: A data brick.
@@ -1709,6 +2256,16 @@ gwy_brick_rtok_cal(GwyBrick *brick,
     return i + (realpos - cdata[i])/(cdata[i+1] - cdata[i]);
 }
 
+static inline void
+set_zmajor_val(GwyBrick *brick, gint col, gint row, gint lev, gdouble value)
+{
+    GwyBrickPrivate *priv = brick->priv;
+
+    if (priv->zmajor.data)
+        priv->zmajor.data[((gsize)row*brick->xres + col)*brick->zres + lev]
+            = value;
+}
+
 /**
  * gwy_brick_get_val:
  * @brick: A data brick.
@@ -1767,6 +2324,7 @@ gwy_brick_set_val(GwyBrick *brick,
                      && lev>=0 && lev < (brick->zres));
 
     brick->data[col + brick->xres*row + brick->xres*brick->yres*lev] = value;
+    set_zmajor_val(brick, col, row, lev, value);
 }
 
 /**
@@ -1835,6 +2393,7 @@ gwy_brick_set_val_real(GwyBrick *brick,
                      && lev>=0 && lev < (brick->zres));
 
     brick->data[col + brick->xres*row + brick->xres*brick->yres*lev] = value;
+    set_zmajor_val(brick, col, row, lev, value);
 }
 
 /**
@@ -1853,6 +2412,7 @@ gwy_brick_fill(GwyBrick *brick,
     gint i;
 
     g_return_if_fail(GWY_IS_BRICK(brick));
+    gwy_brick_invalidate(brick);
     for (i = 0; i < (brick->xres*brick->yres*brick->zres); i++)
         brick->data[i] = value;
 }
@@ -1869,6 +2429,7 @@ void
 gwy_brick_clear(GwyBrick *brick)
 {
     g_return_if_fail(GWY_IS_BRICK(brick));
+    gwy_brick_invalidate(brick);
     gwy_clear(brick->data, brick->xres*brick->yres*brick->zres);
 }
 
@@ -1888,6 +2449,7 @@ gwy_brick_add(GwyBrick *brick,
     gint i;
 
     g_return_if_fail(GWY_IS_BRICK(brick));
+    gwy_brick_invalidate(brick);
     for (i = 0; i < (brick->xres*brick->yres*brick->zres); i++)
         brick->data[i] += value;
 }
@@ -1908,6 +2470,7 @@ gwy_brick_multiply(GwyBrick *brick,
     gint i;
 
     g_return_if_fail(GWY_IS_BRICK(brick));
+    gwy_brick_invalidate(brick);
     for (i = 0; i < (brick->xres*brick->yres*brick->zres); i++)
         brick->data[i] *= value;
 }
@@ -2129,24 +2692,10 @@ gwy_brick_sum_plane(const GwyBrick *brick,
     }
 
     if (width > 0 && height > 0 && depth == -1) {
-        g_return_if_fail((istart+width) <= brick->xres);
-        g_return_if_fail((jstart+height) <= brick->yres);
-
-        gwy_data_field_resample(target, width, height, GWY_INTERPOLATION_NONE);
-        gwy_data_field_clear(target);
-        ddata = gwy_data_field_get_data(target);
-
-        gwy_data_field_set_xreal(target, brick->xreal);
-        gwy_data_field_set_yreal(target, brick->yreal);
-
-        for (col = 0; col < width; col++) {
-            for (row = 0; row < height; row++) {
-                for (lev = 0; lev < brick->zres; lev++) {
-                    gdouble bv = bdata[col + istart + brick->xres*(row + jstart) + brick->xres*brick->yres*(lev)];
-                    ddata[col + row*width] += bv;
-                }
-            }
-        }
+        gwy_brick_stats_plane(brick, istart, jstart, 0,
+                              width, height, brick->zres,
+                              target, NULL, NULL, NULL, NULL, NULL, NULL);
+        return;
     }
 
     si_unit = gwy_brick_get_si_unit_x((GwyBrick *)brick);
@@ -2255,25 +2804,10 @@ gwy_brick_min_plane(const GwyBrick *brick,
     }
 
     if (width > 0 && height > 0 && depth == -1) {
-        g_return_if_fail((istart+width) <= brick->xres);
-        g_return_if_fail((jstart+height) <= brick->yres);
-
-        gwy_data_field_resample(target, width, height, GWY_INTERPOLATION_NONE);
-        gwy_data_field_fill(target, G_MAXDOUBLE);
-        ddata = gwy_data_field_get_data(target);
-
-        gwy_data_field_set_xreal(target, brick->xreal);
-        gwy_data_field_set_yreal(target, brick->yreal);
-
-        for (col = 0; col < width; col++) {
-            for (row = 0; row < height; row++) {
-                for (lev = 0; lev < brick->zres; lev++) {
-                    gdouble bv = bdata[col + istart + brick->xres*(row + jstart) + brick->xres*brick->yres*(lev)];
-                    gdouble fv = ddata[col + row*width];
-                    ddata[col + row*width] = MIN(bv, fv);
-                }
-            }
-        }
+        gwy_brick_stats_plane(brick, istart, jstart, 0,
+                              width, height, brick->zres,
+                              NULL, NULL, NULL, target, NULL, NULL, NULL);
+        return;
     }
 
     si_unit = gwy_brick_get_si_unit_x((GwyBrick *)brick);
@@ -2382,25 +2916,10 @@ gwy_brick_max_plane(const GwyBrick *brick,
     }
 
     if (width > 0 && height > 0 && depth == -1) {
-        g_return_if_fail((istart+width) <= brick->xres);
-        g_return_if_fail((jstart+height) <= brick->yres);
-
-        gwy_data_field_resample(target, width, height, GWY_INTERPOLATION_NONE);
-        gwy_data_field_fill(target, G_MINDOUBLE);
-        ddata = gwy_data_field_get_data(target);
-
-        gwy_data_field_set_xreal(target, brick->xreal);
-        gwy_data_field_set_yreal(target, brick->yreal);
-
-        for (col = 0; col < width; col++) {
-            for (row = 0; row < height; row++) {
-                for (lev = 0; lev < brick->zres; lev++) {
-                    gdouble bv = bdata[col + istart + brick->xres*(row + jstart) + brick->xres*brick->yres*(lev)];
-                    gdouble fv = ddata[col + row*width];
-                    ddata[col + row*width] = MAX(bv, fv);
-                }
-            }
-        }
+        gwy_brick_stats_plane(brick, istart, jstart, 0,
+                              width, height, brick->zres,
+                              NULL, NULL, NULL, NULL, target, NULL, NULL);
+        return;
     }
 
     si_unit = gwy_brick_get_si_unit_x((GwyBrick *)brick);
@@ -2451,8 +2970,6 @@ gwy_brick_minpos_plane(const GwyBrick *brick,
     gdouble *bdata, *ddata;
     gint minpos;
     GwySIUnit *si_unit;
-    GwyDataLine *calibration;
-    gdouble *caldata;
 
     g_return_if_fail(GWY_IS_BRICK(brick));
 
@@ -2524,41 +3041,10 @@ gwy_brick_minpos_plane(const GwyBrick *brick,
     }
 
     if (width > 0 && height > 0 && depth == -1) {
-        g_return_if_fail((istart+width) <= brick->xres);
-        g_return_if_fail((jstart+height) <= brick->yres);
-
-        gwy_data_field_resample(target, width, height, GWY_INTERPOLATION_NONE);
-        gwy_data_field_fill(target, G_MAXDOUBLE);
-        ddata = gwy_data_field_get_data(target);
-
-        gwy_data_field_set_xreal(target, brick->xreal);
-        gwy_data_field_set_yreal(target, brick->yreal);
-
-        calibration = gwy_brick_get_zcalibration((GwyBrick *)brick);
-        if (calibration) {
-            si_unit = gwy_data_line_get_si_unit_y(calibration);
-            caldata = gwy_data_line_get_data(calibration);
-        }
-        else {
-            si_unit = gwy_brick_get_si_unit_z((GwyBrick *)brick);
-        }
-        gwy_data_field_set_si_unit_z(target, si_unit);
-        for (col = 0; col < width; col++) {
-            for (row = 0; row < height; row++) {
-                minpos = 0;
-                for (lev = 0; lev < brick->zres; lev++) {
-                    gdouble bv = bdata[col + istart + brick->xres*(row + jstart) + brick->xres*brick->yres*(lev)];
-                    gdouble fv = ddata[col + row*width];
-                    if (bv < fv)
-                        minpos = lev;
-                    ddata[col + row*width] = MIN(bv, fv);
-                }
-                if (!calibration)
-                    ddata[col + row*width] = minpos;
-                else
-                    ddata[col + row*width] = caldata[minpos];
-            }
-        }
+        gwy_brick_stats_plane(brick, istart, jstart, 0,
+                              width, height, brick->zres,
+                              NULL, NULL, NULL, NULL, NULL, target, NULL);
+        return;
     }
 
     si_unit = gwy_brick_get_si_unit_x((GwyBrick *)brick);
@@ -2606,8 +3092,6 @@ gwy_brick_maxpos_plane(const GwyBrick *brick,
     gdouble *bdata, *ddata;
     gint maxpos;
     GwySIUnit *si_unit;
-    GwyDataLine *calibration;
-    gdouble *caldata;
 
     g_return_if_fail(GWY_IS_BRICK(brick));
 
@@ -2679,41 +3163,10 @@ gwy_brick_maxpos_plane(const GwyBrick *brick,
     }
 
     if (width > 0 && height > 0 && depth == -1) {
-        g_return_if_fail((istart+width) <= brick->xres);
-        g_return_if_fail((jstart+height) <= brick->yres);
-
-        gwy_data_field_resample(target, width, height, GWY_INTERPOLATION_NONE);
-        gwy_data_field_fill(target, G_MINDOUBLE);
-        ddata = gwy_data_field_get_data(target);
-
-        gwy_data_field_set_xreal(target, brick->xreal);
-        gwy_data_field_set_yreal(target, brick->yreal);
-
-        calibration = gwy_brick_get_zcalibration((GwyBrick *)brick);
-        if (calibration) {
-            si_unit = gwy_data_line_get_si_unit_y(calibration);
-            caldata = gwy_data_line_get_data(calibration);
-        }
-        else {
-            si_unit = gwy_brick_get_si_unit_z((GwyBrick *)brick);
-        }
-        gwy_data_field_set_si_unit_z(target, si_unit);
-        for (col = 0; col < width; col++) {
-            for (row = 0; row < height; row++) {
-                maxpos = 0;
-                for (lev = 0; lev < brick->zres; lev++) {
-                    gdouble bv = bdata[col + istart + brick->xres*(row + jstart) + brick->xres*brick->yres*(lev)];
-                    gdouble fv = ddata[col + row*width];
-                    if (bv > fv)
-                        maxpos = lev;
-                    ddata[col + row*width] = MAX(bv, fv);
-                }
-                if (!calibration)
-                    ddata[col + row*width] = maxpos;
-                else
-                    ddata[col + row*width] = caldata[maxpos];
-            }
-        }
+        gwy_brick_stats_plane(brick, istart, jstart, 0,
+                              width, height, brick->zres,
+                              NULL, NULL, NULL, NULL, NULL, NULL, target);
+        return;
     }
 
     si_unit = gwy_brick_get_si_unit_x((GwyBrick *)brick);
@@ -2771,6 +3224,13 @@ gwy_brick_mean_plane(const GwyBrick *brick,
                      && jstart >=0 && jstart < brick->yres
                      && kstart >=0 && kstart < brick->zres);
 
+    if (width > 0 && height > 0 && depth == -1) {
+        gwy_brick_stats_plane(brick, istart, jstart, 0,
+                              width, height, brick->zres,
+                              NULL, target, NULL, NULL, NULL, NULL, NULL);
+        return;
+    }
+
     gwy_brick_sum_plane(brick, target,
                         istart, jstart, kstart, width, height, depth,
                         keep_offsets);
@@ -2799,18 +3259,6 @@ gwy_brick_mean_plane(const GwyBrick *brick,
         }
     }
 
-    if (width > 0 && height > 0 && depth == -1) {
-        g_return_if_fail((istart+width) <= brick->xres);
-        g_return_if_fail((jstart+height) <= brick->yres);
-
-        ddata = gwy_data_field_get_data(target);
-        for (col = 0; col < width; col++) {
-            for (row = 0; row < height; row++) {
-                ddata[col + row*width] /= brick->zres;
-            }
-        }
-    }
-
     si_unit = gwy_brick_get_si_unit_x((GwyBrick *)brick);
     gwy_data_field_set_si_unit_xy(target, si_unit);
 
@@ -2870,6 +3318,13 @@ gwy_brick_rms_plane(const GwyBrick *brick,
                      && jstart >=0 && jstart < brick->yres
                      && kstart >=0 && kstart < brick->zres);
 
+    if (width > 0 && height > 0 && depth == -1) {
+        gwy_brick_stats_plane(brick, istart, jstart, 0,
+                              width, height, brick->zres,
+                              NULL, NULL, target, NULL, NULL, NULL, NULL);
+        return;
+    }
+
     meanfield = gwy_data_field_new(1, 1, 1.0, 1.0, FALSE);
     gwy_brick_mean_plane(brick, meanfield,
                          istart, jstart, kstart, width, height, depth,
@@ -2937,43 +3392,241 @@ gwy_brick_rms_plane(const GwyBrick *brick,
         }
     }
 
-    if (width > 0 && height > 0 && depth == -1) {
-        g_return_if_fail((istart+width) <= brick->xres);
-        g_return_if_fail((jstart+height) <= brick->yres);
+    g_object_unref(meanfield);
 
-        gwy_data_field_resample(target, width, height, GWY_INTERPOLATION_NONE);
-        gwy_data_field_clear(target);
-        ddata = gwy_data_field_get_data(target);
-        mdata = gwy_data_field_get_data(meanfield);
+    si_unit = gwy_brick_get_si_unit_x((GwyBrick *)brick);
+    gwy_data_field_set_si_unit_xy(target, si_unit);
 
-        gwy_data_field_set_xreal(target, brick->xreal);
-        gwy_data_field_set_yreal(target, brick->yreal);
+    si_unit = gwy_brick_get_si_unit_w((GwyBrick *)brick);
+    gwy_data_field_set_si_unit_z(target, si_unit);
+}
 
-        for (col = 0; col < width; col++) {
-            for (row = 0; row < height; row++) {
-                for (lev = 0; lev < brick->zres; lev++) {
-                    gdouble bv = bdata[col + istart + brick->xres*(row + jstart) + brick->xres*brick->yres*(lev)];
-                    gdouble mv = mdata[col + row*width];
-                    ddata[col + row*width] += (bv - mv)*(bv - mv);
+/**
+ * gwy_brick_stats_plane:
+ * @brick: A data brick.
+ * @istart: Column where to start (pixel coordinates).
+ * @jstart: Row where to start (pixel coordinates).
+ * @kstart: Level where to start (pixel coordinates).
+ * @width: Pixel width of the area.
+ * @height: Pixel height of the area.
+ * @depth: Number of levels to summarize.
+ * @sum: Data field to fill with sums of values along z, or %NULL.
+ * @mean: Data field to fill with mean values along z, or %NULL.
+ * @rms: Data field to fill with rms of values along z, or %NULL.
+ * @min: Data field to fill with minima along z, or %NULL.
+ * @max: Data field to fill with maxima along z, or %NULL.
+ * @minpos: Data field to fill with positions of minima along z, or %NULL.
+ * @maxpos: Data field to fill with positions of maxima along z, or %NULL.
+ *
+ * Calculates several statistical quantities of z-lines in a block of a data
+ * brick at once.
+ *
+ * Each requested data field is resized to @width×@height and filled with the
+ * corresponding quantity calculated from the @depth values of each z-line in
+ * the block, starting from level @kstart.  The quantities are the same as
+ * calculated by gwy_brick_sum_plane(), gwy_brick_mean_plane(),
+ * gwy_brick_rms_plane(), gwy_brick_min_plane(), gwy_brick_max_plane(),
+ * gwy_brick_minpos_plane() and gwy_brick_maxpos_plane() for xy planes.
+ * Unlike these functions, the range of levels can be restricted and all
+ * the quantities are obtained in a single pass through the data, which is
+ * also run in parallel.  Positions of extrema are level indices, or the
+ * corresponding z-calibration values if the brick has z-calibration.
+ *
+ * Since: 2.47
+ **/
+void
+gwy_brick_stats_plane(const GwyBrick *brick,
+                      gint istart,
+                      gint jstart,
+                      gint kstart,
+                      gint width,
+                      gint height,
+                      gint depth,
+                      GwyDataField *sum,
+                      GwyDataField *mean,
+                      GwyDataField *rms,
+                      GwyDataField *min,
+                      GwyDataField *max,
+                      GwyDataField *minpos,
+                      GwyDataField *maxpos)
+{
+    GwyDataField *fields[7];
+    GwyDataLine *calibration;
+    GwySIUnit *si_unit;
+    const gdouble *bdata, *caldata = NULL;
+    gdouble *dsum = NULL, *dmean = NULL, *drms = NULL, *dmin = NULL,
+            *dmax = NULL, *dminpos = NULL, *dmaxpos = NULL;
+    gboolean need_extrema;
+    guint nblocks, bpr;
+    gint xres, yres;
+    guint i;
+
+    g_return_if_fail(GWY_IS_BRICK(brick));
+    g_return_if_fail(width > 0 && height > 0 && depth > 0);
+    g_return_if_fail(istart >= 0 && istart + width <= brick->xres
+                     && jstart >= 0 && jstart + height <= brick->yres
+                     && kstart >= 0 && kstart + depth <= brick->zres);
+
+    fields[0] = sum;
+    fields[1] = mean;
+    fields[2] = rms;
+    fields[3] = min;
+    fields[4] = max;
+    fields[5] = minpos;
+    fields[6] = maxpos;
+    for (i = 0; i < G_N_ELEMENTS(fields); i++) {
+        if (!fields[i])
+            continue;
+        g_return_if_fail(GWY_IS_DATA_FIELD(fields[i]));
+        gwy_data_field_resample(fields[i], width, height,
+                                GWY_INTERPOLATION_NONE);
+        gwy_data_field_set_xreal(fields[i],
+                                 brick->xreal*width/brick->xres);
+        gwy_data_field_set_yreal(fields[i],
+                                 brick->yreal*height/brick->yres);
+        si_unit = gwy_brick_get_si_unit_x((GwyBrick*)brick);
+        gwy_data_field_set_si_unit_xy(fields[i], si_unit);
+        si_unit = gwy_brick_get_si_unit_w((GwyBrick*)brick);
+        gwy_data_field_set_si_unit_z(fields[i], si_unit);
+    }
+
+    calibration = gwy_brick_get_zcalibration(brick);
+    if (calibration && gwy_data_line_get_res(calibration) >= brick->zres) {
+        si_unit = gwy_data_line_get_si_unit_y(calibration);
+        caldata = gwy_data_line_get_data_const(calibration);
+    }
+    else
+        si_unit = gwy_brick_get_si_unit_z((GwyBrick*)brick);
+
+    if (sum)
+        dsum = gwy_data_field_get_data(sum);
+    if (mean)
+        dmean = gwy_data_field_get_data(mean);
+    if (rms)
+        drms = gwy_data_field_get_data(rms);
+    if (min)
+        dmin = gwy_data_field_get_data(min);
+    if (max)
+        dmax = gwy_data_field_get_data(max);
+    if (minpos) {
+        dminpos = gwy_data_field_get_data(minpos);
+        gwy_data_field_set_si_unit_z(minpos, si_unit);
+    }
+    if (maxpos) {
+        dmaxpos = gwy_data_field_get_data(maxpos);
+        gwy_data_field_set_si_unit_z(maxpos, si_unit);
+    }
+    need_extrema = (min || max || minpos || maxpos);
+
+    xres = brick->xres;
+    yres = brick->yres;
+    bdata = brick->data + (gsize)kstart*xres*yres + jstart*xres + istart;
+    /* Process row segments through all levels.  The segments are long
+     * enough for reasonably efficient reading of each level, yet the working
+     * buffers fit into cache and segments are reread while still cached
+     * when the rms needs a second pass. */
+    bpr = (width + STATS_BLOCK-1)/STATS_BLOCK;
+    nblocks = bpr*height;
+
+#ifdef _OPENMP
+#pragma omp parallel if(gwy_omp_use_threads((gsize)width*height*depth)) \
+            default(none) \
+            shared(bdata,caldata,xres,yres,width,depth,kstart,bpr,nblocks,need_extrema,dsum,dmean,drms,dmin,dmax,dminpos,dmaxpos)
+#endif
+    {
+        gdouble *s = g_new(gdouble, 5*STATS_BLOCK);
+        gdouble *s2 = s + STATS_BLOCK, *m = s2 + STATS_BLOCK;
+        gdouble *mn = m + STATS_BLOCK, *mx = mn + STATS_BLOCK;
+        gint *imn = g_new(gint, 2*STATS_BLOCK);
+        gint *imx = imn + STATS_BLOCK;
+        guint bfrom = gwy_omp_chunk_start(nblocks);
+        guint bto = gwy_omp_chunk_end(nblocks);
+        guint b;
+        gint row, c0, n, j, l, k;
+
+        for (b = bfrom; b < bto; b++) {
+            const gdouble *p0, *p;
+            gsize off;
+
+            row = b/bpr;
+            c0 = (b % bpr)*STATS_BLOCK;
+            n = MIN(width - c0, STATS_BLOCK);
+            p0 = bdata + row*xres + c0;
+            off = (gsize)row*width + c0;
+
+            gwy_clear(s, n);
+            if (need_extrema) {
+                for (j = 0; j < n; j++) {
+                    mn[j] = mx[j] = p0[j];
+                    imn[j] = imx[j] = 0;
+                }
+            }
+            for (l = 0; l < depth; l++) {
+                p = p0 + (gsize)l*xres*yres;
+                if (need_extrema) {
+                    for (j = 0; j < n; j++) {
+                        gdouble v = p[j];
+
+                        s[j] += v;
+                        if (v < mn[j]) {
+                            mn[j] = v;
+                            imn[j] = l;
+                        }
+                        if (v > mx[j]) {
+                            mx[j] = v;
+                            imx[j] = l;
+                        }
+                    }
+                }
+                else {
+                    for (j = 0; j < n; j++)
+                        s[j] += p[j];
                 }
             }
-        }
 
-        for (col = 0; col < width; col++) {
-            for (row = 0; row < height; row++) {
-                ddata[col + row*width] /= brick->zres;
-                ddata[col + row*width] = sqrt(ddata[col + row*width]);
+            if (drms) {
+                gwy_clear(s2, n);
+                for (j = 0; j < n; j++)
+                    m[j] = s[j]/depth;
+                for (l = 0; l < depth; l++) {
+                    p = p0 + (gsize)l*xres*yres;
+                    for (j = 0; j < n; j++) {
+                        gdouble v = p[j] - m[j];
+                        s2[j] += v*v;
+                    }
+                }
+                for (j = 0; j < n; j++)
+                    drms[off + j] = sqrt(s2[j]/depth);
             }
-        }
-    }
 
-    g_object_unref(meanfield);
+            for (j = 0; j < n; j++) {
+                if (dsum)
+                    dsum[off + j] = s[j];
+                if (dmean)
+                    dmean[off + j] = s[j]/depth;
+                if (dmin)
+                    dmin[off + j] = mn[j];
+                if (dmax)
+                    dmax[off + j] = mx[j];
+                if (dminpos) {
+                    k = imn[j] + kstart;
+                    dminpos[off + j] = caldata ? caldata[k] : k;
+                }
+                if (dmaxpos) {
+                    k = imx[j] + kstart;
+                    dmaxpos[off + j] = caldata ? caldata[k] : k;
+                }
+            }
+        }
 
-    si_unit = gwy_brick_get_si_unit_x((GwyBrick *)brick);
-    gwy_data_field_set_si_unit_xy(target, si_unit);
+        g_free(imn);
+        g_free(s);
+    }
 
-    si_unit = gwy_brick_get_si_unit_w((GwyBrick *)brick);
-    gwy_data_field_set_si_unit_z(target, si_unit);
+    for (i = 0; i < G_N_ELEMENTS(fields); i++) {
+        if (fields[i])
+            gwy_data_field_invalidate(fields[i]);
+    }
 }
 
 /**
@@ -3004,6 +3657,7 @@ gwy_brick_extract_line(const GwyBrick *brick, GwyDataLine *target,
 {
     gint col, row, lev;
     gdouble *bdata, *ddata;
+    const gdouble *zdata;
     GwySIUnit *si_unit;
 
     g_return_if_fail(GWY_IS_BRICK(brick));
@@ -3035,7 +3689,7 @@ gwy_brick_extract_line(const GwyBrick *brick, GwyDataLine *target,
         else
             for (col = 0; col < (istart - iend); col++) {
                 ddata[col] =
-                    bdata[iend - col - 1 + brick->xres * (row) +
+                    bdata[istart - col - 1 + brick->xres * (row) +
                           brick->xres * brick->yres * (lev)];
             }
         gwy_data_line_set_offset(target,
@@ -3084,7 +3738,17 @@ gwy_brick_extract_line(const GwyBrick *brick, GwyDataLine *target,
 
         col = istart;
         row = jstart;
-        if (kend >= kstart)
+        zdata = ((GwyBrickPrivate*)brick->priv)->zmajor.data;
+        if (zdata) {
+            zdata += ((gsize)row*brick->xres + col)*brick->zres;
+            if (kend >= kstart)
+                memcpy(ddata, zdata + kstart, (kend - kstart)*sizeof(gdouble));
+            else {
+                for (lev = 0; lev < (kstart - kend); lev++)
+                    ddata[lev] = zdata[kstart - lev - 1];
+            }
+        }
+        else if (kend >= kstart)
             for (lev = 0; lev < (kend - kstart); lev++) {
                 ddata[lev] =
                     bdata[col + brick->xres * (row) +
@@ -3094,7 +3758,7 @@ gwy_brick_extract_line(const GwyBrick *brick, GwyDataLine *target,
             for (lev = 0; lev < (kstart - kend); lev++) {
                 ddata[lev] =
                     bdata[col + brick->xres * (row) +
-                          brick->xres * brick->yres * (kend - lev - 1)];
+                          brick->xres * brick->yres * (kstart - lev - 1)];
             }
         gwy_data_line_set_offset(target,
                                  MIN(kstart,
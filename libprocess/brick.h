@@ -104,7 +104,20 @@ GwyBrick* gwy_brick_new_part    (const GwyBrick *brick,
                                  gint yres,
                                  gint zres,
                                  gboolean keep_offsets);
+GwyBrick* gwy_brick_new_mapped  (gint xres,
+                                 gint yres,
+                                 gint zres,
+                                 gdouble xreal,
+                                 gdouble yreal,
+                                 gdouble zreal,
+                                 GError **error);
+gboolean  gwy_brick_is_mapped   (GwyBrick *brick);
+void      gwy_brick_set_scratch_threshold(gsize size);
+gsize     gwy_brick_get_scratch_threshold(void);
+void      gwy_brick_set_scratch_dir(const gchar *dirname);
+const gchar* gwy_brick_get_scratch_dir(void);
 void      gwy_brick_data_changed(GwyBrick *brick);
+void      gwy_brick_invalidate  (GwyBrick *brick);
 
 /*void            gwy_brick_set_size    (GwyBrick *brick,
                                        guint xres,
@@ -136,6 +149,7 @@ gdouble           gwy_brick_get_xoffset       (GwyBrick *brick);
 gdouble           gwy_brick_get_yoffset       (GwyBrick *brick);
 gdouble           gwy_brick_get_zoffset       (GwyBrick *brick);
 const gdouble*    gwy_brick_get_data_const    (GwyBrick *brick);
+const gdouble*    gwy_brick_get_data_zmajor   (GwyBrick *brick);
 void              gwy_brick_set_xreal         (GwyBrick *brick,
                                                gdouble xreal);
 void              gwy_brick_set_yreal         (GwyBrick *brick,
@@ -298,6 +312,20 @@ void              gwy_brick_rms_plane         (const GwyBrick *brick,
                                                gint height,
                                                gint depth,
                                                gboolean keep_offsets);
+void              gwy_brick_stats_plane       (const GwyBrick *brick,
+                                               gint istart,
+                                               gint jstart,
+                                               gint kstart,
+                                               gint width,
+                                               gint height,
+                                               gint depth,
+                                               GwyDataField *sum,
+                                               GwyDataField *mean,
+                                               GwyDataField *rms,
+                                               GwyDataField *min,
+                                               GwyDataField *max,
+                                               GwyDataField *minpos,
+                                               GwyDataField *maxpos);
 void              gwy_brick_extract_line      (const GwyBrick *brick,
                                                GwyDataLine *target,
                                                gint istart,
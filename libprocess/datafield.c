@@ -35,6 +35,7 @@
 
 enum {
     DATA_CHANGED,
+    DATA_CHANGED_AREA,
     LAST_SIGNAL
 };
 
@@ -59,6 +60,16 @@ static void        set_cache_for_constant_field    (GwyDataField *data_field,
                                                     gdouble value);
 static gboolean    data_field_is_constant          (GwyDataField *dfield,
                                                     gdouble *z);
+static void        free_histogram                  (GwyDataField *data_field);
+static void        account_data                    (GwyDataField *data_field);
+static void        marshal_VOID__INT_INT_INT_INT   (GClosure *closure,
+                                                    GValue *return_value,
+                                                    guint n_param_values,
+                                                    const GValue *param_values,
+                                                    gpointer invocation_hint,
+                                                    gpointer marshal_data);
+static void        copy_histogram                  (GwyDataField *src,
+                                                    GwyDataField *dest);
 
 static guint data_field_signals[LAST_SIGNAL] = { 0 };
 
@@ -99,6 +110,68 @@ gwy_data_field_class_init(GwyDataFieldClass *klass)
                        NULL, NULL,
                        g_cclosure_marshal_VOID__VOID,
                        G_TYPE_NONE, 0);
+
+/**
+ * GwyDataField::data-changed-area:
+ * @gwydatafield: The #GwyDataField which received the signal.
+ * @arg1: Column of the upper left corner of the changed area.
+ * @arg2: Row of the upper left corner of the changed area.
+ * @arg3: Width of the changed area (number of columns).
+ * @arg4: Height of the changed area (number of rows).
+ *
+ * The ::data-changed-area signal is emitted by
+ * gwy_data_field_data_changed_area() just before ::data-changed to inform
+ * data field users which part of the data has actually changed.  Users
+ * which can update partially can connect to it; others can simply ignore it
+ * and react to the subsequent ::data-changed signal.
+ *
+ * Since: 2.47
+ */
+    data_field_signals[DATA_CHANGED_AREA]
+        = g_signal_new("data-changed-area",
+                       G_OBJECT_CLASS_TYPE(gobject_class),
+                       G_SIGNAL_RUN_FIRST,
+                       0,
+                       NULL, NULL,
+                       marshal_VOID__INT_INT_INT_INT,
+                       G_TYPE_NONE, 4,
+                       G_TYPE_INT, G_TYPE_INT, G_TYPE_INT, G_TYPE_INT);
+}
+
+/* We have no marshaller list in libprocess, the single one needed is simple
+ * enough to write by hand. */
+static void
+marshal_VOID__INT_INT_INT_INT(GClosure *closure,
+                              G_GNUC_UNUSED GValue *return_value,
+                              guint n_param_values,
+                              const GValue *param_values,
+                              G_GNUC_UNUSED gpointer invocation_hint,
+                              gpointer marshal_data)
+{
+    typedef void (*MarshalFunc)(gpointer data1,
+                                gint arg1, gint arg2, gint arg3, gint arg4,
+                                gpointer data2);
+    GCClosure *cc = (GCClosure*)closure;
+    MarshalFunc callback;
+    gpointer data1, data2;
+
+    g_return_if_fail(n_param_values == 5);
+
+    if (G_CCLOSURE_SWAP_DATA(closure)) {
+        data1 = closure->data;
+        data2 = g_value_peek_pointer(param_values + 0);
+    }
+    else {
+        data1 = g_value_peek_pointer(param_values + 0);
+        data2 = closure->data;
+    }
+    callback = (MarshalFunc)(marshal_data ? marshal_data : cc->callback);
+    callback(data1,
+             g_value_get_int(param_values + 1),
+             g_value_get_int(param_values + 2),
+             g_value_get_int(param_values + 3),
+             g_value_get_int(param_values + 4),
+             data2);
 }
 
 static void
@@ -115,6 +188,7 @@ gwy_data_field_finalize(GObject *object)
     GWY_OBJECT_UNREF(data_field->si_unit_xy);
     GWY_OBJECT_UNREF(data_field->si_unit_z);
     g_free(data_field->data);
+    free_histogram(data_field);
 
     G_OBJECT_CLASS(gwy_data_field_parent_class)->finalize(object);
 }
@@ -155,6 +229,7 @@ gwy_data_field_new(gint xres, gint yres,
     }
     else
         data_field->data = g_new(gdouble, data_field->xres*data_field->yres);
+    account_data(data_field);
 
     return data_field;
 }
@@ -197,6 +272,7 @@ gwy_data_field_new_alike(GwyDataField *model,
     }
     else
         data_field->data = g_new(gdouble, data_field->xres*data_field->yres);
+    account_data(data_field);
 
     if (model->si_unit_xy)
         data_field->si_unit_xy = gwy_si_unit_duplicate(model->si_unit_xy);
@@ -398,6 +474,7 @@ gwy_data_field_deserialize(const guchar *buffer,
     data_field->yres = yres;
     data_field->xoff = xoff;
     data_field->yoff = yoff;
+    account_data(data_field);
     if (si_unit_z) {
         GWY_OBJECT_UNREF(data_field->si_unit_z);
         data_field->si_unit_z = si_unit_z;
@@ -422,6 +499,7 @@ gwy_data_field_duplicate_real(GObject *object)
                data_field->xres*data_field->yres);
     duplicate->cached = data_field->cached;
     gwy_assign(duplicate->cache, data_field->cache, GWY_DATA_FIELD_CACHE_SIZE);
+    copy_histogram(data_field, duplicate);
 
     return (GObject*)duplicate;
 }
@@ -443,6 +521,7 @@ gwy_data_field_clone_real(GObject *source, GObject *copy)
         clone->data = g_renew(gdouble, clone->data, n);
     clone->xres = data_field->xres;
     clone->yres = data_field->yres;
+    account_data(clone);
 
     gwy_data_field_copy(data_field, clone, TRUE);
     clone->xoff = data_field->xoff;
@@ -462,6 +541,39 @@ gwy_data_field_data_changed(GwyDataField *data_field)
     g_signal_emit(data_field, data_field_signals[DATA_CHANGED], 0);
 }
 
+/**
+ * gwy_data_field_data_changed_area:
+ * @data_field: A data field.
+ * @col: Upper-left column coordinate.
+ * @row: Upper-left row coordinate.
+ * @width: Area width (number of columns).
+ * @height: Area height (number of rows).
+ *
+ * Emits signals "data-changed-area" and "data-changed" on a data field.
+ *
+ * This function should be used instead of gwy_data_field_data_changed()
+ * when it is known that only a small rectangular part of the data has
+ * changed, for instance during interactive editing.  It permits displays to
+ * redraw only the affected part.
+ *
+ * Since: 2.47
+ **/
+void
+gwy_data_field_data_changed_area(GwyDataField *data_field,
+                                 gint col, gint row,
+                                 gint width, gint height)
+{
+    g_return_if_fail(GWY_IS_DATA_FIELD(data_field));
+    g_return_if_fail(col >= 0 && row >= 0
+                     && width >= 0 && height >= 0
+                     && col + width <= data_field->xres
+                     && row + height <= data_field->yres);
+
+    g_signal_emit(data_field, data_field_signals[DATA_CHANGED_AREA], 0,
+                  col, row, width, height);
+    g_signal_emit(data_field, data_field_signals[DATA_CHANGED], 0);
+}
+
 /**
  * gwy_data_field_copy:
  * @src: Source data field.
@@ -487,6 +599,7 @@ gwy_data_field_copy(GwyDataField *src,
 
     dest->cached = src->cached;
     gwy_assign(dest->cache, src->cache, GWY_DATA_FIELD_CACHE_SIZE);
+    copy_histogram(src, dest);
 
     if (!nondata_too)
         return;
@@ -615,6 +728,7 @@ gwy_data_field_resample(GwyDataField *data_field,
         data_field->yres = yres;
         data_field->data = g_renew(gdouble, data_field->data,
                                    data_field->xres*data_field->yres);
+        account_data(data_field);
         return;
     }
 
@@ -625,6 +739,7 @@ gwy_data_field_resample(GwyDataField *data_field,
         data_field->yres = yres;
         data_field->data = g_renew(gdouble, data_field->data,
                                    data_field->xres*data_field->yres);
+        account_data(data_field);
         gwy_data_field_fill(data_field, z);
         return;
     }
@@ -639,6 +754,7 @@ gwy_data_field_resample(GwyDataField *data_field,
     data_field->data = bdata;
     data_field->xres = xres;
     data_field->yres = yres;
+    account_data(data_field);
 }
 
 static gboolean
@@ -1977,6 +2093,53 @@ set_cache_for_constant_field(GwyDataField *data_field, gdouble value)
     CVAL(data_field, VAR) = 0.0;
 }
 
+static void
+free_histogram(GwyDataField *data_field)
+{
+    GwyFieldHistogram *hist = (GwyFieldHistogram*)data_field->reserved1;
+
+    if (!hist)
+        return;
+
+    g_free(hist->bins);
+    g_free(hist);
+    data_field->reserved1 = NULL;
+    data_field->cached &= ~CBIT(HST);
+}
+
+static void
+account_data(GwyDataField *data_field)
+{
+    gwy_debug_objects_set_size(G_OBJECT(data_field),
+                               (gsize)data_field->xres*data_field->yres
+                               *sizeof(gdouble));
+}
+
+/* Must be called after copying the cached bits from @src to @dest. */
+static void
+copy_histogram(GwyDataField *src, GwyDataField *dest)
+{
+    GwyFieldHistogram *shist = (GwyFieldHistogram*)src->reserved1,
+                      *dhist = (GwyFieldHistogram*)dest->reserved1;
+
+    if (!CTEST(src, HST) || !shist) {
+        dest->cached &= ~CBIT(HST);
+        return;
+    }
+
+    if (!dhist) {
+        dhist = g_new0(GwyFieldHistogram, 1);
+        dest->reserved1 = dhist;
+    }
+    if (dhist->nbins != shist->nbins) {
+        dhist->bins = g_renew(guint, dhist->bins, shist->nbins);
+        dhist->nbins = shist->nbins;
+    }
+    gwy_assign(dhist->bins, shist->bins, shist->nbins);
+    dhist->min = shist->min;
+    dhist->max = shist->max;
+}
+
 /**
  * gwy_data_field_area_fill:
  * @data_field: A data field.
@@ -90,6 +90,11 @@ GwyDataField*     gwy_data_field_new                 (gint xres,
 GwyDataField*     gwy_data_field_new_alike           (GwyDataField *model,
                                                       gboolean nullme);
 void              gwy_data_field_data_changed        (GwyDataField *data_field);
+void              gwy_data_field_data_changed_area   (GwyDataField *data_field,
+                                                      gint col,
+                                                      gint row,
+                                                      gint width,
+                                                      gint height);
 GwyDataField*  gwy_data_field_new_resampled(GwyDataField *data_field,
                                             gint xres, gint yres,
                                             GwyInterpolationType interpolation);
@@ -48,6 +48,7 @@ static GObject*    gwy_data_line_deserialize      (const guchar *buffer,
 static GObject*    gwy_data_line_duplicate_real   (GObject *object);
 static void        gwy_data_line_clone_real       (GObject *source,
                                                    GObject *copy);
+static void        account_data                   (GwyDataLine *data_line);
 
 static guint data_line_signals[LAST_SIGNAL] = { 0 };
 
@@ -133,6 +134,7 @@ gwy_data_line_new(gint res, gdouble real, gboolean nullme)
         data_line->data = g_new0(gdouble, data_line->res);
     else
         data_line->data = g_new(gdouble, data_line->res);
+    account_data(data_line);
 
     return data_line;
 }
@@ -166,6 +168,7 @@ gwy_data_line_new_alike(GwyDataLine *model,
         data_line->data = g_new0(gdouble, data_line->res);
     else
         data_line->data = g_new(gdouble, data_line->res);
+    account_data(data_line);
 
     if (model->si_unit_x)
         data_line->si_unit_x = gwy_si_unit_duplicate(model->si_unit_x);
@@ -322,6 +325,7 @@ gwy_data_line_deserialize(const guchar *buffer,
     data_line->res = res;
     data_line->off = off;
     data_line->data = data;
+    account_data(data_line);
     if (si_unit_y) {
         GWY_OBJECT_UNREF(data_line->si_unit_y);
         data_line->si_unit_y = si_unit_y;
@@ -361,6 +365,7 @@ gwy_data_line_clone_real(GObject *source, GObject *copy)
     if (clone->res != data_line->res) {
         clone->res = data_line->res;
         clone->data = g_renew(gdouble, clone->data, clone->res);
+        account_data(clone);
     }
     clone->real = data_line->real;
     clone->off = data_line->off;
@@ -384,6 +389,13 @@ gwy_data_line_clone_real(GObject *source, GObject *copy)
         GWY_OBJECT_UNREF(clone->si_unit_y);
 }
 
+static void
+account_data(GwyDataLine *data_line)
+{
+    gwy_debug_objects_set_size(G_OBJECT(data_line),
+                               data_line->res*sizeof(gdouble));
+}
+
 /**
  * gwy_data_line_data_changed:
  * @data_line: A data line.
@@ -423,6 +435,7 @@ gwy_data_line_resample(GwyDataLine *data_line,
     if (interpolation == GWY_INTERPOLATION_NONE) {
         data_line->res = res;
         data_line->data = g_renew(gdouble, data_line->data, data_line->res);
+        account_data(data_line);
         return;
     }
 
@@ -433,6 +446,7 @@ gwy_data_line_resample(GwyDataLine *data_line,
     g_free(data_line->data);
     data_line->data = bdata;
     data_line->res = res;
+    account_data(data_line);
 }
 
 /**
@@ -457,7 +471,8 @@ gwy_data_line_resize(GwyDataLine *a, gint from, gint to)
     a->res = to - from;
     if (from > 0)
         memmove(a->data, a->data + from, a->res*sizeof(gdouble));
-    a->data = g_renew(gdouble, a->data, a->res*sizeof(gdouble));
+    a->data = g_renew(gdouble, a->data, a->res);
+    account_data(a);
 }
 
 /**
@@ -1373,8 +1388,8 @@ gwy_data_line_rotate(GwyDataLine *data_line,
     if (maxi != 0) {
         data_line->real *= maxi/((double)data_line->res);
         data_line->res = maxi;
-        data_line->data = g_renew(gdouble, data_line->data,
-                                  data_line->res*sizeof(gdouble));
+        data_line->data = g_renew(gdouble, data_line->data, data_line->res);
+        account_data(data_line);
     }
 
     if (data_line->res != res)
@@ -90,6 +90,7 @@ static gsize       gwy_caldata_get_size         (GObject *obj);
 static GObject*    gwy_caldata_deserialize      (const guchar *buffer,
                                                    gsize size,
                                                    gsize *position);
+static void        free_interpolation           (GwyCalData *caldata);
 
 /*static GObject*    gwy_caldata_duplicate_real   (GObject *object);
 static void        gwy_caldata_clone_real       (GObject *source,
@@ -133,12 +134,7 @@ gwy_caldata_finalize(GObject *object)
     GWY_OBJECT_UNREF(caldata->si_unit_y);
     GWY_OBJECT_UNREF(caldata->si_unit_z);
 
-    if (caldata->err_m)
-    _gwy_delaunay_mesh_free(caldata->err_m);
-    if (caldata->unc_m)
-    _gwy_delaunay_mesh_free(caldata->unc_m);
-    //_gwy_delaunay_vertex_free(caldata->err_m);
-    //_gwy_delaunay_vertex_free(caldata->unc_m);
+    free_interpolation(caldata);
 
     g_free(caldata->x);
     g_free(caldata->y);
@@ -658,6 +654,19 @@ gwy_caldata_set_si_unit_z(GwyCalData *caldata,
     caldata->si_unit_z = si_unit;
 }
 
+static void
+free_interpolation(GwyCalData *caldata)
+{
+    if (caldata->err_m)
+        _gwy_delaunay_mesh_free(caldata->err_m);
+    if (caldata->unc_m)
+        _gwy_delaunay_mesh_free(caldata->unc_m);
+    g_free(caldata->err_ps);
+    g_free(caldata->unc_ps);
+    caldata->err_m = caldata->unc_m = NULL;
+    caldata->err_ps = caldata->unc_ps = NULL;
+}
+
 /**
  * gwy_caldata_setup_interpolation:
  * @caldata: Calibration data.
@@ -670,6 +679,8 @@ gwy_caldata_set_si_unit_z(GwyCalData *caldata,
 void
 gwy_caldata_setup_interpolation (GwyCalData *caldata)
 {
+    free_interpolation(caldata);
+
     caldata->err_ps = _gwy_delaunay_vertex_new(caldata->x, caldata->y, caldata->z,
                                  caldata->xerr, caldata->yerr, caldata->zerr, caldata->ndata);
     caldata->unc_ps = _gwy_delaunay_vertex_new(caldata->x, caldata->y, caldata->z,
@@ -713,6 +724,74 @@ gwy_caldata_interpolate(GwyCalData *caldata,
        _gwy_delaunay_mesh_interpolate3_3(caldata->unc_m, x, y, z, xunc, yunc, zunc);
 }
 
+/**
+ * gwy_caldata_interpolate_batch:
+ * @caldata: Calibration data.
+ * @x: Array of @n x coordinates of requested positions.
+ * @y: Array of @n y coordinates of requested positions.
+ * @z: Array of @n z coordinates of requested positions.
+ * @n: Number of positions.
+ * @xerr: Array of @n items to store x errors to, or %NULL.
+ * @yerr: Array of @n items to store y errors to, or %NULL.
+ * @zerr: Array of @n items to store z errors to, or %NULL.
+ * @xunc: Array of @n items to store x uncertainties to, or %NULL.
+ * @yunc: Array of @n items to store y uncertainties to, or %NULL.
+ * @zunc: Array of @n items to store z uncertainties to, or %NULL.
+ * @set_fraction: Function that sets fraction to output (or %NULL).
+ *
+ * Determines (interpolates) caldata parameters for many positions at once.
+ *
+ * The result is the same as calling gwy_caldata_interpolate() for each
+ * position, but it is considerably faster for large numbers of positions
+ * as their spatial coherence is utilised and the work can be run in
+ * parallel.  Use it to evaluate calibration data for entire images, all in a
+ * single call.
+ *
+ * gwy_caldata_setup_interpolation() must be called first.
+ *
+ * Returns: %TRUE if the interpolation finished, %FALSE if it was cancelled
+ *          using @set_fraction.  The output arrays contents is undefined
+ *          when %FALSE is returned.
+ *
+ * Since: 2.47
+ **/
+gboolean
+gwy_caldata_interpolate_batch(GwyCalData *caldata,
+                              const gdouble *x,
+                              const gdouble *y,
+                              const gdouble *z,
+                              guint n,
+                              gdouble *xerr, gdouble *yerr, gdouble *zerr,
+                              gdouble *xunc, gdouble *yunc, gdouble *zunc,
+                              GwySetFractionFunc set_fraction)
+{
+    gboolean do_err = (xerr || yerr || zerr), do_unc = (xunc || yunc || zunc);
+    gdouble fmid = (do_err && do_unc) ? 0.5 : (do_err ? 1.0 : 0.0);
+    gboolean ok = TRUE;
+    guint *order;
+
+    g_return_val_if_fail(GWY_IS_CALDATA(caldata), FALSE);
+    g_return_val_if_fail(caldata->err_m && caldata->unc_m, FALSE);
+    if (!n)
+        return TRUE;
+    g_return_val_if_fail(x && y && z, FALSE);
+
+    order = _gwy_delaunay_sort_queries(x, y, z, n);
+    if (do_err)
+        ok = _gwy_delaunay_mesh_interpolate3_3_batch(caldata->err_m,
+                                                     x, y, z, order, n,
+                                                     xerr, yerr, zerr,
+                                                     set_fraction, 0.0, fmid);
+    if (ok && do_unc)
+        ok = _gwy_delaunay_mesh_interpolate3_3_batch(caldata->unc_m,
+                                                     x, y, z, order, n,
+                                                     xunc, yunc, zunc,
+                                                     set_fraction, fmid, 1.0);
+    g_free(order);
+
+    return ok;
+}
+
 /**
  * gwy_caldata_get_xerr:
  * @caldata: Calibration data.
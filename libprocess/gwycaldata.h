@@ -22,6 +22,7 @@
 #ifndef __GWY_CALDATA_H__
 #define __GWY_CALDATA_H__
 
+#include <libgwyddion/gwyutils.h>
 #include <libgwyddion/gwysiunit.h>
 #include <libprocess/gwyprocessenums.h>
 
@@ -105,6 +106,18 @@ void        gwy_caldata_interpolate        (GwyCalData *caldata,
                                             gdouble *xunc,
                                             gdouble *yunc,
                                             gdouble *zunc);
+gboolean    gwy_caldata_interpolate_batch  (GwyCalData *caldata,
+                                            const gdouble *x,
+                                            const gdouble *y,
+                                            const gdouble *z,
+                                            guint n,
+                                            gdouble *xerr,
+                                            gdouble *yerr,
+                                            gdouble *zerr,
+                                            gdouble *xunc,
+                                            gdouble *yunc,
+                                            gdouble *zunc,
+                                            GwySetFractionFunc set_fraction);
 
 void        gwy_caldata_save_data          (GwyCalData *caldata,
                                             gchar *filename);
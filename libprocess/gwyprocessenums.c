@@ -494,6 +494,9 @@ gwy_masking_type_get_enum(void)
  * @GWY_DATA_FIELD_CACHE_ARE: Surface area.
  * @GWY_DATA_FIELD_CACHE_VAR: Variation.
  * @GWY_DATA_FIELD_CACHE_ENT: Entropy.
+ * @GWY_DATA_FIELD_CACHE_HST: Value histogram.  The histogram itself is not
+ *                            stored in the cache array, only its validity
+ *                            is tracked by the corresponding bit (Since 2.47).
  * @GWY_DATA_FIELD_CACHE_SIZE: The size of statistics cache.
  *
  * Cached data field quantity type.
@@ -86,6 +86,7 @@ typedef enum {
     GWY_DATA_FIELD_CACHE_ARE,
     GWY_DATA_FIELD_CACHE_VAR,
     GWY_DATA_FIELD_CACHE_ENT,
+    GWY_DATA_FIELD_CACHE_HST,
     GWY_DATA_FIELD_CACHE_SIZE = 30
 } GwyDataFieldCached;
 
@@ -37,6 +37,14 @@ G_BEGIN_DECLS
 #define CBIT(b)             (1 << GWY_DATA_FIELD_CACHE_##b)
 #define CTEST(datafield, b) ((datafield)->cached & CBIT(b))
 
+/* Value histogram kept in GwyDataField's reserved1, valid when CTEST(HST). */
+typedef struct {
+    gdouble min;
+    gdouble max;
+    guint nbins;
+    guint *bins;
+} GwyFieldHistogram;
+
 typedef struct {
     guint col;
     guint row;
@@ -66,12 +74,46 @@ void _gwy_calibration_class_setup_presets(void);
 G_GNUC_INTERNAL
 void _gwy_shape_fit_preset_class_setup_presets(void);
 
+/* Spatial index of points in the plane, used by GwySurface and GwySpectra. */
+typedef struct _GwyXYIndex GwyXYIndex;
+
+G_GNUC_INTERNAL
+GwyXYIndex* _gwy_xy_index_new               (gconstpointer points,
+                                             gsize stride,
+                                             guint n);
+
+G_GNUC_INTERNAL
+void        _gwy_xy_index_free              (GwyXYIndex *xyindex);
+
+G_GNUC_INTERNAL
+guint       _gwy_xy_index_find_nearest      (const GwyXYIndex *xyindex,
+                                             gdouble x,
+                                             gdouble y,
+                                             guint n,
+                                             guint *ilist);
+
+G_GNUC_INTERNAL
+guint*      _gwy_xy_index_find_in_radius    (const GwyXYIndex *xyindex,
+                                             gdouble x,
+                                             gdouble y,
+                                             gdouble r,
+                                             guint *nfound);
+
+G_GNUC_INTERNAL
+guint*      _gwy_xy_index_find_in_rectangle (const GwyXYIndex *xyindex,
+                                             gdouble xfrom,
+                                             gdouble xto,
+                                             gdouble yfrom,
+                                             gdouble yto,
+                                             guint *nfound);
+
 struct _GwySurfacePrivate {
     GwySIUnit *si_unit_xy;
     GwySIUnit *si_unit_z;
     GwyXYZ min;
     GwyXYZ max;
     guchar checksum[16];
+    GwyXYIndex *xyindex;
     gboolean cached_ranges : 1;
     gboolean cached_checksum : 1;
 };
@@ -31,6 +31,7 @@
 #include <libprocess/peaks.h>
 #include <libprocess/gwyshapefitpreset.h>
 #include "gwyprocessinternal.h"
+#include "libgwyddion/gwyomp.h"
 
 enum { NREDLIM = 4096 };
 
@@ -48,14 +49,18 @@ enum { NREDLIM = 4096 };
     static gdouble name##_func(gdouble x, \
                                gdouble y, \
                                const gdouble *param); \
-    static gdouble name##_fitfunc(guint i, \
-                                  const gdouble *param, \
-                                  gpointer user_data, \
-                                  gboolean *fres) \
+    static void name##_fitfunc(guint from, \
+                               guint n, \
+                               const gdouble *param, \
+                               gpointer user_data, \
+                               gdouble *resid, \
+                               gboolean *fres) \
     { \
-        const GwyXYZ *xyz = ((const ShapeFitPreset*)user_data)->xyz; \
+        const GwyXYZ *xyz = ((const ShapeFitPreset*)user_data)->xyz + from; \
+        guint k; \
+        for (k = 0; k < n; k++) \
+            resid[k] = name##_func(xyz[k].x, xyz[k].y, param) - xyz[k].z; \
         *fres = TRUE; \
-        return name##_func(xyz[i].x, xyz[i].y, param) - xyz[i].z; \
     } \
     static gboolean name##_estimate(const GwyXYZ *xyz, \
                                     guint n, \
@@ -132,7 +137,7 @@ typedef struct {
     const gchar *name;
     gboolean needs_same_units;
     FitShapeXYFunc function;
-    GwyNLFitIdxFunc fit_function;
+    GwyNLFitIdxVecFunc fit_function;
     FitShapeEstimate estimate;
     FitShapeEstimate initialise;
     guint nparams;
@@ -901,8 +906,8 @@ gwy_shape_fit_preset_calculate_xyz(GwyShapeFitPreset *preset,
  *
  * Creates a non-linear least-squares fitter for a 3D geometrical shape.
  *
- * The created fitter will be of the opaque indexed data type, as created with
- * gwy_math_nlfit_new_idx().
+ * The created fitter will be of the opaque indexed data type evaluated on
+ * blocks of data, as created with gwy_math_nlfit_new_idx_vec().
  *
  * If you do not need to modify the fitter settings you can use
  * gwy_shape_fit_preset_fit() directly with %NULL fitter.
@@ -918,7 +923,7 @@ gwy_shape_fit_preset_create_fitter(GwyShapeFitPreset *preset)
 
     g_return_val_if_fail(GWY_IS_SHAPE_FIT_PRESET(preset), NULL);
     builtin = preset->priv->builtin;
-    return gwy_math_nlfit_new_idx(builtin->fit_function, NULL);
+    return gwy_math_nlfit_new_idx_vec(builtin->fit_function);
 }
 
 /**
@@ -1085,8 +1090,17 @@ gwy_coshm1(gdouble x)
     return x2*(0.5 + x2/24.0);
 }
 
+/* The caches must be per-thread because the functions are evaluated in
+ * parallel during fitting.  Use without semicolon. */
+#ifdef _OPENMP
+#define OMP_PRAGMA(x) _Pragma(#x)
 #define DEFINE_PHI_CACHE(phi) \
-    static gdouble phi##_last = 0.0, cphi_last = 1.0, sphi_last = 0.0
+    static gdouble phi##_last = 0.0, cphi_last = 1.0, sphi_last = 0.0; \
+    OMP_PRAGMA(omp threadprivate(phi##_last, cphi_last, sphi_last))
+#else
+#define DEFINE_PHI_CACHE(phi) \
+    static gdouble phi##_last = 0.0, cphi_last = 1.0, sphi_last = 0.0;
+#endif
 
 #define HANDLE_PHI_CACHE(phi) \
     do { \
@@ -1885,7 +1899,7 @@ sphere_calc_err_R(const gdouble *param,
 static gdouble
 cylinder_func(gdouble x, gdouble y, const gdouble *param)
 {
-    DEFINE_PHI_CACHE(phi);
+    DEFINE_PHI_CACHE(phi)
 
     gdouble x0 = param[0];
     gdouble z0 = param[1];
@@ -2019,7 +2033,10 @@ static gdouble
 grating_func(gdouble x, gdouble y, const gdouble *param)
 {
     static gdouble c_last = 0.0, coshm1_c_last = 1.0;
-    DEFINE_PHI_CACHE(phi);
+#ifdef _OPENMP
+#pragma omp threadprivate(c_last, coshm1_c_last)
+#endif
+    DEFINE_PHI_CACHE(phi)
 
     gdouble L = fabs(param[0]);
     gdouble h = param[1];
@@ -2106,7 +2123,7 @@ grating_estimate(const GwyXYZ *xyz, guint n, gdouble *param,
 static gdouble
 grating3_func(gdouble x, gdouble y, const gdouble *param)
 {
-    DEFINE_PHI_CACHE(phi);
+    DEFINE_PHI_CACHE(phi)
 
     gdouble L = fabs(param[0]);
     gdouble h1 = fabs(param[1]);
@@ -2387,7 +2404,7 @@ hole_shape(gdouble x, gdouble y, gdouble size, gdouble slope, gdouble roundness)
 static gdouble
 holes_func(gdouble x, gdouble y, const gdouble *param)
 {
-    DEFINE_PHI_CACHE(phi);
+    DEFINE_PHI_CACHE(phi)
 
     gdouble xc = param[0];
     gdouble yc = param[1];
@@ -2576,6 +2593,9 @@ static gdouble
 pring_func(gdouble x, gdouble y, const gdouble *param)
 {
     static gdouble s_h_last = 0.0, rinner_last = 1.0, router_last = 1.0;
+#ifdef _OPENMP
+#pragma omp threadprivate(s_h_last, rinner_last, router_last)
+#endif
 
     gdouble xc = param[0];
     gdouble yc = param[1];
@@ -2760,7 +2780,7 @@ pring_estimate(const GwyXYZ *xyz, guint n, gdouble *param,
 static gdouble
 gaussian_func(gdouble x, gdouble y, const gdouble *param)
 {
-    DEFINE_PHI_CACHE(phi);
+    DEFINE_PHI_CACHE(phi)
 
     gdouble xc = param[0];
     gdouble yc = param[1];
@@ -2867,7 +2887,7 @@ gaussian_calc_err_sigma2(const gdouble *param,
 static gdouble
 lorentzian_func(gdouble x, gdouble y, const gdouble *param)
 {
-    DEFINE_PHI_CACHE(phi);
+    DEFINE_PHI_CACHE(phi)
 
     gdouble xc = param[0];
     gdouble yc = param[1];
@@ -2974,7 +2994,7 @@ lorentzian_calc_err_b2(const gdouble *param,
 static gdouble
 pyramidx_func(gdouble x, gdouble y, const gdouble *param)
 {
-    DEFINE_PHI_CACHE(phi);
+    DEFINE_PHI_CACHE(phi)
 
     gdouble xc = param[0];
     gdouble yc = param[1];
@@ -3058,7 +3078,7 @@ pyramidx_estimate(const GwyXYZ *xyz, guint n, gdouble *param,
 static gdouble
 parbump_func(gdouble x, gdouble y, const gdouble *param)
 {
-    DEFINE_PHI_CACHE(phi);
+    DEFINE_PHI_CACHE(phi)
 
     gdouble xc = param[0];
     gdouble yc = param[1];
@@ -30,8 +30,12 @@
 #include <stdlib.h>
 #include <math.h>
 #include <libgwyddion/gwymacros.h>
+#include "libgwyddion/gwyomp.h"
 #include "morph_lib.h"
 
+/* Number of progress reporting steps in row-parallelised operations. */
+enum { MORPH_NBATCHES = 32 };
+
 
 /*static members forward declaration*/
 static gint
@@ -40,6 +44,12 @@ itip_estimate_iter(gint **image, gint im_xsiz, gint im_ysiz, gint tip_xsiz,
                    gboolean use_edges, GwySetFractionFunc set_fraction,
                    GwySetMessageFunc set_message);
 
+static gint
+itip_estimate_points(const gint *x, const gint *y, gint n, gint **image,
+                     gint im_xsiz, gint im_ysiz, gint tip_xsiz, gint tip_ysiz,
+                     gint xc, gint yc, gint **tip0, gint thresh,
+                     gboolean use_edges, GwySetFractionFunc set_fraction);
+
 static gboolean
 useit(gint x, gint y, gint **image, gint sx, gint sy, gint delta);
 
@@ -158,10 +168,7 @@ _gwy_morph_lib_idilation(gint **surface, gint surf_xsiz, gint surf_ysiz,
                          GwySetMessageFunc set_message)
 {
     gint **result;
-    gint i, j, px, py;          /* index */
-    gint max;
-    gint pxmin, pxmax, pymin, pymax;    /* range of indices into tip */
-    gint temp;
+    gint batch, bfrom, bto, nrows;
 
     /* create output array of appropriate size */
     result = _gwy_morph_lib_iallocmatrix(surf_ysiz, surf_xsiz);
@@ -169,26 +176,52 @@ _gwy_morph_lib_idilation(gint **surface, gint surf_xsiz, gint surf_ysiz,
         set_message(_("Dilation..."));
     if (set_fraction)
         set_fraction(0.0);
-    for (j = 0; j < surf_ysiz; j++) { /* Loop over all points in output array */
-        /* Compute allowed range of py. This may be different from
-           the full range of the tip due to edge overlaps. */
-        pymin = MAX(j - surf_ysiz + 1, -yc);
-        pymax = MIN(tip_ysiz - yc - 1, j);
-        for (i = 0; i < surf_xsiz; i++) {
-            /* Compute allowed range of px. This may be different from
-               the full range of the tip due to edge overlaps. */
-            pxmin = MAX(i - surf_xsiz + 1, -xc);
-            pxmax = MIN(tip_xsiz - xc - 1, i);
-            max = surface[j - pymin][i - pxmin] + tip[pymin + yc][pxmin + xc];
-            for (px = pxmin; px <= pxmax; px++) { /* Loop over points in tip */
-                for (py = pymin; py <= pymax; py++) {
-                    temp = surface[j - py][i - px] + tip[py + yc][px + xc];
-                    max = MAX(temp, max);
+
+    /* Rows are independent, process them in parallel in batches to be able
+     * to report progress. */
+    batch = MAX((surf_ysiz + MORPH_NBATCHES-1)/MORPH_NBATCHES, 1);
+    for (bfrom = 0; bfrom < surf_ysiz; bfrom = bto) {
+        bto = MIN(bfrom + batch, surf_ysiz);
+        nrows = bto - bfrom;
+#ifdef _OPENMP
+#pragma omp parallel \
+            if(gwy_omp_use_threads((gsize)nrows*surf_xsiz*tip_xsiz*tip_ysiz)) \
+            default(none) \
+            shared(surface,tip,result,surf_xsiz,surf_ysiz,tip_xsiz,tip_ysiz) \
+            shared(xc,yc,nrows,bfrom)
+#endif
+        {
+            gint jfrom = bfrom + gwy_omp_chunk_start(nrows);
+            gint jto = bfrom + gwy_omp_chunk_end(nrows);
+            gint i, j, px, py;          /* index */
+            gint max;
+            gint pxmin, pxmax, pymin, pymax;    /* range of indices into tip */
+            gint temp;
+
+            for (j = jfrom; j < jto; j++) {
+                /* Compute allowed range of py. This may be different from
+                   the full range of the tip due to edge overlaps. */
+                pymin = MAX(j - surf_ysiz + 1, -yc);
+                pymax = MIN(tip_ysiz - yc - 1, j);
+                for (i = 0; i < surf_xsiz; i++) {
+                    /* Compute allowed range of px. This may be different from
+                       the full range of the tip due to edge overlaps. */
+                    pxmin = MAX(i - surf_xsiz + 1, -xc);
+                    pxmax = MIN(tip_xsiz - xc - 1, i);
+                    max = surface[j - pymin][i - pxmin]
+                          + tip[pymin + yc][pxmin + xc];
+                    for (px = pxmin; px <= pxmax; px++) {
+                        for (py = pymin; py <= pymax; py++) {
+                            temp = surface[j - py][i - px]
+                                   + tip[py + yc][px + xc];
+                            max = MAX(temp, max);
+                        }
+                    }
+                    result[j][i] = max;
                 }
             }
-            result[j][i] = max;
         }
-        if (set_fraction && !set_fraction((gdouble)j/surf_ysiz)) {
+        if (set_fraction && !set_fraction((gdouble)bto/surf_ysiz)) {
             _gwy_morph_lib_ifreematrix(result);
             return NULL;
         }
@@ -224,10 +257,7 @@ _gwy_morph_lib_ierosion(gint **image, gint im_xsiz, gint im_ysiz,
                         GwySetMessageFunc set_message)
 {
     gint **result;
-    gint i, j, px, py;          /* index */
-    gint min;
-    gint pxmin, pxmax, pymin, pymax;    /* range of indices into tip */
-    gint temp;
+    gint batch, bfrom, bto, nrows;
 
     /* create output array of appropriate size */
     result = _gwy_morph_lib_iallocmatrix(im_ysiz, im_xsiz);
@@ -236,27 +266,50 @@ _gwy_morph_lib_ierosion(gint **image, gint im_xsiz, gint im_ysiz,
     if (set_fraction)
         set_fraction(0.0);
 
-    for (j = 0; j < im_ysiz; j++) {   /* Loop over all points in output array */
-        /* Compute allowed range of py. This may be different from
-           the full range of the tip due to edge overlaps. */
-        pymin = MAX(-j, -yc);
-        pymax = MIN(tip_ysiz - yc, im_ysiz - j) - 1;
-        for (i = 0; i < im_xsiz; i++) {
-            /* Compute allowed range of px. This may be different from
-               the full range of the tip due to edge overlaps. */
-            pxmin = MAX(-xc, -i);
-            pxmax = MIN(tip_xsiz - xc, im_xsiz - i) - 1;
-            min = image[j + pymin][i + pxmin] - tip[pymin + yc][pxmin + xc];
-            for (py = pymin; py <= pymax; py++) { /* Loop over points in tip */
-                for (px = pxmin; px <= pxmax; px++) {
-                    temp = image[j + py][i + px] - tip[py + yc][px + xc];
-                    if (min > temp)
-                        min = temp;
+    batch = MAX((im_ysiz + MORPH_NBATCHES-1)/MORPH_NBATCHES, 1);
+    for (bfrom = 0; bfrom < im_ysiz; bfrom = bto) {
+        bto = MIN(bfrom + batch, im_ysiz);
+        nrows = bto - bfrom;
+#ifdef _OPENMP
+#pragma omp parallel \
+            if(gwy_omp_use_threads((gsize)nrows*im_xsiz*tip_xsiz*tip_ysiz)) \
+            default(none) \
+            shared(image,tip,result,im_xsiz,im_ysiz,tip_xsiz,tip_ysiz) \
+            shared(xc,yc,nrows,bfrom)
+#endif
+        {
+            gint jfrom = bfrom + gwy_omp_chunk_start(nrows);
+            gint jto = bfrom + gwy_omp_chunk_end(nrows);
+            gint i, j, px, py;          /* index */
+            gint min;
+            gint pxmin, pxmax, pymin, pymax;    /* range of indices into tip */
+            gint temp;
+
+            for (j = jfrom; j < jto; j++) {
+                /* Compute allowed range of py. This may be different from
+                   the full range of the tip due to edge overlaps. */
+                pymin = MAX(-j, -yc);
+                pymax = MIN(tip_ysiz - yc, im_ysiz - j) - 1;
+                for (i = 0; i < im_xsiz; i++) {
+                    /* Compute allowed range of px. This may be different from
+                       the full range of the tip due to edge overlaps. */
+                    pxmin = MAX(-xc, -i);
+                    pxmax = MIN(tip_xsiz - xc, im_xsiz - i) - 1;
+                    min = image[j + pymin][i + pxmin]
+                          - tip[pymin + yc][pxmin + xc];
+                    for (py = pymin; py <= pymax; py++) {
+                        for (px = pxmin; px <= pxmax; px++) {
+                            temp = image[j + py][i + px]
+                                   - tip[py + yc][px + xc];
+                            if (min > temp)
+                                min = temp;
+                        }
+                    }
+                    result[j][i] = min;
                 }
             }
-            result[j][i] = min;
         }
-        if (set_fraction && !set_fraction((gdouble)j/im_ysiz)) {
+        if (set_fraction && !set_fraction((gdouble)bto/im_ysiz)) {
             _gwy_morph_lib_ifreematrix(result);
             return NULL;
         }
@@ -380,6 +433,8 @@ iopen(gint **image, gint im_xsiz, gint im_ysiz, gint **tip,
  * @tip0: Tip data to be refined.
  * @thresh: Threshold.
  * @use_edges: Whether to use also image edges.
+ * @maxiter: Maximum number of iterations, zero means no limit.
+ * @stats: Location to store iteration statistics to (or %NULL).
  * @set_fraction: Function to output computation fraction (or %NULL).
  * @set_message: Functon to output computation state message (or %NULL).
  *
@@ -392,6 +447,7 @@ _gwy_morph_lib_itip_estimate(gint **image, gint im_xsiz, gint im_ysiz,
                              gint tip_xsiz, gint tip_ysiz, gint xc,
                              gint yc, gint **tip0,
                              gint thresh, gboolean use_edges,
+                             gint maxiter, GwyTipEstimateStats *stats,
                              GwySetFractionFunc set_fraction,
                              GwySetMessageFunc set_message)
 {
@@ -400,8 +456,11 @@ _gwy_morph_lib_itip_estimate(gint **image, gint im_xsiz, gint im_ysiz,
     gint sumcount = 0;
     GString *str;
 
+    if (stats)
+        gwy_clear(stats, 1);
+
     str = g_string_new("");
-    while (count) {
+    while (count && (maxiter <= 0 || iter < maxiter)) {
         iter++;
         g_string_printf(str, _("Iterating estimate (iteration %d)..."), iter);
         if (set_message && !set_message(str->str))
@@ -419,7 +478,14 @@ _gwy_morph_lib_itip_estimate(gint **image, gint im_xsiz, gint im_ysiz,
         if (set_message && !set_message(str->str))
             return -1;
         sumcount += count;
+        if (stats) {
+            stats->niter = iter;
+            stats->count = sumcount;
+            stats->last_count = count;
+            stats->converged = !count;
+        }
     }
+    g_string_free(str, TRUE);
 
     return sumcount;
 }
@@ -433,35 +499,116 @@ itip_estimate_iter(gint **image, gint im_xsiz, gint im_ysiz, gint tip_xsiz,
 {
     gint ixp, jxp;           /* index into the image (x') */
     gint **open;
-    gdouble total = (im_ysiz - tip_ysiz)*(im_xsiz - tip_xsiz);
-    guint k = 0;
-    gint count = 0;          /* counts places where tip estimate is improved */
+    gint *x, *y;
+    gint n, count, arraysize;
 
     open = iopen(image, im_xsiz, im_ysiz, tip0, tip_xsiz, tip_ysiz);
     if (!open)
         return -1;
 
+    /* Only points where the image differs from its opening can refine the
+     * tip.  Gather them first so that they can be processed in parallel. */
+    n = 0;
+    arraysize = 300;
+    x = g_new(gint, arraysize);
+    y = g_new(gint, arraysize);
     for (jxp = tip_ysiz - 1 - yc; jxp <= im_ysiz - 1 - yc; jxp++) {
         for (ixp = tip_xsiz - 1 - xc; ixp <= im_xsiz - 1 - xc; ixp++) {
             if (image[jxp][ixp] - open[jxp][ixp] > thresh) {
-                if (itip_estimate_point(ixp, jxp, image,
-                                        im_xsiz, im_ysiz, tip_xsiz, tip_ysiz,
-                                        xc, yc, tip0, thresh, use_edges)) {
-                    count++;
+                if (n == arraysize) {
+                    arraysize *= 2;
+                    x = g_renew(gint, x, arraysize);
+                    y = g_renew(gint, y, arraysize);
                 }
+                x[n] = ixp;
+                y[n] = jxp;
+                n++;
+            }
+        }
+    }
+    _gwy_morph_lib_ifreematrix(open);
+
+    count = itip_estimate_points(x, y, n, image, im_xsiz, im_ysiz,
+                                 tip_xsiz, tip_ysiz, xc, yc, tip0, thresh,
+                                 use_edges, set_fraction);
+    g_free(x);
+    g_free(y);
+
+    return count;
+}
+
+/*
+   Refines the tip using a list of image points.  The points are processed
+   in batches.  Within a batch, each thread refines its own copy of the tip
+   using its share of points and the copies are then merged by taking the
+   minimum.  Since each refinement can only lower the tip and a refinement
+   of an upper bound of the tip is again an upper bound, the merged tip is
+   also a valid estimate.  The order in which the points see the refinements
+   differs from the sequential algorithm, so the iteration can converge to
+   a slightly different tip when threshold is non-zero.  With a single
+   thread this is exactly the sequential algorithm.
+*/
+static gint
+itip_estimate_points(const gint *x, const gint *y, gint n, gint **image,
+                     gint im_xsiz, gint im_ysiz, gint tip_xsiz, gint tip_ysiz,
+                     gint xc, gint yc, gint **tip0, gint thresh,
+                     gboolean use_edges, GwySetFractionFunc set_fraction)
+{
+    gint nthreads = gwy_omp_max_threads();
+    gint batch, bfrom, bto, nb, count = 0;
+
+    batch = (nthreads > 1) ? 4*nthreads : 1;
+    for (bfrom = 0; bfrom < n; bfrom = bto) {
+        gint bcount = 0;
+
+        bto = MIN(bfrom + batch, n);
+        nb = bto - bfrom;
+#ifdef _OPENMP
+#pragma omp parallel \
+            if(gwy_omp_use_threads((gsize)nb*tip_xsiz*tip_ysiz \
+                                   *tip_xsiz*tip_ysiz)) \
+            default(none) \
+            shared(x,y,image,tip0,im_xsiz,im_ysiz,tip_xsiz,tip_ysiz) \
+            shared(xc,yc,thresh,use_edges,nb,bfrom) \
+            reduction(+:bcount)
+#endif
+        {
+            gint ifrom = bfrom + gwy_omp_chunk_start(nb);
+            gint ito = bfrom + gwy_omp_chunk_end(nb);
+            gint **mytip = tip0;
+            gint i, k;
+
+            if (gwy_omp_num_threads() > 1) {
+                mytip = _gwy_morph_lib_iallocmatrix(tip_ysiz, tip_xsiz);
+                memcpy(mytip[0], tip0[0], tip_xsiz*tip_ysiz*sizeof(gint));
+#ifdef _OPENMP
+#pragma omp barrier
+#endif
             }
-            k++;
-            if (set_fraction) {
-                gdouble fraction = k/total;
-                fraction = CLAMP(fraction, 0.0, 1.0);
-                if (!set_fraction(fraction)) {
-                    _gwy_morph_lib_ifreematrix(open);
-                    return -1;
+
+            for (i = ifrom; i < ito; i++) {
+                if (itip_estimate_point(x[i], y[i], image,
+                                        im_xsiz, im_ysiz, tip_xsiz, tip_ysiz,
+                                        xc, yc, mytip, thresh, use_edges))
+                    bcount++;
+            }
+
+            if (mytip != tip0) {
+#ifdef _OPENMP
+#pragma omp critical
+#endif
+                {
+                    for (k = 0; k < tip_xsiz*tip_ysiz; k++)
+                        tip0[0][k] = MIN(tip0[0][k], mytip[0][k]);
                 }
+                _gwy_morph_lib_ifreematrix(mytip);
             }
         }
+        count += bcount;
+
+        if (set_fraction && !set_fraction((gdouble)bto/n))
+            return -1;
     }
-    _gwy_morph_lib_ifreematrix(open);
 
     return count;
 }
@@ -557,19 +704,15 @@ _gwy_morph_lib_itip_estimate0(gint **image, gint im_xsiz, gint im_ysiz,
             return -1;
         }
 
-        for (i = 0; i < n; i++) {
-            if (itip_estimate_point(x[i], y[i], image, im_xsiz, im_ysiz,
-                                    tip_xsiz, tip_ysiz, xc, yc, tip0, thresh,
-                                    use_edges)) {
-                count++;
-                sumcount++;
-            }
-            if (set_fraction && !set_fraction((gdouble)i/(gdouble)n)) {
-                g_free(x);
-                g_free(y);
-                return -1;
-            }
+        count = itip_estimate_points(x, y, n, image, im_xsiz, im_ysiz,
+                                     tip_xsiz, tip_ysiz, xc, yc, tip0, thresh,
+                                     use_edges, set_fraction);
+        if (count == -1) {
+            g_free(x);
+            g_free(y);
+            return -1;
         }
+        sumcount += count;
         g_string_printf(str,
                         ngettext("One image location produced refinement",
                                  "%d image locations produced refinement",
@@ -90,6 +90,8 @@ gint _gwy_morph_lib_itip_estimate(gint **image,
                                   gint **tip0,
                                   gint thresh,
                                   gboolean use_edges,
+                                  gint maxiter,
+                                  GwyTipEstimateStats *stats,
                                   GwySetFractionFunc set_fraction,
                                   GwySetMessageFunc set_message);
 
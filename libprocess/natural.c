@@ -37,6 +37,8 @@
 #include <sys/time.h>
 #endif
 
+#include <libgwyddion/gwymacros.h>
+#include "libgwyddion/gwyomp.h"
 #include "natural.h"
 #define SQR(x)  (x)*(x)
 
@@ -117,6 +119,16 @@ struct _GwyDelaunayMesh
   arrayList       *updates;
   neighbourUpdate *neighbourUpdates;
 
+  // The simplex where the last point location ended. Consecutive queries
+  // are usually close so walking from here is much faster than from an
+  // arbitrary simplex.
+  simplex *last;
+
+  // The vertices the mesh was built from and whether we own them (copies).
+  GwyDelaunayVertex *ps;
+  gint nps;
+  gboolean owns_ps;
+
   gint coplanar_degenerecies;
   gint cospherical_degenerecies;
 
@@ -528,6 +540,7 @@ typedef struct
 
 } voronoiCell;
 
+
 /******************************************************************************/
 /* This is how we store an individual simplex: 4 pointers to the coordinates. */
 /* We should try storing this without pointers probably.                      */
@@ -1285,6 +1298,10 @@ void _gwy_delaunay_mesh_build(GwyDelaunayMesh *m, GwyDelaunayVertex* ps, gint n)
   m->coplanar_degenerecies  = 0;
   m->cospherical_degenerecies = 0;
 
+  m->ps  = ps;
+  m->nps = n;
+  m->last = NULL;
+
   // This simplex will contain our entire point-set.
   initSuperSimplex(ps, n, m);
   addSimplexToMesh(m, m->super);
@@ -1294,6 +1311,10 @@ void _gwy_delaunay_mesh_build(GwyDelaunayMesh *m, GwyDelaunayVertex* ps, gint n)
   {
     gwy_delaunay_add_point(&ps[i], m);
 
+    // The new simplicies stay in the mesh; the next walk starts from them.
+    if (arrayListSize(m->updates))
+      m->last = getFromArrayList(m->updates, 0);
+
     // Push conflicts to the memory pool.
     for (j=0; j<arrayListSize(m->conflicts); j++)
       push(m->deadSimplicies, getFromArrayList(m->conflicts, j));
@@ -1350,12 +1371,13 @@ static simplex** swapSimplexNeighbour(simplex *s, simplex *old, simplex *new)
 
 static simplex* findContainingSimplex(GwyDelaunayMesh *m, GwyDelaunayVertex *p)
 {
-  // This will arbitrarily get the first simplex to consider.
+  // Start from where the previous search ended if we can. Otherwise this
+  // will arbitrarily get the first simplex to consider.
   // ideally we want to start from the middle, but chosing a random
   // simplex will give us good performance in general.
 
   listNode *iter = topOfLinkedList(m->tets);
-  simplex  *s    = nextElement(m->tets,&iter);
+  simplex  *s    = m->last ? m->last : nextElement(m->tets,&iter);
   GwyDelaunayVertex *v1, *v2, *v3, *v4;
 
   gint i;
@@ -1953,9 +1975,11 @@ static voronoiCell* gwy_delaunay_get_voronoi_cell(GwyDelaunayVertex *point, simp
   gint i, j = 0;
   gint* done = (gint*)g_alloca(sizeof(gint)*3*n);
   GwyDelaunayVertex **edges = (GwyDelaunayVertex**)g_alloca(sizeof(GwyDelaunayVertex*)*3*n);
+  gint *head = (gint*)g_alloca(sizeof(gint)*3*n);
+  gint *next = (gint*)g_alloca(sizeof(gint)*3*n);
   GwyDelaunayVertex *v1, *v2, *v3;
   gint first, current, lastConsidered;
-  gint match;
+  gint match, k;
 
   // If no neighbours were found, it could be because we are trying to
   // get a cell outside of the points
@@ -1993,6 +2017,29 @@ static voronoiCell* gwy_delaunay_get_voronoi_cell(GwyDelaunayVertex *point, simp
     circumCenter(s, vc->points[i]);
   }
 
+  // Chain the edges with the same far vertex so that we only need to look at
+  // edges which can match below instead of the entire list. The chains are
+  // in increasing index order so the result does not change.
+  for (i=0; i<3*n; i++)
+  {
+    head[i] = i;
+    next[i] = -1;
+    for (k=0; k<i; k++)
+    {
+      if (edges[k] == edges[i])
+      {
+        head[i] = k;
+        break;
+      }
+    }
+    if (head[i] != i)
+    {
+      for (k=head[i]; next[k] >= 0; k=next[k])
+        ;
+      next[k] = i;
+    }
+  }
+
   // For every edge that is in the list, we are going to get the first simplex
   // which is incident to it, and then draw a line from it to the next
   // neighbour that it is incident to it. This next neighbour will be chosen
@@ -2015,7 +2062,7 @@ static voronoiCell* gwy_delaunay_get_voronoi_cell(GwyDelaunayVertex *point, simp
 
     do {
       match=0;
-      for (j=0; j < 3*n; j++)
+      for (j=head[i]; j >= 0; j=next[j])
       {
         if (done[j]) continue;
        // if (done[j]) continue;
@@ -2206,6 +2253,12 @@ GwyDelaunayMesh *_gwy_delaunay_mesh_new()
   m->updates          = newArrayList();
   // This is an array describing the most recent neighbour updates performed.
   m->neighbourUpdates = initNeighbourUpdates();
+  // Nothing located yet.
+  m->last             = NULL;
+  // The vertices are owned by the caller, unless this is a copy.
+  m->ps               = NULL;
+  m->nps              = 0;
+  m->owns_ps          = FALSE;
 
   return m;
 }
@@ -2239,6 +2292,8 @@ void _gwy_delaunay_mesh_free(GwyDelaunayMesh *m)
   freeArrayList(m->conflicts, free);
   freeArrayList(m->updates, NULL);
   freeNeighbourUpdates(m->neighbourUpdates);
+  if (m->owns_ps)
+    g_free(m->ps);
   free(m);
 }
 
@@ -2568,6 +2623,11 @@ void _gwy_delaunay_mesh_interpolate3_3(GwyDelaunayMesh *m, gdouble  x, gdouble
   for (i=0; i<arrayListSize(m->updates); i++)
     push(m->deadSimplicies, getFromArrayList(m->updates, i));
 
+  // The conflicts are back in the mesh and the first one is the simplex
+  // which contained the point. Continue the next walk from there.
+  if (arrayListSize(m->conflicts))
+    m->last = getFromArrayList(m->conflicts, 0);
+
   // Free all the memory that we allocated whilst interpolating this point.
   emptyArrayList(m->conflicts);
   emptyArrayList(m->updates);
@@ -2586,3 +2646,240 @@ void _gwy_delaunay_mesh_interpolate3_3(GwyDelaunayMesh *m, gdouble  x, gdouble
 
 
 
+
+/******************************************************************************/
+// Map a vertex pointer of mesh m to the corresponding vertex of its copy c.
+
+static GwyDelaunayVertex *copyVertexPointer(GwyDelaunayMesh *m, GwyDelaunayMesh *c,
+                                            GwyDelaunayVertex *v)
+{
+  if (v >= m->ps && v < m->ps + m->nps)
+    return c->ps + (v - m->ps);
+  if (v >= m->superVerticies && v < m->superVerticies + 4)
+    return c->superVerticies + (v - m->superVerticies);
+  return v;
+}
+
+/******************************************************************************/
+// Create an independent copy of a built mesh, including its own copy of the
+// vertices (they hold cached Voronoi volumes, so they cannot be shared).
+// Interpolation temporarily modifies the mesh, so each thread needs one.
+
+GwyDelaunayMesh *_gwy_delaunay_mesh_copy(GwyDelaunayMesh *m)
+{
+  GwyDelaunayMesh *c = _gwy_delaunay_mesh_new();
+  GHashTable *map = g_hash_table_new(g_direct_hash, g_direct_equal);
+  listNode *iter;
+  simplex *s, *t;
+  gint i;
+
+  c->nps     = m->nps;
+  c->ps      = g_memdup(m->ps, m->nps*sizeof(GwyDelaunayVertex));
+  c->owns_ps = TRUE;
+  memcpy(c->superVerticies, m->superVerticies, sizeof(m->superVerticies));
+  c->coplanar_degenerecies    = m->coplanar_degenerecies;
+  c->cospherical_degenerecies = m->cospherical_degenerecies;
+
+  // First duplicate the simplicies, then we can connect the neighbours.
+  iter = topOfLinkedList(m->tets);
+  while ((s = nextElement(m->tets, &iter)))
+  {
+    t = newSimplex(c);
+    for (i=0; i<4; i++)
+      t->p[i] = copyVertexPointer(m, c, s->p[i]);
+    addSimplexToMesh(c, t);
+    g_hash_table_insert(map, s, t);
+  }
+
+  iter = topOfLinkedList(m->tets);
+  while ((s = nextElement(m->tets, &iter)))
+  {
+    t = g_hash_table_lookup(map, s);
+    for (i=0; i<4; i++)
+      t->s[i] = s->s[i] ? g_hash_table_lookup(map, s->s[i]) : NULL;
+  }
+
+  // The super simplex is only used for vertex comparison.
+  if (m->super)
+  {
+    c->super = newSimplex(c);
+    for (i=0; i<4; i++)
+      c->super->p[i] = copyVertexPointer(m, c, m->super->p[i]);
+  }
+
+  if (m->last)
+    c->last = g_hash_table_lookup(map, m->last);
+
+  g_hash_table_destroy(map);
+
+  return c;
+}
+
+/******************************************************************************/
+// Spread the lower 10 bits of x so that there are two zero bits between each.
+
+static guint32 spreadBits3(guint32 x)
+{
+  x &= 0x3ff;
+  x = (x | (x << 16)) & 0x030000ff;
+  x = (x | (x << 8))  & 0x0300f00f;
+  x = (x | (x << 4))  & 0x030c30c3;
+  x = (x | (x << 2))  & 0x09249249;
+  return x;
+}
+
+/******************************************************************************/
+// Order query points along a 3D Morton (Z-order) curve so that consecutive
+// points are close and the walk from the last located simplex is short.
+// Each axis is scaled to its own range as the units of x, y and z need not
+// be comparable.
+
+guint *_gwy_delaunay_sort_queries(const gdouble *x, const gdouble *y, const gdouble *z,
+                                  guint n)
+{
+  enum { MORTON_BITS = 10, MORTON_RES = 1 << MORTON_BITS };
+  const gdouble *coords[3];
+  gdouble min[3], q[3];
+  guint32 *key, *tmpkey;
+  guint *id, *tmpid;
+  guint count[MORTON_RES];
+  guint i, j, k, pos, shift;
+
+  coords[0] = x;
+  coords[1] = y;
+  coords[2] = z;
+  for (j=0; j<3; j++)
+  {
+    gdouble max;
+
+    min[j] = max = n ? coords[j][0] : 0.0;
+    for (i=1; i<n; i++)
+    {
+      if (coords[j][i] < min[j])
+        min[j] = coords[j][i];
+      else if (coords[j][i] > max)
+        max = coords[j][i];
+    }
+    q[j] = (max > min[j]) ? (MORTON_RES - 0.5)/(max - min[j]) : 0.0;
+  }
+
+  key = g_new(guint32, n);
+  id  = g_new(guint, n);
+  for (i=0; i<n; i++)
+  {
+    key[i] = (spreadBits3((guint32)((x[i] - min[0])*q[0]))
+              | (spreadBits3((guint32)((y[i] - min[1])*q[1])) << 1)
+              | (spreadBits3((guint32)((z[i] - min[2])*q[2])) << 2));
+    id[i] = i;
+  }
+
+  // LSD radix sort of (key, id) pairs, one axis worth of bits at a time.
+  tmpkey = g_new(guint32, n);
+  tmpid  = g_new(guint, n);
+  for (shift=0; shift<3*MORTON_BITS; shift+=MORTON_BITS)
+  {
+    memset(count, 0, sizeof(count));
+    for (i=0; i<n; i++)
+      count[(key[i] >> shift) & (MORTON_RES-1)]++;
+    for (k=pos=0; k<MORTON_RES; k++)
+    {
+      guint cnt = count[k];
+      count[k] = pos;
+      pos += cnt;
+    }
+    for (i=0; i<n; i++)
+    {
+      pos = count[(key[i] >> shift) & (MORTON_RES-1)]++;
+      tmpkey[pos] = key[i];
+      tmpid[pos]  = id[i];
+    }
+    GWY_SWAP(guint32*, key, tmpkey);
+    GWY_SWAP(guint*, id, tmpid);
+  }
+  g_free(tmpkey);
+  g_free(tmpid);
+  g_free(key);
+
+  return id;
+}
+
+/******************************************************************************/
+// Interpolate the vector field in many points. The points are processed in
+// the given order (normally from _gwy_delaunay_sort_queries()) so each point
+// location walk starts close to the target. When run in parallel, each
+// thread works with its own copy of the mesh since interpolation temporarily
+// inserts the point into it. The copies are made once and kept for all
+// blocks; blocks only exist to report progress. Any of u, v and w can be
+// NULL. The fraction reported goes from ffrom to fto.
+
+gboolean _gwy_delaunay_mesh_interpolate3_3_batch(GwyDelaunayMesh *m,
+                                                 const gdouble *x, const gdouble *y,
+                                                 const gdouble *z, const guint *order,
+                                                 guint n,
+                                                 gdouble *u, gdouble *v, gdouble *w,
+                                                 GwySetFractionFunc set_fraction,
+                                                 gdouble ffrom, gdouble fto)
+{
+  enum { QUERY_WORK = 2000, NBLOCKS = 100, MIN_BLOCK = 4096 };
+  GwyDelaunayMesh **copies;
+  guint nthreads = gwy_omp_max_threads(), block, bfrom, blen, t;
+  gboolean ok = TRUE;
+
+  copies = g_new0(GwyDelaunayMesh*, nthreads);
+  block = set_fraction ? MAX((n + NBLOCKS-1)/NBLOCKS, MIN_BLOCK) : n;
+  for (bfrom=0; bfrom<n; bfrom+=blen)
+  {
+    blen = MIN(block, n - bfrom);
+#ifdef _OPENMP
+#pragma omp parallel if(gwy_omp_use_threads((gsize)blen*QUERY_WORK)) \
+            default(none) \
+            shared(m,x,y,z,order,u,v,w,copies,bfrom,blen)
+#endif
+    {
+      guint ifrom = bfrom + gwy_omp_chunk_start(blen);
+      guint ito = bfrom + gwy_omp_chunk_end(blen);
+      guint tid = gwy_omp_thread_num();
+      GwyDelaunayMesh *tm = m;
+      gdouble a, b, c;
+      guint i, k;
+
+      // The shared mesh is never modified in a parallel region, so it can be
+      // copied safely.
+      if (gwy_omp_num_threads() > 1)
+      {
+        if (!copies[tid])
+          copies[tid] = _gwy_delaunay_mesh_copy(m);
+        tm = copies[tid];
+      }
+
+      for (k=ifrom; k<ito; k++)
+      {
+        i = order ? order[k] : k;
+        _gwy_delaunay_mesh_interpolate3_3(tm, x[i], y[i], z[i], &a, &b, &c);
+        if (u)
+          u[i] = a;
+        if (v)
+          v[i] = b;
+        if (w)
+          w[i] = c;
+      }
+    }
+
+    if (set_fraction
+        && !set_fraction(ffrom + (fto - ffrom)*(bfrom + blen)/n))
+    {
+      ok = FALSE;
+      break;
+    }
+  }
+
+  for (t=0; t<nthreads; t++)
+  {
+    if (copies[t])
+      _gwy_delaunay_mesh_free(copies[t]);
+  }
+  g_free(copies);
+
+  return ok;
+}
+
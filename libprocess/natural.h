@@ -25,6 +25,7 @@
 #define __GWY_PROCESS_NATURAL_H__
 
 #include <glib.h>
+#include <libgwyddion/gwyutils.h>
 
 typedef struct _GwyDelaunayVertex GwyDelaunayVertex;
 typedef struct _GwyDelaunayMesh GwyDelaunayMesh;
@@ -48,6 +49,22 @@ void     _gwy_delaunay_mesh_interpolate3_3(GwyDelaunayMesh *m, gdouble  x, gdoub
 G_GNUC_INTERNAL
 void     _gwy_delaunay_mesh_free(GwyDelaunayMesh *m);
 
+G_GNUC_INTERNAL
+GwyDelaunayMesh* _gwy_delaunay_mesh_copy(GwyDelaunayMesh *m);
+
+G_GNUC_INTERNAL
+guint*   _gwy_delaunay_sort_queries(const gdouble *x, const gdouble *y, const gdouble *z,
+                                    guint n);
+
+G_GNUC_INTERNAL
+gboolean _gwy_delaunay_mesh_interpolate3_3_batch(GwyDelaunayMesh *m,
+                                                 const gdouble *x, const gdouble *y,
+                                                 const gdouble *z, const guint *order,
+                                                 guint n,
+                                                 gdouble *u, gdouble *v, gdouble *w,
+                                                 GwySetFractionFunc set_fraction,
+                                                 gdouble ffrom, gdouble fto);
+
 #endif
 
 /* vim: set cin et ts=4 sw=4 cino=>1s,e0,n0,f0,{0,}0,^0,\:1s,=0,g1s,h0,t0,+1s,c3,(0,u0 : */
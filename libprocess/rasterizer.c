@@ -0,0 +1,1052 @@
+/*
+ *  @(#) $Id$
+ *  Copyright (C) 2016 David Necas (Yeti).
+ *  E-mail: yeti@gwyddion.net.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301, USA.
+ */
+
+#include "config.h"
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#include <glib/gstdio.h>
+#include <libgwyddion/gwymacros.h>
+#include <libgwyddion/gwymath.h>
+#include <libprocess/datafield.h>
+#include <libprocess/stats.h>
+#include <libprocess/correct.h>
+#include <libprocess/triangulation.h>
+#include <libprocess/rasterizer.h>
+
+enum {
+    /* Default tile side and halo width, in pixels. */
+    TILE_SIZE = 256,
+    HALO_SIZE = 16,
+    /* Number of points kept in memory for each spill file before they are
+     * written out. */
+    SPILL_BUFFER = 8192,
+    /* Bands with at most this many points are split to tiles in memory;
+     * larger bands are split to tiles through temporary files again. */
+    BAND_MEMORY_POINTS = 1 << 23,
+    /* Tiles with more points are split to smaller regions before
+     * triangulation. */
+    TILE_MEMORY_POINTS = 1 << 21,
+};
+
+/* A bucket of points which lives in memory until it grows over capacity,
+ * then it is written to a temporary file in chunks. */
+typedef struct {
+    GArray *buffer;
+    guint capacity;
+    gboolean consumed;
+    FILE *fh;
+    gchar *filename;
+    guint64 npoints;
+} SpillFile;
+
+struct _GwyXYZRasterizer {
+    GwyDataField *dfield;
+    GwyXYZRasterizeType type;
+    guint xres;
+    guint yres;
+    gdouble xoff;
+    gdouble yoff;
+    gdouble dx;
+    gdouble dy;
+    guint tile_size;
+    guint halo;
+    guint ntx;
+    guint nty;
+    guint64 npoints;
+    gboolean finished;
+    /* Average: weighted sums and weights.
+     * Nearest: values and squared distances of the nearest points. */
+    gdouble *values;
+    gdouble *weights;
+    /* Nearest: positions of the nearest points. */
+    GwyXY *positions;
+    /* Linear: horizontal bands of tiles. */
+    SpillFile *bands;
+};
+
+static void     spill_init      (SpillFile *spill,
+                                 guint capacity);
+static void     spill_free      (SpillFile *spill);
+static gboolean spill_add       (SpillFile *spill,
+                                 const GwyXYZ *pt,
+                                 GError **error);
+static gboolean spill_flush     (SpillFile *spill,
+                                 GError **error);
+static gboolean spill_rewind    (SpillFile *spill,
+                                 GError **error);
+static gboolean spill_read_chunk(SpillFile *spill,
+                                 GError **error);
+static void     alloc_bands     (GwyXYZRasterizer *rasterizer);
+static void     free_bands      (GwyXYZRasterizer *rasterizer);
+static void     add_average     (GwyXYZRasterizer *rasterizer,
+                                 const GwyXYZ *points,
+                                 guint npoints);
+static void     add_nearest     (GwyXYZRasterizer *rasterizer,
+                                 const GwyXYZ *points,
+                                 guint npoints);
+static gboolean add_linear      (GwyXYZRasterizer *rasterizer,
+                                 const GwyXYZ *points,
+                                 guint npoints,
+                                 GError **error);
+static void     finish_average  (GwyXYZRasterizer *rasterizer);
+static void     finish_nearest  (GwyXYZRasterizer *rasterizer);
+static gboolean finish_linear   (GwyXYZRasterizer *rasterizer,
+                                 GwySetFractionFunc set_fraction,
+                                 GwySetMessageFunc set_message,
+                                 GError **error);
+
+/**
+ * gwy_xyz_rasterizer_new:
+ * @dfield: A data field to fill with the rasterised data.  Its dimensions,
+ *          offsets and resolutions determine the rasterised region.
+ * @type: Rasterisation method.
+ *
+ * Creates a new streaming XYZ data rasteriser.
+ *
+ * The data field is only modified by gwy_xyz_rasterizer_finish().  The
+ * rasteriser keeps a reference to it until it is freed.
+ *
+ * Returns: A new XYZ data rasteriser.
+ *
+ * Since: 2.47
+ **/
+GwyXYZRasterizer*
+gwy_xyz_rasterizer_new(GwyDataField *dfield,
+                       GwyXYZRasterizeType type)
+{
+    GwyXYZRasterizer *rasterizer;
+    guint n;
+
+    g_return_val_if_fail(GWY_IS_DATA_FIELD(dfield), NULL);
+    g_return_val_if_fail(type <= GWY_XYZ_RASTERIZE_LINEAR, NULL);
+
+    rasterizer = g_slice_new0(GwyXYZRasterizer);
+    rasterizer->dfield = g_object_ref(dfield);
+    rasterizer->type = type;
+    rasterizer->xres = gwy_data_field_get_xres(dfield);
+    rasterizer->yres = gwy_data_field_get_yres(dfield);
+    rasterizer->xoff = gwy_data_field_get_xoffset(dfield);
+    rasterizer->yoff = gwy_data_field_get_yoffset(dfield);
+    rasterizer->dx = gwy_data_field_get_xmeasure(dfield);
+    rasterizer->dy = gwy_data_field_get_ymeasure(dfield);
+    rasterizer->tile_size = TILE_SIZE;
+    rasterizer->halo = HALO_SIZE;
+
+    n = rasterizer->xres*rasterizer->yres;
+    if (type == GWY_XYZ_RASTERIZE_AVERAGE) {
+        rasterizer->values = g_new0(gdouble, n);
+        rasterizer->weights = g_new0(gdouble, n);
+    }
+    else if (type == GWY_XYZ_RASTERIZE_NEAREST) {
+        rasterizer->values = g_new0(gdouble, n);
+        rasterizer->weights = g_new(gdouble, n);
+        rasterizer->positions = g_new0(GwyXY, n);
+        while (n--)
+            rasterizer->weights[n] = G_MAXDOUBLE;
+    }
+    else
+        alloc_bands(rasterizer);
+
+    return rasterizer;
+}
+
+/**
+ * gwy_xyz_rasterizer_free:
+ * @rasterizer: An XYZ data rasteriser.
+ *
+ * Frees an XYZ data rasteriser, including all its temporary files.
+ *
+ * Since: 2.47
+ **/
+void
+gwy_xyz_rasterizer_free(GwyXYZRasterizer *rasterizer)
+{
+    g_return_if_fail(rasterizer);
+
+    free_bands(rasterizer);
+    g_free(rasterizer->values);
+    g_free(rasterizer->weights);
+    g_free(rasterizer->positions);
+    g_object_unref(rasterizer->dfield);
+    g_slice_free(GwyXYZRasterizer, rasterizer);
+}
+
+/**
+ * gwy_xyz_rasterizer_set_tiling:
+ * @rasterizer: An XYZ data rasteriser.
+ * @tile_size: Side of the square tiles processed separately, in pixels.
+ * @halo: Width of the overlap region around each tile, in pixels.
+ *
+ * Sets the tiling of the output image used by the linear rasterisation
+ * method.
+ *
+ * Each tile is triangulated separately, using points from the tile and the
+ * halo around it.  The halo should be several times wider than the typical
+ * distance between points, otherwise visible seams can appear at tile edges.
+ * The other methods do not use tiling and ignore this setting.
+ *
+ * This function can be called only before any points are added.
+ *
+ * Since: 2.47
+ **/
+void
+gwy_xyz_rasterizer_set_tiling(GwyXYZRasterizer *rasterizer,
+                              guint tile_size,
+                              guint halo)
+{
+    g_return_if_fail(rasterizer);
+    g_return_if_fail(tile_size >= 2);
+    g_return_if_fail(!rasterizer->npoints && !rasterizer->finished);
+
+    rasterizer->tile_size = tile_size;
+    rasterizer->halo = halo;
+    if (rasterizer->type == GWY_XYZ_RASTERIZE_LINEAR) {
+        free_bands(rasterizer);
+        alloc_bands(rasterizer);
+    }
+}
+
+/**
+ * gwy_xyz_rasterizer_add_points:
+ * @rasterizer: An XYZ data rasteriser.
+ * @points: Array of XYZ points.  Coordinates X and Y represent positions in
+ *          the plane; the Z-coordinate represents values.
+ * @npoints: Number of items in @points.
+ * @error: Return location for a #GError (or %NULL).
+ *
+ * Feeds a chunk of XYZ points to a rasteriser.
+ *
+ * The points are not referenced after the function returns so the caller can
+ * reuse the array for the next chunk.  Points can come in any order.  Points
+ * too far outside the rasterised region are ignored.
+ *
+ * For the average and nearest methods the memory used does not depend on the
+ * number of points at all.  For the linear method the points are sorted to
+ * temporary files by output tiles so only a bounded number of them is kept in
+ * memory.
+ *
+ * Returns: %TRUE if the points were added; %FALSE if writing of a temporary
+ *          file failed.
+ *
+ * Since: 2.47
+ **/
+gboolean
+gwy_xyz_rasterizer_add_points(GwyXYZRasterizer *rasterizer,
+                              const GwyXYZ *points,
+                              guint npoints,
+                              GError **error)
+{
+    g_return_val_if_fail(rasterizer, FALSE);
+    g_return_val_if_fail(!rasterizer->finished, FALSE);
+    g_return_val_if_fail(points || !npoints, FALSE);
+
+    rasterizer->npoints += npoints;
+    if (rasterizer->type == GWY_XYZ_RASTERIZE_AVERAGE)
+        add_average(rasterizer, points, npoints);
+    else if (rasterizer->type == GWY_XYZ_RASTERIZE_NEAREST)
+        add_nearest(rasterizer, points, npoints);
+    else
+        return add_linear(rasterizer, points, npoints, error);
+
+    return TRUE;
+}
+
+/**
+ * gwy_xyz_rasterizer_get_npoints:
+ * @rasterizer: An XYZ data rasteriser.
+ *
+ * Gets the number of points fed to an XYZ data rasteriser.
+ *
+ * Returns: The total number of points passed to
+ *          gwy_xyz_rasterizer_add_points(), including ignored points.
+ *
+ * Since: 2.47
+ **/
+guint64
+gwy_xyz_rasterizer_get_npoints(GwyXYZRasterizer *rasterizer)
+{
+    g_return_val_if_fail(rasterizer, 0);
+    return rasterizer->npoints;
+}
+
+/**
+ * gwy_xyz_rasterizer_finish:
+ * @rasterizer: An XYZ data rasteriser.
+ * @set_fraction: Function that sets fraction to output (or %NULL).
+ * @set_message: Function that sets message to output (or %NULL).
+ * @error: Return location for a #GError (or %NULL).
+ *
+ * Finishes the rasterisation and fills the data field with the result.
+ *
+ * Pixels which cannot be determined from the points, for instance because no
+ * point falls near them, are interpolated from their surroundings using
+ * gwy_data_field_laplace_solve().
+ *
+ * For the linear method, tiles with too many points to triangulate at once,
+ * which happens for strongly clustered data, are split to smaller regions.
+ * A single pixel with still too many points uses only a regular subsample of
+ * them.
+ *
+ * No more points can be added after calling this function.
+ *
+ * Returns: %TRUE if the rasterisation finished.  %FALSE if reading of a
+ *          temporary file failed, in which case @error is set, or if the
+ *          rasterisation was cancelled using @set_fraction or @set_message,
+ *          in which case @error is not set.  The data field contents is
+ *          undefined when %FALSE is returned.
+ *
+ * Since: 2.47
+ **/
+gboolean
+gwy_xyz_rasterizer_finish(GwyXYZRasterizer *rasterizer,
+                          GwySetFractionFunc set_fraction,
+                          GwySetMessageFunc set_message,
+                          GError **error)
+{
+    gboolean ok = TRUE;
+
+    g_return_val_if_fail(rasterizer, FALSE);
+    g_return_val_if_fail(!rasterizer->finished, FALSE);
+
+    rasterizer->finished = TRUE;
+    if (rasterizer->type == GWY_XYZ_RASTERIZE_AVERAGE)
+        finish_average(rasterizer);
+    else if (rasterizer->type == GWY_XYZ_RASTERIZE_NEAREST)
+        finish_nearest(rasterizer);
+    else
+        ok = finish_linear(rasterizer, set_fraction, set_message, error);
+
+    gwy_data_field_invalidate(rasterizer->dfield);
+
+    return ok;
+}
+
+static void
+alloc_bands(GwyXYZRasterizer *rasterizer)
+{
+    guint i, tile_size = rasterizer->tile_size;
+
+    rasterizer->ntx = (rasterizer->xres + tile_size-1)/tile_size;
+    rasterizer->nty = (rasterizer->yres + tile_size-1)/tile_size;
+    rasterizer->bands = g_new(SpillFile, rasterizer->nty);
+    for (i = 0; i < rasterizer->nty; i++)
+        spill_init(rasterizer->bands + i, SPILL_BUFFER);
+}
+
+static void
+free_bands(GwyXYZRasterizer *rasterizer)
+{
+    guint i;
+
+    if (!rasterizer->bands)
+        return;
+
+    for (i = 0; i < rasterizer->nty; i++)
+        spill_free(rasterizer->bands + i);
+    GWY_FREE(rasterizer->bands);
+}
+
+static void
+add_average(GwyXYZRasterizer *rasterizer,
+            const GwyXYZ *points, guint npoints)
+{
+    gint xres = rasterizer->xres, yres = rasterizer->yres;
+    gdouble xoff = rasterizer->xoff, yoff = rasterizer->yoff;
+    gdouble dx = rasterizer->dx, dy = rasterizer->dy;
+    gdouble *d = rasterizer->values, *w = rasterizer->weights;
+    guint k;
+
+    /* This is the same weighting as in gwy_data_field_average_xyz(), just
+     * without the extended field. */
+    for (k = 0; k < npoints; k++) {
+        const GwyXYZ *pt = points + k;
+        gdouble x = (pt->x - xoff)/dx - 0.5;
+        gdouble y = (pt->y - yoff)/dy - 0.5;
+        gdouble z = pt->z, xx, yy, ww;
+        gint i, j, kk;
+
+        if (!(x > -1.0 && x < xres && y > -1.0 && y < yres))
+            continue;
+
+        j = (gint)floor(x);
+        i = (gint)floor(y);
+        xx = x - j;
+        yy = y - i;
+        kk = i*xres + j;
+
+        if (i >= 0) {
+            if (j >= 0) {
+                ww = (1.0 - xx)*(1.0 - yy);
+                d[kk] += ww*z;
+                w[kk] += ww;
+            }
+            if (j+1 < xres) {
+                ww = xx*(1.0 - yy);
+                d[kk+1] += ww*z;
+                w[kk+1] += ww;
+            }
+        }
+        if (i+1 < yres) {
+            if (j >= 0) {
+                ww = (1.0 - xx)*yy;
+                d[kk + xres] += ww*z;
+                w[kk + xres] += ww;
+            }
+            if (j+1 < xres) {
+                ww = xx*yy;
+                d[kk + xres+1] += ww*z;
+                w[kk + xres+1] += ww;
+            }
+        }
+    }
+}
+
+static void
+add_nearest(GwyXYZRasterizer *rasterizer,
+            const GwyXYZ *points, guint npoints)
+{
+    gint xres = rasterizer->xres, yres = rasterizer->yres;
+    gdouble xoff = rasterizer->xoff, yoff = rasterizer->yoff;
+    gdouble dx = rasterizer->dx, dy = rasterizer->dy;
+    gdouble *z = rasterizer->values, *d2 = rasterizer->weights;
+    GwyXY *xy = rasterizer->positions;
+    guint k;
+
+    /* Each point competes for the pixel it falls into and its neighbours, so
+     * dense points are handled exactly.  Points outside are attributed to the
+     * nearest edge pixels; they can still be the nearest ones to their
+     * centres. */
+    for (k = 0; k < npoints; k++) {
+        const GwyXYZ *pt = points + k;
+        gdouble x = (pt->x - xoff)/dx;
+        gdouble y = (pt->y - yoff)/dy;
+        gdouble r2, xx, yy;
+        gint i, j, ii, jj, kk;
+
+        if (gwy_isnan(x) || gwy_isnan(y))
+            continue;
+
+        j = (x < 0.0) ? 0 : (x >= xres) ? xres-1 : (gint)x;
+        i = (y < 0.0) ? 0 : (y >= yres) ? yres-1 : (gint)y;
+        for (ii = MAX(i-1, 0); ii <= MIN(i+1, yres-1); ii++) {
+            yy = pt->y - (yoff + (ii + 0.5)*dy);
+            for (jj = MAX(j-1, 0); jj <= MIN(j+1, xres-1); jj++) {
+                xx = pt->x - (xoff + (jj + 0.5)*dx);
+                r2 = xx*xx + yy*yy;
+                kk = ii*xres + jj;
+                if (r2 < d2[kk]) {
+                    d2[kk] = r2;
+                    z[kk] = pt->z;
+                    xy[kk].x = pt->x;
+                    xy[kk].y = pt->y;
+                }
+            }
+        }
+    }
+}
+
+static gboolean
+add_linear(GwyXYZRasterizer *rasterizer,
+           const GwyXYZ *points, guint npoints,
+           GError **error)
+{
+    gint xres = rasterizer->xres, yres = rasterizer->yres;
+    gdouble xoff = rasterizer->xoff, yoff = rasterizer->yoff;
+    gdouble dx = rasterizer->dx, dy = rasterizer->dy;
+    gdouble halo = rasterizer->halo, tile_size = rasterizer->tile_size;
+    gint nty = rasterizer->nty;
+    guint k;
+
+    /* A point goes to each band whose rows, extended by the halo, contain it.
+     * Normally this is one band; two for points close to band boundaries. */
+    for (k = 0; k < npoints; k++) {
+        const GwyXYZ *pt = points + k;
+        gdouble x = (pt->x - xoff)/dx;
+        gdouble y = (pt->y - yoff)/dy;
+        gint b, bfrom, bto;
+
+        if (!(x >= -halo && x < xres + halo && y >= -halo && y < yres + halo))
+            continue;
+
+        bfrom = (gint)floor((y - halo)/tile_size);
+        bto = (gint)floor((y + halo)/tile_size);
+        bfrom = MAX(bfrom, 0);
+        bto = MIN(bto, nty-1);
+        for (b = bfrom; b <= bto; b++) {
+            if (!spill_add(rasterizer->bands + b, pt, error))
+                return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+static void
+finish_average(GwyXYZRasterizer *rasterizer)
+{
+    GwyDataField *dfield = rasterizer->dfield, *mask;
+    const gdouble *w = rasterizer->weights;
+    gdouble *d, *m;
+    guint k, n, nmissing = 0;
+
+    n = rasterizer->xres*rasterizer->yres;
+    d = gwy_data_field_get_data(dfield);
+    mask = gwy_data_field_new_alike(dfield, TRUE);
+    m = gwy_data_field_get_data(mask);
+    for (k = 0; k < n; k++) {
+        if (w[k])
+            d[k] = rasterizer->values[k]/w[k];
+        else {
+            d[k] = 0.0;
+            m[k] = 1.0;
+            nmissing++;
+        }
+    }
+
+    if (nmissing && nmissing < n)
+        gwy_data_field_laplace_solve(dfield, mask, -1, 1.0);
+    g_object_unref(mask);
+}
+
+static inline void
+try_nearest_candidate(GwyXYZRasterizer *rasterizer,
+                      guint k, guint kn,
+                      gdouble xc, gdouble yc)
+{
+    gdouble *z = rasterizer->values, *d2 = rasterizer->weights;
+    GwyXY *xy = rasterizer->positions;
+    gdouble x, y, r2;
+
+    if (d2[kn] == G_MAXDOUBLE)
+        return;
+
+    x = xy[kn].x - xc;
+    y = xy[kn].y - yc;
+    r2 = x*x + y*y;
+    if (r2 < d2[k]) {
+        d2[k] = r2;
+        z[k] = z[kn];
+        xy[k] = xy[kn];
+    }
+}
+
+static void
+finish_nearest(GwyXYZRasterizer *rasterizer)
+{
+    gint xres = rasterizer->xres, yres = rasterizer->yres;
+    gdouble xoff = rasterizer->xoff, yoff = rasterizer->yoff;
+    gdouble dx = rasterizer->dx, dy = rasterizer->dy;
+    gint i, j, k;
+    gdouble xc, yc;
+
+    if (!rasterizer->npoints) {
+        gwy_data_field_clear(rasterizer->dfield);
+        return;
+    }
+
+    /* Propagate the nearest points to pixels without any point, similar to
+     * a vector distance transform.  Each pixel takes over the point of its
+     * neighbour if it is closer than its own.  One forward and one backward
+     * pass are not exact in all cases but the errors are small and only
+     * occur in configurations where the nearest point is ambiguous anyway. */
+    for (i = 0; i < yres; i++) {
+        yc = yoff + (i + 0.5)*dy;
+        for (j = 0; j < xres; j++) {
+            xc = xoff + (j + 0.5)*dx;
+            k = i*xres + j;
+            if (i) {
+                if (j)
+                    try_nearest_candidate(rasterizer, k, k-xres-1, xc, yc);
+                try_nearest_candidate(rasterizer, k, k-xres, xc, yc);
+                if (j < xres-1)
+                    try_nearest_candidate(rasterizer, k, k-xres+1, xc, yc);
+            }
+            if (j)
+                try_nearest_candidate(rasterizer, k, k-1, xc, yc);
+        }
+    }
+    for (i = yres-1; i >= 0; i--) {
+        yc = yoff + (i + 0.5)*dy;
+        for (j = xres-1; j >= 0; j--) {
+            xc = xoff + (j + 0.5)*dx;
+            k = i*xres + j;
+            if (i < yres-1) {
+                if (j < xres-1)
+                    try_nearest_candidate(rasterizer, k, k+xres+1, xc, yc);
+                try_nearest_candidate(rasterizer, k, k+xres, xc, yc);
+                if (j)
+                    try_nearest_candidate(rasterizer, k, k+xres-1, xc, yc);
+            }
+            if (j < xres-1)
+                try_nearest_candidate(rasterizer, k, k+1, xc, yc);
+        }
+    }
+
+    gwy_assign(gwy_data_field_get_data(rasterizer->dfield), rasterizer->values,
+               xres*yres);
+}
+
+static void
+mark_missing(GwyDataField *dfield, GwyDataField **mask,
+             gint col, gint row, gint width, gint height)
+{
+    if (!*mask)
+        *mask = gwy_data_field_new_alike(dfield, TRUE);
+    gwy_data_field_area_fill(*mask, col, row, width, height, 1.0);
+}
+
+static void
+add_jitter(GArray *points, gdouble xj, gdouble yj)
+{
+    /* We want this to be deterministic.  See xyz_raster for discussion. */
+    GRand *rng = g_rand_new_with_seed(42);
+    guint i;
+
+    for (i = 0; i < points->len; i++) {
+        GwyXYZ *pt = &g_array_index(points, GwyXYZ, i);
+        pt->x += xj*(g_rand_double(rng) - 0.5);
+        pt->y += yj*(g_rand_double(rng) - 0.5);
+    }
+    g_rand_free(rng);
+}
+
+static void
+rasterize_tile(GwyXYZRasterizer *rasterizer,
+               GwyTriangulation *triangulation,
+               GArray *points,
+               gint col, gint row, gint width, gint height,
+               GwyDataField **mask)
+{
+    GwyDataField *dfield = rasterizer->dfield, *tile;
+    gboolean ok;
+
+    if (points->len < 3) {
+        mark_missing(dfield, mask, col, row, width, height);
+        return;
+    }
+
+    ok = gwy_triangulation_triangulate(triangulation,
+                                       points->len, points->data,
+                                       sizeof(GwyXYZ));
+    if (!ok) {
+        /* Try again with a jitter small compared to the pixel size, like
+         * the XYZ rasterisation module does. */
+        add_jitter(points, 0.01*rasterizer->dx, 0.01*rasterizer->dy);
+        ok = gwy_triangulation_triangulate(triangulation,
+                                           points->len, points->data,
+                                           sizeof(GwyXYZ));
+    }
+    if (!ok) {
+        mark_missing(dfield, mask, col, row, width, height);
+        return;
+    }
+
+    tile = gwy_data_field_new(width, height,
+                              width*rasterizer->dx, height*rasterizer->dy,
+                              FALSE);
+    gwy_data_field_set_xoffset(tile, rasterizer->xoff + col*rasterizer->dx);
+    gwy_data_field_set_yoffset(tile, rasterizer->yoff + row*rasterizer->dy);
+    ok = gwy_triangulation_interpolate(triangulation,
+                                       GWY_INTERPOLATION_LINEAR, tile);
+    if (ok)
+        gwy_data_field_area_copy(tile, dfield, 0, 0, width, height, col, row);
+    else
+        mark_missing(dfield, mask, col, row, width, height);
+    g_object_unref(tile);
+}
+
+/* Rasterises a region of the image from points in @spill, which is consumed.
+ * Clustered data can put far too many points into one tile.  Such regions
+ * are split to quarters, with their own halos, until the points fit into
+ * memory.  A single pixel that still has too many points is triangulated
+ * from a regular subsample of them. */
+static gboolean
+rasterize_region(GwyXYZRasterizer *rasterizer,
+                 GwyTriangulation *triangulation,
+                 GArray *points,
+                 SpillFile *spill,
+                 gint col, gint row, gint width, gint height,
+                 GwyDataField **mask,
+                 GError **error)
+{
+    SpillFile parts[4];
+    gdouble xoff = rasterizer->xoff, yoff = rasterizer->yoff;
+    gdouble dx = rasterizer->dx, dy = rasterizer->dy;
+    gdouble halo = rasterizer->halo;
+    gint pcol[4], prow[4], pwidth[4], pheight[4];
+    gint hw, hh, nx, ny, i, nparts = 0;
+    guint64 stride, m;
+    guint k, capacity;
+    gboolean ok;
+
+    if (spill->npoints <= TILE_MEMORY_POINTS || (width == 1 && height == 1)) {
+        stride = (spill->npoints + TILE_MEMORY_POINTS-1)/TILE_MEMORY_POINTS;
+        stride = MAX(stride, 1);
+        g_array_set_size(points, 0);
+        if (!(ok = spill_rewind(spill, error)))
+            goto end;
+        m = 0;
+        while ((ok = spill_read_chunk(spill, error)) && spill->buffer->len) {
+            if (stride == 1) {
+                g_array_append_vals(points, spill->buffer->data,
+                                    spill->buffer->len);
+                continue;
+            }
+            for (k = 0; k < spill->buffer->len; k++, m++) {
+                if (m % stride == 0)
+                    g_array_append_vals(points,
+                                        &g_array_index(spill->buffer,
+                                                       GwyXYZ, k), 1);
+            }
+        }
+        spill_free(spill);
+        if (ok)
+            rasterize_tile(rasterizer, triangulation, points,
+                           col, row, width, height, mask);
+        goto end;
+    }
+
+    nx = (width > 1) ? 2 : 1;
+    ny = (height > 1) ? 2 : 1;
+    hw = (width + 1)/2;
+    hh = (height + 1)/2;
+    nparts = nx*ny;
+    capacity = (spill->npoints <= BAND_MEMORY_POINTS
+                ? G_MAXUINT : SPILL_BUFFER);
+    for (i = 0; i < nparts; i++) {
+        pcol[i] = (i % nx) ? col + hw : col;
+        pwidth[i] = (nx == 1) ? width : ((i % nx) ? width - hw : hw);
+        prow[i] = (i / nx) ? row + hh : row;
+        pheight[i] = (ny == 1) ? height : ((i / nx) ? height - hh : hh);
+        spill_init(parts + i, capacity);
+    }
+
+    if (!(ok = spill_rewind(spill, error)))
+        goto end;
+    while ((ok = spill_read_chunk(spill, error)) && spill->buffer->len) {
+        for (k = 0; k < spill->buffer->len; k++) {
+            const GwyXYZ *pt = &g_array_index(spill->buffer, GwyXYZ, k);
+            gdouble x = (pt->x - xoff)/dx, y = (pt->y - yoff)/dy;
+
+            for (i = 0; i < nparts; i++) {
+                if (x >= pcol[i] - halo && x < pcol[i] + pwidth[i] + halo
+                    && y >= prow[i] - halo && y < prow[i] + pheight[i] + halo
+                    && !(ok = spill_add(parts + i, pt, error)))
+                    goto end;
+            }
+        }
+    }
+    spill_free(spill);
+
+    for (i = 0; i < nparts && ok; i++) {
+        ok = rasterize_region(rasterizer, triangulation, points, parts + i,
+                              pcol[i], prow[i], pwidth[i], pheight[i],
+                              mask, error);
+    }
+
+end:
+    spill_free(spill);
+    for (i = 0; i < nparts; i++)
+        spill_free(parts + i);
+
+    return ok;
+}
+
+static gboolean
+finish_linear(GwyXYZRasterizer *rasterizer,
+              GwySetFractionFunc set_fraction,
+              GwySetMessageFunc set_message,
+              GError **error)
+{
+    GwyTriangulation *triangulation;
+    GwyDataField *mask = NULL;
+    SpillFile *tiles;
+    GArray *points;
+    gdouble xoff = rasterizer->xoff, dx = rasterizer->dx;
+    gdouble halo = rasterizer->halo, tile_size = rasterizer->tile_size;
+    gint ntx = rasterizer->ntx;
+    guint b, t, k, capacity;
+    gboolean ok = TRUE;
+
+    if (set_message && !set_message(_("Triangulating...")))
+        return FALSE;
+
+    triangulation = gwy_triangulation_new();
+    points = g_array_new(FALSE, FALSE, sizeof(GwyXYZ));
+    tiles = g_new(SpillFile, ntx);
+    for (b = 0; b < rasterizer->nty; b++) {
+        SpillFile *band = rasterizer->bands + b;
+
+        /* Split the band to tiles.  Usually the band fits into memory.  If
+         * it does not, the tiles go to temporary files again. */
+        capacity = (band->npoints <= BAND_MEMORY_POINTS
+                    ? G_MAXUINT : SPILL_BUFFER);
+        for (t = 0; t < ntx; t++)
+            spill_init(tiles + t, capacity);
+
+        if (!(ok = spill_rewind(band, error)))
+            goto fail;
+        while ((ok = spill_read_chunk(band, error)) && band->buffer->len) {
+            for (k = 0; k < band->buffer->len; k++) {
+                const GwyXYZ *pt = &g_array_index(band->buffer, GwyXYZ, k);
+                gdouble x = (pt->x - xoff)/dx;
+                gint tfrom, tto, tt;
+
+                tfrom = (gint)floor((x - halo)/tile_size);
+                tto = (gint)floor((x + halo)/tile_size);
+                tfrom = MAX(tfrom, 0);
+                tto = MIN(tto, ntx-1);
+                for (tt = tfrom; tt <= tto; tt++) {
+                    if (!(ok = spill_add(tiles + tt, pt, error)))
+                        goto fail;
+                }
+            }
+        }
+        if (!ok)
+            goto fail;
+        /* Release the disk space early. */
+        spill_free(band);
+        spill_init(band, SPILL_BUFFER);
+
+        for (t = 0; t < ntx; t++) {
+            SpillFile *tile = tiles + t;
+            gint col = t*rasterizer->tile_size, row = b*rasterizer->tile_size;
+
+            ok = rasterize_region(rasterizer, triangulation, points, tile,
+                                  col, row,
+                                  MIN(rasterizer->tile_size,
+                                      rasterizer->xres - col),
+                                  MIN(rasterizer->tile_size,
+                                      rasterizer->yres - row),
+                                  &mask, error);
+            spill_init(tile, SPILL_BUFFER);
+            if (!ok)
+                goto fail;
+
+            if (set_fraction
+                && !set_fraction((b*ntx + t + 1.0)/(rasterizer->nty*ntx))) {
+                ok = FALSE;
+                goto fail;
+            }
+        }
+        for (t = 0; t < ntx; t++)
+            spill_free(tiles + t);
+    }
+
+    if (mask) {
+        if (gwy_data_field_get_min(mask) == 0.0)
+            gwy_data_field_laplace_solve(rasterizer->dfield, mask, -1, 1.0);
+        else
+            gwy_data_field_clear(rasterizer->dfield);
+    }
+    GWY_OBJECT_UNREF(mask);
+    g_array_free(points, TRUE);
+    g_object_unref(triangulation);
+    g_free(tiles);
+
+    return TRUE;
+
+fail:
+    for (t = 0; t < ntx; t++)
+        spill_free(tiles + t);
+    GWY_OBJECT_UNREF(mask);
+    g_array_free(points, TRUE);
+    g_object_unref(triangulation);
+    g_free(tiles);
+
+    return FALSE;
+}
+
+static void
+spill_init(SpillFile *spill, guint capacity)
+{
+    gwy_clear(spill, 1);
+    spill->buffer = g_array_new(FALSE, FALSE, sizeof(GwyXYZ));
+    spill->capacity = capacity;
+}
+
+static void
+spill_free(SpillFile *spill)
+{
+    if (spill->buffer)
+        g_array_free(spill->buffer, TRUE);
+    if (spill->fh)
+        fclose(spill->fh);
+    if (spill->filename) {
+        g_unlink(spill->filename);
+        g_free(spill->filename);
+    }
+    gwy_clear(spill, 1);
+}
+
+static void
+spill_set_error(GError **error, const gchar *message)
+{
+    gint saved_errno = errno;
+
+    g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(saved_errno),
+                message, g_strerror(saved_errno));
+}
+
+static gboolean
+spill_add(SpillFile *spill, const GwyXYZ *pt, GError **error)
+{
+    g_array_append_vals(spill->buffer, pt, 1);
+    spill->npoints++;
+    if (spill->buffer->len < spill->capacity)
+        return TRUE;
+    return spill_flush(spill, error);
+}
+
+static gboolean
+spill_flush(SpillFile *spill, GError **error)
+{
+    GArray *buffer = spill->buffer;
+
+    if (!buffer->len)
+        return TRUE;
+
+    if (!spill->fh) {
+#ifdef G_OS_WIN32
+        spill->filename = g_strdup_printf("%s\\gwyxyz%08x%08x.tmp",
+                                          g_get_tmp_dir(),
+                                          g_random_int(), g_random_int());
+        if (!(spill->fh = g_fopen(spill->filename, "w+b"))) {
+            spill_set_error(error, _("Cannot create a temporary file: %s."));
+            return FALSE;
+        }
+#else
+        GError *err = NULL;
+        gint fd;
+
+        fd = g_file_open_tmp("gwyxyzXXXXXX", &spill->filename, &err);
+        if (fd < 0) {
+            g_propagate_error(error, err);
+            return FALSE;
+        }
+        if (!(spill->fh = fdopen(fd, "w+b"))) {
+            spill_set_error(error, _("Cannot create a temporary file: %s."));
+            close(fd);
+            return FALSE;
+        }
+#endif
+    }
+
+    if (fwrite(buffer->data, sizeof(GwyXYZ), buffer->len, spill->fh)
+        != buffer->len) {
+        spill_set_error(error, _("Cannot write to a temporary file: %s."));
+        return FALSE;
+    }
+    g_array_set_size(buffer, 0);
+
+    return TRUE;
+}
+
+static gboolean
+spill_rewind(SpillFile *spill, GError **error)
+{
+    spill->consumed = FALSE;
+    if (!spill->fh)
+        return TRUE;
+
+    if (!spill_flush(spill, error))
+        return FALSE;
+    if (fflush(spill->fh) != 0) {
+        spill_set_error(error, _("Cannot write to a temporary file: %s."));
+        return FALSE;
+    }
+    rewind(spill->fh);
+
+    return TRUE;
+}
+
+/* Fills the buffer with the next chunk of points.  An empty buffer means we
+ * have read everything. */
+static gboolean
+spill_read_chunk(SpillFile *spill, GError **error)
+{
+    GArray *buffer = spill->buffer;
+    guint n;
+
+    if (!spill->fh) {
+        if (spill->consumed)
+            g_array_set_size(buffer, 0);
+        spill->consumed = TRUE;
+        return TRUE;
+    }
+
+    g_array_set_size(buffer, SPILL_BUFFER);
+    n = fread(buffer->data, sizeof(GwyXYZ), SPILL_BUFFER, spill->fh);
+    g_array_set_size(buffer, n);
+    if (n < SPILL_BUFFER && ferror(spill->fh)) {
+        spill_set_error(error, _("Cannot read from a temporary file: %s."));
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/************************** Documentation ****************************/
+
+/**
+ * SECTION:rasterizer
+ * @title: GwyXYZRasterizer
+ * @short_description: Streaming XYZ data rasterisation
+ *
+ * #GwyXYZRasterizer renders XYZ data to a #GwyDataField without having all
+ * the points in memory at once.  It is intended for point clouds which are
+ * too large to be loaded as a #GwySurface.
+ *
+ * Create the rasteriser for a data field with the required dimensions using
+ * gwy_xyz_rasterizer_new(), feed it chunks of points read from a file with
+ * gwy_xyz_rasterizer_add_points() and then produce the image with
+ * gwy_xyz_rasterizer_finish().
+ **/
+
+/**
+ * GwyXYZRasterizer:
+ *
+ * #GwyXYZRasterizer is an opaque data structure and should be only manipulated
+ * with the functions below.
+ *
+ * Since: 2.47
+ **/
+
+/**
+ * GwyXYZRasterizeType:
+ * @GWY_XYZ_RASTERIZE_AVERAGE: Values are weighted averages of points near each
+ *                             pixel, like in gwy_data_field_average_xyz().
+ * @GWY_XYZ_RASTERIZE_NEAREST: Values are taken from the nearest point to each
+ *                             pixel centre.
+ * @GWY_XYZ_RASTERIZE_LINEAR: Values are linearly interpolated in the Delaunay
+ *                            triangulation, which is constructed separately
+ *                            for each tile of the image.
+ *
+ * Type of streaming XYZ data rasterisation.
+ *
+ * Since: 2.47
+ **/
+
+/* vim: set cin et ts=4 sw=4 cino=>1s,e0,n0,f0,{0,}0,^0,\:1s,=0,g1s,h0,t0,+1s,c3,(0,u0 : */
@@ -0,0 +1,60 @@
+/*
+ *  @(#) $Id$
+ *  Copyright (C) 2016 David Necas (Yeti).
+ *  E-mail: yeti@gwyddion.net.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GWY_PROCESS_RASTERIZER_H__
+#define __GWY_PROCESS_RASTERIZER_H__
+
+#include <glib.h>
+#include <libgwyddion/gwymath.h>
+#include <libgwyddion/gwyutils.h>
+#include <libprocess/datafield.h>
+
+G_BEGIN_DECLS
+
+typedef enum {
+    GWY_XYZ_RASTERIZE_AVERAGE = 0,
+    GWY_XYZ_RASTERIZE_NEAREST = 1,
+    GWY_XYZ_RASTERIZE_LINEAR  = 2,
+} GwyXYZRasterizeType;
+
+typedef struct _GwyXYZRasterizer GwyXYZRasterizer;
+
+GwyXYZRasterizer* gwy_xyz_rasterizer_new        (GwyDataField *dfield,
+                                                 GwyXYZRasterizeType type);
+void              gwy_xyz_rasterizer_free       (GwyXYZRasterizer *rasterizer);
+void              gwy_xyz_rasterizer_set_tiling (GwyXYZRasterizer *rasterizer,
+                                                 guint tile_size,
+                                                 guint halo);
+gboolean          gwy_xyz_rasterizer_add_points (GwyXYZRasterizer *rasterizer,
+                                                 const GwyXYZ *points,
+                                                 guint npoints,
+                                                 GError **error);
+guint64           gwy_xyz_rasterizer_get_npoints(GwyXYZRasterizer *rasterizer);
+gboolean          gwy_xyz_rasterizer_finish     (GwyXYZRasterizer *rasterizer,
+                                                 GwySetFractionFunc set_fraction,
+                                                 GwySetMessageFunc set_message,
+                                                 GError **error);
+
+G_END_DECLS
+
+#endif /* __GWY_PROCESS_RASTERIZER_H__ */
+
+/* vim: set cin et ts=4 sw=4 cino=>1s,e0,n0,f0,{0,}0,^0,\:1s,=0,g1s,h0,t0,+1s,c3,(0,u0 : */
@@ -30,6 +30,7 @@
 #include <libprocess/spectra.h>
 #include <libprocess/linestats.h>
 #include <libprocess/interpolation.h>
+#include "gwyprocessinternal.h"
 
 #define GWY_SPECTRA_TYPE_NAME "GwySpectra"
 /* default number number of spectra allocated to data and coords */
@@ -48,11 +49,6 @@ enum {
     LAST_SIGNAL
 };
 
-typedef struct {
-    guint index;
-    gdouble r;
-} CoordPos;
-
 typedef struct {
     gdouble x;
     gdouble y;
@@ -80,6 +76,9 @@ static void        gwy_spectra_get_property     (GObject *object,
                                                  GValue *value,
                                                  GParamSpec *pspec);
 
+static void        ensure_xyindex               (GwySpectra *spectra);
+static void        drop_xyindex                 (GwySpectra *spectra);
+
 static guint spectra_signals[LAST_SIGNAL] = { 0 };
 
 G_DEFINE_TYPE_EXTENDED
@@ -188,6 +187,7 @@ gwy_spectra_finalize(GObject *object)
     }
     g_array_free(spectra->spectra, TRUE);
     spectra->spectra = NULL;
+    drop_xyindex(spectra);
 
     g_free(spectra->title);
     g_free(spectra->spec_xlabel);
@@ -584,6 +584,7 @@ gwy_spectra_clone_real(GObject *source, GObject *copy)
     }
 
     /* Copy the spectra to clone */
+    drop_xyindex(clone);
     g_array_set_size(clone->spectra, 0);
     g_array_append_vals(clone->spectra, spectra->spectra->data,
                         spectra->spectra->len);
@@ -726,19 +727,6 @@ gwy_spectra_xytoi(GwySpectra *spectra, gdouble x, gdouble y)
     return i;
 }
 
-static gint
-compare_coord_pos(gconstpointer a, gconstpointer b)
-{
-    const CoordPos *acp = (const CoordPos*)a;
-    const CoordPos *bcp = (const CoordPos*)b;
-
-    if (acp->r < bcp->r)
-        return -1;
-    if (acp->r > bcp->r)
-        return 1;
-    return 0;
-}
-
 /**
  * gwy_spectra_find_nearest:
  * @spectra: A spectra object.
@@ -753,7 +741,9 @@ compare_coord_pos(gconstpointer a, gconstpointer b)
  * Gets the list of the indices to spectra ordered by their distance from a
  * given point.
  *
- * List positions
+ * A spatial index of spectra positions is built on the first call and kept
+ * until spectra are added, removed or moved, making repeated queries fast
+ * even for large numbers of spectra.
  *
  * Since: 2.7
  **/
@@ -764,72 +754,102 @@ gwy_spectra_find_nearest(GwySpectra *spectra,
                          guint n,
                          guint *ilist)
 {
-    enum { DIRECT_LIMIT = 6 };
-
-    CoordPos *items;
-    guint nspec, i;
-
     g_return_if_fail(GWY_IS_SPECTRA(spectra));
     g_return_if_fail(ilist || !n);
 
-    nspec = spectra->spectra->len;
-    n = MIN(n, nspec);
-    if (!n)
-        return;
+    ensure_xyindex(spectra);
+    _gwy_xy_index_find_nearest(spectra->reserved3, x, y, n, ilist);
+}
 
-    if (n <= DIRECT_LIMIT) {
-        items = g_newa(CoordPos, n);
+/**
+ * gwy_spectra_find_in_radius:
+ * @spectra: A spectra object.
+ * @x: Centre x-coordinate.
+ * @y: Centre y-coordinate.
+ * @r: Radius.
+ * @n: Location to store the number of found spectra.
+ *
+ * Finds all spectra located within given distance from a point.
+ *
+ * Spectra exactly at distance @r are included.  Like
+ * gwy_spectra_find_nearest(), this function uses a spatial index of spectra
+ * positions, which is rebuilt when spectra are added, removed or moved.
+ *
+ * Returns: A newly allocated array of spectra indices, sorted in ascending
+ *          order.  If there are no such spectra %NULL is returned.
+ *
+ * Since: 2.47
+ **/
+guint*
+gwy_spectra_find_in_radius(GwySpectra *spectra,
+                           gdouble x,
+                           gdouble y,
+                           gdouble r,
+                           guint *n)
+{
+    g_return_val_if_fail(n, NULL);
+    *n = 0;
+    g_return_val_if_fail(GWY_IS_SPECTRA(spectra), NULL);
 
-        /* Initialize with sorted initial n items */
-        for (i = 0; i < n; i++) {
-            GwySpectrum *spec = &g_array_index(spectra->spectra, GwySpectrum,
-                                               i);
-            items[i].index = i;
-            items[i].r = ((spec->x - x)*(spec->x - x)
-                          + (spec->y - y)*(spec->y - y));
-        }
-        qsort(items, n, sizeof(CoordPos), compare_coord_pos);
-
-        /* And let the remaining items compete for positions */
-        for (i = n; i < nspec; i++) {
-            guint j, k;
-            gdouble r;
-            GwySpectrum *spec = &g_array_index(spectra->spectra, GwySpectrum,
-                                               i);
-
-            r = ((spec->x - x)*(spec->x - x)
-                 + (spec->y - y)*(spec->y - y));
-            if (r < items[n-1].r) {
-                for (j = 1; j < n && r < items[n-1 - j].r; j++)
-                    ;
-                for (k = 0; k < j-1; k++)
-                    items[n-k] = items[n-1 - k];
-
-                items[n-j].index = i;
-                items[n-j].r = r;
-            }
-        }
+    ensure_xyindex(spectra);
+    return _gwy_xy_index_find_in_radius(spectra->reserved3, x, y, r, n);
+}
 
-        /* Move the results to ilist */
-        for (i = 0; i < n; i++)
-            ilist[i] = items[i].index;
-    }
-    else {
-        /* Sort all items and take the head */
-        items = g_new(CoordPos, spectra->spectra->len);
-        for (i = 0; i < spectra->spectra->len; i++) {
-            GwySpectrum *spec = &g_array_index(spectra->spectra, GwySpectrum,
-                                               i);
-
-            items[i].index = i;
-            items[i].r = ((spec->x - x)*(spec->x - x)
-                          + (spec->y - y)*(spec->y - y));
-        }
-        qsort(items, nspec, sizeof(CoordPos), compare_coord_pos);
-        for (i = 0; i < n; i++)
-            ilist[i] = items[i].index;
+/**
+ * gwy_spectra_find_in_rectangle:
+ * @spectra: A spectra object.
+ * @xfrom: Minimum x-coordinate value.
+ * @xto: Maximum x-coordinate value.
+ * @yfrom: Minimum y-coordinate value.
+ * @yto: Maximum y-coordinate value.
+ * @n: Location to store the number of found spectra.
+ *
+ * Finds all spectra located in a rectangle.
+ *
+ * The ranges are inclusive.  The spatial index is used as in
+ * gwy_spectra_find_in_radius().
+ *
+ * Returns: A newly allocated array of spectra indices, sorted in ascending
+ *          order.  If there are no such spectra %NULL is returned.
+ *
+ * Since: 2.47
+ **/
+guint*
+gwy_spectra_find_in_rectangle(GwySpectra *spectra,
+                              gdouble xfrom,
+                              gdouble xto,
+                              gdouble yfrom,
+                              gdouble yto,
+                              guint *n)
+{
+    g_return_val_if_fail(n, NULL);
+    *n = 0;
+    g_return_val_if_fail(GWY_IS_SPECTRA(spectra), NULL);
 
-        g_free(items);
+    ensure_xyindex(spectra);
+    return _gwy_xy_index_find_in_rectangle(spectra->reserved3,
+                                           xfrom, xto, yfrom, yto, n);
+}
+
+/* The spatial index is kept in reserved3. */
+static void
+ensure_xyindex(GwySpectra *spectra)
+{
+    GArray *array = spectra->spectra;
+
+    if (spectra->reserved3)
+        return;
+
+    spectra->reserved3 = _gwy_xy_index_new(array->data, sizeof(GwySpectrum),
+                                           array->len);
+}
+
+static void
+drop_xyindex(GwySpectra *spectra)
+{
+    if (spectra->reserved3) {
+        _gwy_xy_index_free((GwyXYIndex*)spectra->reserved3);
+        spectra->reserved3 = NULL;
     }
 }
 
@@ -857,6 +877,7 @@ gwy_spectra_setpos(GwySpectra *spectra,
     spec = &g_array_index(spectra->spectra, GwySpectrum, i);
     spec->x = x;
     spec->y = y;
+    drop_xyindex(spectra);
 }
 
 /**
@@ -1006,6 +1027,7 @@ gwy_spectra_add_spectrum(GwySpectra *spectra,
     spec.ydata = new_spectrum;
     spec.selected = FALSE;
     g_array_append_val(spectra->spectra, spec);
+    drop_xyindex(spectra);
 }
 
 /**
@@ -1031,6 +1053,7 @@ gwy_spectra_remove_spectrum(GwySpectra *spectra,
     g_object_unref(spec->ydata);
 
     g_array_remove_index(spectra->spectra, i);
+    drop_xyindex(spectra);
 }
 
 /* FIXME: Uncomment once it does anything. */
@@ -1255,6 +1278,7 @@ gwy_spectra_clear(GwySpectra *spectra)
         g_object_unref(spec->ydata);
     }
     g_array_set_size(spectra->spectra, 0);
+    drop_xyindex(spectra);
 }
 
 /************************** Documentation ****************************/
@@ -109,6 +109,17 @@ void         gwy_spectra_find_nearest         (GwySpectra *spectra,
                                                gdouble y,
                                                guint n,
                                                guint *ilist);
+guint*       gwy_spectra_find_in_radius       (GwySpectra *spectra,
+                                               gdouble x,
+                                               gdouble y,
+                                               gdouble r,
+                                               guint *n);
+guint*       gwy_spectra_find_in_rectangle    (GwySpectra *spectra,
+                                               gdouble xfrom,
+                                               gdouble xto,
+                                               gdouble yfrom,
+                                               gdouble yto,
+                                               guint *n);
 void         gwy_spectra_add_spectrum         (GwySpectra *spectra,
                                                GwyDataLine *new_spectrum,
                                                gdouble x,
@@ -28,6 +28,7 @@
 
 #include <libgwyddion/gwymacros.h>
 #include <libgwyddion/gwymath.h>
+#include "libgwyddion/gwyomp.h"
 #include <libprocess/datafield.h>
 #include <libprocess/level.h>
 #include <libprocess/stats.h>
@@ -1100,10 +1101,10 @@ gwy_data_field_get_autorange(GwyDataField *data_field,
                              gdouble *to)
 {
     enum { AR_NDH = 512 };
-    guint dh[AR_NDH];
-    gdouble min, max, rmin, rmax, q;
-    gdouble *p;
-    guint i, n, j;
+    gdouble dh[AR_NDH];
+    const guint *bins;
+    gdouble min, max, rmin, rmax, q, s, c, t, prev;
+    guint i, j, k, n, nbins;
 
     g_return_if_fail(GWY_IS_DATA_FIELD(data_field));
 
@@ -1117,30 +1118,34 @@ gwy_data_field_get_autorange(GwyDataField *data_field,
         return;
     }
 
-    gwy_data_field_get_min_max(data_field, &min, &max);
+    bins = gwy_data_field_get_value_histogram(data_field, &nbins, &min, &max);
     if (min == max) {
         rmin = min;
         rmax = max;
     }
     else {
-        max += 1e-6*(max - min);
-        q = AR_NDH/(max - min);
-
+        /* Resample the cached fine histogram to AR_NDH coarse bins by linear
+         * interpolation of the cumulative counts. */
         n = data_field->xres*data_field->yres;
-        gwy_clear(dh, AR_NDH);
-        for (i = n, p = data_field->data; i; i--, p++) {
-            j = (*p - min)*q;
-            dh[MIN(j, AR_NDH-1)]++;
+        q = AR_NDH/(max - min);
+        s = prev = 0.0;
+        for (j = k = 0; j < AR_NDH; j++) {
+            t = (j + 1.0)*nbins/AR_NDH;
+            while (k < nbins && k + 1 <= t)
+                s += bins[k++];
+            c = (k < nbins) ? s + (t - k)*bins[k] : s;
+            dh[j] = c - prev;
+            prev = c;
         }
 
-        j = 0;
-        for (i = j = 0; dh[i] < 5e-2*n/AR_NDH && j < 2e-2*n; i++)
-            j += dh[i];
+        s = 0.0;
+        for (i = 0; i < AR_NDH-1 && dh[i] < 5e-2*n/AR_NDH && s < 2e-2*n; i++)
+            s += dh[i];
         rmin = min + i/q;
 
-        j = 0;
-        for (i = AR_NDH-1, j = 0; dh[i] < 5e-2*n/AR_NDH && j < 2e-2*n; i--)
-            j += dh[i];
+        s = 0.0;
+        for (i = AR_NDH-1; i && dh[i] < 5e-2*n/AR_NDH && s < 2e-2*n; i--)
+            s += dh[i];
         rmax = min + (i + 1)/q;
     }
 
@@ -1154,6 +1159,128 @@ gwy_data_field_get_autorange(GwyDataField *data_field,
     data_field->cached |= CBIT(ARF) | CBIT(ART);
 }
 
+static inline guint
+value_histogram_bin(gdouble v, gdouble min, gdouble q, guint nbins)
+{
+    gint k = (gint)((v - min)*q);
+
+    return (guint)CLAMP(k, 0, (gint)nbins - 1);
+}
+
+static GwyFieldHistogram*
+ensure_value_histogram(GwyDataField *data_field)
+{
+    GwyFieldHistogram *hist = (GwyFieldHistogram*)data_field->reserved1;
+    const gdouble *d;
+    gdouble min, max, q;
+    guint i, n, nbins;
+
+    if (hist && CTEST(data_field, HST))
+        return hist;
+
+    n = data_field->xres*data_field->yres;
+    nbins = GWY_ROUND(pow(n, 2.0/3.0));
+    nbins = MAX(nbins, 2) - 1;
+    gwy_data_field_get_min_max(data_field, &min, &max);
+
+    if (!hist) {
+        hist = g_new0(GwyFieldHistogram, 1);
+        data_field->reserved1 = hist;
+    }
+    if (hist->nbins != nbins) {
+        hist->bins = g_renew(guint, hist->bins, nbins);
+        hist->nbins = nbins;
+    }
+    gwy_clear(hist->bins, nbins);
+    hist->min = min;
+    hist->max = max;
+
+    if (min == max)
+        hist->bins[0] = n;
+    else {
+        d = data_field->data;
+        q = nbins/(max - min);
+#ifdef _OPENMP
+#pragma omp parallel if(gwy_omp_use_threads(n)) \
+            private(i) \
+            shared(d,n,nbins,min,q,hist)
+#endif
+        {
+            guint ifrom = gwy_omp_chunk_start(n), ito = gwy_omp_chunk_end(n);
+            guint *bins = hist->bins;
+
+            if (gwy_omp_num_threads() > 1)
+                bins = g_new0(guint, nbins);
+
+            for (i = ifrom; i < ito; i++)
+                bins[value_histogram_bin(d[i], min, q, nbins)]++;
+
+            if (bins != hist->bins) {
+#ifdef _OPENMP
+#pragma omp critical
+#endif
+                {
+                    guint k;
+
+                    for (k = 0; k < nbins; k++)
+                        hist->bins[k] += bins[k];
+                }
+                g_free(bins);
+            }
+        }
+    }
+
+    data_field->cached |= CBIT(HST);
+
+    return hist;
+}
+
+/**
+ * gwy_data_field_get_value_histogram:
+ * @data_field: A data field.
+ * @nbins: Location to store the number of histogram bins.
+ * @min: Location to store the lower bound of the first bin, or %NULL.
+ * @max: Location to store the upper bound of the last bin, or %NULL.
+ *
+ * Obtains a fine-grained histogram of data field values.
+ *
+ * The histogram has @nbins bins of equal width covering the entire value
+ * range, i.e. @min and @max are the minimum and maximum of the data.  Values
+ * equal to the maximum are counted in the last bin.  The number of bins is
+ * chosen automatically, approximately as the 2/3 power of the number of
+ * pixels.  This makes the histogram fine enough to serve as a quantile
+ * estimate, for instance for adaptive false colour mapping.
+ *
+ * This quantity is cached.
+ *
+ * Returns: The histogram counts.  The array is owned by @data_field and must
+ *          not be modified nor freed.  It is valid until @data_field is
+ *          destroyed or the histogram is recalculated after a data change.
+ *
+ * Since: 2.47
+ **/
+const guint*
+gwy_data_field_get_value_histogram(GwyDataField *data_field,
+                                   guint *nbins,
+                                   gdouble *min,
+                                   gdouble *max)
+{
+    GwyFieldHistogram *hist;
+
+    g_return_val_if_fail(GWY_IS_DATA_FIELD(data_field), NULL);
+    g_return_val_if_fail(nbins, NULL);
+
+    gwy_debug("%s", CTEST(data_field, HST) ? "cache" : "lame");
+    hist = ensure_value_histogram(data_field);
+    *nbins = hist->nbins;
+    if (min)
+        *min = hist->min;
+    if (max)
+        *max = hist->max;
+
+    return hist->bins;
+}
+
 /**
  * gwy_data_field_get_stats:
  * @data_field: A data field.
@@ -5721,9 +5848,12 @@ gwy_data_field_area_get_median_mask(GwyDataField *dfield,
 gdouble
 gwy_data_field_get_median(GwyDataField *data_field)
 {
-    gint xres, yres;
+    GwyFieldHistogram *hist;
+    const gdouble *d;
     gdouble *buffer;
-    gdouble med;
+    gdouble med, q;
+    guint i, j, k, n, s, rank;
+    gboolean found;
 
     g_return_val_if_fail(GWY_IS_DATA_FIELD(data_field), 0.0);
 
@@ -5731,11 +5861,45 @@ gwy_data_field_get_median(GwyDataField *data_field)
     if (CTEST(data_field, MED))
         return CVAL(data_field, MED);
 
-    xres = data_field->xres;
-    yres = data_field->yres;
-    buffer = g_memdup(data_field->data, xres*yres*sizeof(gdouble));
-    med = gwy_math_median(xres*yres, buffer);
-    g_free(buffer);
+    /* Use the value histogram to find the bin containing the median and
+     * then only rank the values falling into this bin.  Fall back to plain
+     * median calculation if the distribution is too concentrated. */
+    hist = ensure_value_histogram(data_field);
+    n = data_field->xres*data_field->yres;
+    rank = n/2;
+    for (k = s = 0; k < hist->nbins && s + hist->bins[k] <= rank; k++)
+        s += hist->bins[k];
+
+    med = hist->min;
+    found = (hist->min == hist->max);
+    if (!found && k < hist->nbins && hist->bins[k] <= n/8) {
+        d = data_field->data;
+        q = hist->nbins/(hist->max - hist->min);
+        buffer = g_new(gdouble, hist->bins[k]);
+        for (i = j = 0; i < n; i++) {
+            if (value_histogram_bin(d[i], hist->min, q, hist->nbins) == k) {
+                if (j == hist->bins[k])
+                    break;
+                buffer[j++] = d[i];
+            }
+        }
+        if (i == n && j == hist->bins[k]) {
+            gwy_math_sort(j, buffer);
+            med = buffer[rank - s];
+            found = TRUE;
+        }
+        else {
+            /* The histogram does not match the data, which were probably
+             * modified without invalidation.  Forget it. */
+            data_field->cached &= ~CBIT(HST);
+        }
+        g_free(buffer);
+    }
+    if (!found) {
+        buffer = g_memdup(data_field->data, n*sizeof(gdouble));
+        med = gwy_math_median(n, buffer);
+        g_free(buffer);
+    }
 
     CVAL(data_field, MED) = med;
     data_field->cached |= CBIT(MED);
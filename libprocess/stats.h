@@ -190,6 +190,10 @@ gdouble gwy_data_field_area_get_volume      (GwyDataField *data_field,
 void    gwy_data_field_get_autorange        (GwyDataField *data_field,
                                              gdouble *from,
                                              gdouble *to);
+const guint* gwy_data_field_get_value_histogram(GwyDataField *data_field,
+                                                guint *nbins,
+                                                gdouble *min,
+                                                gdouble *max);
 void    gwy_data_field_get_stats            (GwyDataField *data_field,
                                              gdouble *avg,
                                              gdouble *ra,
@@ -53,6 +53,8 @@ static void        copy_info                    (GwySurface *dest,
                                                  const GwySurface *src);
 static void        ensure_ranges                (GwySurface *surface);
 static void        ensure_checksum              (GwySurface *surface);
+static void        ensure_xyindex               (GwySurface *surface);
+static void        drop_xyindex                 (GwySurface *surface);
 
 static guint signals[N_SIGNALS];
 
@@ -112,6 +114,8 @@ alloc_data(GwySurface *surface)
     GWY_FREE(surface->data);
     if (surface->n)
         surface->data = g_new(GwyXYZ, surface->n);
+    gwy_debug_objects_set_size(G_OBJECT(surface),
+                               surface->n*sizeof(GwyXYZ));
 }
 
 static void
@@ -136,6 +140,7 @@ gwy_surface_finalize(GObject *object)
 {
     GwySurface *surface = GWY_SURFACE(object);
     free_data(surface);
+    drop_xyindex(surface);
     G_OBJECT_CLASS(gwy_surface_parent_class)->finalize(object);
 }
 
@@ -233,6 +238,8 @@ gwy_surface_deserialize(const guchar *buffer,
     g_free(surface->data);
     surface->data = data;
     surface->n = datasize/3;
+    gwy_debug_objects_set_size(G_OBJECT(surface),
+                               surface->n*sizeof(GwyXYZ));
 
     if (si_unit_z) {
         GWY_OBJECT_UNREF(surface->priv->si_unit_z);
@@ -307,6 +314,9 @@ copy_info(GwySurface *dest,
 
     dpriv->cached_checksum = spriv->cached_checksum;
     gwy_assign(dpriv->checksum, spriv->checksum, G_N_ELEMENTS(spriv->checksum));
+
+    /* The spatial index is not shared, it is rebuilt on demand. */
+    drop_xyindex(dest);
 }
 
 /**
@@ -643,8 +653,9 @@ gwy_surface_copy(GwySurface *src,
  *
  * Cached statistics include ranges returned by gwy_surface_get_xrange(),
  * gwy_surface_get_yrange() and gwy_surface_get_min_max(), the fingerprint
- * for gwy_surface_xy_is_compatible() and and possibly other characteristics
- * in the future.
+ * for gwy_surface_xy_is_compatible(), the spatial index used by
+ * gwy_surface_find_nearest() and similar functions and possibly other
+ * characteristics in the future.
  *
  * See gwy_data_field_invalidate() for discussion of invalidation and examples.
  *
@@ -656,6 +667,7 @@ gwy_surface_invalidate(GwySurface *surface)
     g_return_if_fail(GWY_IS_SURFACE(surface));
     surface->priv->cached_ranges = FALSE;
     surface->priv->cached_checksum = FALSE;
+    drop_xyindex(surface);
 }
 
 /**
@@ -1009,6 +1021,7 @@ gwy_surface_set(GwySurface *surface,
     g_return_if_fail(GWY_IS_SURFACE(surface));
     g_return_if_fail(pos < surface->n);
     surface->data[pos] = point;
+    gwy_surface_invalidate(surface);
 }
 
 /**
@@ -1062,6 +1075,7 @@ gwy_surface_set_data_full(GwySurface *surface,
     }
     if (n)
         gwy_assign(surface->data, points, n);
+    gwy_surface_invalidate(surface);
 }
 
 /**
@@ -1243,6 +1257,136 @@ ensure_checksum(GwySurface *surface)
     surface->priv->cached_checksum = TRUE;
 }
 
+static void
+ensure_xyindex(GwySurface *surface)
+{
+    Surface *priv = surface->priv;
+
+    if (priv->xyindex)
+        return;
+
+    priv->xyindex = _gwy_xy_index_new(surface->data, sizeof(GwyXYZ),
+                                      surface->n);
+}
+
+static void
+drop_xyindex(GwySurface *surface)
+{
+    Surface *priv = surface->priv;
+
+    if (priv->xyindex) {
+        _gwy_xy_index_free(priv->xyindex);
+        priv->xyindex = NULL;
+    }
+}
+
+/**
+ * gwy_surface_find_nearest:
+ * @surface: A surface.
+ * @x: Point x-coordinate.
+ * @y: Point y-coordinate.
+ * @n: Number of indices to find.  Array @ilist must have at least this
+ *     number of items.
+ * @ilist: Array to place the point indices to.  They will be sorted by the
+ *         distance from (@x, @y).  Positions after the number of points in
+ *         @surface will be left untouched.
+ *
+ * Finds the surface points nearest to a given point in the XY plane.
+ *
+ * The first query builds a spatial index of the surface points which is then
+ * kept until the surface is invalidated.  Subsequent queries take time
+ * roughly proportional to the number of points found, not to the number of
+ * points in @surface.  See gwy_surface_invalidate() for discussion.
+ *
+ * Returns: The number of indices stored to @ilist, i.e. the smaller of @n
+ *          and the number of points in @surface.
+ *
+ * Since: 2.47
+ **/
+guint
+gwy_surface_find_nearest(GwySurface *surface,
+                         gdouble x,
+                         gdouble y,
+                         guint n,
+                         guint *ilist)
+{
+    g_return_val_if_fail(GWY_IS_SURFACE(surface), 0);
+    g_return_val_if_fail(ilist || !n, 0);
+
+    ensure_xyindex(surface);
+    return _gwy_xy_index_find_nearest(surface->priv->xyindex, x, y, n, ilist);
+}
+
+/**
+ * gwy_surface_find_in_radius:
+ * @surface: A surface.
+ * @x: Centre x-coordinate.
+ * @y: Centre y-coordinate.
+ * @r: Radius.
+ * @n: Location to store the number of found points.
+ *
+ * Finds all surface points within given distance from a point in the XY
+ * plane.
+ *
+ * Points exactly at distance @r are included.  The spatial index is used as
+ * in gwy_surface_find_nearest().
+ *
+ * Returns: A newly allocated array of point indices, sorted in ascending
+ *          order.  If there are no such points %NULL is returned.
+ *
+ * Since: 2.47
+ **/
+guint*
+gwy_surface_find_in_radius(GwySurface *surface,
+                           gdouble x,
+                           gdouble y,
+                           gdouble r,
+                           guint *n)
+{
+    g_return_val_if_fail(n, NULL);
+    *n = 0;
+    g_return_val_if_fail(GWY_IS_SURFACE(surface), NULL);
+
+    ensure_xyindex(surface);
+    return _gwy_xy_index_find_in_radius(surface->priv->xyindex, x, y, r, n);
+}
+
+/**
+ * gwy_surface_find_in_rectangle:
+ * @surface: A surface.
+ * @xfrom: Minimum x-coordinate value.
+ * @xto: Maximum x-coordinate value.
+ * @yfrom: Minimum y-coordinate value.
+ * @yto: Maximum y-coordinate value.
+ * @n: Location to store the number of found points.
+ *
+ * Finds all surface points with lateral coordinates within given ranges.
+ *
+ * The ranges are inclusive, as in gwy_surface_new_part().  The spatial index
+ * is used as in gwy_surface_find_nearest().
+ *
+ * Returns: A newly allocated array of point indices, sorted in ascending
+ *          order.  If there are no such points %NULL is returned.
+ *
+ * Since: 2.47
+ **/
+guint*
+gwy_surface_find_in_rectangle(GwySurface *surface,
+                              gdouble xfrom,
+                              gdouble xto,
+                              gdouble yfrom,
+                              gdouble yto,
+                              guint *n)
+{
+    g_return_val_if_fail(n, NULL);
+    *n = 0;
+    g_return_val_if_fail(GWY_IS_SURFACE(surface), NULL);
+
+    ensure_xyindex(surface);
+    return _gwy_xy_index_find_in_rectangle(surface->priv->xyindex,
+                                           xfrom, xto, yfrom, yto, n);
+}
+
 /**
  * SECTION: surface
  * @title: GwySurface
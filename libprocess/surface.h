@@ -127,6 +127,22 @@ void              gwy_surface_set_data_full      (GwySurface *surface,
                                                   guint n);
 gboolean          gwy_surface_xy_is_compatible   (GwySurface *surface,
                                                   GwySurface *othersurface);
+guint             gwy_surface_find_nearest       (GwySurface *surface,
+                                                  gdouble x,
+                                                  gdouble y,
+                                                  guint n,
+                                                  guint *ilist);
+guint*            gwy_surface_find_in_radius     (GwySurface *surface,
+                                                  gdouble x,
+                                                  gdouble y,
+                                                  gdouble r,
+                                                  guint *n);
+guint*            gwy_surface_find_in_rectangle  (GwySurface *surface,
+                                                  gdouble xfrom,
+                                                  gdouble xto,
+                                                  gdouble yfrom,
+                                                  gdouble yto,
+                                                  guint *n);
 
 G_END_DECLS
 
@@ -21,12 +21,14 @@
 
 #include "config.h"
 #include <string.h>
+#include <stdlib.h>
 #include <libgwyddion/gwymacros.h>
 #include <libgwyddion/gwymath.h>
 #include <libprocess/filters.h>
 #include <libprocess/stats.h>
 #include <libprocess/grains.h>
 #include <libprocess/morph_lib.h>
+#include "libgwyddion/gwyomp.h"
 
 /* INTERPOLATION: New (not applicable). */
 
@@ -920,35 +922,40 @@ i_datafield_to_largefield(GwyDataField *datafield,
     return ret;
 }
 
-static GwyDataField*
-i_largefield_to_datafield(gint **field,
-                          GwyDataField *ret,
-                          GwyDataField *tipfield,
-                          gdouble min,
-                          gdouble step)
+static void
+largefield_to_datafield(const gdouble *field,
+                        GwyDataField *ret,
+                        GwyDataField *tipfield)
 {
     gint col, row;
-    gint xnew, ynew;
+    gint xres, yres, xnew;
     gint txr2, tyr2;
 
-    xnew = ret->xres + tipfield->xres;
-    ynew = ret->yres + tipfield->yres;
+    xres = ret->xres;
+    yres = ret->yres;
+    xnew = xres + tipfield->xres;
     txr2 = tipfield->xres/2;
     tyr2 = tipfield->yres/2;
 
-    for (row = 0; row < ynew; row++) {
-        for (col = 0; col < xnew; col++) {
-            if (col >= txr2
-                && col < (ret->xres + txr2)
-                && row >= tyr2
-                && row < (ret->yres + tyr2)) {
-                ret->data[col - txr2 + ret->xres*(row - tyr2)]
-                    = field[row][col]*step + min;
-            }
-        }
+    for (row = 0; row < yres; row++) {
+        for (col = 0; col < xres; col++)
+            ret->data[col + xres*row] = field[col + txr2 + xnew*(row + tyr2)];
     }
 
     gwy_data_field_invalidate(ret);
+}
+
+static gdouble*
+imatrix_to_doubles(gint **field, gint xres, gint yres)
+{
+    gdouble *ret = g_new(gdouble, xres*yres);
+    gint col, row;
+
+    for (row = 0; row < yres; row++) {
+        for (col = 0; col < xres; col++)
+            ret[row*xres + col] = field[row][col];
+    }
+
     return ret;
 }
 
@@ -967,43 +974,316 @@ get_right_tip_field(GwyDataField *tip,
                                         GWY_INTERPOLATION_BSPLINE);
 }
 
-static inline gdouble
-tip_convolve_interior(const gdouble *src, gint xres,
-                      const gdouble *tip, gint txres, gint tyres)
+/*
+ * All the tip operations are evaluated as
+ *
+ *   dest[i,j] = max_{ii,jj} src[i+ii-ioff, j+jj-joff] + tip[ii,jj]
+ *
+ * Erosion is the same with negated data.  Instead of going through the tip
+ * in the natural order, we go through the tip rows sorted by their maximum,
+ * and the pixels in each row sorted by height.  Since src does not exceed its
+ * maximum over the footprint (or over the corresponding part of one row), we
+ * can stop as soon as this maximum plus the tip height is not larger than the
+ * current maximum.  This only skips terms that cannot change the result so
+ * the result is exactly the same as the brute-force evaluation.  The maxima
+ * are computed by the separable van Herk-Gil-Werman running maximum whose
+ * cost does not depend on the tip size.
+ */
+typedef struct {
+    gint dj;
+    gdouble t;
+} TipPoint;
+
+typedef struct {
+    gint di;
+    gint from;
+    gdouble tmax;
+} TipRow;
+
+typedef struct {
+    TipPoint *points;
+    TipRow *rows;
+    gint txres;
+    gint tyres;
+    gint ioff;
+    gint joff;
+    gboolean clamp;
+    gboolean flat;
+} TipMorph;
+
+/* Number of progress reporting steps. */
+enum { TIP_NBATCHES = 32 };
+
+static gint
+compare_tip_points(gconstpointer pa, gconstpointer pb)
 {
-    gdouble hmax = -G_MAXDOUBLE;
-    gint i, j;
+    const TipPoint *a = (const TipPoint*)pa;
+    const TipPoint *b = (const TipPoint*)pb;
+
+    if (a->t > b->t)
+        return -1;
+    if (a->t < b->t)
+        return 1;
+    return a->dj - b->dj;
+}
 
-    for (i = 0; i < tyres; i++) {
-        const gdouble *srcrow = src + i*xres;
-        for (j = txres; j; j--) {
-            gdouble h = *(srcrow++) + *(tip++);
-            if (h > hmax)
-                hmax = h;
-        }
-    }
-    return hmax;
+static gint
+compare_tip_rows(gconstpointer pa, gconstpointer pb)
+{
+    const TipRow *a = (const TipRow*)pa;
+    const TipRow *b = (const TipRow*)pb;
+
+    if (a->tmax > b->tmax)
+        return -1;
+    if (a->tmax < b->tmax)
+        return 1;
+    return a->di - b->di;
 }
 
-static inline gdouble
-tip_convolve_border(const gdouble *src, gint xres, gint yres,
-                    const gdouble *tip, gint txres, gint tyres,
-                    gint j, gint i)
+static void
+tip_morph_init(TipMorph *morph,
+               const gdouble *tip, gint txres, gint tyres,
+               gint ioff, gint joff, gboolean clamp)
 {
-    gint ioff = tyres/2, joff = txres/2;
-    gdouble hmax = -G_MAXDOUBLE;
+    TipPoint *tp;
     gint ii, jj;
 
+    morph->txres = txres;
+    morph->tyres = tyres;
+    morph->ioff = ioff;
+    morph->joff = joff;
+    morph->clamp = clamp;
+    morph->points = g_new(TipPoint, txres*tyres);
+    morph->rows = g_new(TipRow, tyres);
     for (ii = 0; ii < tyres; ii++) {
-        gint isrc = CLAMP(i + ii - ioff, 0, yres-1);
+        tp = morph->points + ii*txres;
         for (jj = 0; jj < txres; jj++) {
-            gint jsrc = CLAMP(j + jj - joff, 0, xres-1);
-            gdouble h = src[isrc*xres + jsrc] + *(tip++);
-            if (h > hmax)
-                hmax = h;
+            tp[jj].dj = jj - joff;
+            tp[jj].t = tip[ii*txres + jj];
+        }
+        qsort(tp, txres, sizeof(TipPoint), compare_tip_points);
+        morph->rows[ii].di = ii - ioff;
+        morph->rows[ii].from = ii*txres;
+        morph->rows[ii].tmax = tp[0].t;
+    }
+    qsort(morph->rows, tyres, sizeof(TipRow), compare_tip_rows);
+
+    morph->flat = TRUE;
+    for (ii = 0; ii < txres*tyres; ii++) {
+        if (tip[ii] != tip[0]) {
+            morph->flat = FALSE;
+            break;
         }
     }
-    return hmax;
+}
+
+static void
+tip_morph_free(TipMorph *morph)
+{
+    g_free(morph->points);
+    g_free(morph->rows);
+}
+
+/* Computes dest[j*dstride] = max of src[k*sstride] for k in window [j-off,
+ * j-off+w-1] with k clamped to [0, n-1].  The buffer must have space for
+ * 3*(n+w-1) items. */
+static void
+running_max(const gdouble *src, gint sstride, gint n, gint w, gint off,
+            gdouble *dest, gint dstride, gdouble *buf)
+{
+    gint len = n + w - 1, k;
+    gdouble *ext = buf, *g = buf + len, *h = buf + 2*len;
+
+    for (k = 0; k < len; k++)
+        ext[k] = src[CLAMP(k - off, 0, n-1)*sstride];
+
+    g[0] = ext[0];
+    for (k = 1; k < len; k++)
+        g[k] = (k % w) ? MAX(g[k-1], ext[k]) : ext[k];
+
+    h[len-1] = ext[len-1];
+    for (k = len-2; k >= 0; k--)
+        h[k] = ((k + 1) % w) ? MAX(h[k+1], ext[k]) : ext[k];
+
+    for (k = 0; k < n; k++)
+        dest[k*dstride] = MAX(h[k], g[k + w-1]);
+}
+
+/* Maxima of data over the tip row footprint (rowmax) and the entire
+ * footprint (dest) around each pixel.  When the footprint is cropped instead
+ * of clamped, the values are the same because clamping only repeats edge
+ * pixels which are within the cropped footprint anyway. */
+static void
+footprint_max(const gdouble *src, gint xres, gint yres,
+              const TipMorph *morph, gdouble *rowmax, gdouble *dest)
+{
+    gint txres = morph->txres, tyres = morph->tyres;
+    gint ioff = morph->ioff, joff = morph->joff;
+
+#ifdef _OPENMP
+#pragma omp parallel if(gwy_omp_use_threads((gsize)xres*yres)) \
+            default(none) \
+            shared(src,dest,rowmax,xres,yres,txres,tyres,ioff,joff)
+#endif
+    {
+        gint ifrom = gwy_omp_chunk_start(yres), ito = gwy_omp_chunk_end(yres);
+        gint jfrom = gwy_omp_chunk_start(xres), jto = gwy_omp_chunk_end(xres);
+        gdouble *buf = g_new(gdouble, 3*(MAX(xres + txres, yres + tyres)));
+        gint i, j;
+
+        for (i = ifrom; i < ito; i++) {
+            running_max(src + i*xres, 1, xres, txres, joff,
+                        rowmax + i*xres, 1, buf);
+        }
+#ifdef _OPENMP
+#pragma omp barrier
+#endif
+        for (j = jfrom; j < jto; j++) {
+            running_max(rowmax + j, xres, yres, tyres, ioff,
+                        dest + j, xres, buf);
+        }
+        g_free(buf);
+    }
+}
+
+static void
+tip_morph_row(const gdouble *src, gint xres, gint yres,
+              const TipMorph *morph,
+              const gdouble *rowmax, const gdouble *lmax,
+              gint i, gdouble *dest)
+{
+    const TipRow *rows = morph->rows;
+    const TipPoint *tp;
+    gint txres = morph->txres, tyres = morph->tyres;
+    gint ioff = morph->ioff, joff = morph->joff;
+    gboolean row_inside = (i >= ioff && i + tyres-ioff <= yres);
+    gboolean inside;
+    gdouble m, m1, t, h, hmax;
+    gint j, k, r, isrc, jsrc;
+
+    for (j = 0; j < xres; j++) {
+        m = lmax[i*xres + j];
+        /* All terms have the same tip height so the maximum is reached for
+         * the maximum of data. */
+        if (morph->flat) {
+            dest[i*xres + j] = m + rows[0].tmax;
+            continue;
+        }
+
+        inside = row_inside && j >= joff && j + txres-joff <= xres;
+        hmax = -G_MAXDOUBLE;
+        for (r = 0; r < tyres; r++) {
+            if (m + rows[r].tmax <= hmax)
+                break;
+
+            isrc = i + rows[r].di;
+            if (isrc < 0 || isrc >= yres) {
+                if (!morph->clamp)
+                    continue;
+                isrc = CLAMP(isrc, 0, yres-1);
+            }
+            m1 = rowmax[isrc*xres + j];
+            if (m1 + rows[r].tmax <= hmax)
+                continue;
+
+            tp = morph->points + rows[r].from;
+            if (inside) {
+                const gdouble *srow = src + isrc*xres + j;
+
+                for (k = 0; k < txres; k++) {
+                    t = tp[k].t;
+                    if (m1 + t <= hmax)
+                        break;
+                    h = srow[tp[k].dj] + t;
+                    if (h > hmax)
+                        hmax = h;
+                }
+            }
+            else {
+                const gdouble *srow = src + isrc*xres;
+
+                for (k = 0; k < txres; k++) {
+                    t = tp[k].t;
+                    if (m1 + t <= hmax)
+                        break;
+                    jsrc = j + tp[k].dj;
+                    if (jsrc < 0 || jsrc >= xres) {
+                        if (!morph->clamp)
+                            continue;
+                        jsrc = CLAMP(jsrc, 0, xres-1);
+                    }
+                    h = srow[jsrc] + t;
+                    if (h > hmax)
+                        hmax = h;
+                }
+            }
+        }
+        dest[i*xres + j] = hmax;
+    }
+}
+
+/* Performs the dilation-like max-plus operation, parallelised over rows.
+ * Rows are processed in batches to be able to report progress and abort. */
+static gboolean
+tip_morph(const gdouble *src, gint xres, gint yres,
+          const gdouble *tip, gint txres, gint tyres, gint ioff, gint joff,
+          gboolean clamp, gdouble *dest,
+          GwySetFractionFunc set_fraction)
+{
+    TipMorph morph;
+    gdouble *lmax, *rowmax;
+    gint batch, bfrom, bto;
+    gboolean ok = TRUE;
+
+    tip_morph_init(&morph, tip, txres, tyres, ioff, joff, clamp);
+    lmax = g_new(gdouble, xres*yres);
+    rowmax = g_new(gdouble, xres*yres);
+    footprint_max(src, xres, yres, &morph, rowmax, lmax);
+
+    batch = MAX((yres + TIP_NBATCHES-1)/TIP_NBATCHES, 1);
+    for (bfrom = 0; bfrom < yres; bfrom = bto) {
+        gint nrows;
+
+        bto = MIN(bfrom + batch, yres);
+        nrows = bto - bfrom;
+#ifdef _OPENMP
+#pragma omp parallel \
+            if(gwy_omp_use_threads((gsize)nrows*xres*MIN(txres*tyres, 64))) \
+            default(none) \
+            shared(src,dest,lmax,rowmax,morph,xres,yres,nrows,bfrom)
+#endif
+        {
+            gint ifrom = bfrom + gwy_omp_chunk_start(nrows);
+            gint ito = bfrom + gwy_omp_chunk_end(nrows);
+            gint i;
+
+            for (i = ifrom; i < ito; i++)
+                tip_morph_row(src, xres, yres, &morph, rowmax, lmax, i, dest);
+        }
+
+        if (set_fraction && !set_fraction((gdouble)bto/yres)) {
+            ok = FALSE;
+            break;
+        }
+    }
+
+    g_free(rowmax);
+    g_free(lmax);
+    tip_morph_free(&morph);
+
+    return ok;
+}
+
+/* Negates the max-plus result back to the min-minus result.  Subtracting
+ * from zero instead of plain negation gives +0 instead of -0 for exact
+ * touches, like the direct evaluation. */
+static void
+tip_morph_negate(gdouble *data, gint n)
+{
+    gint k;
+
+    for (k = 0; k < n; k++)
+        data[k] = 0.0 - data[k];
 }
 
 /**
@@ -1030,10 +1310,8 @@ gwy_tip_dilation(GwyDataField *tip,
                  GwySetFractionFunc set_fraction,
                  GwySetMessageFunc set_message)
 {
-    gint txres, tyres, xres, yres, ioff, joff, i, j;
-    const gdouble *sdata, *tdata;
-    gdouble *data;
     GwyDataField *mytip;
+    gboolean ok;
 
     g_return_val_if_fail(GWY_IS_DATA_FIELD(tip), NULL);
     g_return_val_if_fail(GWY_IS_DATA_FIELD(surface), NULL);
@@ -1052,79 +1330,12 @@ gwy_tip_dilation(GwyDataField *tip,
     mytip = gwy_data_field_duplicate(tip);
     gwy_data_field_add(mytip, -gwy_data_field_get_max(mytip));
 
-    txres = tip->xres;
-    tyres = tip->yres;
-    xres = surface->xres;
-    yres = surface->yres;
-    sdata = surface->data;
-    tdata = mytip->data;
-    data = result->data;
-    ioff = tyres/2;
-    joff = txres/2;
-
-    for (i = 0; i < yres; i++) {
-        gboolean row_inside = (i >= ioff && i + tyres-ioff <= yres);
-        for (j = 0; j < xres; j++) {
-            gboolean col_inside = (j >= joff && j + txres-joff <= xres);
-            if (row_inside && col_inside) {
-                const gdouble *src = sdata + (i - ioff)*xres + (j - joff);
-                data[i*xres + j] = tip_convolve_interior(src, xres,
-                                                         tdata, txres, tyres);
-            }
-            else {
-                data[i*xres + j] = tip_convolve_border(sdata, xres, yres,
-                                                       tdata, txres, tyres,
-                                                       j, i);
-            }
-        }
-
-        if (set_fraction && !set_fraction((i + 1.0)/yres)) {
-            g_object_unref(mytip);
-            return NULL;
-        }
-    }
-
+    ok = tip_morph(surface->data, surface->xres, surface->yres,
+                   mytip->data, tip->xres, tip->yres, tip->yres/2, tip->xres/2,
+                   TRUE, result->data, set_fraction);
     g_object_unref(mytip);
-    return result;
-}
-
-static inline gdouble
-tip_erode_interior(const gdouble *src, gint xres,
-                   const gdouble *tip, gint txres, gint tyres)
-{
-    gdouble hmin = G_MAXDOUBLE;
-    gint i, j;
 
-    for (i = 0; i < tyres; i++) {
-        const gdouble *srcrow = src + i*xres;
-        for (j = txres; j; j--) {
-            gdouble h = *(srcrow++) - *(tip++);
-            if (h < hmin)
-                hmin = h;
-        }
-    }
-    return hmin;
-}
-
-static inline gdouble
-tip_erode_border(const gdouble *src, gint xres, gint yres,
-                 const gdouble *tip, gint txres, gint tyres,
-                 gint j, gint i)
-{
-    gint ioff = tyres/2, joff = txres/2;
-    gdouble hmin = G_MAXDOUBLE;
-    gint ii, jj;
-
-    for (ii = 0; ii < tyres; ii++) {
-        gint isrc = CLAMP(i + ii - ioff, 0, yres-1);
-        for (jj = 0; jj < txres; jj++) {
-            gint jsrc = CLAMP(j + jj - joff, 0, xres-1);
-            gdouble h = src[isrc*xres + jsrc] - *(tip++);
-            if (h < hmin)
-                hmin = h;
-        }
-    }
-    return hmin;
+    return ok ? result : NULL;
 }
 
 /**
@@ -1151,10 +1362,8 @@ gwy_tip_erosion(GwyDataField *tip,
                 GwySetFractionFunc set_fraction,
                 GwySetMessageFunc set_message)
 {
-    gint txres, tyres, xres, yres, ioff, joff, i, j;
-    const gdouble *sdata, *tdata;
-    GwyDataField *mytip;
-    gdouble *data;
+    GwyDataField *mytip, *negsurface;
+    gboolean ok;
 
     g_return_val_if_fail(GWY_IS_DATA_FIELD(tip), NULL);
     g_return_val_if_fail(GWY_IS_DATA_FIELD(surface), NULL);
@@ -1174,40 +1383,139 @@ gwy_tip_erosion(GwyDataField *tip,
     gwy_data_field_invert(mytip, TRUE, TRUE, FALSE);
     gwy_data_field_add(mytip, -gwy_data_field_get_max(mytip));
 
-    txres = tip->xres;
-    tyres = tip->yres;
-    xres = surface->xres;
-    yres = surface->yres;
-    sdata = surface->data;
-    tdata = mytip->data;
-    data = result->data;
-    ioff = tyres/2;
-    joff = txres/2;
-
-    for (i = 0; i < yres; i++) {
-        gboolean row_inside = (i >= ioff && i + tyres-ioff <= yres);
-        for (j = 0; j < xres; j++) {
-            gboolean col_inside = (j >= joff && j + txres-joff <= xres);
-            if (row_inside && col_inside) {
-                const gdouble *src = sdata + (i - ioff)*xres + (j - joff);
-                data[i*xres + j] = tip_erode_interior(src, xres,
-                                                      tdata, txres, tyres);
-            }
-            else {
-                data[i*xres + j] = tip_erode_border(sdata, xres, yres,
-                                                    tdata, txres, tyres,
-                                                    j, i);
+    /* min(z - t) = -max(-z + t), exactly, because negation is exact. */
+    negsurface = gwy_data_field_duplicate(surface);
+    gwy_data_field_multiply(negsurface, -1.0);
+    ok = tip_morph(negsurface->data, surface->xres, surface->yres,
+                   mytip->data, tip->xres, tip->yres, tip->yres/2, tip->xres/2,
+                   TRUE, result->data, set_fraction);
+    g_object_unref(negsurface);
+    g_object_unref(mytip);
+    if (!ok)
+        return NULL;
+
+    tip_morph_negate(result->data, surface->xres*surface->yres);
+    return result;
+}
+
+/* The certainty map evaluation from morph_lib, on integer-valued data stored
+ * as doubles.  A surface point is certain if it is touched by the tip from
+ * exactly one image point.  The tip rows and points are again sorted by
+ * height, which lets us stop when the image minus tip exceeds the maximum of
+ * the eroded surface within the footprint. */
+static gboolean
+tip_certainty_map(const gdouble *image, gint xres, gint yres,
+                  const gdouble *tip, gint txres, gint tyres,
+                  const gdouble *rsurf, gint xc, gint yc,
+                  gdouble *cmap,
+                  GwySetFractionFunc set_fraction)
+{
+    TipMorph morph;
+    gdouble *fliptip, *rmax, *rowmax;
+    gint *touch;
+    gint rxc, ryc, ifrom, ito, jfrom, jto, batch, bfrom, bto, i, j;
+    gboolean ok = TRUE;
+
+    rxc = txres - 1 - xc;
+    ryc = tyres - 1 - yc;
+    gwy_clear(cmap, xres*yres);
+    /* Pixels near the edge are skipped.  Since it is possible there are
+     * unseen touches over the edge, we must conservatively leave these cmap
+     * entries at 0. */
+    ifrom = ryc;
+    ito = yres + ryc - tyres + 1;
+    jfrom = rxc;
+    jto = xres + rxc - txres + 1;
+    if (ito <= ifrom || jto <= jfrom)
+        return TRUE;
+
+    fliptip = g_new(gdouble, txres*tyres);
+    for (i = 0; i < tyres; i++) {
+        for (j = 0; j < txres; j++)
+            fliptip[i*txres + j] = tip[(tyres-1 - i)*txres + txres-1 - j];
+    }
+    tip_morph_init(&morph, fliptip, txres, tyres, ryc, rxc, FALSE);
+    g_free(fliptip);
+    rmax = g_new(gdouble, xres*yres);
+    rowmax = g_new(gdouble, xres*yres);
+    footprint_max(rsurf, xres, yres, &morph, rowmax, rmax);
+    touch = g_new(gint, xres*yres);
+
+    batch = MAX((ito - ifrom + TIP_NBATCHES-1)/TIP_NBATCHES, 1);
+    for (bfrom = ifrom; bfrom < ito; bfrom = bto) {
+        gint nrows;
+
+        bto = MIN(bfrom + batch, ito);
+        nrows = bto - bfrom;
+#ifdef _OPENMP
+#pragma omp parallel \
+            if(gwy_omp_use_threads((gsize)nrows*xres*MIN(txres*tyres, 64))) \
+            default(none) \
+            shared(image,rsurf,rmax,rowmax,touch,morph,xres,nrows,bfrom) \
+            shared(jfrom,jto)
+#endif
+        {
+            const TipRow *rows = morph.rows;
+            const TipPoint *tp;
+            gint rfrom = bfrom + gwy_omp_chunk_start(nrows);
+            gint rto = bfrom + gwy_omp_chunk_end(nrows);
+            gint tyr = morph.tyres, txr = morph.txres;
+            gint ir, jr, k, r, count, where, pos, rpos;
+            gdouble z, m, m1, h;
+
+            for (ir = rfrom; ir < rto; ir++) {
+                for (jr = jfrom; jr < jto; jr++) {
+                    pos = ir*xres + jr;
+                    z = image[pos];
+                    m = rmax[pos];
+                    count = 0;
+                    where = -1;
+                    for (r = 0; r < tyr && count < 2; r++) {
+                        if (z - rows[r].tmax > m)
+                            break;
+                        rpos = pos + rows[r].di*xres;
+                        m1 = rowmax[rpos];
+                        if (z - rows[r].tmax > m1)
+                            continue;
+                        tp = morph.points + rows[r].from;
+                        for (k = 0; k < txr; k++) {
+                            h = z - tp[k].t;
+                            if (h > m1)
+                                break;
+                            if (h == rsurf[rpos + tp[k].dj]) {
+                                where = rpos + tp[k].dj;
+                                if (++count == 2)
+                                    break;
+                            }
+                        }
+                    }
+                    touch[pos] = (count == 1) ? where : -1;
+                }
             }
         }
 
-        if (set_fraction && !set_fraction((i + 1.0)/yres)) {
-            g_object_unref(mytip);
-            return NULL;
+        if (set_fraction
+            && !set_fraction((gdouble)(bto - ifrom)/(ito - ifrom))) {
+            ok = FALSE;
+            break;
         }
     }
 
-    g_object_unref(mytip);
-    return result;
+    if (ok) {
+        for (i = ifrom; i < ito; i++) {
+            for (j = jfrom; j < jto; j++) {
+                if (touch[i*xres + j] >= 0)
+                    cmap[touch[i*xres + j]] = 1.0;
+            }
+        }
+    }
+
+    g_free(touch);
+    g_free(rowmax);
+    g_free(rmax);
+    tip_morph_free(&morph);
+
+    return ok;
 }
 
 /**
@@ -1236,19 +1544,21 @@ gwy_tip_cmap(GwyDataField *tip,
 {
     gint **ftip;
     gint **fsurface;
-    gint **rsurface;
-    gint **fresult;
-    gint newx, newy;
+    gdouble *dtip, *dsurface, *rsurface, *dresult;
+    gint newx, newy, txres, tyres, k;
     gdouble tipmin, surfacemin, step;
     GwyDataField *buffertip;
+    gboolean ok;
 
     /*if tip and surface have different spacings, make new, resampled tip*/
     buffertip = get_right_tip_field(tip, surface);
     /*invert tip (as necessary by dilation algorithm)*/
     gwy_data_field_invert(buffertip, TRUE, TRUE, FALSE);
 
-    newx = surface->xres + buffertip->xres;
-    newy = surface->yres + buffertip->yres;
+    txres = buffertip->xres;
+    tyres = buffertip->yres;
+    newx = surface->xres + txres;
+    newy = surface->yres + tyres;
 
     /*convert fields to integer arrays*/
     tipmin = gwy_data_field_get_min(buffertip);
@@ -1257,46 +1567,54 @@ gwy_tip_cmap(GwyDataField *tip,
 
     ftip = i_datafield_to_field(buffertip, TRUE, tipmin, step);
     fsurface = i_datafield_to_largefield(surface, buffertip, surfacemin, step);
+    /* The integers are represented exactly so all the arithmetic is also
+     * exact and gives the same results as integer morph_lib functions. */
+    dtip = imatrix_to_doubles(ftip, txres, tyres);
+    dsurface = imatrix_to_doubles(fsurface, newx, newy);
+    _gwy_morph_lib_ifreematrix(ftip);
+    _gwy_morph_lib_ifreematrix(fsurface);
+    rsurface = g_new(gdouble, newx*newy);
+    dresult = NULL;
 
     /*perform erosion as it is necessary parameter of certainty map algorithm*/
-    rsurface = _gwy_morph_lib_ierosion(fsurface, newx, newy,
-                                       ftip, buffertip->xres, buffertip->yres,
-                                       buffertip->xres/2, buffertip->yres/2,
-                                       set_fraction, set_message);
-    if (!rsurface) {
-        _gwy_morph_lib_ifreematrix(ftip);
-        _gwy_morph_lib_ifreematrix(fsurface);
-        g_object_unref(buffertip);
-       return NULL;
-    }
+    if (set_message)
+        set_message(_("Erosion..."));
+    if (set_fraction)
+        set_fraction(0.0);
+    for (k = 0; k < newx*newy; k++)
+        dsurface[k] = -dsurface[k];
+    ok = tip_morph(dsurface, newx, newy, dtip, txres, tyres, tyres/2, txres/2,
+                   FALSE, rsurface, set_fraction);
+    for (k = 0; k < newx*newy; k++)
+        dsurface[k] = -dsurface[k];
+    tip_morph_negate(rsurface, newx*newy);
 
     /*find certanty map*/
-    if (rsurface) {
-        fresult = _gwy_morph_lib_icmap(fsurface, newx, newy,
-                                       ftip, buffertip->xres, buffertip->yres,
-                                       rsurface,
-                                       buffertip->xres/2, buffertip->yres/2,
-                                       set_fraction, set_message);
+    if (ok) {
+        if (set_message)
+            set_message(_("Certainty map..."));
+        if (set_fraction)
+            set_fraction(0.0);
+        dresult = g_new(gdouble, newx*newy);
+        ok = tip_certainty_map(dsurface, newx, newy, dtip, txres, tyres,
+                               rsurface, txres/2, tyres/2,
+                               dresult, set_fraction);
     }
-    else
-        fresult = NULL;
 
     /*convert result back*/
-    if (fresult) {
+    if (ok) {
         gwy_data_field_resample(result, surface->xres, surface->yres,
                                 GWY_INTERPOLATION_NONE);
-        result = i_largefield_to_datafield(fresult, result, buffertip,
-                                           0.0, 1.0);
+        largefield_to_datafield(dresult, result, buffertip);
     }
     else
         result = NULL;
 
     g_object_unref(buffertip);
-    _gwy_morph_lib_ifreematrix(ftip);
-    _gwy_morph_lib_ifreematrix(fsurface);
-    _gwy_morph_lib_ifreematrix(rsurface);
-    if (fresult)
-        _gwy_morph_lib_ifreematrix(fresult);
+    g_free(dtip);
+    g_free(dsurface);
+    g_free(rsurface);
+    g_free(dresult);
 
     return result;
 }
@@ -1378,35 +1696,16 @@ gwy_tip_estimate_partial(GwyDataField *tip,
 }
 
 
-/**
- * gwy_tip_estimate_full:
- * @tip: Tip data to be refined (allocated).
- * @surface: Surface data.
- * @threshold: Threshold for noise supression.
- * @use_edges: Whether use also edges of image.
- * @count: Where to store the number of places that produced refinements to.
- * @set_fraction: Function that sets fraction to output (or %NULL).
- * @set_message: Function that sets message to output (or %NULL).
- *
- * Performs full blind estimation algorithm published by Villarrubia. This
- * function converts all fields into form requested by "morph_lib.c" library,
- * that is almost identical with original Villarubia's library. Note that the
- * threshold value must be chosen sufficently high value to supress small
- * fluctulations due to noise (that would lead to very sharp tip) but
- * sufficiently low value to put algorithm at work. A value similar to 1/10000
- * of surface range can be good. Otherwise we recommend to start with zero
- * threshold and increase it slowly to observe changes and choose right value.
- *
- * Returns: Estimated tip.  May return %NULL if aborted.
- **/
-GwyDataField*
-gwy_tip_estimate_full(GwyDataField *tip,
-                      GwyDataField *surface,
-                      gdouble threshold,
-                      gboolean use_edges,
-                      gint *count,
-                      GwySetFractionFunc set_fraction,
-                      GwySetMessageFunc set_message)
+static GwyDataField*
+tip_estimate_full(GwyDataField *tip,
+                  GwyDataField *surface,
+                  gdouble threshold,
+                  gboolean use_edges,
+                  gint maxiter,
+                  GwyTipEstimateStats *stats,
+                  gint *count,
+                  GwySetFractionFunc set_fraction,
+                  GwySetMessageFunc set_message)
 {
     gint **ftip;
     gint **fsurface;
@@ -1433,6 +1732,7 @@ gwy_tip_estimate_full(GwyDataField *tip,
                                        tip->xres, tip->yres,
                                        tip->xres/2, tip->yres/2,
                                        ftip, threshold/step, use_edges,
+                                       maxiter, stats,
                                        set_fraction, set_message);
     if (cnt == -1 || (set_fraction && !set_fraction(0.0))) {
         _gwy_morph_lib_ifreematrix(ftip);
@@ -1452,6 +1752,175 @@ gwy_tip_estimate_full(GwyDataField *tip,
     return tip;
 }
 
+/**
+ * gwy_tip_estimate_full:
+ * @tip: Tip data to be refined (allocated).
+ * @surface: Surface data.
+ * @threshold: Threshold for noise supression.
+ * @use_edges: Whether use also edges of image.
+ * @count: Where to store the number of places that produced refinements to.
+ * @set_fraction: Function that sets fraction to output (or %NULL).
+ * @set_message: Function that sets message to output (or %NULL).
+ *
+ * Performs full blind estimation algorithm published by Villarrubia. This
+ * function converts all fields into form requested by "morph_lib.c" library,
+ * that is almost identical with original Villarubia's library. Note that the
+ * threshold value must be chosen sufficently high value to supress small
+ * fluctulations due to noise (that would lead to very sharp tip) but
+ * sufficiently low value to put algorithm at work. A value similar to 1/10000
+ * of surface range can be good. Otherwise we recommend to start with zero
+ * threshold and increase it slowly to observe changes and choose right value.
+ *
+ * See gwy_tip_estimate_full_multiscale() for a variant with more control
+ * over the iteration.
+ *
+ * Returns: Estimated tip.  May return %NULL if aborted.
+ **/
+GwyDataField*
+gwy_tip_estimate_full(GwyDataField *tip,
+                      GwyDataField *surface,
+                      gdouble threshold,
+                      gboolean use_edges,
+                      gint *count,
+                      GwySetFractionFunc set_fraction,
+                      GwySetMessageFunc set_message)
+{
+    return tip_estimate_full(tip, surface, threshold, use_edges, 0, NULL,
+                             count, set_fraction, set_message);
+}
+
+/**
+ * gwy_tip_estimate_full_multiscale:
+ * @tip: Tip data to be refined (allocated).
+ * @surface: Surface data.
+ * @threshold: Threshold for noise supression.
+ * @use_edges: Whether use also edges of image.
+ * @nlevels: Number of coarse levels to estimate the tip at before the full
+ *           resolution estimation.  Each level halves the resolution.  Pass
+ *           zero for the plain full resolution estimation.
+ * @maxiter: Maximum number of iterations at each level.  Pass zero to
+ *           iterate until the tip does not change.
+ * @stats: Location to store statistics of the iteration to (or %NULL).  The
+ *         @count field includes refinements at all levels, the other fields
+ *         describe the full resolution iteration.
+ * @set_fraction: Function that sets fraction to output (or %NULL).
+ * @set_message: Function that sets message to output (or %NULL).
+ *
+ * Performs full blind estimation algorithm published by Villarrubia, with
+ * optional coarse-to-fine refinement and iteration limit.
+ *
+ * The algorithm and the meaning of @threshold are the same as in
+ * gwy_tip_estimate_full().  When @nlevels is non-zero the tip is first
+ * estimated from the image downsampled by factor
+ * 2<superscript>@nlevels</superscript>, then upsampled and used as the
+ * starting tip for the estimation at twice the resolution, etc.  Since most
+ * of the tip refinement then happens on small images, this is usually much
+ * faster than the estimation at full resolution.
+ * Since the refinement can only lower the tip, the upsampled coarse estimate
+ * is dilated by the coarse pixel size before it is used, so that it remains
+ * an upper bound of the tip at the finer resolution.  Levels at which the
+ * downsampled tip would be smaller than 5 pixels are skipped.
+ *
+ * If @maxiter is non-zero the iteration can be terminated before it
+ * converges.  Whether it happened can be checked using the
+ * @converged field of @stats.
+ *
+ * Returns: Estimated tip.  May return %NULL if aborted.
+ *
+ * Since: 2.47
+ **/
+GwyDataField*
+gwy_tip_estimate_full_multiscale(GwyDataField *tip,
+                                 GwyDataField *surface,
+                                 gdouble threshold,
+                                 gboolean use_edges,
+                                 guint nlevels,
+                                 guint maxiter,
+                                 GwyTipEstimateStats *stats,
+                                 GwySetFractionFunc set_fraction,
+                                 GwySetMessageFunc set_message)
+{
+    GwyDataField *ctip, *csurface, *utip;
+    gint cxres, cyres, ctxres, ctyres, size, k, n, count, coarse_count = 0;
+    gdouble *d, *u;
+    guint level;
+
+    g_return_val_if_fail(GWY_IS_DATA_FIELD(tip), NULL);
+    g_return_val_if_fail(GWY_IS_DATA_FIELD(surface), NULL);
+    g_return_val_if_fail(nlevels < 16, NULL);
+
+    for (level = nlevels; level > 0; level--) {
+        cxres = surface->xres >> level;
+        cyres = surface->yres >> level;
+        ctxres = GWY_ROUND(tip->xres*(gdouble)cxres/surface->xres);
+        ctyres = GWY_ROUND(tip->yres*(gdouble)cyres/surface->yres);
+        if (ctxres < 5 || ctyres < 5)
+            continue;
+
+        gwy_debug("level %u: image %dx%d, tip %dx%d",
+                  level, cxres, cyres, ctxres, ctyres);
+        csurface = gwy_data_field_new_resampled(surface, cxres, cyres,
+                                                GWY_INTERPOLATION_LINEAR);
+        ctip = gwy_data_field_new_resampled(tip, ctxres, ctyres,
+                                            GWY_INTERPOLATION_LINEAR);
+        utip = tip_estimate_full(ctip, csurface, threshold, use_edges,
+                                 maxiter, NULL, &count,
+                                 set_fraction, set_message);
+        g_object_unref(csurface);
+        if (!utip) {
+            g_object_unref(ctip);
+            return NULL;
+        }
+        coarse_count += count;
+
+        utip = gwy_data_field_new_resampled(ctip, tip->xres, tip->yres,
+                                            GWY_INTERPOLATION_LINEAR);
+        g_object_unref(ctip);
+
+        /* Interpolation can put the upsampled tip below the true tip between
+         * the coarse pixels.  The refinement only lowers the tip, so it must
+         * start from an upper bound.  Dilate the upsampled tip by one coarse
+         * pixel in each direction to get it. */
+        size = 2*MAX((tip->xres + ctxres-1)/ctxres,
+                     (tip->yres + ctyres-1)/ctyres) + 1;
+        gwy_data_field_filter_maximum(utip, size);
+
+        /* Tip heights are relative to the apex.  Both the current and the
+         * upsampled tip are upper bounds so keep the lower of them. */
+        gwy_data_field_add(utip, -gwy_data_field_get_max(utip));
+        gwy_data_field_add(tip, -gwy_data_field_get_max(tip));
+        n = tip->xres*tip->yres;
+        d = tip->data;
+        u = utip->data;
+        for (k = 0; k < n; k++)
+            d[k] = MIN(d[k], u[k]);
+        gwy_data_field_invalidate(tip);
+        g_object_unref(utip);
+    }
+
+    if (!tip_estimate_full(tip, surface, threshold, use_edges, maxiter,
+                           stats, NULL, set_fraction, set_message))
+        return NULL;
+    if (stats)
+        stats->count += coarse_count;
+
+    return tip;
+}
+
+/**
+ * GwyTipEstimateStats:
+ * @niter: Number of iterations performed.
+ * @count: Total number of image locations that produced refinement.
+ * @last_count: Number of image locations that produced refinement in the
+ *              last iteration.
+ * @converged: %TRUE if the iteration finished because the tip no longer
+ *             changed, %FALSE if it was terminated by the iteration limit.
+ *
+ * Statistics of blind tip estimation iteration.
+ *
+ * Since: 2.47
+ **/
+
 /************************** Documentation ****************************/
 
 /**
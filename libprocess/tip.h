@@ -52,6 +52,13 @@ struct _GwyTipModelPreset {
 };
 #endif
 
+typedef struct {
+    gint niter;
+    gint count;
+    gint last_count;
+    gboolean converged;
+} GwyTipEstimateStats;
+
 gint                     gwy_tip_model_get_npresets            (void);
 const GwyTipModelPreset* gwy_tip_model_get_preset              (gint preset_id);
 const GwyTipModelPreset* gwy_tip_model_get_preset_by_name      (const gchar *name);
@@ -104,6 +111,16 @@ GwyDataField*   gwy_tip_estimate_full(GwyDataField *tip,
                                       GwySetFractionFunc set_fraction,
                                       GwySetMessageFunc set_message);
 
+GwyDataField*   gwy_tip_estimate_full_multiscale(GwyDataField *tip,
+                                                 GwyDataField *surface,
+                                                 gdouble threshold,
+                                                 gboolean use_edges,
+                                                 guint nlevels,
+                                                 guint maxiter,
+                                                 GwyTipEstimateStats *stats,
+                                                 GwySetFractionFunc set_fraction,
+                                                 GwySetMessageFunc set_message);
+
 G_END_DECLS
 
 #endif /* __GWY_PROCESS_TIP__ */
@@ -24,6 +24,7 @@
 #include <libgwyddion/gwymacros.h>
 #include <libgwyddion/gwymath.h>
 #include <libprocess/triangulation.h>
+#include "libgwyddion/gwyomp.h"
 
 /*
  * Some identities for planar triangulations
@@ -48,11 +49,19 @@ enum {
     QUEUE = 128,
     /* Tunables */
     NEIGHBOURS = 8,
-    WSPACE_CACHE_SIZE = 128,
+    INTERPOLATE_BLOCK = 16,
+    WSPACE_CACHE_SIZE = 1024,
     WSPACE_CACHE_BLOCK = 8,
 };
 
-#define CELL_SIDE 6.0
+/* Points are ordered along a Hilbert curve on a grid of HILBERT_RES×HILBERT_RES
+ * cells covering their bounding square, sorted using RADIX_BITS-bit digits. */
+enum {
+    HILBERT_BITS = 16,
+    HILBERT_RES = 1 << HILBERT_BITS,
+    RADIX_BITS = 11,
+    RADIX_SIZE = 1 << RADIX_BITS,
+};
 
 #define get_point(points, point_size, i) \
     (const GwyXY*)((const gchar*)(points) + (i)*(point_size))
@@ -92,8 +101,10 @@ typedef struct {
 /* One neighbour of the currently processed point, contains various
  * pre-calculated quantities. */
 typedef struct {
-    /* Radial coordinates with respect to the origin, i.e. the point we are
-     * finding the neighbours of. */
+    /* Cartesian and radial coordinates with respect to the origin, i.e. the
+     * point we are finding the neighbours of. */
+    gdouble x;
+    gdouble y;
     gdouble r;
     gdouble phi;
     /* Intersection times (i.e. t-coordinates) with the previous and next line.
@@ -255,28 +266,29 @@ block_clear(guint *block,
     memset(block, 0xff, len*sizeof(guint));
 }
 
-static inline guint
-coords_to_grid_index(guint xres,
-                     guint yres,
-                     gdouble step,
-                     gdouble x,
-                     gdouble y)
+/* The position of cell (@x,@y) along the Hilbert curve filling the
+ * HILBERT_RES×HILBERT_RES square. */
+static inline guint32
+hilbert_index(guint32 x, guint32 y)
 {
-    guint ix, iy;
+    guint32 s, rx, ry, t, d = 0;
 
-    ix = (gint)floor(x/step);
-    if (G_UNLIKELY(ix == xres))
-        ix--;
-
-    iy = (gint)floor(y/step);
-    if (G_UNLIKELY(iy == yres))
-        iy--;
-
-    /* Go zig-zag through the cells */
-    if (iy % 2)
-        ix = xres-1 - ix;
+    for (s = HILBERT_RES/2; s; s /= 2) {
+        rx = (x & s) ? 1 : 0;
+        ry = (y & s) ? 1 : 0;
+        d += s*s*((3*rx) ^ ry);
+        if (!ry) {
+            if (rx) {
+                x = HILBERT_RES-1 - x;
+                y = HILBERT_RES-1 - y;
+            }
+            t = x;
+            x = y;
+            y = t;
+        }
+    }
 
-    return iy*xres + ix;
+    return d;
 }
 
 static inline void
@@ -300,10 +312,12 @@ index_rewind(guint *index_array,
     index_array[0] = 0;
 }
 
-/* Try to increase locality of the point list by sorting it to grid cells
- * and then taking the points cell-by-cell.  Also reduces the workind set size
- * by constructing a list of plain Points instead of whatever might the
- * caller's representation be. */
+/* Increase locality of the point list by sorting it along a Hilbert curve.
+ * Consecutive points are then close to each other so the walk to the
+ * triangle containing the next point is short and the neighbourhoods we need
+ * to update are mostly still in the work space cache.  Also reduces the
+ * working set size by constructing a list of plain Points instead of whatever
+ * might the caller's representation be. */
 static void
 build_compact_point_list(PointList *pointlist,
                          guint npoints,
@@ -311,9 +325,11 @@ build_compact_point_list(PointList *pointlist,
                          gsize point_size)
 {
     const GwyXY *pt;
-    gdouble xmin, xmax, ymin, ymax, xreal, yreal, step, xr, yr;
-    guint i, xres, yres, ncells, ig, pos;
-    guint *cell_index;
+    gdouble xmin, xmax, ymin, ymax, q;
+    guint32 *key, *tmpkey;
+    guint *id, *tmpid;
+    guint count[RADIX_SIZE];
+    guint i, k, pos, shift;
 
     pointlist->npoints = npoints;
     pointlist->points = g_new(GwyXY, npoints);
@@ -336,44 +352,62 @@ build_compact_point_list(PointList *pointlist,
             ymax = pt->y;
     }
 
-    xreal = xmax - xmin;
-    yreal = ymax - ymin;
-    xr = xreal/sqrt(npoints)*CELL_SIDE;
-    yr = yreal/sqrt(npoints)*CELL_SIDE;
+    /* Use the same scale in both directions to keep the curve local. */
+    q = MAX(xmax - xmin, ymax - ymin);
+    q = (q > 0.0) ? (HILBERT_RES - 0.5)/q : 0.0;
 
-    if (xr <= yr) {
-        xres = (guint)ceil(xreal/xr);
-        step = xreal/xres;
-        yres = (guint)ceil(yreal/step);
-    }
-    else {
-        yres = (guint)ceil(yreal/yr);
-        step = yreal/yres;
-        xres = (guint)ceil(xreal/step);
+    key = g_new(guint32, npoints);
+    id = g_new(guint, npoints);
+#ifdef _OPENMP
+#pragma omp parallel if(gwy_omp_use_threads(npoints)) \
+            default(none) \
+            shared(key,id,points,point_size,npoints,xmin,ymin,q)
+#endif
+    {
+        guint ifrom = gwy_omp_chunk_start(npoints);
+        guint ito = gwy_omp_chunk_end(npoints);
+        const GwyXY *ptj;
+        guint j;
+
+        for (j = ifrom; j < ito; j++) {
+            ptj = get_point(points, point_size, j);
+            key[j] = hilbert_index((guint32)((ptj->x - xmin)*q),
+                                   (guint32)((ptj->y - ymin)*q));
+            id[j] = j;
+        }
     }
 
-    ncells = xres*yres;
-    cell_index = g_new0(guint, ncells + 1);
-
-    for (i = 0; i < npoints; i++) {
-        pt = get_point(points, point_size, i);
-        ig = coords_to_grid_index(xres, yres, step, pt->x - xmin, pt->y - ymin);
-        cell_index[ig]++;
+    /* LSD radix sort of (key, id) pairs.  It is stable so points with
+     * identical keys keep their original order. */
+    tmpkey = g_new(guint32, npoints);
+    tmpid = g_new(guint, npoints);
+    for (shift = 0; shift < 2*HILBERT_BITS; shift += RADIX_BITS) {
+        gwy_clear(count, RADIX_SIZE);
+        for (i = 0; i < npoints; i++)
+            count[(key[i] >> shift) & (RADIX_SIZE-1)]++;
+        for (k = pos = 0; k < RADIX_SIZE; k++) {
+            guint c = count[k];
+            count[k] = pos;
+            pos += c;
+        }
+        for (i = 0; i < npoints; i++) {
+            pos = count[(key[i] >> shift) & (RADIX_SIZE-1)]++;
+            tmpkey[pos] = key[i];
+            tmpid[pos] = id[i];
+        }
+        GWY_SWAP(guint32*, key, tmpkey);
+        GWY_SWAP(guint*, id, tmpid);
     }
-
-    index_accumulate(cell_index, xres*yres);
-    index_rewind(cell_index, xres*yres);
+    g_free(tmpkey);
+    g_free(tmpid);
+    g_free(key);
 
     for (i = 0; i < npoints; i++) {
-        pt = get_point(points, point_size, i);
-        ig = coords_to_grid_index(xres, yres, step, pt->x - xmin, pt->y - ymin);
-        pos = cell_index[ig];
-        pointlist->orig_index[pos] = i;
-        pointlist->points[pos] = *pt;
-        cell_index[ig]++;
+        pt = get_point(points, point_size, id[i]);
+        pointlist->orig_index[i] = id[i];
+        pointlist->points[i] = *pt;
     }
-
-    g_free(cell_index);
+    g_free(id);
 }
 
 static inline void
@@ -395,7 +429,9 @@ get_workspace_point(WorkSpacePoint *wpt,
     pt = pointlist->points[id];
     pt.x -= origin->x;
     pt.y -= origin->y;
-    wpt->r = hypot(pt.x, pt.y);
+    wpt->x = pt.x;
+    wpt->y = pt.y;
+    wpt->r = sqrt(pt.x*pt.x + pt.y*pt.y);
     if (G_UNLIKELY(wpt->r == 0.0))
         return FALSE;
     wpt->phi = atan2(pt.y, pt.x);
@@ -461,7 +497,7 @@ intersection_times(const WorkSpacePoint *p, gdouble *tp,
                    const WorkSpacePoint *q, gdouble *tq)
 {
     gdouble dphi = q->phi - p->phi;
-    gdouble cdphi, sdphi;
+    gdouble cdphi, sdphi, cross, dot;
 
     /* Intersection on the wrong side -> make the lines open-ended. */
     if (dphi > G_PI || (dphi < 0 && dphi > -G_PI)) {
@@ -470,6 +506,17 @@ intersection_times(const WorkSpacePoint *p, gdouble *tp,
         return;
     }
 
+    /* The sine and cosine of the angle are available from the Cartesian
+     * coordinates, avoiding the trigonometric functions.  Exactly opposite
+     * points would give infinities here though. */
+    cross = p->x*q->y - p->y*q->x;
+    if (G_LIKELY(cross != 0.0)) {
+        dot = p->x*q->x + p->y*q->y;
+        *tp = p->r*(q->r*q->r - dot)/cross;
+        *tq = q->r*(dot - p->r*p->r)/cross;
+        return;
+    }
+
     cdphi = cos(dphi);
     sdphi = sin(dphi);
     *tp = (q->r - p->r*cdphi)/sdphi;
@@ -2392,6 +2439,51 @@ interpolate_linear(Triangulation *triangulation,
     return TRUE;
 }
 
+static gboolean
+interpolate_rows(Triangulation *triangulation,
+                 GwyInterpolationType interpolation,
+                 GwyDataField *dfield,
+                 guint ifrom,
+                 guint ito)
+{
+    guint xres, i, j;
+    gdouble qx, qy, xoff, yoff;
+    gdouble *d;
+    Triangle triangle;
+    gboolean ok;
+    GwyXY pt;
+
+    if (interpolation == GWY_INTERPOLATION_LINEAR)
+        make_valid_triangle(triangulation->neighbours, triangulation->index[1],
+                            triangulation->points, triangulation->point_size,
+                            &triangle, 0);
+    else
+        make_valid_vtriangle(triangulation, &triangle, 0);
+
+    xres = dfield->xres;
+    xoff = dfield->xoff;
+    yoff = dfield->yoff;
+    qx = dfield->xreal/dfield->xres;
+    qy = dfield->yreal/dfield->yres;
+    d = dfield->data + ifrom*xres;
+
+    for (i = ifrom; i < ito; i++) {
+        pt.y = yoff + qy*(i + 0.5);
+        for (j = 0; j < xres; j++) {
+            pt.x = xoff + qx*(j + 0.5);
+            if (interpolation == GWY_INTERPOLATION_LINEAR)
+                ok = interpolate_linear(triangulation, &triangle, &pt, d);
+            else
+                ok = interpolate_round(triangulation, &triangle, &pt, d);
+            if (!ok)
+                return FALSE;
+            d++;
+        }
+    }
+
+    return TRUE;
+}
+
 /**
  * gwy_triangulation_interpolate:
  * @triangulation: Triangulation.
@@ -2417,12 +2509,8 @@ gwy_triangulation_interpolate(GwyTriangulation *object,
                               GwyDataField *dfield)
 {
     Triangulation *triangulation;
-    guint xres, yres, i, j;
-    gdouble qx, qy, xoff, yoff;
-    gdouble *d;
-    Triangle triangle;
-    gboolean ok = FALSE;
-    GwyXY pt;
+    guint nblocks;
+    gboolean ok = TRUE;
 
     g_return_val_if_fail(GWY_IS_TRIANGULATION(object), FALSE);
     g_return_val_if_fail(GWY_IS_DATA_FIELD(dfield), FALSE);
@@ -2431,37 +2519,29 @@ gwy_triangulation_interpolate(GwyTriangulation *object,
     g_return_val_if_fail(interpolation == GWY_INTERPOLATION_LINEAR
                          || interpolation == GWY_INTERPOLATION_ROUND, FALSE);
 
-    if (interpolation == GWY_INTERPOLATION_LINEAR)
-        make_valid_triangle(triangulation->neighbours, triangulation->index[1],
-                            triangulation->points, triangulation->point_size,
-                            &triangle, 0);
-    else
-        make_valid_vtriangle(triangulation, &triangle, 0);
-
-    xres = dfield->xres;
-    yres = dfield->yres;
-    xoff = dfield->xoff;
-    yoff = dfield->yoff;
-    qx = dfield->xreal/dfield->xres;
-    qy = dfield->yreal/dfield->yres;
-    d = dfield->data;
-
-    for (i = 0; i < yres; i++) {
-        pt.y = yoff + qy*(i + 0.5);
-        for (j = 0; j < xres; j++) {
-            pt.x = xoff + qx*(j + 0.5);
-            if (interpolation == GWY_INTERPOLATION_LINEAR)
-                ok = interpolate_linear(triangulation, &triangle, &pt, d);
-            else
-                ok = interpolate_round(triangulation, &triangle, &pt, d);
-            if (!ok)
-                goto fail;
-            d++;
+    /* Blocks of rows are processed independently, each starting from the
+     * same triangle, so the result does not depend on the number of
+     * threads. */
+    nblocks = (dfield->yres + INTERPOLATE_BLOCK-1)/INTERPOLATE_BLOCK;
+#ifdef _OPENMP
+#pragma omp parallel if(gwy_omp_use_threads(dfield->xres*dfield->yres)) \
+            default(none) \
+            shared(triangulation,interpolation,dfield,nblocks) \
+            reduction(&&:ok)
+#endif
+    {
+        guint bfrom = gwy_omp_chunk_start(nblocks);
+        guint bto = gwy_omp_chunk_end(nblocks);
+        guint b;
+
+        for (b = bfrom; b < bto && ok; b++) {
+            ok = interpolate_rows(triangulation, interpolation, dfield,
+                                  b*INTERPOLATE_BLOCK,
+                                  MIN((b + 1)*INTERPOLATE_BLOCK,
+                                      dfield->yres));
         }
     }
-    ok = TRUE;
 
-fail:
     gwy_data_field_invalidate(dfield);
 
     return ok;
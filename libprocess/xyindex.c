@@ -0,0 +1,467 @@
+/*
+ *  $Id$
+ *  Copyright (C) 2016 David Necas (Yeti).
+ *  E-mail: yeti@gwyddion.net.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301, USA.
+ */
+
+#include "config.h"
+#include <string.h>
+#include <stdlib.h>
+#include <libgwyddion/gwymacros.h>
+#include <libgwyddion/gwymath.h>
+#include "gwyprocessinternal.h"
+
+/* Average number of points per index cell. */
+enum { CELL_POINTS = 2 };
+
+/*
+ * Uniform bucket grid over the bounding rectangle of the points.  Point ids
+ * and coordinates are stored sorted by cell so that points in one cell form
+ * a contiguous block [cell_index[k], cell_index[k+1]).
+ */
+struct _GwyXYIndex {
+    guint n;
+    guint xres;
+    guint yres;
+    gdouble xmin;
+    gdouble ymin;
+    gdouble dx;
+    gdouble dy;
+    guint *cell_index;
+    guint *id;
+    GwyXY *xy;
+};
+
+typedef struct {
+    gdouble r2;
+    guint id;
+} NearestItem;
+
+static inline guint
+cell_coord(gdouble t, gdouble step, guint res)
+{
+    gdouble c = t/step;
+
+    /* This also catches NaNs. */
+    if (!(c >= 0.0))
+        return 0;
+    if (c >= res)
+        return res-1;
+    return (guint)c;
+}
+
+/**
+ * _gwy_xy_index_new:
+ * @points: Array of @n items, each starting with the x and y coordinates as
+ *          two #gdouble<!-- -->s (for instance #GwyXY or #GwyXYZ).
+ * @stride: Distance between consecutive items in @points, in bytes.
+ * @n: Number of items.
+ *
+ * Creates a spatial index of points in the plane.
+ *
+ * The index does not keep any reference to @points; it must be recreated when
+ * they change.
+ *
+ * Returns: A newly created spatial index.
+ **/
+GwyXYIndex*
+_gwy_xy_index_new(gconstpointer points,
+                  gsize stride,
+                  guint n)
+{
+    const guchar *p = (const guchar*)points;
+    GwyXYIndex *xyindex;
+    gdouble xmin, xmax, ymin, ymax, xreal, yreal, s;
+    guint *cellno, *cell_index;
+    guint i, k, target, xres = 1, yres = 1, ncells;
+
+    g_return_val_if_fail(points || !n, NULL);
+
+    xyindex = g_new0(GwyXYIndex, 1);
+    xyindex->n = n;
+    xyindex->xres = xyindex->yres = 1;
+    xyindex->dx = xyindex->dy = 1.0;
+    if (!n) {
+        xyindex->cell_index = g_new0(guint, 2);
+        return xyindex;
+    }
+
+    xmin = xmax = ((const gdouble*)p)[0];
+    ymin = ymax = ((const gdouble*)p)[1];
+    for (i = 1; i < n; i++) {
+        const gdouble *xy = (const gdouble*)(p + i*stride);
+
+        if (xy[0] < xmin)
+            xmin = xy[0];
+        if (xy[0] > xmax)
+            xmax = xy[0];
+        if (xy[1] < ymin)
+            ymin = xy[1];
+        if (xy[1] > ymax)
+            ymax = xy[1];
+    }
+
+    /* Make approximately square cells, but degrade gracefully to a single
+     * row or column when the points lie on a line. */
+    xreal = xmax - xmin;
+    yreal = ymax - ymin;
+    target = MAX(n/CELL_POINTS, 1);
+    if (xreal > 0.0 && yreal > 0.0) {
+        s = sqrt(xreal*yreal/target);
+        xres = (guint)CLAMP(ceil(xreal/s), 1.0, (gdouble)target);
+        yres = (guint)CLAMP(ceil(yreal/s), 1.0, (gdouble)target);
+    }
+    else if (xreal > 0.0)
+        xres = target;
+    else if (yreal > 0.0)
+        yres = target;
+
+    xyindex->xres = xres;
+    xyindex->yres = yres;
+    xyindex->xmin = xmin;
+    xyindex->ymin = ymin;
+    if (xreal > 0.0)
+        xyindex->dx = xreal/xres;
+    if (yreal > 0.0)
+        xyindex->dy = yreal/yres;
+
+    /* Counting sort of the points by cell. */
+    ncells = xres*yres;
+    cell_index = xyindex->cell_index = g_new0(guint, ncells + 1);
+    cellno = g_new(guint, n);
+    for (i = 0; i < n; i++) {
+        const gdouble *xy = (const gdouble*)(p + i*stride);
+
+        k = (cell_coord(xy[1] - ymin, xyindex->dy, yres)*xres
+             + cell_coord(xy[0] - xmin, xyindex->dx, xres));
+        cellno[i] = k;
+        cell_index[k+1]++;
+    }
+    for (k = 1; k <= ncells; k++)
+        cell_index[k] += cell_index[k-1];
+
+    xyindex->id = g_new(guint, n);
+    xyindex->xy = g_new(GwyXY, n);
+    for (i = 0; i < n; i++) {
+        const gdouble *xy = (const gdouble*)(p + i*stride);
+
+        k = cell_index[cellno[i]]++;
+        xyindex->id[k] = i;
+        xyindex->xy[k].x = xy[0];
+        xyindex->xy[k].y = xy[1];
+    }
+    g_free(cellno);
+
+    /* Now cell_index[k] is the end of cell k; shift it back to starts. */
+    memmove(cell_index + 1, cell_index, ncells*sizeof(guint));
+    cell_index[0] = 0;
+
+    return xyindex;
+}
+
+/**
+ * _gwy_xy_index_free:
+ * @xyindex: A spatial index.  It can be %NULL.
+ *
+ * Frees a spatial index of points in the plane.
+ **/
+void
+_gwy_xy_index_free(GwyXYIndex *xyindex)
+{
+    if (!xyindex)
+        return;
+
+    g_free(xyindex->cell_index);
+    g_free(xyindex->id);
+    g_free(xyindex->xy);
+    g_free(xyindex);
+}
+
+static gint
+compare_uint(gconstpointer a, gconstpointer b)
+{
+    const guint ia = *(const guint*)a;
+    const guint ib = *(const guint*)b;
+
+    if (ia < ib)
+        return -1;
+    if (ia > ib)
+        return 1;
+    return 0;
+}
+
+static guint*
+find_in_range(const GwyXYIndex *xyindex,
+              gdouble xfrom, gdouble xto,
+              gdouble yfrom, gdouble yto,
+              gboolean use_radius,
+              gdouble x, gdouble y, gdouble r2,
+              guint *nfound)
+{
+    guint xres = xyindex->xres;
+    const guint *cell_index = xyindex->cell_index;
+    guint ifrom, ito, jfrom, jto, i, j, m;
+    GArray *found;
+
+    *nfound = 0;
+    if (!xyindex->n || !(xfrom <= xto) || !(yfrom <= yto))
+        return NULL;
+
+    jfrom = cell_coord(xfrom - xyindex->xmin, xyindex->dx, xres);
+    jto = cell_coord(xto - xyindex->xmin, xyindex->dx, xres);
+    ifrom = cell_coord(yfrom - xyindex->ymin, xyindex->dy, xyindex->yres);
+    ito = cell_coord(yto - xyindex->ymin, xyindex->dy, xyindex->yres);
+
+    found = g_array_new(FALSE, FALSE, sizeof(guint));
+    for (i = ifrom; i <= ito; i++) {
+        for (j = jfrom; j <= jto; j++) {
+            guint k = i*xres + j;
+
+            for (m = cell_index[k]; m < cell_index[k+1]; m++) {
+                const GwyXY *pt = xyindex->xy + m;
+
+                if (pt->x < xfrom || pt->x > xto
+                    || pt->y < yfrom || pt->y > yto)
+                    continue;
+                if (use_radius
+                    && ((pt->x - x)*(pt->x - x)
+                        + (pt->y - y)*(pt->y - y)) > r2)
+                    continue;
+                g_array_append_val(found, xyindex->id[m]);
+            }
+        }
+    }
+
+    if (!found->len) {
+        g_array_free(found, TRUE);
+        return NULL;
+    }
+
+    g_array_sort(found, compare_uint);
+    *nfound = found->len;
+    return (guint*)g_array_free(found, FALSE);
+}
+
+/**
+ * _gwy_xy_index_find_in_rectangle:
+ * @xyindex: A spatial index.
+ * @xfrom: Minimum x-coordinate.
+ * @xto: Maximum x-coordinate.
+ * @yfrom: Minimum y-coordinate.
+ * @yto: Maximum y-coordinate.
+ * @nfound: Location to store the number of found points.
+ *
+ * Finds all indexed points inside a rectangle, including its boundary.
+ *
+ * Returns: Newly allocated array of point indices, sorted in ascending order.
+ *          %NULL is returned when there are no such points.
+ **/
+guint*
+_gwy_xy_index_find_in_rectangle(const GwyXYIndex *xyindex,
+                                gdouble xfrom, gdouble xto,
+                                gdouble yfrom, gdouble yto,
+                                guint *nfound)
+{
+    return find_in_range(xyindex, xfrom, xto, yfrom, yto,
+                         FALSE, 0.0, 0.0, 0.0, nfound);
+}
+
+/**
+ * _gwy_xy_index_find_in_radius:
+ * @xyindex: A spatial index.
+ * @x: Centre x-coordinate.
+ * @y: Centre y-coordinate.
+ * @r: Radius.
+ * @nfound: Location to store the number of found points.
+ *
+ * Finds all indexed points inside a disc, including its boundary.
+ *
+ * Returns: Newly allocated array of point indices, sorted in ascending order.
+ *          %NULL is returned when there are no such points.
+ **/
+guint*
+_gwy_xy_index_find_in_radius(const GwyXYIndex *xyindex,
+                             gdouble x, gdouble y, gdouble r,
+                             guint *nfound)
+{
+    if (!(r >= 0.0)) {
+        *nfound = 0;
+        return NULL;
+    }
+    return find_in_range(xyindex, x - r, x + r, y - r, y + r,
+                         TRUE, x, y, r*r, nfound);
+}
+
+/* Keep the k best candidates in a max-heap by distance so that the worst one
+ * is always items[0]. */
+static void
+nearest_heap_add(NearestItem *items, guint *len, guint k,
+                 gdouble r2, guint id)
+{
+    guint i, c;
+
+    if (*len < k) {
+        i = (*len)++;
+        while (i) {
+            c = (i - 1)/2;
+            if (items[c].r2 >= r2)
+                break;
+            items[i] = items[c];
+            i = c;
+        }
+        items[i].r2 = r2;
+        items[i].id = id;
+        return;
+    }
+
+    if (r2 >= items[0].r2)
+        return;
+
+    i = 0;
+    while ((c = 2*i + 1) < k) {
+        if (c+1 < k && items[c+1].r2 > items[c].r2)
+            c++;
+        if (items[c].r2 <= r2)
+            break;
+        items[i] = items[c];
+        i = c;
+    }
+    items[i].r2 = r2;
+    items[i].id = id;
+}
+
+static gint
+compare_nearest_item(gconstpointer a, gconstpointer b)
+{
+    const NearestItem *ia = (const NearestItem*)a;
+    const NearestItem *ib = (const NearestItem*)b;
+
+    if (ia->r2 < ib->r2)
+        return -1;
+    if (ia->r2 > ib->r2)
+        return 1;
+    if (ia->id < ib->id)
+        return -1;
+    if (ia->id > ib->id)
+        return 1;
+    return 0;
+}
+
+static inline void
+nearest_visit_cell(const GwyXYIndex *xyindex, guint k,
+                   gdouble x, gdouble y,
+                   NearestItem *items, guint *len, guint nitems)
+{
+    guint m;
+
+    for (m = xyindex->cell_index[k]; m < xyindex->cell_index[k+1]; m++) {
+        const GwyXY *pt = xyindex->xy + m;
+        gdouble r2 = (pt->x - x)*(pt->x - x) + (pt->y - y)*(pt->y - y);
+
+        nearest_heap_add(items, len, nitems, r2, xyindex->id[m]);
+    }
+}
+
+/**
+ * _gwy_xy_index_find_nearest:
+ * @xyindex: A spatial index.
+ * @x: Point x-coordinate.
+ * @y: Point y-coordinate.
+ * @n: Number of indices to find.  Array @ilist must have at least this
+ *     number of items.
+ * @ilist: Array to place the point indices to.
+ *
+ * Finds the indexed points nearest to a given point.
+ *
+ * Cells are visited in growing square rings around the cell containing
+ * (@x, @y) until all unvisited cells are farther than the n-th nearest point
+ * found so far.
+ *
+ * Returns: The number of indices stored to @ilist, which is the smaller of
+ *          @n and the number of indexed points.  The indices are sorted by
+ *          the distance from (@x, @y).
+ **/
+guint
+_gwy_xy_index_find_nearest(const GwyXYIndex *xyindex,
+                           gdouble x, gdouble y,
+                           guint n, guint *ilist)
+{
+    gint xres = xyindex->xres, yres = xyindex->yres;
+    gint cx, cy, ilo, ihi, jlo, jhi, i, j, rho;
+    NearestItem *items;
+    guint len = 0, m;
+
+    n = MIN(n, xyindex->n);
+    if (!n)
+        return 0;
+
+    items = g_new(NearestItem, n);
+    cx = cell_coord(x - xyindex->xmin, xyindex->dx, xres);
+    cy = cell_coord(y - xyindex->ymin, xyindex->dy, yres);
+    for (rho = 0; ; rho++) {
+        ilo = cy - rho;
+        ihi = cy + rho;
+        jlo = cx - rho;
+        jhi = cx + rho;
+
+        for (i = MAX(ilo, 0); i <= MIN(ihi, yres-1); i++) {
+            if (i == ilo || i == ihi) {
+                for (j = MAX(jlo, 0); j <= MIN(jhi, xres-1); j++)
+                    nearest_visit_cell(xyindex, i*xres + j, x, y,
+                                       items, &len, n);
+            }
+            else {
+                if (jlo >= 0)
+                    nearest_visit_cell(xyindex, i*xres + jlo, x, y,
+                                       items, &len, n);
+                if (jhi < xres)
+                    nearest_visit_cell(xyindex, i*xres + jhi, x, y,
+                                       items, &len, n);
+            }
+        }
+
+        if (ilo <= 0 && jlo <= 0 && ihi >= yres-1 && jhi >= xres-1)
+            break;
+
+        /* Lower bound on the distance of any point in unvisited cells. */
+        if (len == n) {
+            gdouble bound = G_MAXDOUBLE;
+
+            if (jlo > 0)
+                bound = MIN(bound, x - (xyindex->xmin + jlo*xyindex->dx));
+            if (jhi < xres-1)
+                bound = MIN(bound, xyindex->xmin + (jhi + 1)*xyindex->dx - x);
+            if (ilo > 0)
+                bound = MIN(bound, y - (xyindex->ymin + ilo*xyindex->dy));
+            if (ihi < yres-1)
+                bound = MIN(bound, xyindex->ymin + (ihi + 1)*xyindex->dy - y);
+
+            if (bound > 0.0 && bound*bound > items[0].r2)
+                break;
+        }
+    }
+
+    qsort(items, len, sizeof(NearestItem), compare_nearest_item);
+    for (m = 0; m < len; m++)
+        ilist[m] = items[m].id;
+    g_free(items);
+
+    return len;
+}
+
+/* vim: set cin et ts=4 sw=4 cino=>1s,e0,n0,f0,{0,}0,^0,\:1s,=0,g1s,h0,t0,+1s,c3,(0,u0 : */
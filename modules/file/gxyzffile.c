@@ -45,12 +45,16 @@
 
 #include <string.h>
 #include <stdlib.h>
+#include <stdio.h>
+#include <sys/types.h>
+#include <sys/stat.h>
 #include <glib/gstdio.h>
 #include <libgwyddion/gwymacros.h>
 #include <libgwyddion/gwymath.h>
 #include <libgwyddion/gwyutils.h>
 #include <libprocess/arithmetic.h>
 #include <libprocess/surface.h>
+#include <libprocess/rasterizer.h>
 #include <libgwydgets/gwydgetutils.h>
 #include <app/gwymoduleutils-file.h>
 #include <app/gwyapp.h>
@@ -61,16 +65,51 @@
 #define MAGIC_SIZE (sizeof(MAGIC)-1)
 #define EXTENSION ".gxyzf"
 
+#if (!GLIB_CHECK_VERSION(2, 26, 0))
+#define GStatBuf struct stat
+#endif
+
+enum {
+    /* For files larger than this the user is offered rasterisation while
+     * reading instead of loading them as XYZ data. */
+    HUGE_FILE_SIZE = 256*1024*1024,
+    /* Memory for the images and the rasteriser when rasterising. */
+    RASTER_MEMORY = 1024*1024*1024,
+    HEADER_SIZE = 65536,
+    CHUNK_POINTS = 65536,
+    MAX_RES = 16384,
+};
+
 typedef struct {
     gboolean all_channels;
 } GXYZExportArgs;
 
+typedef struct {
+    GHashTable *hash;
+    gchar *header;
+    guint nchan;
+    GwySIUnit *xyunit;
+    GwySIUnit *zunit;
+    GwySIUnit **zunits;
+} GXYZFHeader;
+
 static gboolean      module_register              (void);
 static gint          gxyzf_detect                 (const GwyFileDetectInfo *fileinfo,
                                                    gboolean only_name);
 static GwyContainer* gxyzf_load                   (const gchar *filename,
                                                    GwyRunType mode,
                                                    GError **error);
+static gint          gxyzf_huge_file_dialog       (guint64 size);
+static GwyContainer* gxyzf_load_rasterized        (const gchar *filename,
+                                                   guint64 size,
+                                                   GwyRunType mode,
+                                                   GError **error);
+static gboolean      parse_header                 (const guchar *buffer,
+                                                   gsize size,
+                                                   GXYZFHeader *header,
+                                                   gsize *datapos,
+                                                   GError **error);
+static void          free_header                  (GXYZFHeader *header);
 static gboolean      gxyzf_export                 (GwyContainer *container,
                                                    const gchar *filename,
                                                    GwyRunType mode,
@@ -117,7 +156,7 @@ static GwyModuleInfo module_info = {
     &module_register,
     N_("Imports Gwyddion XYZ field files."),
     "Yeti <yeti@gwyddion.net>",
-    "2.0",
+    "2.1",
     "David Nečas (Yeti)",
     "2013",
 };
@@ -167,85 +206,54 @@ append_double(gdouble *target, const gdouble v)
 
 static GwyContainer*
 gxyzf_load(const gchar *filename,
-           G_GNUC_UNUSED GwyRunType mode,
+           GwyRunType mode,
            GError **error)
 {
     GwyContainer *container = NULL;
-    GwyTextHeaderParser parser;
-    GHashTable *hash = NULL;
-    guchar *p, *value, *buffer = NULL, *header = NULL, *datap;
+    GXYZFHeader header;
+    guchar *value, *buffer = NULL;
     GwyXYZ *xyzpoints = NULL;
     gdouble *points = NULL;
-    gsize size;
+    gsize size, datapos;
     GError *err = NULL;
-    GwySIUnit **zunits = NULL;
-    GwySIUnit *xyunit = NULL, *zunit = NULL;
-    guint nchan = 0, pointlen, pointsize, npoints, i, id;
-
-    if (!g_file_get_contents(filename, (gchar**)&buffer, &size, &err)) {
-        err_GET_FILE_CONTENTS(error, &err);
-        goto fail;
-    }
-
-    if (size < MAGIC_SIZE || memcmp(buffer, MAGIC, MAGIC_SIZE) != 0) {
-        err_FILE_TYPE(error, "Gwyddion XYZ Field");
-        goto fail;
-    }
+    GStatBuf st;
+    guint nchan, pointlen, pointsize, npoints, i, id;
+    gint response;
 
-    p = buffer + MAGIC_SIZE;
-    datap = memchr(p, '\0', size - (p - buffer));
-    if (!datap) {
-        g_set_error(error, GWY_MODULE_FILE_ERROR, GWY_MODULE_FILE_ERROR_DATA,
-                    _("File header is truncated."));
-        goto fail;
+    /* Rasterisation is an explicit choice.  Non-interactive import gives XYZ
+     * data whatever the file size. */
+    if (mode == GWY_RUN_INTERACTIVE
+        && g_stat(filename, &st) == 0 && st.st_size > HUGE_FILE_SIZE) {
+        response = gxyzf_huge_file_dialog(st.st_size);
+        if (response == GTK_RESPONSE_YES)
+            return gxyzf_load_rasterized(filename, st.st_size, mode, error);
+        if (response != GTK_RESPONSE_NO) {
+            err_CANCELLED(error);
+            return NULL;
+        }
     }
-    header = g_strdup(p);
-    datap += 8 - ((datap - buffer) % 8);
 
-    gwy_clear(&parser, 1);
-    parser.key_value_separator = "=";
-    if (!(hash = gwy_text_header_parse(header, &parser, NULL, NULL))) {
-        g_propagate_error(error, err);
+    gwy_clear(&header, 1);
+    if (!g_file_get_contents(filename, (gchar**)&buffer, &size, &err)) {
+        err_GET_FILE_CONTENTS(error, &err);
         goto fail;
     }
 
-    if (!(value = g_hash_table_lookup(hash, "NChannels"))) {
-        err_MISSING_FIELD(error, "NChannels");
-        goto fail;
-    }
-    nchan = atoi(value);
-    if (nchan < 1 || nchan > 1024) {
-        err_INVALID(error, "NChannels");
+    if (!parse_header(buffer, size, &header, &datapos, error))
         goto fail;
-    }
 
+    nchan = header.nchan;
     pointlen = nchan + 2;
     pointsize = pointlen*sizeof(gdouble);
-    if ((size - (datap - buffer)) % pointsize) {
+    if ((size - datapos) % pointsize) {
         g_set_error(error, GWY_MODULE_FILE_ERROR, GWY_MODULE_FILE_ERROR_DATA,
                     _("Data size %lu is not a multiple of point size %u."),
-                    (gulong)(size - (datap - buffer)), pointsize);
+                    (gulong)(size - datapos), pointsize);
         goto fail;
     }
-    npoints = (size - (datap - buffer))/pointsize;
-
-    value = g_hash_table_lookup(hash, "XYUnits");
-    xyunit = gwy_si_unit_new(value);
-
-    /* If there is ZUnits it applies to all channels. */
-    if ((value = g_hash_table_lookup(hash, "ZUnits")))
-        zunit = gwy_si_unit_new(value);
-    else {
-        zunits = g_new0(GwySIUnit*, nchan);
-        for (id = 0; id < nchan; id++) {
-            gchar buf[16];
-            g_snprintf(buf, sizeof(buf), "ZUnits%u", id+1);
-            value = g_hash_table_lookup(hash, buf);
-            zunits[id] = gwy_si_unit_new(value);
-        }
-    }
+    npoints = (size - datapos)/pointsize;
 
-    points = (gdouble*)datap;
+    points = (gdouble*)(buffer + datapos);
     xyzpoints = g_new(GwyXYZ, npoints);
     for (i = 0; i < npoints; i++) {
         append_double(&xyzpoints[i].x, points[i*pointlen]);
@@ -264,19 +272,20 @@ gxyzf_load(const gchar *filename,
 
         surface = gwy_surface_new_from_data(xyzpoints, npoints);
         unit = gwy_surface_get_si_unit_z(surface);
-        if (zunit)
-            gwy_serializable_clone(G_OBJECT(zunit), G_OBJECT(unit));
+        if (header.zunit)
+            gwy_serializable_clone(G_OBJECT(header.zunit), G_OBJECT(unit));
         else
-            gwy_serializable_clone(G_OBJECT(zunits[id]), G_OBJECT(unit));
+            gwy_serializable_clone(G_OBJECT(header.zunits[id]),
+                                   G_OBJECT(unit));
         unit = gwy_surface_get_si_unit_xy(surface);
-        gwy_serializable_clone(G_OBJECT(xyunit), G_OBJECT(unit));
+        gwy_serializable_clone(G_OBJECT(header.xyunit), G_OBJECT(unit));
 
         quark = gwy_app_get_surface_key_for_id(id);
         gwy_container_set_object(container, quark, surface);
         g_object_unref(surface);
 
         g_snprintf(buf, sizeof(buf), "Title%u", id+1);
-        if ((value = g_hash_table_lookup(hash, buf))) {
+        if ((value = g_hash_table_lookup(header.hash, buf))) {
             quark = gwy_app_get_surface_title_key_for_id(id);
             gwy_container_set_const_string(container, quark, value);
         }
@@ -286,19 +295,330 @@ gxyzf_load(const gchar *filename,
 fail:
     g_free(xyzpoints);
     g_free(buffer);
-    if (hash)
-        g_hash_table_destroy(hash);
-    GWY_OBJECT_UNREF(xyunit);
-    GWY_OBJECT_UNREF(zunit);
-    if (zunits) {
-        for (i = 0; i < nchan; i++)
-            GWY_OBJECT_UNREF(zunits[i]);
-        g_free(zunits);
+    free_header(&header);
+
+    return container;
+}
+
+static gboolean
+read_points(FILE *fh, gdouble *points, guint pointlen, guint n,
+            GError **error)
+{
+    if (fread(points, pointlen*sizeof(gdouble), n, fh) != n) {
+        err_READ(error);
+        return FALSE;
     }
+    return TRUE;
+}
+
+static gint
+gxyzf_huge_file_dialog(guint64 size)
+{
+    GtkWidget *dialog;
+    gint response;
+
+    dialog = gtk_message_dialog_new(NULL, GTK_DIALOG_MODAL,
+                                    GTK_MESSAGE_QUESTION, GTK_BUTTONS_NONE,
+                                    _("The file is very large (%.1f MB)."),
+                                    size/1048576.0);
+    gtk_message_dialog_format_secondary_text
+        (GTK_MESSAGE_DIALOG(dialog),
+         _("Loading it as XYZ data requires much memory.  It can be also "
+           "rasterized to images while reading."));
+    gtk_dialog_add_buttons(GTK_DIALOG(dialog),
+                           GTK_STOCK_CANCEL, GTK_RESPONSE_CANCEL,
+                           _("Load _XYZ Data"), GTK_RESPONSE_NO,
+                           _("_Rasterize"), GTK_RESPONSE_YES,
+                           NULL);
+    gtk_dialog_set_default_response(GTK_DIALOG(dialog), GTK_RESPONSE_YES);
+    response = gtk_dialog_run(GTK_DIALOG(dialog));
+    if (response != GTK_RESPONSE_NONE)
+        gtk_widget_destroy(dialog);
+
+    return response;
+}
+
+/* Huge files are rendered directly to images, without ever having all the
+ * points in memory.  The file is read once to find the lateral ranges and
+ * then once for each channel to feed the points to the rasteriser, so only
+ * one rasteriser exists at a time.  The resolution is limited so that the
+ * images and the rasteriser fit into RASTER_MEMORY. */
+static GwyContainer*
+gxyzf_load_rasterized(const gchar *filename,
+                      guint64 size,
+                      GwyRunType mode,
+                      GError **error)
+{
+    GwyContainer *container = NULL;
+    GXYZFHeader header;
+    GwyXYZRasterizer *rasterizer = NULL;
+    GwyDataField **fields = NULL;
+    GwyXYZ *xyzpoints = NULL;
+    gdouble *points = NULL;
+    guchar *buffer, *value;
+    gsize n, datapos;
+    guint64 npoints, k;
+    gdouble xmin = G_MAXDOUBLE, xmax = -G_MAXDOUBLE;
+    gdouble ymin = G_MAXDOUBLE, ymax = -G_MAXDOUBLE;
+    gdouble hx, hy, x, y, q, maxpixels;
+    gint xres = 0, yres = 0;
+    guint nchan = 0, pointlen, pointsize, i, id, pass, nchunk;
+    gboolean ok = FALSE, waiting = FALSE;
+    GError *err = NULL;
+    FILE *fh;
+
+    gwy_clear(&header, 1);
+    if (!(fh = gwy_fopen(filename, "rb"))) {
+        err_OPEN_READ(error);
+        return NULL;
+    }
+
+    buffer = g_new(guchar, HEADER_SIZE);
+    n = fread(buffer, 1, HEADER_SIZE, fh);
+    ok = parse_header(buffer, n, &header, &datapos, error);
+    g_free(buffer);
+    if (!ok)
+        goto fail;
+    ok = FALSE;
+
+    nchan = header.nchan;
+    pointlen = nchan + 2;
+    pointsize = pointlen*sizeof(gdouble);
+    if ((size - datapos) % pointsize) {
+        g_set_error(error, GWY_MODULE_FILE_ERROR, GWY_MODULE_FILE_ERROR_DATA,
+                    _("Data size %lu is not a multiple of point size %u."),
+                    (gulong)(size - datapos), pointsize);
+        goto fail;
+    }
+    npoints = (size - datapos)/pointsize;
+    if (!npoints) {
+        err_NO_DATA(error);
+        goto fail;
+    }
+
+    if (mode == GWY_RUN_INTERACTIVE) {
+        gwy_app_wait_start(NULL, _("Reading points..."));
+        waiting = TRUE;
+    }
+
+    points = g_new(gdouble, CHUNK_POINTS*pointlen);
+    xyzpoints = g_new(GwyXYZ, CHUNK_POINTS);
+    fields = g_new0(GwyDataField*, nchan);
+    for (pass = 0; pass <= nchan; pass++) {
+        id = pass - 1;
+        if (pass == 1) {
+            /* Regular grids exported from images know their resolution. */
+            if ((value = g_hash_table_lookup(header.hash, "XRes")))
+                xres = atoi(value);
+            if ((value = g_hash_table_lookup(header.hash, "YRes")))
+                yres = atoi(value);
+            if (xres < 2 || yres < 2 || (guint64)xres*yres != npoints)
+                xres = yres = GWY_ROUND(sqrt(npoints));
+            /* All images plus the two arrays of an averaging rasteriser. */
+            maxpixels = RASTER_MEMORY/((nchan + 2.0)*sizeof(gdouble));
+            if ((gdouble)xres*yres > maxpixels) {
+                q = sqrt(maxpixels/((gdouble)xres*yres));
+                xres = (gint)(q*xres);
+                yres = (gint)(q*yres);
+            }
+            xres = CLAMP(xres, 2, MAX_RES);
+            yres = CLAMP(yres, 2, MAX_RES);
+            hx = (xmax - xmin)/(xres - 1);
+            hy = (ymax - ymin)/(yres - 1);
+            if (!(hx > 0.0))
+                hx = (hy > 0.0) ? hy : 1.0;
+            if (!(hy > 0.0))
+                hy = hx;
+        }
+        if (pass) {
+            fields[id] = gwy_data_field_new(xres, yres, hx*xres, hy*yres,
+                                            FALSE);
+            gwy_data_field_set_xoffset(fields[id], xmin - 0.5*hx);
+            gwy_data_field_set_yoffset(fields[id], ymin - 0.5*hy);
+            rasterizer = gwy_xyz_rasterizer_new(fields[id],
+                                                GWY_XYZ_RASTERIZE_AVERAGE);
+        }
+
+        if (fseek(fh, datapos, SEEK_SET) != 0) {
+            err_READ(error);
+            goto fail;
+        }
+        nchunk = 0;
+        for (k = 0; k < npoints; k += n) {
+            n = MIN(npoints - k, CHUNK_POINTS);
+            if (!read_points(fh, points, pointlen, n, error))
+                goto fail;
+
+            for (i = 0; i < n; i++) {
+                append_double(&xyzpoints[i].x, points[i*pointlen]);
+                append_double(&xyzpoints[i].y, points[i*pointlen + 1]);
+            }
+            if (pass == 0) {
+                for (i = 0; i < n; i++) {
+                    x = xyzpoints[i].x;
+                    y = xyzpoints[i].y;
+                    xmin = MIN(xmin, x);
+                    xmax = MAX(xmax, x);
+                    ymin = MIN(ymin, y);
+                    ymax = MAX(ymax, y);
+                }
+            }
+            else {
+                for (i = 0; i < n; i++)
+                    append_double(&xyzpoints[i].z, points[i*pointlen + 2+id]);
+                if (!gwy_xyz_rasterizer_add_points(rasterizer,
+                                                   xyzpoints, n, error))
+                    goto fail;
+            }
+
+            if (waiting && !(++nchunk % 16)) {
+                x = (pass + (gdouble)k/npoints)/(nchan + 1);
+                if (!gwy_app_wait_set_fraction(x)) {
+                    err_CANCELLED(error);
+                    goto fail;
+                }
+            }
+        }
+
+        if (pass) {
+            if (!gwy_xyz_rasterizer_finish(rasterizer, NULL, NULL, &err)) {
+                g_propagate_error(error, err);
+                goto fail;
+            }
+            gwy_xyz_rasterizer_free(rasterizer);
+            rasterizer = NULL;
+        }
+    }
+
+    container = gwy_container_new();
+    for (id = 0; id < nchan; id++) {
+        GwySIUnit *unit;
+        GQuark quark;
+        gchar buf[24];
+
+        unit = gwy_data_field_get_si_unit_z(fields[id]);
+        if (header.zunit)
+            gwy_serializable_clone(G_OBJECT(header.zunit), G_OBJECT(unit));
+        else
+            gwy_serializable_clone(G_OBJECT(header.zunits[id]),
+                                   G_OBJECT(unit));
+        unit = gwy_data_field_get_si_unit_xy(fields[id]);
+        gwy_serializable_clone(G_OBJECT(header.xyunit), G_OBJECT(unit));
+
+        quark = gwy_app_get_data_key_for_id(id);
+        gwy_container_set_object(container, quark, fields[id]);
+
+        g_snprintf(buf, sizeof(buf), "Title%u", id+1);
+        if ((value = g_hash_table_lookup(header.hash, buf))) {
+            quark = gwy_app_get_data_title_key_for_id(id);
+            gwy_container_set_const_string(container, quark, value);
+        }
+        else
+            gwy_app_channel_title_fall_back(container, id);
+        gwy_file_channel_import_log_add(container, id, NULL, filename);
+    }
+
+fail:
+    if (waiting)
+        gwy_app_wait_finish();
+    fclose(fh);
+    g_free(points);
+    g_free(xyzpoints);
+    if (rasterizer)
+        gwy_xyz_rasterizer_free(rasterizer);
+    for (id = 0; id < nchan; id++) {
+        if (fields)
+            GWY_OBJECT_UNREF(fields[id]);
+    }
+    g_free(fields);
+    free_header(&header);
 
     return container;
 }
 
+static gboolean
+parse_header(const guchar *buffer, gsize size,
+             GXYZFHeader *header, gsize *datapos,
+             GError **error)
+{
+    GwyTextHeaderParser parser;
+    const guchar *p, *datap;
+    guchar *value;
+    GError *err = NULL;
+    guint id;
+
+    if (size < MAGIC_SIZE || memcmp(buffer, MAGIC, MAGIC_SIZE) != 0) {
+        err_FILE_TYPE(error, "Gwyddion XYZ Field");
+        return FALSE;
+    }
+
+    p = buffer + MAGIC_SIZE;
+    datap = memchr(p, '\0', size - (p - buffer));
+    if (!datap) {
+        g_set_error(error, GWY_MODULE_FILE_ERROR, GWY_MODULE_FILE_ERROR_DATA,
+                    _("File header is truncated."));
+        return FALSE;
+    }
+    header->header = g_strdup(p);
+    datap += 8 - ((datap - buffer) % 8);
+    *datapos = datap - buffer;
+
+    gwy_clear(&parser, 1);
+    parser.key_value_separator = "=";
+    if (!(header->hash = gwy_text_header_parse(header->header, &parser,
+                                               NULL, NULL))) {
+        g_propagate_error(error, err);
+        return FALSE;
+    }
+
+    if (!(value = g_hash_table_lookup(header->hash, "NChannels"))) {
+        err_MISSING_FIELD(error, "NChannels");
+        return FALSE;
+    }
+    header->nchan = atoi(value);
+    if (header->nchan < 1 || header->nchan > 1024) {
+        err_INVALID(error, "NChannels");
+        header->nchan = 0;
+        return FALSE;
+    }
+
+    value = g_hash_table_lookup(header->hash, "XYUnits");
+    header->xyunit = gwy_si_unit_new(value);
+
+    /* If there is ZUnits it applies to all channels. */
+    if ((value = g_hash_table_lookup(header->hash, "ZUnits")))
+        header->zunit = gwy_si_unit_new(value);
+    else {
+        header->zunits = g_new0(GwySIUnit*, header->nchan);
+        for (id = 0; id < header->nchan; id++) {
+            gchar buf[16];
+            g_snprintf(buf, sizeof(buf), "ZUnits%u", id+1);
+            value = g_hash_table_lookup(header->hash, buf);
+            header->zunits[id] = gwy_si_unit_new(value);
+        }
+    }
+
+    return TRUE;
+}
+
+static void
+free_header(GXYZFHeader *header)
+{
+    guint i;
+
+    if (header->hash)
+        g_hash_table_destroy(header->hash);
+    g_free(header->header);
+    GWY_OBJECT_UNREF(header->xyunit);
+    GWY_OBJECT_UNREF(header->zunit);
+    if (header->zunits) {
+        for (i = 0; i < header->nchan; i++)
+            GWY_OBJECT_UNREF(header->zunits[i]);
+        g_free(header->zunits);
+    }
+    gwy_clear(header, 1);
+}
+
 static gboolean
 gxyzf_export(G_GNUC_UNUSED GwyContainer *data,
              const gchar *filename,
@@ -28,11 +28,19 @@
 #include "config.h"
 #include <string.h>
 #include <stdlib.h>
+#include <stdio.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <glib/gstdio.h>
 #include <gtk/gtk.h>
 #include <libgwyddion/gwymacros.h>
 #include <libgwyddion/gwymath.h>
 #include <libgwyddion/gwyutils.h>
+#include <libprocess/arithmetic.h>
 #include <libprocess/surface.h>
+#include <libprocess/rasterizer.h>
+#include <libgwydgets/gwydgetutils.h>
+#include <libgwydgets/gwycombobox.h>
 #include <libgwymodule/gwymodule-file.h>
 #include <app/gwyapp.h>
 #include <app/gwymoduleutils-file.h>
@@ -41,14 +49,41 @@
 
 #define EXTENSION ".xyz"
 
+#if (!GLIB_CHECK_VERSION(2, 26, 0))
+#define GStatBuf struct stat
+#endif
+
+enum {
+    /* Files larger than this are not loaded to memory as a whole before the
+     * user decides whether to rasterise them while reading. */
+    HUGE_FILE_SIZE = 256*1024*1024,
+    CHUNK_POINTS = 65536,
+    LINE_SIZE = 1024,
+    MAX_RES = 16384,
+};
+
 typedef struct {
     gchar *xy_units;
     gchar *z_units;
+    gboolean rasterize;
+    gint xres;
+    GwyXYZRasterizeType method;
 } RawXYZArgs;
 
+typedef struct {
+    guint64 npoints;
+    gdouble xmin;
+    gdouble xmax;
+    gdouble ymin;
+    gdouble ymax;
+    gdouble zmin;
+    gdouble zmax;
+    gboolean huge;
+} RawXYZInfo;
+
 typedef struct {
     RawXYZArgs *args;
-    GwySurface *surface;
+    const RawXYZInfo *info;
     GtkWidget *dialog;
     GtkWidget *xmin;
     GtkWidget *xmax;
@@ -61,6 +96,11 @@ typedef struct {
     GtkWidget *zunit;
     GtkWidget *xy_units;
     GtkWidget *z_units;
+    GtkWidget *rasterize;
+    GtkObject *xres;
+    GtkWidget *xres_spin;
+    GtkWidget *yres;
+    GtkWidget *method;
 } RawXYZControls;
 
 static gboolean      module_register (void);
@@ -70,28 +110,54 @@ static GwyContainer* rawxyz_load     (const gchar *filename,
                                       GwyRunType mode,
                                       GError **error);
 static gboolean      rawxyz_dialog   (RawXYZArgs *arg,
-                                      GwySurface *surface);
+                                      const RawXYZInfo *info);
 static void          xyunits_changed (RawXYZControls *controls,
                                       GtkEntry *entry);
 static void          zunits_changed  (RawXYZControls *controls,
                                       GtkEntry *entry);
+static void          rasterize_changed(RawXYZControls *controls,
+                                      GtkToggleButton *toggle);
+static void          xres_changed    (RawXYZControls *controls,
+                                      GtkAdjustment *adj);
+static void          method_changed  (RawXYZControls *controls,
+                                      GtkComboBox *combo);
 static gint          construct_units (RawXYZControls *controls,
                                       GtkTable *table,
                                       gint row);
+static gint          construct_raster(RawXYZControls *controls,
+                                      GtkTable *table,
+                                      gint row);
 static void          construct_range (GtkTable *table,
                                       const gchar *name,
                                       gint row,
                                       GtkWidget **from,
                                       GtkWidget **to,
                                       GtkWidget **unit);
+static GwySurface*   read_xyz_file   (const gchar *filename,
+                                      GError **error);
 static GwySurface*   read_xyz_points (gchar *p);
+static gboolean      scan_xyz_file   (const gchar *filename,
+                                      RawXYZInfo *info,
+                                      GwyXYZRasterizer *rasterizer,
+                                      gboolean waiting,
+                                      GError **error);
+static GwyDataField* rasterize_xyz   (const gchar *filename,
+                                      GwySurface *surface,
+                                      const RawXYZInfo *info,
+                                      const RawXYZArgs *args,
+                                      gboolean waiting,
+                                      GError **error);
+static void          info_from_surface(GwySurface *surface,
+                                      RawXYZInfo *info);
+static gint          rasterized_yres (const RawXYZInfo *info,
+                                      gint xres);
 static void          rawxyz_load_args(GwyContainer *container,
                                       RawXYZArgs *args);
 static void          rawxyz_save_args(GwyContainer *container,
                                       RawXYZArgs *args);
 
 static const RawXYZArgs rawxyz_defaults = {
-    NULL, NULL,
+    NULL, NULL, FALSE, 1024, GWY_XYZ_RASTERIZE_AVERAGE,
 };
 
 static GwyModuleInfo module_info = {
@@ -99,7 +165,7 @@ static GwyModuleInfo module_info = {
     &module_register,
     N_("Imports raw XYZ data files."),
     "Yeti <yeti@gwyddion.net>",
-    "3.1",
+    "3.2",
     "David Nečas (Yeti)",
     "2009",
 };
@@ -178,78 +244,138 @@ rawxyz_load(const gchar *filename,
 {
     GwyContainer *settings, *container = NULL;
     GwySurface *surface = NULL;
+    GwyDataField *dfield = NULL;
     RawXYZArgs args;
+    RawXYZInfo info;
     GwySIUnit *unit;
+    GStatBuf st;
     gint power10;
     gdouble q;
-    gchar *buffer = NULL;
-    gsize size;
-    GError *err = NULL;
-    gboolean ok;
+    gboolean ok, rasterize, waiting = FALSE;
     guint k;
 
-    if (!g_file_get_contents(filename, &buffer, &size, &err)) {
-        err_GET_FILE_CONTENTS(error, &err);
-        goto fail;
+    settings = gwy_app_settings_get();
+    rawxyz_load_args(settings, &args);
+
+    /* Rasterisation is always an explicit choice in the dialogue.
+     * Non-interactive import gives XYZ data whatever the file size. */
+    gwy_clear(&info, 1);
+    info.huge = (mode == GWY_RUN_INTERACTIVE
+                 && g_stat(filename, &st) == 0
+                 && st.st_size > HUGE_FILE_SIZE);
+    if (mode != GWY_RUN_INTERACTIVE)
+        args.rasterize = FALSE;
+    if (info.huge) {
+        /* Do not even try to load the points to memory.  Just find out what
+         * is in the file and stream the points to the rasteriser later. */
+        if (mode == GWY_RUN_INTERACTIVE) {
+            gwy_app_wait_start(NULL, _("Scanning file..."));
+            waiting = TRUE;
+        }
+        ok = scan_xyz_file(filename, &info, NULL, waiting, error);
+        if (waiting) {
+            gwy_app_wait_finish();
+            waiting = FALSE;
+        }
+        if (!ok)
+            goto fail;
+    }
+    else {
+        if (!(surface = read_xyz_file(filename, error)))
+            goto fail;
+        info_from_surface(surface, &info);
     }
 
-    surface = read_xyz_points(buffer);
-    g_free(buffer);
-    if (!surface->n) {
+    if (!info.npoints) {
         err_NO_DATA(error);
         goto fail;
     }
 
-    settings = gwy_app_settings_get();
-    rawxyz_load_args(settings, &args);
     if (mode == GWY_RUN_INTERACTIVE) {
-        ok = rawxyz_dialog(&args, surface);
+        rasterize = args.rasterize;
+        ok = rawxyz_dialog(&args, &info);
+        /* Do not remember the state suggested for huge files. */
+        if (info.huge)
+            GWY_SWAP(gboolean, rasterize, args.rasterize);
         rawxyz_save_args(settings, &args);
+        if (info.huge)
+            args.rasterize = rasterize;
         if (!ok) {
             err_CANCELLED(error);
             goto fail;
         }
     }
 
-    unit = gwy_si_unit_new_parse(args.xy_units, &power10);
-    if (power10) {
-        q = pow10(power10);
-        for (k = 0; k < surface->n; k++) {
-            surface->data[k].x *= q;
-            surface->data[k].y *= q;
+    if (args.rasterize) {
+        if (mode == GWY_RUN_INTERACTIVE) {
+            gwy_app_wait_start(NULL, _("Reading points..."));
+            waiting = TRUE;
         }
-        gwy_surface_invalidate(surface);
-    }
-    gwy_serializable_clone(G_OBJECT(unit),
-                           G_OBJECT(gwy_surface_get_si_unit_xy(surface)));
+        dfield = rasterize_xyz(filename, surface, &info, &args, waiting,
+                               error);
+        if (!dfield)
+            goto fail;
 
-    unit = gwy_si_unit_new_parse(args.z_units, &power10);
-    if (power10) {
-        q = pow10(power10);
-        for (k = 0; k < surface->n; k++)
-            surface->data[k].z *= q;
-        gwy_surface_invalidate(surface);
+        container = gwy_container_new();
+        gwy_container_set_object(container, gwy_app_get_data_key_for_id(0),
+                                 dfield);
+        gwy_app_channel_title_fall_back(container, 0);
+        gwy_file_channel_import_log_add(container, 0, NULL, filename);
     }
-    gwy_serializable_clone(G_OBJECT(unit),
-                           G_OBJECT(gwy_surface_get_si_unit_z(surface)));
+    else {
+        /* The user chose to import a huge file as XYZ data anyway. */
+        if (!surface) {
+            if (!(surface = read_xyz_file(filename, error)))
+                goto fail;
+            if (!surface->n) {
+                err_NO_DATA(error);
+                goto fail;
+            }
+        }
 
-    container = gwy_container_new();
-    gwy_container_set_object(container, gwy_app_get_surface_key_for_id(0),
-                             surface);
-    gwy_app_xyz_title_fall_back(container, 0);
-    gwy_file_xyz_import_log_add(container, 0, NULL, filename);
+        unit = gwy_si_unit_new_parse(args.xy_units, &power10);
+        if (power10) {
+            q = pow10(power10);
+            for (k = 0; k < surface->n; k++) {
+                surface->data[k].x *= q;
+                surface->data[k].y *= q;
+            }
+            gwy_surface_invalidate(surface);
+        }
+        gwy_serializable_clone(G_OBJECT(unit),
+                               G_OBJECT(gwy_surface_get_si_unit_xy(surface)));
+
+        unit = gwy_si_unit_new_parse(args.z_units, &power10);
+        if (power10) {
+            q = pow10(power10);
+            for (k = 0; k < surface->n; k++)
+                surface->data[k].z *= q;
+            gwy_surface_invalidate(surface);
+        }
+        gwy_serializable_clone(G_OBJECT(unit),
+                               G_OBJECT(gwy_surface_get_si_unit_z(surface)));
+
+        container = gwy_container_new();
+        gwy_container_set_object(container, gwy_app_get_surface_key_for_id(0),
+                                 surface);
+        gwy_app_xyz_title_fall_back(container, 0);
+        gwy_file_xyz_import_log_add(container, 0, NULL, filename);
+    }
 
 fail:
+    if (waiting)
+        gwy_app_wait_finish();
     g_free(args.xy_units);
     g_free(args.z_units);
     GWY_OBJECT_UNREF(surface);
+    GWY_OBJECT_UNREF(dfield);
 
     return container;
 }
 
 static gboolean
 rawxyz_dialog(RawXYZArgs *args,
-              GwySurface *surface)
+              const RawXYZInfo *info)
 {
     GtkWidget *dialog, *label;
     GtkTable *table;
@@ -258,7 +384,7 @@ rawxyz_dialog(RawXYZArgs *args,
     gchar *s;
 
     controls.args = args;
-    controls.surface = surface;
+    controls.info = info;
 
     dialog = gtk_dialog_new_with_buttons(_("Import XYZ Data"), NULL, 0,
                                          GTK_STOCK_CANCEL, GTK_RESPONSE_CANCEL,
@@ -268,7 +394,7 @@ rawxyz_dialog(RawXYZArgs *args,
     gwy_help_add_to_file_dialog(GTK_DIALOG(dialog), GWY_HELP_DEFAULT);
     controls.dialog = dialog;
 
-    table = GTK_TABLE(gtk_table_new(6, 5, FALSE));
+    table = GTK_TABLE(gtk_table_new(12, 5, FALSE));
     gtk_table_set_row_spacings(table, 2);
     gtk_table_set_col_spacings(table, 6);
     gtk_container_set_border_width(GTK_CONTAINER(table), 4);
@@ -280,7 +406,7 @@ rawxyz_dialog(RawXYZArgs *args,
     gtk_misc_set_alignment(GTK_MISC(label), 0.0, 0.5);
     gtk_table_attach(table, label, 0, 1, row, row+1, GTK_FILL, 0, 0, 0);
 
-    s = g_strdup_printf("%u", surface->n);
+    s = g_strdup_printf("%" G_GUINT64_FORMAT, info->npoints);
     label = gtk_label_new(s);
     g_free(s);
     gtk_misc_set_alignment(GTK_MISC(label), 1.0, 0.5);
@@ -304,6 +430,9 @@ rawxyz_dialog(RawXYZArgs *args,
     gtk_entry_set_text(GTK_ENTRY(controls.z_units), args->z_units);
     xyunits_changed(&controls, GTK_ENTRY(controls.xy_units));
     zunits_changed(&controls, GTK_ENTRY(controls.z_units));
+    gtk_table_set_row_spacing(table, row-1, 8);
+
+    row = construct_raster(&controls, table, row);
 
     gtk_widget_show_all(dialog);
 
@@ -429,18 +558,16 @@ xyunits_changed(RawXYZControls *controls,
                 GtkEntry *entry)
 {
     RawXYZArgs *args = controls->args;
-    gdouble xmin, xmax, ymin, ymax;
+    const RawXYZInfo *info = controls->info;
     gchar *s;
 
     s = args->xy_units;
     args->xy_units = gtk_editable_get_chars(GTK_EDITABLE(entry), 0, G_MAXINT);
     g_free(s);
-    gwy_surface_get_xrange(controls->surface, &xmin, &xmax);
     update_range_lables(controls->xmin, controls->xmax, controls->xunit,
-                        xmin, xmax, args->xy_units);
-    gwy_surface_get_yrange(controls->surface, &ymin, &ymax);
+                        info->xmin, info->xmax, args->xy_units);
     update_range_lables(controls->ymin, controls->ymax, controls->yunit,
-                        ymin, ymax, args->xy_units);
+                        info->ymin, info->ymax, args->xy_units);
 }
 
 static void
@@ -448,15 +575,130 @@ zunits_changed(RawXYZControls *controls,
                GtkEntry *entry)
 {
     RawXYZArgs *args = controls->args;
-    gdouble zmin, zmax;
+    const RawXYZInfo *info = controls->info;
     gchar *s;
 
     s = args->z_units;
     args->z_units = gtk_editable_get_chars(GTK_EDITABLE(entry), 0, G_MAXINT);
     g_free(s);
-    gwy_surface_get_min_max(controls->surface, &zmin, &zmax);
     update_range_lables(controls->zmin, controls->zmax, controls->zunit,
-                        zmin, zmax, args->z_units);
+                        info->zmin, info->zmax, args->z_units);
+}
+
+static gint
+construct_raster(RawXYZControls *controls,
+                 GtkTable *table,
+                 gint row)
+{
+    RawXYZArgs *args = controls->args;
+    GtkWidget *label, *spin;
+
+    controls->rasterize
+        = gtk_check_button_new_with_mnemonic(_("_Rasterize while reading"));
+    /* Suggest rasterisation for huge files, but let the user decide. */
+    gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(controls->rasterize),
+                                 args->rasterize || controls->info->huge);
+    gtk_table_attach(table, controls->rasterize, 0, 5, row, row+1,
+                     GTK_EXPAND | GTK_FILL, 0, 0, 0);
+    g_signal_connect_swapped(controls->rasterize, "toggled",
+                             G_CALLBACK(rasterize_changed), controls);
+    row++;
+
+    if (controls->info->huge) {
+        label = gtk_label_new(_("The file is very large.  Importing it as "
+                                "XYZ data requires much memory."));
+        gtk_label_set_line_wrap(GTK_LABEL(label), TRUE);
+        gtk_misc_set_alignment(GTK_MISC(label), 0.0, 0.5);
+        gtk_table_attach(table, label, 0, 5, row, row+1,
+                         GTK_EXPAND | GTK_FILL, 0, 0, 0);
+        row++;
+    }
+
+    label = gtk_label_new_with_mnemonic(_("_Horizontal size:"));
+    gtk_misc_set_alignment(GTK_MISC(label), 0.0, 0.5);
+    gtk_table_attach(table, label, 0, 1, row, row+1,
+                     GTK_EXPAND | GTK_FILL, 0, 0, 0);
+    controls->xres = gtk_adjustment_new(args->xres, 2, MAX_RES, 1, 100, 0);
+    controls->xres_spin = spin
+        = gtk_spin_button_new(GTK_ADJUSTMENT(controls->xres), 0, 0);
+    gtk_label_set_mnemonic_widget(GTK_LABEL(label), spin);
+    gtk_table_attach(table, spin, 1, 4, row, row+1,
+                     GTK_EXPAND | GTK_FILL, 0, 0, 0);
+    label = gtk_label_new("px");
+    gtk_misc_set_alignment(GTK_MISC(label), 0.0, 0.5);
+    gtk_table_attach(table, label, 4, 5, row, row+1,
+                     GTK_EXPAND | GTK_FILL, 0, 0, 0);
+    g_signal_connect_swapped(controls->xres, "value-changed",
+                             G_CALLBACK(xres_changed), controls);
+    row++;
+
+    label = gtk_label_new(_("Vertical size:"));
+    gtk_misc_set_alignment(GTK_MISC(label), 0.0, 0.5);
+    gtk_table_attach(table, label, 0, 1, row, row+1,
+                     GTK_EXPAND | GTK_FILL, 0, 0, 0);
+    controls->yres = gtk_label_new(NULL);
+    gtk_misc_set_alignment(GTK_MISC(controls->yres), 1.0, 0.5);
+    gtk_table_attach(table, controls->yres, 1, 4, row, row+1,
+                     GTK_EXPAND | GTK_FILL, 0, 0, 0);
+    label = gtk_label_new("px");
+    gtk_misc_set_alignment(GTK_MISC(label), 0.0, 0.5);
+    gtk_table_attach(table, label, 4, 5, row, row+1,
+                     GTK_EXPAND | GTK_FILL, 0, 0, 0);
+    row++;
+
+    label = gtk_label_new_with_mnemonic(_("_Method:"));
+    gtk_misc_set_alignment(GTK_MISC(label), 0.0, 0.5);
+    gtk_table_attach(table, label, 0, 1, row, row+1,
+                     GTK_EXPAND | GTK_FILL, 0, 0, 0);
+    controls->method
+        = gwy_enum_combo_box_newl(G_CALLBACK(method_changed), controls,
+                                  args->method,
+                                  _("Average"), GWY_XYZ_RASTERIZE_AVERAGE,
+                                  _("Nearest"), GWY_XYZ_RASTERIZE_NEAREST,
+                                  _("Linear"), GWY_XYZ_RASTERIZE_LINEAR,
+                                  NULL);
+    gtk_label_set_mnemonic_widget(GTK_LABEL(label), controls->method);
+    gtk_table_attach(table, controls->method, 1, 5, row, row+1,
+                     GTK_EXPAND | GTK_FILL, 0, 0, 0);
+    row++;
+
+    xres_changed(controls, GTK_ADJUSTMENT(controls->xres));
+    rasterize_changed(controls, GTK_TOGGLE_BUTTON(controls->rasterize));
+
+    return row;
+}
+
+static void
+rasterize_changed(RawXYZControls *controls,
+                  GtkToggleButton *toggle)
+{
+    gboolean sens;
+
+    sens = gtk_toggle_button_get_active(toggle);
+    controls->args->rasterize = sens;
+    gtk_widget_set_sensitive(controls->xres_spin, sens);
+    gtk_widget_set_sensitive(controls->yres, sens);
+    gtk_widget_set_sensitive(controls->method, sens);
+}
+
+static void
+xres_changed(RawXYZControls *controls,
+             GtkAdjustment *adj)
+{
+    gchar *s;
+
+    controls->args->xres = gwy_adjustment_get_int(adj);
+    s = g_strdup_printf("%d",
+                        rasterized_yres(controls->info, controls->args->xres));
+    gtk_label_set_text(GTK_LABEL(controls->yres), s);
+    g_free(s);
+}
+
+static void
+method_changed(RawXYZControls *controls,
+               GtkComboBox *combo)
+{
+    controls->args->method = gwy_enum_combo_box_get_active(combo);
 }
 
 static gchar
@@ -491,58 +733,296 @@ figure_out_comma_fix_char(const gchar *line)
     return '.';
 }
 
+static gboolean
+parse_xyz_line(gchar *line, gchar *comma_fix_char, GwyXYZ *pt)
+{
+    gchar *end;
+
+    if (!line[0] || line[0] == '#')
+        return FALSE;
+
+    if (!*comma_fix_char) {
+        *comma_fix_char = figure_out_comma_fix_char(line);
+        if (!*comma_fix_char)
+            return FALSE;
+    }
+
+    for (end = line; *end; end++) {
+        if (*end == ';')
+            *end = ' ';
+        else if (*end == ',')
+            *end = *comma_fix_char;
+    }
+
+    if (!(pt->x = g_ascii_strtod(line, &end)) && end == line)
+        return FALSE;
+    line = end;
+    while (g_ascii_isspace(*line))
+         line++;
+    if (!(pt->y = g_ascii_strtod(line, &end)) && end == line)
+        return FALSE;
+    line = end;
+    while (g_ascii_isspace(*line))
+         line++;
+    if (!(pt->z = g_ascii_strtod(line, &end)) && end == line)
+        return FALSE;
+
+    return TRUE;
+}
+
+static GwySurface*
+read_xyz_file(const gchar *filename, GError **error)
+{
+    GwySurface *surface;
+    GError *err = NULL;
+    gchar *buffer = NULL;
+    gsize size;
+
+    if (!g_file_get_contents(filename, &buffer, &size, &err)) {
+        err_GET_FILE_CONTENTS(error, &err);
+        return NULL;
+    }
+
+    surface = read_xyz_points(buffer);
+    g_free(buffer);
+
+    return surface;
+}
+
 static GwySurface*
 read_xyz_points(gchar *p)
 {
     GwySurface *surface;
     GArray *points;
-    gchar *line, *end;
+    gchar *line;
     char comma_fix_char = 0;
 
     points = g_array_new(FALSE, FALSE, sizeof(GwyXYZ));
     for (line = gwy_str_next_line(&p); line; line = gwy_str_next_line(&p)) {
         GwyXYZ pt;
 
-        if (!line[0] || line[0] == '#')
-            continue;
+        if (parse_xyz_line(line, &comma_fix_char, &pt))
+            g_array_append_val(points, pt);
+    }
 
-        if (!comma_fix_char) {
-            comma_fix_char = figure_out_comma_fix_char(line);
-            if (!comma_fix_char)
-                continue;
-        }
+    surface = gwy_surface_new_from_data((GwyXYZ*)points->data, points->len);
+    g_array_free(points, TRUE);
 
-        for (end = line; *end; end++) {
-            if (*end == ';')
-                *end = ' ';
-            else if (*end == ',')
-                *end = comma_fix_char;
+    return surface;
+}
+
+static void
+update_info(RawXYZInfo *info, const GwyXYZ *points, guint n)
+{
+    guint k;
+
+    for (k = 0; k < n; k++) {
+        const GwyXYZ *pt = points + k;
+
+        if (!info->npoints) {
+            info->xmin = info->xmax = pt->x;
+            info->ymin = info->ymax = pt->y;
+            info->zmin = info->zmax = pt->z;
+        }
+        else {
+            info->xmin = MIN(info->xmin, pt->x);
+            info->xmax = MAX(info->xmax, pt->x);
+            info->ymin = MIN(info->ymin, pt->y);
+            info->ymax = MAX(info->ymax, pt->y);
+            info->zmin = MIN(info->zmin, pt->z);
+            info->zmax = MAX(info->zmax, pt->z);
         }
+        info->npoints++;
+    }
+}
 
-        if (!(pt.x = g_ascii_strtod(line, &end)) && end == line)
+static void
+info_from_surface(GwySurface *surface, RawXYZInfo *info)
+{
+    info->npoints = 0;
+    update_info(info, gwy_surface_get_data_const(surface), surface->n);
+}
+
+/* Reads the file line by line, without ever having more than a chunk of
+ * points in memory.  Without a rasteriser it gathers the information about
+ * the points; with a rasteriser it feeds the points to it. */
+static gboolean
+scan_xyz_file(const gchar *filename,
+              RawXYZInfo *info,
+              GwyXYZRasterizer *rasterizer,
+              gboolean waiting,
+              GError **error)
+{
+    GwyXYZ *points;
+    gchar *line;
+    gchar comma_fix_char = 0;
+    guint64 bytes = 0, nchunks = 0, size = 0;
+    GStatBuf st;
+    FILE *fh;
+    guint n = 0, len;
+    gboolean ok = TRUE;
+
+    if (!(fh = gwy_fopen(filename, "r"))) {
+        err_OPEN_READ(error);
+        return FALSE;
+    }
+    if (g_stat(filename, &st) == 0)
+        size = st.st_size;
+
+    line = g_new(gchar, LINE_SIZE);
+    points = g_new(GwyXYZ, CHUNK_POINTS);
+    while (ok && fgets(line, LINE_SIZE, fh)) {
+        len = strlen(line);
+        bytes += len;
+        /* Lines too long to be XYZ data are garbage; skip the rest. */
+        if (len == LINE_SIZE-1 && line[len-1] != '\n') {
+            gint c;
+
+            while ((c = fgetc(fh)) != EOF && c != '\n')
+                bytes++;
             continue;
-        line = end;
-        while (g_ascii_isspace(*line))
-             line++;
-        if (!(pt.y = g_ascii_strtod(line, &end)) && end == line)
+        }
+        g_strchomp(line);
+        if (!parse_xyz_line(line, &comma_fix_char, points + n))
             continue;
-        line = end;
-        while (g_ascii_isspace(*line))
-             line++;
-        if (!(pt.z = g_ascii_strtod(line, &end)) && end == line)
+        if (++n < CHUNK_POINTS)
             continue;
 
-        g_array_append_val(points, pt);
+        if (rasterizer)
+            ok = gwy_xyz_rasterizer_add_points(rasterizer, points, n, error);
+        else
+            update_info(info, points, n);
+        n = 0;
+        nchunks++;
+        if (ok && waiting && size && !(nchunks % 16)
+            && !gwy_app_wait_set_fraction(MIN((gdouble)bytes/size, 1.0))) {
+            err_CANCELLED(error);
+            ok = FALSE;
+        }
+    }
+    if (ok && ferror(fh)) {
+        err_READ(error);
+        ok = FALSE;
+    }
+    if (ok && n) {
+        if (rasterizer)
+            ok = gwy_xyz_rasterizer_add_points(rasterizer, points, n, error);
+        else
+            update_info(info, points, n);
     }
 
-    surface = gwy_surface_new_from_data((GwyXYZ*)points->data, points->len);
-    g_array_free(points, TRUE);
+    fclose(fh);
+    g_free(points);
+    g_free(line);
 
-    return surface;
+    return ok;
+}
+
+/* Square pixels, with the pixel centres at the extreme points. */
+static gdouble
+rasterized_pixel_size(const RawXYZInfo *info, gint xres)
+{
+    gdouble h;
+
+    h = (info->xmax - info->xmin)/(xres - 1);
+    if (!(h > 0.0))
+        h = (info->ymax - info->ymin)/(xres - 1);
+    if (!(h > 0.0))
+        h = 1.0;
+
+    return h;
 }
 
-static const gchar xy_units_key[] = "/module/rawxyz/xy-units";
-static const gchar z_units_key[]  = "/module/rawxyz/z-units";
+static gint
+rasterized_yres(const RawXYZInfo *info, gint xres)
+{
+    gdouble h = rasterized_pixel_size(info, xres);
+    gint yres = GWY_ROUND((info->ymax - info->ymin)/h) + 1;
+
+    return CLAMP(yres, 1, MAX_RES);
+}
+
+static GwyDataField*
+rasterize_xyz(const gchar *filename,
+              GwySurface *surface,
+              const RawXYZInfo *info,
+              const RawXYZArgs *args,
+              gboolean waiting,
+              GError **error)
+{
+    GwyXYZRasterizer *rasterizer;
+    GwyDataField *dfield;
+    GwySIUnit *unit;
+    GError *err = NULL;
+    gint xres = args->xres, yres, power10;
+    gdouble h, q;
+    gboolean ok;
+
+    h = rasterized_pixel_size(info, xres);
+    yres = rasterized_yres(info, xres);
+    dfield = gwy_data_field_new(xres, yres, h*xres, h*yres, FALSE);
+    gwy_data_field_set_xoffset(dfield, info->xmin - 0.5*h);
+    gwy_data_field_set_yoffset(dfield, info->ymin - 0.5*h);
+
+    rasterizer = gwy_xyz_rasterizer_new(dfield, args->method);
+    if (surface) {
+        ok = gwy_xyz_rasterizer_add_points(rasterizer,
+                                           gwy_surface_get_data_const(surface),
+                                           surface->n, &err);
+    }
+    else
+        ok = scan_xyz_file(filename, NULL, rasterizer, waiting, &err);
+
+    if (ok && waiting && !gwy_app_wait_set_fraction(0.0)) {
+        err_CANCELLED(error);
+        ok = FALSE;
+    }
+    else if (ok) {
+        ok = gwy_xyz_rasterizer_finish(rasterizer,
+                                       waiting
+                                       ? gwy_app_wait_set_fraction : NULL,
+                                       waiting
+                                       ? gwy_app_wait_set_message : NULL,
+                                       &err);
+        if (!ok && !err)
+            err_CANCELLED(error);
+    }
+    if (err)
+        g_propagate_error(error, err);
+    gwy_xyz_rasterizer_free(rasterizer);
+
+    if (!ok) {
+        g_object_unref(dfield);
+        return NULL;
+    }
+
+    unit = gwy_si_unit_new_parse(args->xy_units, &power10);
+    if (power10) {
+        q = pow10(power10);
+        gwy_data_field_set_xreal(dfield, q*h*xres);
+        gwy_data_field_set_yreal(dfield, q*h*yres);
+        gwy_data_field_set_xoffset(dfield, q*(info->xmin - 0.5*h));
+        gwy_data_field_set_yoffset(dfield, q*(info->ymin - 0.5*h));
+    }
+    gwy_serializable_clone(G_OBJECT(unit),
+                           G_OBJECT(gwy_data_field_get_si_unit_xy(dfield)));
+    g_object_unref(unit);
+
+    unit = gwy_si_unit_new_parse(args->z_units, &power10);
+    if (power10)
+        gwy_data_field_multiply(dfield, pow10(power10));
+    gwy_serializable_clone(G_OBJECT(unit),
+                           G_OBJECT(gwy_data_field_get_si_unit_z(dfield)));
+    g_object_unref(unit);
+
+    return dfield;
+}
+
+static const gchar method_key[]    = "/module/rawxyz/method";
+static const gchar rasterize_key[] = "/module/rawxyz/rasterize";
+static const gchar xres_key[]      = "/module/rawxyz/xres";
+static const gchar xy_units_key[]  = "/module/rawxyz/xy-units";
+static const gchar z_units_key[]   = "/module/rawxyz/z-units";
 
 static void
 rawxyz_load_args(GwyContainer *container,
@@ -555,8 +1035,16 @@ rawxyz_load_args(GwyContainer *container,
     gwy_container_gis_string_by_name(container, z_units_key,
                                      (const guchar**)&args->z_units);
 
+    gwy_container_gis_boolean_by_name(container, rasterize_key,
+                                      &args->rasterize);
+    gwy_container_gis_int32_by_name(container, xres_key, &args->xres);
+    gwy_container_gis_enum_by_name(container, method_key, &args->method);
+
     args->xy_units = g_strdup(args->xy_units ? args->xy_units : "");
     args->z_units = g_strdup(args->z_units ? args->z_units : "");
+    args->rasterize = !!args->rasterize;
+    args->xres = CLAMP(args->xres, 2, MAX_RES);
+    args->method = MIN(args->method, GWY_XYZ_RASTERIZE_LINEAR);
 }
 
 static void
@@ -567,6 +1055,10 @@ rawxyz_save_args(GwyContainer *container,
                                            args->xy_units);
     gwy_container_set_const_string_by_name(container, z_units_key,
                                            args->z_units);
+    gwy_container_set_boolean_by_name(container, rasterize_key,
+                                      args->rasterize);
+    gwy_container_set_int32_by_name(container, xres_key, args->xres);
+    gwy_container_set_enum_by_name(container, method_key, args->method);
 }
 
 /* vim: set cin et ts=4 sw=4 cino=>1s,e0,n0,f0,{0,}0,^0,\:1s,=0,g1s,h0,t0,+1s,c3,(0,u0 : */
@@ -42,6 +42,33 @@
  * XXX: Plug-ins cannot specify sens_flags.
  */
 
+/* Dump formats.
+ *
+ * The text dump consists of "key=value" lines, with data fields written as
+ * "key=[" followed by "[", the raw little-endian doubles and "]]".  Data field
+ * properties are given by "key/xres", "key/yres", "key/xreal", "key/yreal",
+ * "key/unit-xy" and "key/unit-z" values preceding the data.
+ *
+ * Plug-ins can also exchange data in the binary dump format.  They advertise
+ * it by an extra registration line, following the run modes, containing
+ * "binary".  Such plug-ins get binary dumps; the plug-in proxy recognises
+ * either format in the data returned by any plug-in.
+ *
+ * The binary dump is designed to be memory-mapped.  All integers are 32bit
+ * and all numbers little-endian.  Everything is padded to multiples of 8
+ * bytes so that all doubles are aligned.  It starts with a 16 byte header:
+ *   "GWYBDUMP", version (1), reserved (0)
+ * followed by items, each starting with
+ *   type, key length, key (not nul-terminated)
+ * where type is one of
+ *   0: end of dump, key length is 0,
+ *   1: string; length, reserved (0), string (not nul-terminated),
+ *   2: data field; xres, yres, double xreal, yreal, xoffset, yoffset,
+ *      xres*yres doubles.
+ * Units and title of a data field are given as strings "key/unit-xy",
+ * "key/unit-z" and "key/title" preceding the data field, as in text dumps.
+ */
+
 #include "config.h"
 #include <stdlib.h>
 #include <string.h>
@@ -56,12 +83,34 @@
 #include <libgwymodule/gwymodule.h>
 #include <libprocess/datafield.h>
 #include <app/gwyapp.h>
+#include <app/gwymoduleutils-file.h>
+
+#define BINARY_DUMP_MAGIC "GWYBDUMP"
+#define BINARY_DUMP_MAGIC_SIZE (sizeof(BINARY_DUMP_MAGIC)-1)
+#define BINARY_DUMP_HEADER_SIZE (BINARY_DUMP_MAGIC_SIZE + 8)
+#define BINARY_DUMP_PAD(n) (((n) + 7) & ~(gsize)7)
+
+enum {
+    BINARY_DUMP_VERSION = 1,
+};
+
+typedef enum {
+    BINARY_DUMP_END        = 0,
+    BINARY_DUMP_STRING     = 1,
+    BINARY_DUMP_DATA_FIELD = 2,
+} BinaryDumpItemType;
+
+typedef enum {
+    DUMP_FORMAT_TEXT   = 1 << 0,
+    DUMP_FORMAT_BINARY = 1 << 1,
+} DumpFormat;
 
 typedef struct {
     gchar *name;
     gchar *menu_path;
     gchar *tooltip;
     GwyRunType run;
+    DumpFormat formats;
     gchar *file;  /* The file to execute to run the plug-in */
 } ProcPluginInfo;
 
@@ -69,6 +118,7 @@ typedef struct {
     gchar *name;
     gchar *description;
     GwyFileOperationType run;
+    DumpFormat formats;
     gchar *glob;
     GPatternSpec **pattern;
     glong *specificity;
@@ -123,6 +173,13 @@ static glong*          file_glob_specificities   (const gchar *glob);
 static glong           file_pattern_specificity  (const gchar *pattern);
 
 /* common helpers */
+static DumpFormat      parse_dump_formats        (gchar **buffer);
+static FILE*           dump_export               (GwyContainer *data,
+                                                  GQuark dquark,
+                                                  GQuark mquark,
+                                                  DumpFormat formats,
+                                                  gchar **filename,
+                                                  GError **error);
 static FILE*           text_dump_export          (GwyContainer *data,
                                                   GQuark dquark,
                                                   GQuark mquark,
@@ -133,9 +190,22 @@ static void            dump_export_data_field    (GwyDataField *dfield,
                                                   FILE *fh);
 static FILE*           open_temporary_file       (gchar **filename,
                                                   GError **error);
+static FILE*           binary_dump_export        (GwyContainer *data,
+                                                  GQuark dquark,
+                                                  GQuark mquark,
+                                                  gchar **filename,
+                                                  GError **error);
+static void       binary_dump_export_data_field  (GwyDataField *dfield,
+                                                  const gchar *name,
+                                                  FILE *fh);
+static GwyContainer*   dump_import               (const gchar *filename,
+                                                  GError **error);
 static GwyContainer*   text_dump_import          (gchar *buffer,
                                                   gsize size,
                                                   GError **error);
+static GwyContainer*   binary_dump_import        (const guchar *buffer,
+                                                  gsize size,
+                                                  GError **error);
 static gchar*        decode_glib_encoded_filename(const gchar *filename);
 
 /* The module info. */
@@ -146,7 +216,7 @@ static GwyModuleInfo module_info = {
        "running external programs (plug-ins) on data pretending they are "
        "data processing or file loading/saving modules."),
     "Yeti <yeti@gwyddion.net>",
-    "3.9",
+    "3.10",
     "David Nečas (Yeti) & Petr Klapetek",
     "2004",
 };
@@ -176,6 +246,12 @@ static const GwyEnum file_op_names[] = {
     { NULL,     -1,                        },
 };
 
+static const GwyEnum dump_format_names[] = {
+    { "text",   DUMP_FORMAT_TEXT,   },
+    { "binary", DUMP_FORMAT_BINARY, },
+    { NULL,     -1,                 },
+};
+
 static gboolean
 module_register(void)
 {
@@ -463,6 +539,7 @@ proc_register_plugins(GList *plugins,
             info->menu_path = g_strconcat(_("/_Plug-Ins"), menu_path, NULL);
             info->tooltip = g_strdup_printf(_("Run plug-in %s"), menu_path+1);
             info->run = run;
+            info->formats = parse_dump_formats(&buffer);
             if (gwy_process_func_register(info->name,
                                           proc_plugin_proxy_run,
                                           info->menu_path,
@@ -508,11 +585,10 @@ proc_plugin_proxy_run(GwyContainer *data,
                       const gchar *name)
 {
     ProcPluginInfo *info;
-    GwyContainer *newdata;
-    gchar *filename, *buffer = NULL;
+    GwyContainer *newdata = NULL;
+    gchar *filename;
     GError *err = NULL;
     gint exit_status, id, newid;
-    gsize size = 0;
     FILE *fh;
     gchar *args[] = { NULL, "run", NULL, NULL, NULL };
     GQuark dquark, mquark, squark;
@@ -527,7 +603,7 @@ proc_plugin_proxy_run(GwyContainer *data,
     if (!(info = proc_find_plugin(name, run)))
         return;
 
-    fh = text_dump_export(data, dquark, mquark, &filename, NULL);
+    fh = dump_export(data, dquark, mquark, info->formats, &filename, NULL);
     g_return_if_fail(fh);
     args[0] = info->file;
     args[2] = g_strdup(gwy_enum_to_string(run, run_mode_names, -1));
@@ -535,13 +611,13 @@ proc_plugin_proxy_run(GwyContainer *data,
     gwy_debug("%s %s %s %s", args[0], args[1], args[2], args[3]);
     ok = g_spawn_sync(NULL, args, NULL, 0, NULL, NULL,
                       NULL, NULL, &exit_status, &err);
-    if (!err)
-        ok &= g_file_get_contents(filename, &buffer, &size, &err);
+    ok &= !exit_status;
+    if (ok)
+        newdata = dump_import(filename, &err);
     g_unlink(filename);
     fclose(fh);
     gwy_debug("ok = %d, exit_status = %d, err = %p", ok, exit_status, err);
-    ok &= !exit_status;
-    if (ok && (newdata = text_dump_import(buffer, size, NULL))) {
+    if (ok && newdata) {
         GwyDataField *dfield;
 
         /* Merge data */
@@ -595,7 +671,6 @@ proc_plugin_proxy_run(GwyContainer *data,
     g_free(args[3]);
     g_free(args[2]);
     g_clear_error(&err);
-    g_free(buffer);
     g_free(filename);
 }
 
@@ -669,6 +744,7 @@ file_register_plugins(GList *plugins,
             info = g_new0(FilePluginInfo, 1);
             info->name = g_strdup(pname);
             info->description = g_strdup(file_desc);
+            info->formats = parse_dump_formats(&buffer);
             if (gwy_file_func_register(info->name, info->description,
                                        &file_plugin_proxy_detect,
                                        (run & GWY_FILE_OPERATION_LOAD)
@@ -722,10 +798,9 @@ file_plugin_proxy_load(const gchar *filename,
     FilePluginInfo *info;
     GwyContainer *data = NULL;
     GObject *dfield;
-    gchar *tmpname = NULL, *buffer = NULL;
+    gchar *tmpname = NULL;
     GError *err = NULL;
     gint exit_status;
-    gsize size = 0;
     FILE *fh;
     gchar *args[] = { NULL, NULL, NULL, NULL, NULL };
     gboolean ok;
@@ -754,22 +829,12 @@ file_plugin_proxy_load(const gchar *filename,
     gwy_debug("%s %s %s %s", args[0], args[1], args[2], args[3]);
     ok = g_spawn_sync(NULL, args, NULL, 0, NULL, NULL,
                       NULL, NULL, &exit_status, &err);
-    if (ok) {
-        ok = g_file_get_contents(tmpname, &buffer, &size, &err);
-        if (!ok) {
-            g_set_error(error, GWY_MODULE_FILE_ERROR, GWY_MODULE_FILE_ERROR_IO,
-                        _("Cannot read temporary file: %s."), err->message);
-            g_clear_error(&err);
-        }
-    }
-    else {
+    if (!ok) {
         g_set_error(error, GWY_MODULE_FILE_ERROR,
                     GWY_MODULE_FILE_ERROR_SPECIFIC,
                     _("Cannot execute plug-in `%s': %s."), name, err->message);
         g_clear_error(&err);
     }
-    g_unlink(tmpname);
-    fclose(fh);
     gwy_debug("ok = %d, exit_status = %d, err = %p", ok, exit_status, err);
     if (ok && exit_status) {
         g_set_error(error, GWY_MODULE_FILE_ERROR,
@@ -779,10 +844,12 @@ file_plugin_proxy_load(const gchar *filename,
         ok = FALSE;
     }
     if (ok) {
-        data = text_dump_import(buffer, size, error);
+        data = dump_import(tmpname, error);
         if (!data)
             ok = FALSE;
     }
+    g_unlink(tmpname);
+    fclose(fh);
     if (ok
         && (!gwy_container_gis_object_by_name(data, "/0/data", &dfield)
             || !GWY_IS_DATA_FIELD(dfield))) {
@@ -793,7 +860,6 @@ file_plugin_proxy_load(const gchar *filename,
     }
     g_free(args[1]);
     g_free(args[3]);
-    g_free(buffer);
     g_free(tmpname);
 
     return data;
@@ -845,7 +911,7 @@ file_plugin_proxy_export(GwyContainer *data,
         return FALSE;
     }
 
-    fh = text_dump_export(data, dquark, mquark, &tmpname, error);
+    fh = dump_export(data, dquark, mquark, info->formats, &tmpname, error);
     if (!fh)
         return FALSE;
 
@@ -1082,6 +1148,54 @@ file_pattern_specificity(const gchar *pattern)
 
 /***** Sub *****************************************************************/
 
+/**
+ * parse_dump_formats:
+ * @buffer: The rest of output from "plugin register", after run modes.
+ *
+ * Parses the optional line with dump formats the plug-in understands.
+ *
+ * Returns: The supported formats.  Text dumps are always supported.
+ **/
+static DumpFormat
+parse_dump_formats(gchar **buffer)
+{
+    gchar *line;
+    gint formats;
+
+    if (!*buffer || !**buffer || !(line = gwy_str_next_line(buffer)))
+        return DUMP_FORMAT_TEXT;
+
+    formats = gwy_string_to_flags(line, dump_format_names, -1, NULL);
+    return (formats > 0 ? formats : 0) | DUMP_FORMAT_TEXT;
+}
+
+/**
+ * dump_export:
+ * @data: A %GwyContainer to dump.
+ * @dquark: Data field key.
+ * @mquark: Mask field key.
+ * @formats: Dump formats the plug-in understands.
+ * @filename: Where the dump file name is to be stored.
+ * @error: Return location for a #GError (or %NULL).
+ *
+ * Dumps data container to a temporary file in the best format the plug-in
+ * understands.
+ *
+ * Returns: A filehandle of the dump file open in "wb" mode.
+ **/
+static FILE*
+dump_export(GwyContainer *data,
+            GQuark dquark,
+            GQuark mquark,
+            DumpFormat formats,
+            gchar **filename,
+            GError **error)
+{
+    if (formats & DUMP_FORMAT_BINARY)
+        return binary_dump_export(data, dquark, mquark, filename, error);
+    return text_dump_export(data, dquark, mquark, filename, error);
+}
+
 /**
  * text_dump_export:
  * @data: A %GwyContainer to dump.
@@ -1163,7 +1277,7 @@ dump_export_data_field(GwyDataField *dfield, const gchar *name, FILE *fh)
         d = g_new(guint8, sizeof(gdouble)*xres*yres);
         gwy_memcpy_byte_swap((const guint8*)data, d,
                              sizeof(gdouble), xres*yres, sizeof(gdouble) - 1);
-        fwrite(data, sizeof(gdouble), xres*yres, fh);
+        fwrite(d, sizeof(gdouble), xres*yres, fh);
         g_free(d);
     }
 #endif
@@ -1171,6 +1285,154 @@ dump_export_data_field(GwyDataField *dfield, const gchar *name, FILE *fh)
     fflush(fh);
 }
 
+static void
+binary_dump_put_uint32(guint32 value, FILE *fh)
+{
+    value = GUINT32_TO_LE(value);
+    fwrite(&value, sizeof(guint32), 1, fh);
+}
+
+static void
+binary_dump_put_double(gdouble value, FILE *fh)
+{
+    union { gdouble d; guint64 u; } v;
+
+    v.d = value;
+    v.u = GUINT64_TO_LE(v.u);
+    fwrite(&v.u, sizeof(guint64), 1, fh);
+}
+
+static void
+binary_dump_put_padded(const gchar *s, gsize len, FILE *fh)
+{
+    static const gchar zeros[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+
+    fwrite(s, 1, len, fh);
+    fwrite(zeros, 1, BINARY_DUMP_PAD(len) - len, fh);
+}
+
+static void
+binary_dump_put_item_header(BinaryDumpItemType type, const gchar *key,
+                            FILE *fh)
+{
+    gsize len = key ? strlen(key) : 0;
+
+    binary_dump_put_uint32(type, fh);
+    binary_dump_put_uint32(len, fh);
+    binary_dump_put_padded(key, len, fh);
+}
+
+static void
+binary_dump_put_string(const gchar *key, const gchar *value, FILE *fh)
+{
+    gsize len = strlen(value);
+
+    binary_dump_put_item_header(BINARY_DUMP_STRING, key, fh);
+    binary_dump_put_uint32(len, fh);
+    binary_dump_put_uint32(0, fh);
+    binary_dump_put_padded(value, len, fh);
+}
+
+/**
+ * binary_dump_export:
+ * @data: A %GwyContainer to dump.
+ * @dquark: Data field key.
+ * @mquark: Mask field key.
+ * @filename: Where the dump file name is to be stored.
+ * @error: Return location for a #GError (or %NULL).
+ *
+ * Dumps data container to a temporary file in the binary format.
+ *
+ * It dumps the same things as text_dump_export().
+ *
+ * Returns: A filehandle of the dump file open in "wb" mode.
+ **/
+static FILE*
+binary_dump_export(GwyContainer *data,
+                   GQuark dquark,
+                   GQuark mquark,
+                   gchar **filename,
+                   GError **error)
+{
+    GwyDataField *dfield;
+    FILE *fh;
+
+    if (!(fh = open_temporary_file(filename, error)))
+        return NULL;
+
+    fwrite(BINARY_DUMP_MAGIC, 1, BINARY_DUMP_MAGIC_SIZE, fh);
+    binary_dump_put_uint32(BINARY_DUMP_VERSION, fh);
+    binary_dump_put_uint32(0, fh);
+
+    dfield = GWY_DATA_FIELD(gwy_container_get_object(data, dquark));
+    binary_dump_export_data_field(dfield, "/0/data", fh);
+    if (gwy_container_gis_object(data, mquark, &dfield)) {
+        binary_dump_export_data_field(dfield, "/0/mask", fh);
+    }
+    binary_dump_put_item_header(BINARY_DUMP_END, NULL, fh);
+    fflush(fh);
+
+    return fh;
+}
+
+/**
+ * binary_dump_export_data_field:
+ * @dfield: A #GwyDataField.
+ * @name: The name of @dfield.
+ * @fh: A filehandle open for writing.
+ *
+ * Dumps a one #GwyDataField to @fh in the binary format.
+ **/
+static void
+binary_dump_export_data_field(GwyDataField *dfield, const gchar *name,
+                              FILE *fh)
+{
+    const gdouble *data;
+    gchar *unit, *key;
+    gint xres, yres;
+
+    gwy_debug("Exporting %s", name);
+    xres = gwy_data_field_get_xres(dfield);
+    yres = gwy_data_field_get_yres(dfield);
+
+    unit = gwy_si_unit_get_string(gwy_data_field_get_si_unit_xy(dfield),
+                                  GWY_SI_UNIT_FORMAT_PLAIN);
+    key = g_strconcat(name, "/unit-xy", NULL);
+    binary_dump_put_string(key, unit, fh);
+    g_free(key);
+    g_free(unit);
+
+    unit = gwy_si_unit_get_string(gwy_data_field_get_si_unit_z(dfield),
+                                  GWY_SI_UNIT_FORMAT_PLAIN);
+    key = g_strconcat(name, "/unit-z", NULL);
+    binary_dump_put_string(key, unit, fh);
+    g_free(key);
+    g_free(unit);
+
+    binary_dump_put_item_header(BINARY_DUMP_DATA_FIELD, name, fh);
+    binary_dump_put_uint32(xres, fh);
+    binary_dump_put_uint32(yres, fh);
+    binary_dump_put_double(gwy_data_field_get_xreal(dfield), fh);
+    binary_dump_put_double(gwy_data_field_get_yreal(dfield), fh);
+    binary_dump_put_double(gwy_data_field_get_xoffset(dfield), fh);
+    binary_dump_put_double(gwy_data_field_get_yoffset(dfield), fh);
+
+    data = gwy_data_field_get_data_const(dfield);
+#if (G_BYTE_ORDER == G_LITTLE_ENDIAN)
+    fwrite(data, sizeof(gdouble), xres*yres, fh);
+#else
+    {
+        guint8 *d;
+
+        d = g_new(guint8, sizeof(gdouble)*xres*yres);
+        gwy_memcpy_byte_swap((const guint8*)data, d,
+                             sizeof(gdouble), xres*yres, sizeof(gdouble) - 1);
+        fwrite(d, sizeof(gdouble), xres*yres, fh);
+        g_free(d);
+    }
+#endif
+}
+
 /**
  * open_temporary_file:
  * @filename: Where the filename is to be stored.
@@ -1225,6 +1487,48 @@ open_temporary_file(gchar **filename,
     return fh;
 }
 
+/**
+ * dump_import:
+ * @filename: Dump file written by a plug-in.
+ * @error: Return location for a #GError (or %NULL).
+ *
+ * Reads a dump file in either format.
+ *
+ * Returns: A newly created container with the dump contents.
+ **/
+static GwyContainer*
+dump_import(const gchar *filename,
+            GError **error)
+{
+    GwyContainer *data;
+    GError *err = NULL;
+    guchar *buffer = NULL;
+    gchar *text;
+    gsize size = 0;
+
+    if (!gwy_file_get_contents(filename, &buffer, &size, &err)) {
+        g_set_error(error, GWY_MODULE_FILE_ERROR, GWY_MODULE_FILE_ERROR_IO,
+                    _("Cannot read temporary file: %s."), err->message);
+        g_clear_error(&err);
+        return NULL;
+    }
+
+    if (size >= BINARY_DUMP_MAGIC_SIZE
+        && memcmp(buffer, BINARY_DUMP_MAGIC, BINARY_DUMP_MAGIC_SIZE) == 0)
+        data = binary_dump_import(buffer, size, error);
+    else {
+        /* The text parser modifies the buffer and needs it nul-terminated. */
+        text = g_new(gchar, size + 1);
+        memcpy(text, buffer, size);
+        text[size] = '\0';
+        data = text_dump_import(text, size, error);
+        g_free(text);
+    }
+    gwy_file_abandon_contents(buffer, size, NULL);
+
+    return data;
+}
+
 static GwyContainer*
 text_dump_import(gchar *buffer,
                  gsize size,
@@ -1408,6 +1712,160 @@ fail:
     return NULL;
 }
 
+static GwyContainer*
+binary_dump_import(const guchar *buffer,
+                   gsize size,
+                   GError **error)
+{
+    const guchar *p = buffer, *end = buffer + size;
+    GwyContainer *data;
+    GwyDataField *dfield;
+    GwySIUnit *unit;
+    gdouble xreal, yreal, xoff, yoff;
+    guint type, keylen, len, xres, yres;
+    const guchar *s;
+    gchar *key, *ukey, *title;
+    gdouble *d;
+    gsize n;
+
+    if (size < BINARY_DUMP_HEADER_SIZE) {
+        g_set_error(error, GWY_MODULE_FILE_ERROR, GWY_MODULE_FILE_ERROR_DATA,
+                    _("End of file reached in binary dump."));
+        return NULL;
+    }
+    p += BINARY_DUMP_MAGIC_SIZE;
+    if (gwy_get_guint32_le(&p) != BINARY_DUMP_VERSION) {
+        g_set_error(error, GWY_MODULE_FILE_ERROR, GWY_MODULE_FILE_ERROR_DATA,
+                    _("Unsupported binary dump version."));
+        return NULL;
+    }
+    p += 4;
+
+    data = gwy_container_new();
+    while (TRUE) {
+        if (end - p < 8)
+            goto truncated;
+        type = gwy_get_guint32_le(&p);
+        keylen = gwy_get_guint32_le(&p);
+        if (type == BINARY_DUMP_END)
+            return data;
+        if ((gsize)(end - p) < BINARY_DUMP_PAD(keylen))
+            goto truncated;
+        if (!keylen || *p != '/') {
+            g_set_error(error, GWY_MODULE_FILE_ERROR,
+                        GWY_MODULE_FILE_ERROR_DATA,
+                        _("Invalid item key in binary dump."));
+            goto fail;
+        }
+        key = g_strndup((const gchar*)p, keylen);
+        p += BINARY_DUMP_PAD(keylen);
+
+        if (type == BINARY_DUMP_STRING) {
+            if (end - p < 8) {
+                g_free(key);
+                goto truncated;
+            }
+            len = gwy_get_guint32_le(&p);
+            p += 4;
+            if ((gsize)(end - p) < BINARY_DUMP_PAD(len)) {
+                g_free(key);
+                goto truncated;
+            }
+            if (len)
+                gwy_container_set_string_by_name(data, key,
+                                                 g_strndup((const gchar*)p,
+                                                           len));
+            else
+                gwy_container_remove_by_name(data, key);
+            p += BINARY_DUMP_PAD(len);
+            g_free(key);
+            continue;
+        }
+
+        if (type != BINARY_DUMP_DATA_FIELD) {
+            g_set_error(error, GWY_MODULE_FILE_ERROR,
+                        GWY_MODULE_FILE_ERROR_DATA,
+                        _("Unknown item type %u in binary dump."), type);
+            g_free(key);
+            goto fail;
+        }
+
+        if (end - p < 40) {
+            g_free(key);
+            goto truncated;
+        }
+        xres = gwy_get_guint32_le(&p);
+        yres = gwy_get_guint32_le(&p);
+        xreal = gwy_get_gdouble_le(&p);
+        yreal = gwy_get_gdouble_le(&p);
+        xoff = gwy_get_gdouble_le(&p);
+        yoff = gwy_get_gdouble_le(&p);
+        if (!(xres > 0 && yres > 0 && xreal > 0 && yreal > 0)
+            || xres > G_MAXINT/yres) {
+            g_set_error(error, GWY_MODULE_FILE_ERROR,
+                        GWY_MODULE_FILE_ERROR_DATA,
+                        _("Data field dimensions are not positive numbers."));
+            g_free(key);
+            goto fail;
+        }
+        n = (gsize)xres*yres;
+        if ((gsize)(end - p)/sizeof(gdouble) < n) {
+            g_free(key);
+            goto truncated;
+        }
+
+        dfield = gwy_data_field_new(xres, yres, xreal, yreal, FALSE);
+        gwy_data_field_set_xoffset(dfield, xoff);
+        gwy_data_field_set_yoffset(dfield, yoff);
+
+        ukey = g_strconcat(key, "/unit-xy", NULL);
+        unit = gwy_data_field_get_si_unit_xy(dfield);
+        if (gwy_container_gis_string_by_name(data, ukey, &s))
+            gwy_si_unit_set_from_string(unit, (const gchar*)s);
+        else
+            gwy_si_unit_set_from_string(unit, "m");
+        g_free(ukey);
+
+        ukey = g_strconcat(key, "/unit-z", NULL);
+        unit = gwy_data_field_get_si_unit_z(dfield);
+        if (gwy_container_gis_string_by_name(data, ukey, &s))
+            gwy_si_unit_set_from_string(unit, (const gchar*)s);
+        else
+            gwy_si_unit_set_from_string(unit, "m");
+        g_free(ukey);
+
+        ukey = g_strconcat(key, "/title", NULL);
+        title = NULL;
+        gwy_container_gis_string_by_name(data, ukey, (const guchar**)&title);
+        title = g_strdup(title);
+
+        d = gwy_data_field_get_data(dfield);
+#if (G_BYTE_ORDER == G_LITTLE_ENDIAN)
+        memcpy(d, p, n*sizeof(gdouble));
+#else
+        gwy_memcpy_byte_swap(p, (guint8*)d,
+                             sizeof(gdouble), n, sizeof(gdouble)-1);
+#endif
+        p += n*sizeof(gdouble);
+
+        gwy_container_remove_by_prefix(data, key);
+        gwy_container_set_object_by_name(data, key, dfield);
+        g_object_unref(dfield);
+        if (title)
+            gwy_container_set_string_by_name(data, ukey, title);
+        g_free(ukey);
+        g_free(key);
+    }
+
+truncated:
+    g_set_error(error, GWY_MODULE_FILE_ERROR, GWY_MODULE_FILE_ERROR_DATA,
+                _("End of file reached in binary dump."));
+fail:
+    gwy_container_remove_by_prefix(data, NULL);
+    g_object_unref(data);
+    return NULL;
+}
+
 /* Convert GLib-encoded file name to on-disk file name to be used with
  * NON-widechar libc functions.  In fact, we just don't know what methods
  * plug-ins may use to open files.  Why file names can't be just sequences
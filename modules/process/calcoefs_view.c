@@ -201,6 +201,13 @@ static void         brutal_search          (GwyCalData *caldata,
                                             gdouble *dist,
                                             gint *ndata,
                                             GwyCCViewInterpolationType snap_type);
+static gboolean     evaluate_points        (CCViewControls *controls,
+                                            GwyCalData *caldata,
+                                            const gdouble *x,
+                                            const gdouble *y,
+                                            const gdouble *z,
+                                            gint n,
+                                            GwyCCViewInterpolationType interpolation_type);
 static void         get_value              (GwyCalData *caldata,
                                             gdouble x,
                                             gdouble y,
@@ -701,8 +708,9 @@ static void show_info(CCViewControls *controls, GwyDataField *dfield)
 static void
 update_view(CCViewControls *controls, CCViewArgs *args)
 {
-    gint col, row, xres, yres, zres;
-    gdouble x, y, z, xerr, yerr, zerr, xunc, yunc, zunc;
+    gint col, row, xres, yres, zres, n;
+    gdouble x, y, z;
+    gdouble *qx, *qy, *qz;
     gdouble x_from, x_to, y_from, y_to, z_from, z_to;
     GwyDataField *viewfield;
     gchar msg[50];
@@ -793,7 +801,15 @@ update_view(CCViewControls *controls, CCViewArgs *args)
         run = gwy_app_wait_set_message(_("Triangulating..."));
         run = gwy_app_wait_set_fraction(0);
 
+        n = MAX(xres, MAX(yres, zres));
+        n *= n;
+        qx = g_new(gdouble, n);
+        qy = g_new(gdouble, n);
+        qz = g_new(gdouble, n);
+        n = 0;
+
         if (run && controls->args->crop) {
+            n = xres*yres;
             for (row=0; row<yres; row++)
             {
                 y = controls->args->yoffset + gwy_data_field_get_yoffset(controls->actual_field) +
@@ -806,59 +822,42 @@ update_view(CCViewControls *controls, CCViewArgs *args)
                                                 row*gwy_data_field_get_yreal(controls->actual_field)/yres,
                                                 GWY_INTERPOLATION_BILINEAR);
 
-                    get_value(caldata, x, y, z, &xerr, &yerr, &zerr, &xunc, &yunc, &zunc, args->interpolation_type);
-                    controls->xerr->data[col + xres*row] = xerr;
-                    controls->yerr->data[col + xres*row] = yerr;
-                    controls->zerr->data[col + xres*row] = zerr;
-                    controls->xunc->data[col + xres*row] = xunc;
-                    controls->yunc->data[col + xres*row] = yunc;
-                    controls->zunc->data[col + xres*row] = zunc;
-
+                    qx[col + xres*row] = x;
+                    qy[col + xres*row] = y;
+                    qz[col + xres*row] = z;
                 }
-                if (!(run = gwy_app_wait_set_fraction((gdouble)row/(gdouble)yres))) break;
             }
         } else if (run) {
             if (controls->args->plane_type == GWY_CC_VIEW_PLANE_X)
             {
                 gwy_data_field_resample(viewfield, yres, zres, GWY_INTERPOLATION_NONE);
+                n = yres*zres;
                 x = x_from + (x_to-x_from)*(gdouble)args->xplane/100.0;
                 for (col=0; col<yres; col++)
                 {
                     y = y_from + (y_to-y_from)*(gdouble)col/(double)yres;
                     for (row=0; row<zres; row++) {
                         z = z_from + (z_to-z_from)*(gdouble)row/(double)zres;
-
-                        get_value(caldata, x, y, z, &xerr, &yerr, &zerr, &xunc, &yunc, &zunc, args->interpolation_type);
-                        controls->xerr->data[col + yres*row] = xerr;
-                        controls->yerr->data[col + yres*row] = yerr;
-                        controls->zerr->data[col + yres*row] = zerr;
-                        controls->xunc->data[col + yres*row] = xunc;
-                        controls->yunc->data[col + yres*row] = yunc;
-                        controls->zunc->data[col + yres*row] = zunc;
+                        qx[col + yres*row] = x;
+                        qy[col + yres*row] = y;
+                        qz[col + yres*row] = z;
                     }
-                    if (!(run = gwy_app_wait_set_fraction((gdouble)col/(gdouble)yres))) break;
-
                 }
             }
             if (controls->args->plane_type == GWY_CC_VIEW_PLANE_Y)
             {
                 gwy_data_field_resample(viewfield, xres, zres, GWY_INTERPOLATION_NONE);
+                n = xres*zres;
                 y = y_from + (y_to-y_from)*(gdouble)args->yplane/100.0;
                 for (col=0; col<xres; col++)
                 {
                     x = x_from + (x_to-x_from)*(gdouble)col/(double)xres;
                     for (row=0; row<zres; row++) {
                         z = z_from + (z_to-z_from)*(gdouble)row/(double)zres;
-                        get_value(caldata, x, y, z, &xerr, &yerr, &zerr, &xunc, &yunc, &zunc, args->interpolation_type);
-                        controls->xerr->data[col + xres*row] = xerr;
-                        controls->yerr->data[col + xres*row] = yerr;
-                        controls->zerr->data[col + xres*row] = zerr;
-                        controls->xunc->data[col + xres*row] = xunc;
-                        controls->yunc->data[col + xres*row] = yunc;
-                        controls->zunc->data[col + xres*row] = zunc;
+                        qx[col + xres*row] = x;
+                        qy[col + xres*row] = y;
+                        qz[col + xres*row] = z;
                     }
-                    if (!(run = gwy_app_wait_set_fraction((gdouble)col/(gdouble)xres))) break;
-
                 }
             }
             if (controls->args->plane_type == GWY_CC_VIEW_PLANE_Z)
@@ -866,6 +865,7 @@ update_view(CCViewControls *controls, CCViewArgs *args)
                 gwy_data_field_resample(viewfield, xres, yres, GWY_INTERPOLATION_NONE);
                 gwy_data_field_set_xreal(viewfield, x_to - x_from);
                 gwy_data_field_set_yreal(viewfield, y_to - y_from);
+                n = xres*yres;
 
                 z = z_from + (z_to-z_from)*(gdouble)args->zplane/100.0;
                 for (col=0; col<xres; col++)
@@ -876,19 +876,21 @@ update_view(CCViewControls *controls, CCViewArgs *args)
                         y = gwy_data_field_get_yoffset(viewfield) +
                             row*gwy_data_field_get_yreal(viewfield)/yres;
 
-                        get_value(caldata, x, y, z, &xerr, &yerr, &zerr, &xunc, &yunc, &zunc, args->interpolation_type);
-                        controls->xerr->data[col + xres*row] = xerr;
-                        controls->yerr->data[col + xres*row] = yerr;
-                        controls->zerr->data[col + xres*row] = zerr;
-                        controls->xunc->data[col + xres*row] = xunc;
-                        controls->yunc->data[col + xres*row] = yunc;
-                        controls->zunc->data[col + xres*row] = zunc;
+                        qx[col + xres*row] = x;
+                        qy[col + xres*row] = y;
+                        qz[col + xres*row] = z;
                     }
-                    if (!(run = gwy_app_wait_set_fraction((gdouble)col/(gdouble)xres))) break;
                 }
             }
 
         }
+        if (run)
+            run = evaluate_points(controls, caldata, qx, qy, qz, n,
+                                  args->interpolation_type);
+        g_free(qx);
+        g_free(qy);
+        g_free(qz);
+
         gwy_data_field_invalidate(controls->xerr);
         gwy_data_field_invalidate(controls->yerr);
         gwy_data_field_invalidate(controls->zerr);
@@ -932,6 +934,47 @@ update_view(CCViewControls *controls, CCViewArgs *args)
 }
 
 
+/* Evaluate the calibration in n points, storing the results to the result
+ * fields.  Natural neighbour interpolation is done by a single call of the
+ * batch function, the other methods point by point. */
+static gboolean
+evaluate_points(CCViewControls *controls, GwyCalData *caldata,
+                const gdouble *x, const gdouble *y, const gdouble *z, gint n,
+                GwyCCViewInterpolationType interpolation_type)
+{
+    enum { BLOCK_SIZE = 4096 };
+    gint i, k, len;
+
+    if (interpolation_type == GWY_CC_VIEW_INTERPOLATION_NATURAL) {
+        return gwy_caldata_interpolate_batch(caldata, x, y, z, n,
+                                             controls->xerr->data,
+                                             controls->yerr->data,
+                                             controls->zerr->data,
+                                             controls->xunc->data,
+                                             controls->yunc->data,
+                                             controls->zunc->data,
+                                             gwy_app_wait_set_fraction);
+    }
+
+    for (k = 0; k < n; k += BLOCK_SIZE) {
+        len = MIN(BLOCK_SIZE, n - k);
+        for (i = k; i < k + len; i++) {
+            get_value(caldata, x[i], y[i], z[i],
+                      controls->xerr->data + i,
+                      controls->yerr->data + i,
+                      controls->zerr->data + i,
+                      controls->xunc->data + i,
+                      controls->yunc->data + i,
+                      controls->zunc->data + i,
+                      interpolation_type);
+        }
+        if (!gwy_app_wait_set_fraction((gdouble)(k + len)/n))
+            return FALSE;
+    }
+
+    return TRUE;
+}
+
 static void
 add_calibration(GwyDataField *dfield,
                 GwyContainer *data,
@@ -55,7 +55,11 @@
 /* i MUST be greater or equal than j */
 #define SLi(a, i, j) a[(i)*((i) + 1)/2 + (j)]
 
-enum { NREDLIM = 4096 };
+enum {
+    NREDLIM = 4096,
+    /* Point count multiplier between consecutive coarse-to-fine stages. */
+    MULTIRES_STEP = 16,
+};
 
 typedef enum {
     FIT_SHAPE_DISPLAY_DATA   = 0,
@@ -88,8 +92,16 @@ typedef struct {
     FitShapeOutputType output;
     gboolean diff_colourmap;
     gboolean diff_excluded;
+    gboolean multires;
+    gdouble multires_tol;
 } FitShapeArgs;
 
+typedef struct {
+    guint npoints;
+    gdouble time;
+    gdouble rss;
+} FitShapeStage;
+
 /* XXX XXX XXX XXX XXX */
 typedef struct {
     guint nparam;
@@ -138,6 +150,8 @@ typedef struct {
     GtkWidget *function;
     GtkWidget *diff_colourmap;
     GtkWidget *diff_excluded;
+    GtkWidget *multires;
+    GtkObject *multires_tol;
     GtkWidget *output;
     GSList *display;
     GSList *masking;
@@ -153,6 +167,7 @@ typedef struct {
     GPtrArray *correl_vlabels;
     GtkWidget *secondary_table;
     GArray *secondary_controls;
+    GArray *stages;
 } FitShapeControls;
 
 static gboolean      module_register             (void);
@@ -195,6 +210,10 @@ static void          diff_excluded_changed       (GtkToggleButton *toggle,
                                                   FitShapeControls *controls);
 static void          output_changed              (GtkComboBox *combo,
                                                   FitShapeControls *controls);
+static void          multires_changed            (GtkToggleButton *toggle,
+                                                  FitShapeControls *controls);
+static void          multires_tol_changed        (GtkAdjustment *adj,
+                                                  FitShapeControls *controls);
 static void          masking_changed             (GtkToggleButton *toggle,
                                                   FitShapeControls *controls);
 static void          update_colourmap_key        (FitShapeControls *controls);
@@ -237,6 +256,12 @@ static GwyNLFitter*  fit_reduced                 (GwyShapeFitPreset *preset,
                                                   const FitShapeContext *ctx,
                                                   gdouble *param,
                                                   gdouble *rss);
+static GwyNLFitter*  fit_multires                (GwyShapeFitPreset *preset,
+                                                  const FitShapeContext *ctx,
+                                                  gdouble tolerance,
+                                                  gdouble *param,
+                                                  gdouble *rss,
+                                                  GArray *stages);
 static void          calculate_field             (GwyShapeFitPreset *preset,
                                                   const gdouble *params,
                                                   GwyDataField *dfield);
@@ -255,6 +280,7 @@ static const FitShapeArgs fit_shape_defaults = {
     "Grating (simple)", GWY_MASK_IGNORE,
     FIT_SHAPE_DISPLAY_RESULT, FIT_SHAPE_OUTPUT_FIT,
     TRUE, TRUE,
+    FALSE, 1e-3,
 };
 
 static GwyModuleInfo module_info = {
@@ -262,7 +288,7 @@ static GwyModuleInfo module_info = {
     &module_register,
     N_("Fits predefined geometrical shapes to data."),
     "Yeti <yeti@gwyddion.net>",
-    "1.1",
+    "1.2",
     "David Nečas (Yeti)",
     "2016",
 };
@@ -352,6 +378,7 @@ fit_shape_dialogue(FitShapeArgs *args,
     controls.args = args;
     controls.ctx = &ctx;
     controls.id = id;
+    controls.stages = g_array_new(FALSE, FALSE, sizeof(FitShapeStage));
 
     if (surface) {
         controls.pageno = GWY_PAGE_XYZS;
@@ -542,6 +569,7 @@ finalise:
     g_ptr_array_free(controls.correl_hlabels, TRUE);
     g_ptr_array_free(controls.correl_vlabels, TRUE);
     g_array_free(controls.secondary_controls, TRUE);
+    g_array_free(controls.stages, TRUE);
     fit_context_free(controls.ctx);
 }
 
@@ -652,13 +680,13 @@ basic_tab_new(FitShapeControls *controls,
         { N_("Both"),         FIT_SHAPE_OUTPUT_BOTH, },
     };
 
-    GtkWidget *table, *label, *hbox;
+    GtkWidget *table, *label, *hbox, *spin;
     FitShapeArgs *args = controls->args;
     gint row;
 
     hbox = gtk_hbox_new(FALSE, 0);
 
-    table = gtk_table_new(8 + 4*(!!mfield), 4, FALSE);
+    table = gtk_table_new(11 + 4*(!!mfield), 4, FALSE);
     gtk_container_set_border_width(GTK_CONTAINER(table), 4);
     gtk_table_set_row_spacings(GTK_TABLE(table), 2);
     gtk_table_set_col_spacings(GTK_TABLE(table), 6);
@@ -704,6 +732,28 @@ basic_tab_new(FitShapeControls *controls,
                      G_CALLBACK(diff_colourmap_changed), controls);
     row++;
 
+    gtk_table_set_row_spacing(GTK_TABLE(table), row-1, 8);
+    controls->multires
+        = gtk_check_button_new_with_mnemonic(_("Coarse-to-fine _fitting"));
+    gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(controls->multires),
+                                 args->multires);
+    gtk_table_attach(GTK_TABLE(table), controls->multires,
+                     0, 3, row, row+1, GTK_EXPAND | GTK_FILL, 0, 0, 0);
+    g_signal_connect(controls->multires, "toggled",
+                     G_CALLBACK(multires_changed), controls);
+    row++;
+
+    controls->multires_tol = gtk_adjustment_new(args->multires_tol,
+                                                1e-5, 0.1, 1e-5, 1e-3, 0);
+    gwy_table_attach_hscale(table, row, _("Convergence _tolerance:"), NULL,
+                            controls->multires_tol, GWY_HSCALE_LOG);
+    spin = gwy_table_hscale_get_middle_widget(controls->multires_tol);
+    gtk_spin_button_set_digits(GTK_SPIN_BUTTON(spin), 5);
+    gwy_table_hscale_set_sensitive(controls->multires_tol, args->multires);
+    g_signal_connect(controls->multires_tol, "value-changed",
+                     G_CALLBACK(multires_tol_changed), controls);
+    row++;
+
     if (mfield)
         row = basic_tab_add_masking(controls, table, row);
 
@@ -1207,6 +1257,20 @@ output_changed(GtkComboBox *combo, FitShapeControls *controls)
     controls->args->output = gwy_enum_combo_box_get_active(combo);
 }
 
+static void
+multires_changed(GtkToggleButton *toggle, FitShapeControls *controls)
+{
+    controls->args->multires = gtk_toggle_button_get_active(toggle);
+    gwy_table_hscale_set_sensitive(controls->multires_tol,
+                                   controls->args->multires);
+}
+
+static void
+multires_tol_changed(GtkAdjustment *adj, FitShapeControls *controls)
+{
+    controls->args->multires_tol = gtk_adjustment_get_value(adj);
+}
+
 static void
 masking_changed(GtkToggleButton *toggle, FitShapeControls *controls)
 {
@@ -1581,8 +1645,24 @@ fit_shape_full_fit(FitShapeControls *controls)
     nparams = gwy_shape_fit_preset_get_nparams(controls->preset);
     update_all_param_values(controls);
     gwy_assign(controls->alt_param, controls->param, nparams);
-    fitter = fit(controls->preset, ctx, G_MAXUINT, controls->param, &rss,
-                 gwy_app_wait_set_fraction, gwy_app_wait_set_message);
+    g_array_set_size(controls->stages, 0);
+    if (controls->args->multires) {
+        fitter = fit_multires(controls->preset, ctx,
+                              controls->args->multires_tol,
+                              controls->param, &rss, controls->stages);
+    }
+    else {
+        FitShapeStage stage;
+        GTimer *timer = g_timer_new();
+
+        fitter = fit(controls->preset, ctx, G_MAXUINT, controls->param, &rss,
+                     gwy_app_wait_set_fraction, gwy_app_wait_set_message);
+        stage.npoints = ctx->n;
+        stage.time = g_timer_elapsed(timer, NULL);
+        stage.rss = rss;
+        g_array_append_val(controls->stages, stage);
+        g_timer_destroy(timer);
+    }
 
     if (rss >= 0.0)
         controls->state = FIT_SHAPE_FITTED;
@@ -1602,7 +1682,8 @@ fit_shape_full_fit(FitShapeControls *controls)
     update_fit_results(controls, fitter);
     update_fields(controls);
     update_fit_state(controls);
-    gwy_math_nlfit_free(fitter);
+    if (fitter)
+        gwy_math_nlfit_free(fitter);
     gwy_app_wait_finish();
 }
 
@@ -1957,6 +2038,119 @@ fit_reduced(GwyShapeFitPreset *preset, const FitShapeContext *ctx,
     return fitter;
 }
 
+/* Fit on random point subsets growing by MULTIRES_STEP, each stage starting
+ * from the parameters of the previous one.  Once the parameters stop changing
+ * (relative to their values and errors) we skip directly to the full data.
+ * The last stage is always the full data so errors and correlations are
+ * exactly as for the plain fit.  When cancelled during a reduced stage, the
+ * initial parameters are restored and no fitter is returned. */
+static GwyNLFitter*
+fit_multires(GwyShapeFitPreset *preset, const FitShapeContext *ctx,
+             gdouble tolerance, gdouble *param, gdouble *rss,
+             GArray *stages)
+{
+    GwyNLFitter *fitter = NULL;
+    FitShapeContext ctxred;
+    FitShapeStage stage;
+    GTimer *timer;
+    gdouble *prev_param, *init_param, sigma_scale;
+    guint i, nred, nparams = ctx->nparam;
+    gboolean converged;
+    gchar *message;
+
+    timer = g_timer_new();
+    prev_param = g_new(gdouble, nparams);
+    init_param = g_memdup(param, nparams*sizeof(gdouble));
+    ctxred = *ctx;
+    for (nred = MIN(NREDLIM, ctx->n); nred < ctx->n; nred *= MULTIRES_STEP) {
+        /* Do not make a tiny last step; fit the full data instead. */
+        if (nred > ctx->n/4)
+            break;
+
+        message = g_strdup_printf(_("Fitting %u of %u points..."),
+                                  nred, ctx->n);
+        gwy_app_wait_set_message(message);
+        g_free(message);
+
+        g_timer_start(timer);
+        ctxred.n = nred;
+        ctxred.surface = gwy_surface_new_sized(nred);
+        ctxred.xyz = gwy_surface_get_data_const(ctxred.surface);
+        reduce_data_size(gwy_surface_get_data_const(ctx->surface), ctx->n,
+                         ctxred.surface);
+        gwy_assign(prev_param, param, nparams);
+        if (fitter)
+            gwy_math_nlfit_free(fitter);
+        fitter = fit(preset, &ctxred, G_MAXUINT, param, rss,
+                     gwy_app_wait_set_fraction, NULL);
+        g_object_unref(ctxred.surface);
+
+        stage.npoints = nred;
+        stage.time = g_timer_elapsed(timer, NULL);
+        stage.rss = *rss;
+        g_array_append_val(stages, stage);
+        gwy_debug("stage %u points: rss %g, time %g s",
+                  nred, *rss, stage.time);
+
+        /* Cancelled.  Failed reduced fits are not fatal; restore the
+         * parameters and let the next stage try it again. */
+        if (*rss == -2.0) {
+            gwy_math_nlfit_free(fitter);
+            fitter = NULL;
+            gwy_assign(param, init_param, nparams);
+            goto finish;
+        }
+        if (*rss < 0.0) {
+            gwy_assign(param, prev_param, nparams);
+            continue;
+        }
+
+        /* The first stage has nothing to compare to. */
+        if (stages->len == 1)
+            continue;
+
+        /* The parameter errors scale as 1/sqrt(N) with the number of points.
+         * The subset is random, so the full data error is estimated well
+         * enough by rescaling the subset error; fitting the full data just to
+         * get the errors would defeat the purpose of the stages. */
+        sigma_scale = sqrt((gdouble)nred/ctx->n);
+        converged = TRUE;
+        for (i = 0; i < nparams; i++) {
+            if (ctx->param_fixed[i])
+                continue;
+            if (fabs(param[i] - prev_param[i])
+                > tolerance*(fabs(param[i])
+                             + sigma_scale*gwy_math_nlfit_get_sigma(fitter,
+                                                                    i))) {
+                converged = FALSE;
+                break;
+            }
+        }
+        if (converged)
+            break;
+    }
+
+    gwy_app_wait_set_message(_("Fitting..."));
+    g_timer_start(timer);
+    if (fitter)
+        gwy_math_nlfit_free(fitter);
+    fitter = fit(preset, ctx, G_MAXUINT, param, rss,
+                 gwy_app_wait_set_fraction, NULL);
+    stage.npoints = ctx->n;
+    stage.time = g_timer_elapsed(timer, NULL);
+    stage.rss = *rss;
+    g_array_append_val(stages, stage);
+    gwy_debug("final stage %u points: rss %g, time %g s",
+              ctx->n, *rss, stage.time);
+
+finish:
+    g_free(init_param);
+    g_free(prev_param);
+    g_timer_destroy(timer);
+
+    return fitter;
+}
+
 static void
 calculate_field(GwyShapeFitPreset *preset, const gdouble *params,
                 GwyDataField *dfield)
@@ -2132,6 +2326,33 @@ create_fit_report(FitShapeControls *controls)
     if (nsecondary)
         g_string_append_c(report, '\n');
 
+    if (controls->stages->len) {
+        gdouble time = 0.0;
+
+        unitstr = gwy_si_unit_get_string(zunit, GWY_SI_UNIT_FORMAT_PLAIN);
+        g_string_append(report, _("Fitting Stages"));
+        g_string_append_c(report, '\n');
+        for (i = 0; i < controls->stages->len; i++) {
+            const FitShapeStage *stage = &g_array_index(controls->stages,
+                                                        FitShapeStage, i);
+            g_string_append_printf(report, "%8u ", stage->npoints);
+            g_string_append_printf(report, _("points: %.3f s"), stage->time);
+            if (stage->rss >= 0.0) {
+                g_string_append_printf(report, ", %s %g %s\n",
+                                       _("mean square difference"),
+                                       sqrt(stage->rss/stage->npoints),
+                                       unitstr);
+            }
+            else
+                g_string_append_printf(report, ", %s\n", _("failed"));
+            time += stage->time;
+        }
+        g_free(unitstr);
+        g_string_append_printf(report, _("Total fitting time: %.3f s\n"),
+                               time);
+        g_string_append_c(report, '\n');
+    }
+
     g_object_unref(unit);
 
     return report;
@@ -2142,6 +2363,8 @@ static const gchar diff_excluded_key[]  = "/module/fit_shape/diff_excluded";
 static const gchar display_key[]        = "/module/fit_shape/display";
 static const gchar function_key[]       = "/module/fit_shape/function";
 static const gchar masking_key[]        = "/module/fit_shape/masking";
+static const gchar multires_key[]       = "/module/fit_shape/multires";
+static const gchar multires_tol_key[]   = "/module/fit_shape/multires_tol";
 static const gchar output_key[]         = "/module/fit_shape/output";
 
 static void
@@ -2153,6 +2376,8 @@ fit_shape_sanitize_args(FitShapeArgs *args)
     args->output = MIN(args->output, FIT_SHAPE_OUTPUT_BOTH);
     args->diff_colourmap = !!args->diff_colourmap;
     args->diff_excluded = !!args->diff_excluded;
+    args->multires = !!args->multires;
+    args->multires_tol = CLAMP(args->multires_tol, 1e-5, 0.1);
     if (gwy_inventory_get_item_position(gwy_shape_fit_presets(),
                                         args->function) == (guint)-1)
         args->function = fit_shape_defaults.function;
@@ -2173,6 +2398,10 @@ fit_shape_load_args(GwyContainer *container,
                                       &args->diff_colourmap);
     gwy_container_gis_boolean_by_name(container, diff_excluded_key,
                                       &args->diff_excluded);
+    gwy_container_gis_boolean_by_name(container, multires_key,
+                                      &args->multires);
+    gwy_container_gis_double_by_name(container, multires_tol_key,
+                                     &args->multires_tol);
     fit_shape_sanitize_args(args);
 }
 
@@ -2189,6 +2418,10 @@ fit_shape_save_args(GwyContainer *container,
                                       args->diff_colourmap);
     gwy_container_set_boolean_by_name(container, diff_excluded_key,
                                       args->diff_excluded);
+    gwy_container_set_boolean_by_name(container, multires_key,
+                                      args->multires);
+    gwy_container_set_double_by_name(container, multires_tol_key,
+                                     args->multires_tol);
 }
 
 /* vim: set cin et ts=4 sw=4 cino=>1s,e0,n0,f0,{0,}0,^0,\:1s,=0,g1s,h0,t0,+1s,c3,(0,u0 : */
@@ -668,12 +668,13 @@ cost_function(GwyBrick *brick, GwyDataField *mask,
 {
     gint i, j, k, m, xres, yres, zres;
     gdouble sum, jsum, h, x, y, theta;
-    gdouble *bp, *mp;
+    const gdouble *bp;
+    gdouble *mp;
 
     xres = gwy_brick_get_xres(brick);
     yres = gwy_brick_get_yres(brick);
     zres = gwy_brick_get_zres(brick);
-    bp = gwy_brick_get_data(brick);
+    bp = gwy_brick_get_data_const(brick);
     m = xres * yres;
 
     mp = gwy_data_field_get_data(mask);
@@ -717,12 +718,13 @@ predict(GwyBrick *brick, gdouble *thetas, GwyDataField *dfield)
 {
     gint i, j, k, xres, yres, zres;
     gdouble sum, x;
-    gdouble *bp, *dp;
+    const gdouble *bp;
+    gdouble *dp;
 
     xres = gwy_brick_get_xres(brick);
     yres = gwy_brick_get_yres(brick);
     zres = gwy_brick_get_zres(brick);
-    bp = gwy_brick_get_data(brick);
+    bp = gwy_brick_get_data_const(brick);
     dp = gwy_data_field_get_data(dfield);
 
     for (i = 0; i < yres; i++)
@@ -742,12 +744,13 @@ predict_mask(GwyBrick *brick, gdouble *thetas, GwyDataField *mask)
 {
     gint i, j, k, xres, yres, zres;
     gdouble sum, x;
-    gdouble *bp, *mp;
+    const gdouble *bp;
+    gdouble *mp;
 
     xres = gwy_brick_get_xres(brick);
     yres = gwy_brick_get_yres(brick);
     zres = gwy_brick_get_zres(brick);
-    bp = gwy_brick_get_data(brick);
+    bp = gwy_brick_get_data_const(brick);
     mp = gwy_data_field_get_data(mask);
 
     for (i = 0; i < yres; i++)
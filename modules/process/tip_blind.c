@@ -43,6 +43,9 @@ enum {
     MAX_RES = 128,
     MIN_STRIPES = 2,
     MAX_STRIPES = 64,
+    /* Levels at which the tip would be too small are skipped, so this is
+     * just the limit for huge tips. */
+    MULTISCALE_LEVELS = 4,
 };
 
 typedef struct {
@@ -60,6 +63,7 @@ typedef struct {
     gint yres;
     gdouble thresh;
     gboolean use_boundaries;
+    gboolean multiscale;
     gboolean same_resolution;
     gboolean split_to_stripes;
     gboolean create_images;
@@ -83,6 +87,7 @@ typedef struct {
     GtkWidget *threshold_spin;
     GtkWidget *threshold_unit;
     GtkWidget *boundaries;
+    GtkWidget *multiscale;
     GwyDataField *tip;
     GwyContainer *vtip;
     GtkObject *xres;
@@ -131,6 +136,8 @@ static void           thresh_changed          (gpointer object,
                                                TipBlindControls *controls);
 static void           bound_changed           (GtkToggleButton *button,
                                                TipBlindArgs *args);
+static void           multiscale_changed      (GtkToggleButton *button,
+                                               TipBlindArgs *args);
 static void           same_resolution_changed (GtkToggleButton *button,
                                                TipBlindControls *controls);
 static void           data_changed            (GwyDataChooser *chooser,
@@ -166,7 +173,7 @@ static void           tip_curvatures          (GwyDataField *tipfield,
 static GwyGraphModel* size_plot               (TipBlindArgs *args);
 
 static const TipBlindArgs tip_blind_defaults = {
-    10, 10, 1e-10, FALSE, TRUE,
+    10, 10, 1e-10, FALSE, FALSE, TRUE,
     FALSE, FALSE, TRUE, 16,
     GWY_APP_DATA_ID_NONE, GWY_APP_DATA_ID_NONE,
     NULL, NULL,
@@ -177,7 +184,7 @@ static GwyModuleInfo module_info = {
     &module_register,
     N_("Blind estimation of SPM tip using Villarubia's algorithm."),
     "Petr Klapetek <petr@klapetek.cz>",
-    "1.9",
+    "1.10",
     "David Nečas (Yeti) & Petr Klapetek",
     "2004",
 };
@@ -390,6 +397,16 @@ tip_blind_dialog(TipBlindArgs *args)
                                                  args->use_boundaries);
     g_signal_connect(controls.boundaries, "toggled",
                      G_CALLBACK(bound_changed), args);
+    row++;
+
+    controls.multiscale
+        = gtk_check_button_new_with_mnemonic(_("Coarse-to-fine _estimation"));
+    gtk_table_attach(GTK_TABLE(table), controls.multiscale,
+                     0, 4, row, row+1, GTK_EXPAND | GTK_FILL, 0, 0, 0);
+    gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(controls.multiscale),
+                                 args->multiscale);
+    g_signal_connect(controls.multiscale, "toggled",
+                     G_CALLBACK(multiscale_changed), args);
     gtk_table_set_row_spacing(GTK_TABLE(table), row, 8);
     row++;
 
@@ -578,6 +595,13 @@ bound_changed(GtkToggleButton *button,
         = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(button));
 }
 
+static void
+multiscale_changed(GtkToggleButton *button,
+                   TipBlindArgs *args)
+{
+    args->multiscale = gtk_toggle_button_get_active(button);
+}
+
 static void
 same_resolution_changed(GtkToggleButton *button,
                         TipBlindControls *controls)
@@ -755,22 +779,48 @@ prepare_stripe_fields(TipBlindControls *controls,
     }
 }
 
+static GwyDataField*
+estimate_tip(GwyDataField *tip,
+             GwyDataField *surface,
+             TipBlindArgs *args,
+             gboolean full,
+             gint *count)
+{
+    GwyTipEstimateStats stats;
+
+    if (!full) {
+        return gwy_tip_estimate_partial(tip, surface,
+                                        args->thresh, args->use_boundaries,
+                                        count,
+                                        gwy_app_wait_set_fraction,
+                                        gwy_app_wait_set_message);
+    }
+    if (!args->multiscale) {
+        return gwy_tip_estimate_full(tip, surface,
+                                     args->thresh, args->use_boundaries,
+                                     count,
+                                     gwy_app_wait_set_fraction,
+                                     gwy_app_wait_set_message);
+    }
+    if (!gwy_tip_estimate_full_multiscale(tip, surface,
+                                          args->thresh, args->use_boundaries,
+                                          MULTISCALE_LEVELS, 0, &stats,
+                                          gwy_app_wait_set_fraction,
+                                          gwy_app_wait_set_message))
+        return NULL;
+
+    *count = stats.count;
+    return tip;
+}
+
 static void
 tip_blind_run(TipBlindControls *controls,
               TipBlindArgs *args,
               gboolean full)
 {
-    typedef GwyDataField* (*TipFunc)(GwyDataField *tip,
-                                     GwyDataField *surface,
-                                     gdouble threshold,
-                                     gboolean use_edges,
-                                     gint *count,
-                                     GwySetFractionFunc set_fraction,
-                                     GwySetMessageFunc set_message);
     GwyDataField *surface;
     GwyGraphModel *gmodel;
     GwyContainer *data;
-    TipFunc tipfunc;
     GQuark quark;
     gint count;
     gboolean keep;
@@ -794,7 +844,6 @@ tip_blind_run(TipBlindControls *controls,
     }
     controls->oldnstripes = args->nstripes;
 
-    tipfunc = full ? gwy_tip_estimate_full : gwy_tip_estimate_partial;
     if (args->split_to_stripes) {
         guint ns = args->nstripes;
         guint xres = surface->xres, yres = surface->yres;
@@ -818,11 +867,8 @@ tip_blind_run(TipBlindControls *controls,
             gwy_debug("[%u] (%u, %u) of %u", i, row, height, yres);
             count = -1;
             stripe = gwy_data_field_area_extract(surface, 0, row, xres, height);
-            ok = !!tipfunc(args->stripetips[i], stripe,
-                           args->thresh, args->use_boundaries,
-                           &count,
-                           gwy_app_wait_set_fraction,
-                           gwy_app_wait_set_message);
+            ok = !!estimate_tip(args->stripetips[i], stripe, args, full,
+                                &count);
             args->goodtip[i] = ok && count > 0;
             g_object_unref(stripe);
             gwy_debug("[%u] count = %d", i, count);
@@ -842,11 +888,8 @@ tip_blind_run(TipBlindControls *controls,
     }
     else {
         count = -1;
-        controls->good_tip = (tipfunc(controls->tip, surface,
-                                      args->thresh, args->use_boundaries,
-                                      &count,
-                                      gwy_app_wait_set_fraction,
-                                      gwy_app_wait_set_message)
+        controls->good_tip = (estimate_tip(controls->tip, surface, args, full,
+                                           &count)
                               && count > 0);
         gwy_debug("count = %d", count);
         gmodel = gwy_graph_model_new();
@@ -1241,6 +1284,7 @@ static const gchar xres_key[]             = "/module/tip_blind/xres";
 static const gchar yres_key[]             = "/module/tip_blind/yres";
 static const gchar thresh_key[]           = "/module/tip_blind/threshold";
 static const gchar use_boundaries_key[]   = "/module/tip_blind/use_boundaries";
+static const gchar multiscale_key[]       = "/module/tip_blind/multiscale";
 static const gchar same_resolution_key[]  = "/module/tip_blind/same_resolution";
 static const gchar split_to_stripes_key[] = "/module/tip_blind/split_to_stripes";
 static const gchar create_images_key[]    = "/module/tip_blind/create_images";
@@ -1254,6 +1298,7 @@ tip_blind_sanitize_args(TipBlindArgs *args)
     args->yres = CLAMP(args->yres, MIN_RES, MAX_RES);
     args->nstripes = CLAMP(args->nstripes, MIN_STRIPES, MAX_STRIPES);
     args->use_boundaries = !!args->use_boundaries;
+    args->multiscale = !!args->multiscale;
     args->same_resolution = !!args->same_resolution;
     args->split_to_stripes = !!args->split_to_stripes;
     args->create_images = !!args->create_images;
@@ -1274,6 +1319,8 @@ tip_blind_load_args(GwyContainer *container,
     gwy_container_gis_double_by_name(container, thresh_key, &args->thresh);
     gwy_container_gis_boolean_by_name(container, use_boundaries_key,
                                       &args->use_boundaries);
+    gwy_container_gis_boolean_by_name(container, multiscale_key,
+                                      &args->multiscale);
     gwy_container_gis_boolean_by_name(container, same_resolution_key,
                                       &args->same_resolution);
     gwy_container_gis_boolean_by_name(container, split_to_stripes_key,
@@ -1295,6 +1342,8 @@ tip_blind_save_args(GwyContainer *container,
     gwy_container_set_double_by_name(container, thresh_key, args->thresh);
     gwy_container_set_boolean_by_name(container, use_boundaries_key,
                                       args->use_boundaries);
+    gwy_container_set_boolean_by_name(container, multiscale_key,
+                                      args->multiscale);
     gwy_container_set_boolean_by_name(container, same_resolution_key,
                                       args->same_resolution);
     gwy_container_set_boolean_by_name(container, split_to_stripes_key,
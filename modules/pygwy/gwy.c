@@ -195,6 +195,7 @@ initgwy(void)
     dict = PyModule_GetDict(mod);
     /* This does "import gtk" so display is required. */
     pygwy_register_classes(dict);
+    pygwy_enable_buffer_protocol();
     pygwy_add_constants(mod, "GWY_");
 
     switch_between_gwyddion_bin_dir(TRUE);
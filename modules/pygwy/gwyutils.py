@@ -70,50 +70,28 @@ else:
    def data_field_data_as_array(field):
       """Create a view the DataField's data as numpy array.
 
-      The array can point to an invalid memory location after using other
-      gwyddion functions and lead to application crash. Use with care.
+      The array is indexed [col,row].  It keeps the field alive and writes to
+      it invalidate the cached field statistics.  However, the array points
+      to invalid memory after the field is resized or resampled.  Use
+      np.asarray(field) to obtain a view indexed [row,col].
 
       @param field: the L{gwy.DataField} to view
       @return: array viewing the data
       """
-      class gwydfdatap():
-         def __init__(self,addr,shape):
-            data = (addr,False)
-            stride = (8,shape[0]*8)
-            self.__array_interface__= {
-               'strides' : stride,
-               'shape'   : shape,
-               'data'    : data,
-               'typestr' : "|f8",
-               'version' : 3}
-
-      addr = field.get_data_pointer()
-      shape = (field.get_xres(),field.get_yres())
-      return np.array(gwydfdatap(addr,shape),copy=False)
+      return np.asarray(field).transpose()
 
    def brick_data_as_array(brick):
       """Create a view the Brick's data as numpy array.
 
-      The array can point to an invalid memory location after using other
-      gwyddion functions and lead to application crash. Use with care.
+      The array is indexed [col,row,level].  It keeps the brick alive and
+      writes to it invalidate the cached brick statistics.  However, the array
+      points to invalid memory after the brick is resized or resampled.  Use
+      np.asarray(brick) to obtain a view indexed [level,row,col].
 
       @param field: the L{gwy.Brick} to view
       @return: array viewing the data
       """
-      class gwydfdatap():
-         def __init__(self,addr,shape):
-            data = (addr,False)
-            stride = (8,shape[0]*8,shape[0]*shape[1]*8)
-            self.__array_interface__= {
-               'strides' : stride,
-               'shape'   : shape,
-               'data'    : data,
-               'typestr' : "|f8",
-               'version' : 3}
-
-      addr = brick.get_data_pointer()
-      shape = (brick.get_xres(),brick.get_yres(),brick.get_zres())
-      return np.array(gwydfdatap(addr,shape),copy=False)
+      return np.asarray(brick).transpose()
 
    def data_field_get_data(datafield):
         """Gets the data from a data field.
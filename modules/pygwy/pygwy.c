@@ -219,6 +219,7 @@ pygwy_initialize(void)
 
         gwy_debug("Register classes");
         pygwy_register_classes(s_pygwy.dict);
+        pygwy_enable_buffer_protocol();
         gwy_debug("Register constaints");
         pygwy_add_constants(m, "GWY_");
      } else {
@@ -25,12 +25,13 @@
 
 #define pygwy_plugin_dir_name "pygwy"
 
-PyObject* pygwy_create_environment (const gchar *filename,
-                                    gboolean show_errors);
-void      pygwy_initialize         (void);
-void      pygwy_run_string         (const char *cmd,
-                                    int type,
-                                    PyObject *g,
-                                    PyObject *l);
+PyObject* pygwy_create_environment    (const gchar *filename,
+                                       gboolean show_errors);
+void      pygwy_initialize            (void);
+void      pygwy_enable_buffer_protocol(void);
+void      pygwy_run_string            (const char *cmd,
+                                       int type,
+                                       PyObject *g,
+                                       PyObject *l);
 
 #endif
@@ -85,6 +85,8 @@ static void gwy_tool_grain_remover_mode_changed     (GtkWidget *radio,
 static void gwy_tool_grain_remover_method_changed   (GtkComboBox *combo,
                                                      GwyToolGrainRemover *tool);
 static void gwy_tool_grain_remover_selection_finished(GwyPlainTool *plain_tool);
+static void find_grain_bbox                         (GwyDataField *grain,
+                                                     gint *bbox);
 
 static void laplace_interpolation                   (GwyDataField *dfield,
                                                      GwyDataField *grain);
@@ -297,7 +299,7 @@ gwy_tool_grain_remover_selection_finished(GwyPlainTool *plain_tool)
 {
     gdouble point[2];
     GQuark quarks[2];
-    gint col, row;
+    gint col, row, bbox[4];
     RemoveMode mode;
     GwyDataField *tmp;
 
@@ -319,9 +321,10 @@ gwy_tool_grain_remover_selection_finished(GwyPlainTool *plain_tool)
         quarks[1] = gwy_app_get_mask_key_for_id(plain_tool->id);
 
     gwy_app_undo_qcheckpointv(plain_tool->container, 2, quarks);
+    tmp = gwy_data_field_duplicate(plain_tool->mask_field);
+    gwy_data_field_grains_extract_grain(tmp, col, row);
+    find_grain_bbox(tmp, bbox);
     if (mode & GRAIN_REMOVE_DATA) {
-        tmp = gwy_data_field_duplicate(plain_tool->mask_field);
-        gwy_data_field_grains_extract_grain(tmp, col, row);
         switch (GWY_TOOL_GRAIN_REMOVER(plain_tool)->args.method) {
             case GRAIN_REMOVE_LAPLACE:
             laplace_interpolation(plain_tool->data_field, tmp);
@@ -332,17 +335,54 @@ gwy_tool_grain_remover_selection_finished(GwyPlainTool *plain_tool)
                                               GWY_INTERPOLATION_LINEAR);
             break;
         }
-        g_object_unref(tmp);
-        gwy_data_field_data_changed(plain_tool->data_field);
+        gwy_data_field_data_changed_area(plain_tool->data_field,
+                                         bbox[0], bbox[1], bbox[2], bbox[3]);
     }
     if (mode & GRAIN_REMOVE_MASK) {
         gwy_data_field_grains_remove_grain(plain_tool->mask_field, col, row);
-        gwy_data_field_data_changed(plain_tool->mask_field);
+        gwy_data_field_data_changed_area(plain_tool->mask_field,
+                                         bbox[0], bbox[1], bbox[2], bbox[3]);
     }
+    g_object_unref(tmp);
     gwy_plain_tool_log_add(plain_tool);
     gwy_selection_clear(plain_tool->selection);
 }
 
+/* Finds the bounding box of the single grain in @grain as col, row, width,
+ * height.  Only this area changes when the grain is removed. */
+static void
+find_grain_bbox(GwyDataField *grain, gint *bbox)
+{
+    gint xres, yres, i, j, imin, jmin, imax, jmax;
+    const gdouble *d;
+
+    xres = gwy_data_field_get_xres(grain);
+    yres = gwy_data_field_get_yres(grain);
+    d = gwy_data_field_get_data_const(grain);
+    imin = yres;
+    jmin = xres;
+    imax = jmax = -1;
+    for (i = 0; i < yres; i++) {
+        for (j = 0; j < xres; j++) {
+            if (d[i*xres + j]) {
+                imin = MIN(imin, i);
+                imax = MAX(imax, i);
+                jmin = MIN(jmin, j);
+                jmax = MAX(jmax, j);
+            }
+        }
+    }
+
+    if (imax < 0) {
+        bbox[0] = bbox[1] = bbox[2] = bbox[3] = 0;
+        return;
+    }
+    bbox[0] = jmin;
+    bbox[1] = imin;
+    bbox[2] = jmax+1 - jmin;
+    bbox[3] = imax+1 - imin;
+}
+
 static void
 laplace_interpolation(GwyDataField *dfield,
                       GwyDataField *grain)
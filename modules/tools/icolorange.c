@@ -890,6 +890,11 @@ gwy_tool_color_range_update_histogram(GwyToolColorRange *tool)
 {
     GwyPlainTool *plain_tool;
     GwyGraphCurveModel *cmodel;
+    GwyDataField *dfield;
+    const guint *bins;
+    gdouble *d;
+    gdouble min, max, s, c, t, prev;
+    guint i, k, n, nbins, nstats;
 
     plain_tool = GWY_PLAIN_TOOL(tool);
     cmodel = gwy_graph_model_get_curve(tool->histogram_model, 0);
@@ -900,7 +905,33 @@ gwy_tool_color_range_update_histogram(GwyToolColorRange *tool)
         return;
     }
 
-    gwy_data_field_dh(plain_tool->data_field, tool->heightdist, 0);
+    /* Resample the histogram cached in the data field instead of scanning
+     * the data again.  The curve is only for orientation so linear
+     * interpolation of the cumulative counts is good enough. */
+    dfield = plain_tool->data_field;
+    bins = gwy_data_field_get_value_histogram(dfield, &nbins, &min, &max);
+    if (min == max)
+        gwy_data_field_dh(dfield, tool->heightdist, 0);
+    else {
+        n = dfield->xres*dfield->yres;
+        nstats = GWY_ROUND(3.49*cbrt(n));
+        nstats = MIN(nstats, nbins);
+        nstats = MAX(nstats, 2);
+        gwy_data_line_resample(tool->heightdist, nstats,
+                               GWY_INTERPOLATION_NONE);
+        gwy_data_line_set_real(tool->heightdist, max - min);
+        gwy_data_line_set_offset(tool->heightdist, min);
+        d = gwy_data_line_get_data(tool->heightdist);
+        s = prev = 0.0;
+        for (i = k = 0; i < nstats; i++) {
+            t = (i + 1.0)*nbins/nstats;
+            while (k < nbins && k + 1 <= t)
+                s += bins[k++];
+            c = (k < nbins) ? s + (t - k)*bins[k] : s;
+            d[i] = (c - prev)*nstats/(n*(max - min));
+            prev = c;
+        }
+    }
     /* rescale to sqrt to make more readable  */
     gwy_data_line_sqrt(tool->heightdist);
 
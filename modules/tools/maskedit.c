@@ -163,6 +163,12 @@ static void  gwy_tool_mask_editor_bucket_fill           (GwyToolMaskEditor *tool
 static void  gwy_tool_mask_editor_selection_changed     (GwyPlainTool *plain_tool,
                                                          gint hint);
 static void  gwy_tool_mask_editor_save_args             (GwyToolMaskEditor *tool);
+static void  mask_changed_around                        (GwyDataField *mfield,
+                                                         gint x1,
+                                                         gint y1,
+                                                         gint x2,
+                                                         gint y2,
+                                                         gdouble r);
 
 static GwyModuleInfo module_info = {
     GWY_MODULE_ABI_VERSION,
@@ -1371,7 +1377,7 @@ gwy_tool_mask_editor_selection_changed(GwyPlainTool *plain_tool,
     gint xres, yres;
     gdouble sel[2];
     gdouble fillvalue, r;
-    gint isel[2];
+    gint isel[2], oldisel[2];
 
     tool = GWY_TOOL_MASK_EDITOR(plain_tool);
     if (tool->in_setup || tool->args.style != MASK_EDIT_STYLE_DRAWING)
@@ -1405,10 +1411,15 @@ gwy_tool_mask_editor_selection_changed(GwyPlainTool *plain_tool,
             gwy_app_undo_qcheckpointv(plain_tool->container, 1, &quark);
             gwy_data_field_circular_area_fill(mfield, isel[0], isel[1],
                                               r, fillvalue);
+            oldisel[0] = isel[0];
+            oldisel[1] = isel[1];
         }
         else {
             gint xy[4];
 
+            oldisel[0] = tool->oldisel[0];
+            oldisel[1] = tool->oldisel[1];
+
             xy[0] = tool->oldisel[0];
             xy[1] = tool->oldisel[1];
             xy[2] = isel[0];
@@ -1422,13 +1433,34 @@ gwy_tool_mask_editor_selection_changed(GwyPlainTool *plain_tool,
             gwy_data_field_paint_wide_line(mfield, xy[0], xy[1], xy[2], xy[3],
                                            r, fillvalue);
         }
-        gwy_data_field_data_changed(mfield);
+        mask_changed_around(mfield, oldisel[0], oldisel[1], isel[0], isel[1],
+                            r);
         tool->oldisel[0] = isel[0];
         tool->oldisel[1] = isel[1];
         tool->drawing_started = TRUE;
     }
 }
 
+/* Notifies about a mask change limited to the neighbourhood of a stroke, so
+ * the data window can redraw just this part while painting. */
+static void
+mask_changed_around(GwyDataField *mfield,
+                    gint x1, gint y1, gint x2, gint y2,
+                    gdouble r)
+{
+    gint xres, yres, m, xmin, ymin, xmax, ymax;
+
+    xres = gwy_data_field_get_xres(mfield);
+    yres = gwy_data_field_get_yres(mfield);
+    m = (gint)ceil(r) + 1;
+    xmin = MAX(MIN(x1, x2) - m, 0);
+    ymin = MAX(MIN(y1, y2) - m, 0);
+    xmax = MIN(MAX(x1, x2) + m + 1, xres);
+    ymax = MIN(MAX(y1, y2) + m + 1, yres);
+    gwy_data_field_data_changed_area(mfield, xmin, ymin,
+                                     xmax - xmin, ymax - ymin);
+}
+
 static void
 gwy_tool_mask_editor_save_args(GwyToolMaskEditor *tool)
 {
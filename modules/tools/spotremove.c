@@ -647,7 +647,10 @@ gwy_tool_spot_remover_apply(GwyToolSpotRemover *tool)
     method_functions[tool->args.method](plain_tool->data_field,
                                         tool->zisel[0], tool->zisel[1],
                                         tool->zisel[2], tool->zisel[3]);
-    gwy_data_field_data_changed(plain_tool->data_field);
+    gwy_data_field_data_changed_area(plain_tool->data_field,
+                                     tool->zisel[0], tool->zisel[1],
+                                     tool->zisel[2] - tool->zisel[0],
+                                     tool->zisel[3] - tool->zisel[1]);
     gwy_tool_spot_remover_save_args(tool);
     gwy_plain_tool_log_add(plain_tool);
 }
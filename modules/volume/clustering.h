@@ -0,0 +1,312 @@
+/*
+ *  @(#) $Id$
+ *  Copyright (C) 2016 David Necas (Yeti).
+ *  E-mail: yeti@gwyddion.net.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GWY_VOLUME_CLUSTERING_H__
+#define __GWY_VOLUME_CLUSTERING_H__
+
+#include <string.h>
+#include <libgwyddion/gwymacros.h>
+#include <libgwyddion/gwymath.h>
+#include <libgwyddion/gwyomp.h>
+
+/* Common machinery of k-means-like clustering of volume data curves.
+ *
+ * The data are @n vectors of length @dim stored contiguously, as given by
+ * gwy_brick_get_data_zmajor().  Points are assigned to the closest centre in
+ * the Euclidean metric.  The assignment keeps Hamerly's bounds for each
+ * point: an upper bound of the distance to its own centre and a lower bound
+ * of the distance to any other centre.  They are updated using how far the
+ * centres moved and once the clustering starts to settle most points are
+ * proved to stay in their cluster without calculating any distance. */
+
+typedef struct {
+    const gdouble *data;
+    guint n;
+    guint dim;
+    guint k;
+    gdouble *centers;
+    guint *assignment;
+    gdouble *upper;
+    gdouble *lower;
+    gdouble *shift;
+    gdouble *halfsep;
+    gboolean have_bounds;
+} ClusterState;
+
+static inline gdouble
+cluster_distance2(const gdouble *x, const gdouble *y, guint dim)
+{
+    gdouble s = 0.0, d;
+    guint l;
+
+    for (l = 0; l < dim; l++) {
+        d = x[l] - y[l];
+        s += d*d;
+    }
+    return s;
+}
+
+/* Finds the closest and second closest centre to @x. */
+static inline guint
+cluster_nearest(const gdouble *x, const gdouble *centers, guint k, guint dim,
+                gdouble *dist1, gdouble *dist2)
+{
+    gdouble d, d1 = G_MAXDOUBLE, d2 = G_MAXDOUBLE;
+    guint c, a = 0;
+
+    for (c = 0; c < k; c++) {
+        d = cluster_distance2(x, centers + (gsize)c*dim, dim);
+        if (d < d1) {
+            d2 = d1;
+            d1 = d;
+            a = c;
+        }
+        else if (d < d2)
+            d2 = d;
+    }
+    *dist1 = sqrt(d1);
+    *dist2 = (d2 == G_MAXDOUBLE) ? G_MAXDOUBLE : sqrt(d2);
+    return a;
+}
+
+G_GNUC_UNUSED
+static void
+cluster_state_init(ClusterState *state,
+                   const gdouble *data, guint n, guint dim, guint k)
+{
+    gwy_clear(state, 1);
+    state->data = data;
+    state->n = n;
+    state->dim = dim;
+    state->k = k;
+    state->centers = g_new0(gdouble, (gsize)k*dim);
+    state->assignment = g_new0(guint, n);
+    state->upper = g_new(gdouble, n);
+    state->lower = g_new(gdouble, n);
+    state->shift = g_new0(gdouble, k);
+    state->halfsep = g_new(gdouble, k);
+}
+
+G_GNUC_UNUSED
+static void
+cluster_state_free(ClusterState *state)
+{
+    g_free(state->centers);
+    g_free(state->assignment);
+    g_free(state->upper);
+    g_free(state->lower);
+    g_free(state->shift);
+    g_free(state->halfsep);
+}
+
+/* Chooses initial centres using k-means++, i.e. each new centre is a random
+ * point chosen with probability proportional to the squared distance to the
+ * closest already chosen centre. */
+G_GNUC_UNUSED
+static void
+cluster_seed_plusplus(ClusterState *state, GRand *rng)
+{
+    const gdouble *data = state->data;
+    gdouble *centers = state->centers;
+    guint n = state->n, dim = state->dim, k = state->k;
+    gdouble *mind2 = g_new(gdouble, n);
+    const gdouble *center;
+    gdouble total, r;
+    guint c, i;
+
+    i = g_rand_int_range(rng, 0, n);
+    memcpy(centers, data + (gsize)i*dim, dim*sizeof(gdouble));
+    for (c = 1; c < k; c++) {
+        center = centers + (gsize)(c-1)*dim;
+        total = 0.0;
+#ifdef _OPENMP
+#pragma omp parallel if(gwy_omp_use_threads((gsize)n*dim)) \
+            default(none) \
+            shared(data,mind2,center,n,dim,c) \
+            reduction(+:total)
+#endif
+        {
+            guint jfrom = gwy_omp_chunk_start(n), jto = gwy_omp_chunk_end(n);
+            guint j;
+            gdouble d;
+
+            for (j = jfrom; j < jto; j++) {
+                d = cluster_distance2(data + (gsize)j*dim, center, dim);
+                if (c == 1 || d < mind2[j])
+                    mind2[j] = d;
+                total += mind2[j];
+            }
+        }
+
+        r = g_rand_double(rng)*total;
+        for (i = 0; i < n-1 && r >= mind2[i]; i++)
+            r -= mind2[i];
+        memcpy(centers + (gsize)c*dim, data + (gsize)i*dim,
+               dim*sizeof(gdouble));
+    }
+
+    g_free(mind2);
+    state->have_bounds = FALSE;
+}
+
+/* Replaces the centres with @newcenters, remembering how far they moved. */
+G_GNUC_UNUSED
+static void
+cluster_move_centers(ClusterState *state, const gdouble *newcenters)
+{
+    guint c, dim = state->dim;
+    gdouble *center;
+
+    for (c = 0; c < state->k; c++) {
+        center = state->centers + (gsize)c*dim;
+        state->shift[c] += sqrt(cluster_distance2(center,
+                                                  newcenters + (gsize)c*dim,
+                                                  dim));
+        memcpy(center, newcenters + (gsize)c*dim, dim*sizeof(gdouble));
+    }
+}
+
+/* Assigns all points to the closest centres.  Returns the number of points
+ * which changed cluster. */
+G_GNUC_UNUSED
+static guint
+cluster_assign(ClusterState *state)
+{
+    const gdouble *data = state->data, *centers = state->centers;
+    guint *assignment = state->assignment;
+    gdouble *upper = state->upper, *lower = state->lower;
+    const gdouble *shift = state->shift, *halfsep = state->halfsep;
+    guint n = state->n, dim = state->dim, k = state->k;
+    gboolean have_bounds = state->have_bounds;
+    gdouble shift1 = 0.0, shift2 = 0.0, d;
+    guint c, cc, cmax = 0, changed = 0;
+
+    /* A point closer to its centre than half the distance to the nearest
+     * other centre cannot be closer to any other centre. */
+    for (c = 0; c < k; c++) {
+        state->halfsep[c] = G_MAXDOUBLE;
+        for (cc = 0; cc < k; cc++) {
+            if (cc == c)
+                continue;
+            d = 0.5*sqrt(cluster_distance2(centers + (gsize)c*dim,
+                                           centers + (gsize)cc*dim, dim));
+            state->halfsep[c] = MIN(state->halfsep[c], d);
+        }
+        if (shift[c] > shift1) {
+            shift2 = shift1;
+            shift1 = shift[c];
+            cmax = c;
+        }
+        else if (shift[c] > shift2)
+            shift2 = shift[c];
+    }
+
+#ifdef _OPENMP
+#pragma omp parallel if(gwy_omp_use_threads((gsize)n*k*dim)) \
+            default(none) \
+            shared(data,centers,assignment,upper,lower,shift,halfsep) \
+            shared(n,dim,k,have_bounds,shift1,shift2,cmax) \
+            reduction(+:changed)
+#endif
+    {
+        guint ifrom = gwy_omp_chunk_start(n), ito = gwy_omp_chunk_end(n);
+        guint i, a, anew;
+        const gdouble *x;
+        gdouble u, l, m;
+
+        for (i = ifrom; i < ito; i++) {
+            x = data + (gsize)i*dim;
+            a = assignment[i];
+            if (have_bounds) {
+                u = upper[i] + shift[a];
+                l = lower[i] - (a == cmax ? shift2 : shift1);
+                m = MAX(halfsep[a], l);
+                if (u <= m) {
+                    upper[i] = u;
+                    lower[i] = l;
+                    continue;
+                }
+                u = sqrt(cluster_distance2(x, centers + (gsize)a*dim, dim));
+                if (u <= m) {
+                    upper[i] = u;
+                    lower[i] = l;
+                    continue;
+                }
+            }
+            anew = cluster_nearest(x, centers, k, dim, upper + i, lower + i);
+            if (anew != a || !have_bounds) {
+                assignment[i] = anew;
+                changed++;
+            }
+        }
+    }
+
+    gwy_clear(state->shift, k);
+    state->have_bounds = TRUE;
+
+    return changed;
+}
+
+/* Calculates exact distances of all points to their centres. */
+G_GNUC_UNUSED
+static void
+cluster_own_distances(const ClusterState *state, gdouble *dist)
+{
+    const gdouble *data = state->data, *centers = state->centers;
+    const guint *assignment = state->assignment;
+    guint n = state->n, dim = state->dim;
+
+#ifdef _OPENMP
+#pragma omp parallel if(gwy_omp_use_threads((gsize)n*dim)) \
+            default(none) \
+            shared(data,centers,assignment,dist,n,dim)
+#endif
+    {
+        guint ifrom = gwy_omp_chunk_start(n), ito = gwy_omp_chunk_end(n);
+        guint i;
+
+        for (i = ifrom; i < ito; i++) {
+            dist[i] = sqrt(cluster_distance2(data + (gsize)i*dim,
+                                             centers
+                                             + (gsize)assignment[i]*dim,
+                                             dim));
+        }
+    }
+}
+
+/* Checks if any centre coordinate changed by more than @epsilon. */
+G_GNUC_UNUSED
+static gboolean
+cluster_centers_moved(const gdouble *centers, const gdouble *newcenters,
+                      guint k, guint dim, gdouble epsilon)
+{
+    gsize i;
+
+    for (i = 0; i < (gsize)k*dim; i++) {
+        if (fabs(centers[i] - newcenters[i]) > epsilon)
+            return TRUE;
+    }
+    return FALSE;
+}
+
+#endif
+
+/* vim: set cin et ts=4 sw=4 cino=>1s,e0,n0,f0,{0,}0,^0,\:1s,=0,g1s,h0,t0,+1s,c3,(0,u0 : */
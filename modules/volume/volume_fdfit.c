@@ -25,6 +25,7 @@
 #include <gtk/gtk.h>
 #include <libgwyddion/gwymacros.h>
 #include <libgwyddion/gwymath.h>
+#include <libgwyddion/gwyomp.h>
 #include <libgwyddion/gwyfdcurvepreset.h>
 #include <libprocess/gwyprocess.h>
 #include <libgwydgets/gwygraph.h>
@@ -43,6 +44,13 @@
 
 #define VOLFIT_RUN_MODES (GWY_RUN_IMMEDIATE | GWY_RUN_INTERACTIVE)
 
+/* Number of pixels fitted between progress and preview updates. */
+#define FIT_BATCH_PIXELS 1024
+
+/* Rough number of function evaluations per data point and parameter in one
+ * fit, for the estimate of parallel work. */
+#define FIT_WORK_FACTOR 20
+
 enum {
         PREVIEW_SIZE = 400
 };
@@ -76,6 +84,7 @@ typedef struct {
     gboolean is_volfitted;
     gboolean auto_estimate;
     gboolean auto_plot;
+    gboolean warm_start;
     GwyGraphModel *graph_model;
     GwyDataLine *xdata;
     GwyDataLine *ydata;
@@ -88,6 +97,24 @@ typedef struct {
     GwyContainer *data;
 } VolfitArgs;
 
+typedef struct {
+    GwyNLFitPreset *preset;
+    const gdouble *zdata;
+    const gdouble *xdata;
+    gint xres;
+    gint zres;
+    gint zfrom;
+    gint ndata;
+    gint nparams;
+    const gboolean *fixed;
+    const gdouble *init;
+    gboolean warm_start;
+    gdouble **result;
+    gdouble **eresult;
+    gdouble *cresult;
+    gdouble *chresult;
+} VolfitBatch;
+
 typedef struct {
     GtkWidget *fix;
     GtkWidget *name;
@@ -117,6 +144,7 @@ typedef struct {
     GArray *param;
     GtkWidget *auto_estimate;
     GtkWidget *auto_plot;
+    GtkWidget *warm_start;
     gboolean in_update;
     GtkObject *xpos;
     GtkObject *ypos;
@@ -140,11 +168,23 @@ static void       volfit_param_row_create      (VolfitControls *controls,
 static void       volfit_param_row_destroy     (VolfitControls *controls,
                                                 gint i);
 static void       volfit_do                    (VolfitControls *controls);
+static gint       volfit_first_level           (VolfitArgs *args);
+static gboolean   volfit_fit_pixel             (const VolfitBatch *batch,
+                                                GwyNLFitter **fitter,
+                                                gint col,
+                                                gint row,
+                                                gdouble *param,
+                                                gdouble *error);
+static void       volfit_fit_rows              (const VolfitBatch *batch,
+                                                gint rowfrom,
+                                                gint rowto);
 static void       volfit_single                (VolfitControls *controls);
 static void       auto_estimate_changed        (GtkToggleButton *check,
                                                 VolfitControls *controls);
 static void       auto_plot_changed            (GtkToggleButton *check,
                                                 VolfitControls *controls);
+static void       warm_start_changed           (GtkToggleButton *check,
+                                                VolfitControls *controls);
 static void       function_changed             (GtkComboBox *combo,
                                                 VolfitControls *controls);
 static void       range_changed                (GtkWidget *entry,
@@ -198,7 +238,7 @@ static GwyModuleInfo module_info = {
     &module_register,
     N_("Evaluate volume force-distance data"),
     "Petr Klapetek <klapetek@gwyddion.net>",
-    "1.0",
+    "1.1",
     "David Nečas (Yeti) & Petr Klapetek",
     "2013",
 };
@@ -231,6 +271,7 @@ volfit(GwyContainer *data, GwyRunType run)
 
     args.auto_estimate = TRUE;
     args.auto_plot = TRUE;
+    args.warm_start = TRUE;
     args.xdata = gwy_data_line_new(1, 1.0, FALSE);
     args.ydata = gwy_data_line_new(1, 1.0, FALSE);
     args.param = g_array_new(FALSE, TRUE, sizeof(FitParamArg));
@@ -546,6 +587,17 @@ volfit_dialog(VolfitArgs *args)
     g_signal_connect(controls.auto_plot, "toggled",
                      G_CALLBACK(auto_plot_changed), &controls);
 
+    controls.warm_start
+        = gtk_check_button_new_with_mnemonic(_("Start _fits from neighbor "
+                                               "pixels"));
+    gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(controls.warm_start),
+                                 args->warm_start);
+    gtk_table_attach(GTK_TABLE(table), controls.warm_start,
+                     0, 2, row, row+1, GTK_FILL, 0, 0, 0);
+    g_signal_connect(controls.warm_start, "toggled",
+                     G_CALLBACK(warm_start_changed), &controls);
+    row++;
+
     function_changed(GTK_COMBO_BOX(controls.function), &controls);
     graph_selected(selection, -1, &controls);
 
@@ -915,24 +967,20 @@ volfit_do(VolfitControls *controls)
     FitParamArg *arg;
     VolfitArgs *args;
     GtkWidget *dialog;
-    gdouble *param, *error, *data, max;
+    VolfitBatch batch;
+    gdouble *param, *data, max;
     gboolean *fixed;
-    gint newid, i, j, k, m, nparams, nfree = 0;
-    gboolean allfixed, errorknown;
+    gint newid, i, j, k, m, nparams, xres, yres, nrows, nfree = 0;
+    gboolean allfixed, cancelled = FALSE;
     GwyDataField **result;
     GwyDataField **eresult;
     GwyDataField *cresult, *chresult;
 
     args = controls->args;
 
-    //printf("Now fit everything\n");
-
-    gwy_app_wait_start(GTK_WINDOW(controls->dialog), "Computation in progress.");
-
     nparams = gwy_nlfit_preset_get_nparams(args->volfitfunc);
     fixed = g_newa(gboolean, nparams);
     param = g_newa(gdouble, nparams);
-    error = g_newa(gdouble, nparams);
 
     allfixed = TRUE;
     nfree = 0;
@@ -941,12 +989,31 @@ volfit_do(VolfitControls *controls)
         fixed[k] = arg->fix;
         allfixed &= fixed[k];
         arg->value = arg->init;
+        param[k] = arg->init;
         if (!fixed[k])
             nfree++;
     }
     if (allfixed)
         return;
 
+    /* The abscissa is the same for all pixels. */
+    batch.ndata = pick_and_normalize_data(args, 0, 0);
+    if (batch.ndata <= nfree) {
+        dialog = gtk_message_dialog_new(GTK_WINDOW(controls->dialog),
+                                        GTK_DIALOG_DESTROY_WITH_PARENT,
+                                        GTK_MESSAGE_ERROR,
+                                        GTK_BUTTONS_OK,
+                                        _("It is necessary to select more "
+                                          "data points than free fit "
+                                          "parameters"));
+        gtk_dialog_run(GTK_DIALOG(dialog));
+        gtk_widget_destroy(dialog);
+        return;
+    }
+
+    xres = gwy_brick_get_xres(args->brick);
+    yres = gwy_brick_get_yres(args->brick);
+
     result = g_new(GwyDataField *, nfree);
     for (i=0; i<nfree; i++) result[i] = gwy_data_field_new_alike(args->dfield, TRUE);
 
@@ -957,61 +1024,66 @@ volfit_do(VolfitControls *controls)
     chresult = gwy_data_field_new_alike(args->dfield, TRUE);
     gwy_data_field_fill(chresult, -1.0);
 
+    batch.preset = args->volfitfunc;
+    /* All z-lines are fitted, make it efficient by creating the transposed
+     * data.  Each pixel's curve is then a contiguous block. */
+    batch.zdata = gwy_brick_get_data_zmajor(args->brick);
+    batch.xdata = gwy_data_line_get_data_const(args->xdata);
+    batch.xres = xres;
+    batch.zres = gwy_brick_get_zres(args->brick);
+    batch.zfrom = volfit_first_level(args);
+    batch.nparams = nparams;
+    batch.fixed = fixed;
+    batch.init = param;
+    batch.warm_start = args->warm_start;
+    batch.result = g_new(gdouble*, nfree);
+    batch.eresult = g_new(gdouble*, nfree);
+    for (m = 0; m < nfree; m++) {
+        batch.result[m] = gwy_data_field_get_data(result[m]);
+        batch.eresult[m] = gwy_data_field_get_data(eresult[m]);
+    }
+    batch.cresult = gwy_data_field_get_data(cresult);
+    batch.chresult = gwy_data_field_get_data(chresult);
 
+    /* Show the first parameter map in the preview while it is being filled
+     * so that the user can see how the fit goes and cancel it early. */
+    gwy_container_set_object_by_name(controls->mydata, "/0/data", result[0]);
 
-    for (i=0; i<gwy_brick_get_xres(args->brick); i++)
-    {
-        for (j=0; j<gwy_brick_get_yres(args->brick); j++)
-        {
-            pick_and_normalize_data(controls->args, i, j);
-
-            for (k = 0; k < nparams; k++) {
-                arg = &g_array_index(args->param, FitParamArg, k);
-                arg->value = arg->init;
-            }
-
-            if (gwy_data_line_get_res(args->xdata) <= nfree) {
-                dialog = gtk_message_dialog_new(GTK_WINDOW(controls->dialog),
-                                                GTK_DIALOG_DESTROY_WITH_PARENT,
-                                                GTK_MESSAGE_ERROR,
-                                                GTK_BUTTONS_OK,
-                                                _("It is necessary to select more "
-                                                  "data points than free fit "
-                                                  "parameters"));
-                gtk_dialog_run(GTK_DIALOG(dialog));
-                gtk_widget_destroy(dialog);
-                return;
-            }
-
-            if (args->fitter)
-                gwy_math_nlfit_free(args->fitter);
-
-            for (k = 0; k < nparams; k++)
-                param[k] = g_array_index(args->param, FitParamArg, k).value;
-            args->fitter
-                = gwy_nlfit_preset_fit(args->volfitfunc, NULL,
-                                       gwy_data_line_get_res(args->xdata),
-                                       gwy_data_line_get_data_const(args->xdata),
-                                       gwy_data_line_get_data_const(args->ydata),
-                                       param, error, fixed);
-            errorknown = (args->fitter->covar != NULL);
-
-            m = 0;
-            for (k = 0; k < nparams; k++) {
-                if (!fixed[k]) {
-                    gwy_data_field_set_val(result[m], i, j, param[k]);
-                    gwy_data_field_set_val(eresult[m], i, j, error[k]);
-                    m++;
-                }
-            }
-            gwy_data_field_set_val(cresult, i, j, errorknown);
+    gwy_app_wait_start(GTK_WINDOW(controls->dialog),
+                       _("Fitting curves..."));
 
-            if (errorknown) gwy_data_field_set_val(chresult, i, j, gwy_math_nlfit_get_dispersion(args->fitter));
+    nrows = MAX(1, FIT_BATCH_PIXELS/xres);
+    for (j = 0; j < yres; j += nrows) {
+        volfit_fit_rows(&batch, j, MIN(j + nrows, yres));
 
+        gwy_data_field_invalidate(result[0]);
+        gwy_data_field_data_changed(result[0]);
+        if (!gwy_app_wait_set_fraction((gdouble)MIN(j + nrows, yres)/yres)) {
+            cancelled = TRUE;
+            break;
         }
-        gwy_app_wait_set_fraction((gdouble)i/gwy_brick_get_xres(args->brick));
     }
     gwy_app_wait_finish();
+    /* The z-major copy was only needed for the batch fit.  Curves shown in
+     * the dialogue are extracted one at a time, so free the memory now. */
+    gwy_brick_invalidate(args->brick);
+
+    gwy_container_set_object_by_name(controls->mydata, "/0/data",
+                                     args->dfield);
+    g_free(batch.result);
+    g_free(batch.eresult);
+
+    if (cancelled) {
+        for (m = 0; m < nfree; m++) {
+            g_object_unref(result[m]);
+            g_object_unref(eresult[m]);
+        }
+        g_object_unref(cresult);
+        g_object_unref(chresult);
+        g_free(result);
+        g_free(eresult);
+        return;
+    }
 
     m = 0;
     for (k = 0; k < nparams; k++) {
@@ -1022,28 +1094,143 @@ volfit_do(VolfitControls *controls)
             arg = &g_array_index(args->param, FitParamArg, k);
             name = gwy_nlfit_preset_get_param_name(args->volfitfunc, k);
 
+            gwy_data_field_invalidate(result[m]);
+            gwy_data_field_invalidate(eresult[m]);
+
             g_snprintf(resname, sizeof(resname), "result: %s", name);
             newid = gwy_app_data_browser_add_data_field(result[m], args->data, TRUE);
             gwy_app_set_data_field_title(args->data, newid, resname);
+            g_object_unref(result[m]);
 
             g_snprintf(resname, sizeof(resname), "error: %s", name);
             newid = gwy_app_data_browser_add_data_field(eresult[m], args->data, TRUE);
             gwy_app_set_data_field_title(args->data, newid, resname);
+            g_object_unref(eresult[m]);
             m++;
         }
     }
+    g_free(result);
+    g_free(eresult);
+
+    gwy_data_field_invalidate(cresult);
     newid = gwy_app_data_browser_add_data_field(cresult, args->data, TRUE);
     gwy_app_set_data_field_title(args->data, newid, "Fit OK");
+    g_object_unref(cresult);
 
+    gwy_data_field_invalidate(chresult);
     max = gwy_data_field_get_max(chresult);
     data = gwy_data_field_get_data(chresult);
-    for (i=0; i<(gwy_brick_get_xres(args->brick)*gwy_brick_get_yres(args->brick)); i++)
+    for (i=0; i<xres*yres; i++)
         if (data[i]==-1) data[i] = max;
 
     newid = gwy_app_data_browser_add_data_field(chresult, args->data, TRUE);
     gwy_app_set_data_field_title(args->data, newid, "Chi sq.");
+    g_object_unref(chresult);
+}
+
+/* Finds the first brick level inside the fitted range, matching
+ * pick_and_normalize_data(). */
+static gint
+volfit_first_level(VolfitArgs *args)
+{
+    gint i, ns;
+    gdouble ratio;
+
+    ns = gwy_brick_get_zres(args->brick);
+    ratio = gwy_brick_get_zreal(args->brick)/(gdouble)ns;
+    if (args->from == args->to)
+        return 0;
+
+    for (i = 0; i < ns; i++) {
+        if (i*ratio >= args->from && i*ratio <= args->to)
+            return i;
+    }
+    return 0;
+}
+
+/* Fits the curve of pixel (@col, @row), starting from @param.  On return,
+ * @param contains the fitted parameters. */
+static gboolean
+volfit_fit_pixel(const VolfitBatch *batch, GwyNLFitter **fitter,
+                 gint col, gint row, gdouble *param, gdouble *error)
+{
+    const gdouble *ydata;
+    gint k, m, n;
+    gboolean ok;
+
+    ydata = batch->zdata + ((gsize)row*batch->xres + col)*batch->zres
+            + batch->zfrom;
+    *fitter = gwy_nlfit_preset_fit(batch->preset, *fitter,
+                                   batch->ndata, batch->xdata, ydata,
+                                   param, error, batch->fixed);
+    ok = ((*fitter)->covar != NULL);
+
+    n = row*batch->xres + col;
+    m = 0;
+    for (k = 0; k < batch->nparams; k++) {
+        if (!batch->fixed[k]) {
+            batch->result[m][n] = param[k];
+            batch->eresult[m][n] = ok ? error[k] : 0.0;
+            m++;
+        }
+    }
+    batch->cresult[n] = ok;
+    batch->chresult[n] = ok ? gwy_math_nlfit_get_dispersion(*fitter) : -1.0;
 
+    return ok;
+}
 
+/* Fits all pixels in rows [@rowfrom, @rowto).  Each thread takes the same
+ * range of columns in all rows, so the warm start from the pixel in the
+ * previous row does not depend on other threads and the results do not
+ * depend on the number of threads. */
+static void
+volfit_fit_rows(const VolfitBatch *batch, gint rowfrom, gint rowto)
+{
+    gint xres = batch->xres;
+
+#ifdef _OPENMP
+#pragma omp parallel if(gwy_omp_use_threads((gsize)(rowto - rowfrom)*xres \
+                                            *batch->ndata*batch->nparams \
+                                            *FIT_WORK_FACTOR)) \
+            default(none) \
+            shared(batch,rowfrom,rowto,xres)
+#endif
+    {
+        GwyNLFitter *fitter = NULL;
+        gint ifrom = gwy_omp_chunk_start(xres), ito = gwy_omp_chunk_end(xres);
+        gint nparams = batch->nparams;
+        gdouble *param = g_new(gdouble, nparams);
+        gdouble *error = g_new(gdouble, nparams);
+        gint i, j, k, m, nabove;
+        gboolean warm;
+
+        for (j = rowfrom; j < rowto; j++) {
+            for (i = ifrom; i < ito; i++) {
+                nabove = (j - 1)*xres + i;
+                warm = (batch->warm_start && j > 0 && batch->cresult[nabove]);
+                m = 0;
+                for (k = 0; k < nparams; k++) {
+                    if (warm && !batch->fixed[k])
+                        param[k] = batch->result[m++][nabove];
+                    else
+                        param[k] = batch->init[k];
+                }
+                if (volfit_fit_pixel(batch, &fitter, i, j, param, error)
+                    || !warm)
+                    continue;
+
+                /* The neighbour was not a good starting point after all. */
+                memcpy(param, batch->init, nparams*sizeof(gdouble));
+                volfit_fit_pixel(batch, &fitter, i, j, param, error);
+            }
+        }
+
+        if (fitter)
+            gwy_math_nlfit_free(fitter);
+        g_free(error);
+        g_free(param);
+    }
 }
 
 static void
@@ -1158,6 +1345,13 @@ auto_plot_changed(GtkToggleButton *check,
         volfit_plot_curve(controls->args);
 }
 
+static void
+warm_start_changed(GtkToggleButton *check,
+                   VolfitControls *controls)
+{
+    controls->args->warm_start = gtk_toggle_button_get_active(check);
+}
+
 static void
 function_changed(GtkComboBox *combo, VolfitControls *controls)
 {
@@ -1645,6 +1839,7 @@ pick_and_normalize_data(VolfitArgs *args, gint xpos, gint ypos)
 static const gchar preset_key[]        = "/module/graph_volfit/preset";
 static const gchar auto_estimate_key[] = "/module/graph_volfit/auto_estimate";
 static const gchar auto_plot_key[]     = "/module/graph_volfit/auto_plot";
+static const gchar warm_start_key[]    = "/module/graph_volfit/warm_start";
 
 static void
 load_args(GwyContainer *container,
@@ -1662,6 +1857,8 @@ load_args(GwyContainer *container,
                                       &args->auto_estimate);
     gwy_container_gis_boolean_by_name(container, auto_plot_key,
                                       &args->auto_plot);
+    gwy_container_gis_boolean_by_name(container, warm_start_key,
+                                      &args->warm_start);
 }
 
 static void
@@ -1678,6 +1875,8 @@ save_args(GwyContainer *container,
                                       args->auto_estimate);
     gwy_container_set_boolean_by_name(container, auto_plot_key,
                                       args->auto_plot);
+    gwy_container_set_boolean_by_name(container, warm_start_key,
+                                      args->warm_start);
 }
 
 /************************* volfit report *****************************/
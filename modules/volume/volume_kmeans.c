@@ -34,6 +34,7 @@
 #include <libgwydgets/gwydgets.h>
 #include <libgwymodule/gwymodule-volume.h>
 #include <app/gwyapp.h>
+#include "clustering.h"
 
 #define KMEANS_RUN_MODES (GWY_RUN_IMMEDIATE | GWY_RUN_INTERACTIVE)
 
@@ -48,6 +49,8 @@ typedef struct {
     gboolean normalize;  /* normalize brick before K-means run */
     gboolean remove_outliers;
     gdouble outliers_threshold;
+    gboolean minibatch;
+    gint batch_size;
 } KMeansArgs;
 
 typedef struct {
@@ -58,6 +61,8 @@ typedef struct {
     GtkWidget *normalize;
     GtkWidget *remove_outliers;
     GtkObject *outliers_threshold;
+    GtkWidget *minibatch;
+    GtkObject *batch_size;
 } KMeansControls;
 
 static gboolean  module_register     (void);
@@ -66,6 +71,7 @@ static void      volume_kmeans       (GwyContainer *data,
 static void      kmeans_dialog       (GwyContainer *data,
                                       KMeansArgs *args);
 static void  remove_outliers_toggled (KMeansControls *controls);
+static void      minibatch_toggled   (KMeansControls *controls);
 static void      kmeans_dialog_update(KMeansControls *controls,
                                       KMeansArgs *args);
 static void      kmeans_values_update(KMeansControls *controls,
@@ -74,6 +80,20 @@ static GwyBrick* normalize_brick     (GwyBrick *brick,
                                       GwyDataField *intfield);
 static void      volume_kmeans_do    (GwyContainer *data,
                                       KMeansArgs *args);
+static void      kmeans_update_centers(const ClusterState *state,
+                                       const gdouble *dist,
+                                       const gdouble *variance,
+                                       gdouble threshold,
+                                       gdouble *newcenters);
+static void      kmeans_cluster_rms  (const ClusterState *state,
+                                      const gdouble *dist,
+                                      gdouble *variance);
+static gboolean  kmeans_minibatch    (ClusterState *state,
+                                      GRand *rng,
+                                      gint batch_size,
+                                      gint max_iterations,
+                                      gdouble epsilon,
+                                      gint *iterations);
 static void      kmeans_load_args    (GwyContainer *container,
                                       KMeansArgs *args);
 static void      kmeans_save_args    (GwyContainer *container,
@@ -85,7 +105,9 @@ static const KMeansArgs kmeans_defaults = {
     100,
     FALSE,
     FALSE,
-    3.0
+    3.0,
+    FALSE,
+    10000,
 };
 
 static GwyModuleInfo module_info = {
@@ -93,7 +115,7 @@ static GwyModuleInfo module_info = {
     &module_register,
     N_("Calculates K-means clustering on volume data."),
     "Daniil Bratashov <dn2010@gmail.com> & Evgeniy Ryabov <k1u2r3ka@mail.ru>",
-    "1.4",
+    "1.5",
     "David Nečas (Yeti) & Petr Klapetek & Daniil Bratashov & Evgeniy Ryabov",
     "2014",
 };
@@ -158,7 +180,7 @@ kmeans_dialog(GwyContainer *data, KMeansArgs *args)
     gtk_dialog_set_default_response(GTK_DIALOG(dialog), GTK_RESPONSE_OK);
     gwy_help_add_to_volume_dialog(GTK_DIALOG(dialog), GWY_HELP_DEFAULT);
 
-    table = gtk_table_new(6, 4, FALSE);
+    table = gtk_table_new(8, 4, FALSE);
     gtk_table_set_row_spacings(GTK_TABLE(table), 2);
     gtk_table_set_col_spacings(GTK_TABLE(table), 6);
     gtk_container_set_border_width(GTK_CONTAINER(table), 4);
@@ -212,6 +234,22 @@ kmeans_dialog(GwyContainer *data, KMeansArgs *args)
                                    gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(controls.remove_outliers)));
     row++;
 
+    controls.minibatch
+        = gtk_check_button_new_with_mnemonic(_("Mini-_batch iteration"));
+    gtk_table_attach_defaults(GTK_TABLE(table), controls.minibatch,
+                              0, 3, row, row+1);
+    g_signal_connect_swapped(controls.minibatch, "toggled",
+                             G_CALLBACK(minibatch_toggled), &controls);
+    row++;
+
+    controls.batch_size = gtk_adjustment_new(args->batch_size,
+                                             100, 1000000, 100, 1000, 0);
+    gwy_table_attach_hscale(table, row,
+                            _("Batch _size:"), NULL,
+                            controls.batch_size, GWY_HSCALE_LOG);
+    gwy_table_hscale_set_sensitive(controls.batch_size, args->minibatch);
+    row++;
+
     kmeans_dialog_update(&controls, args);
     gtk_widget_show_all(dialog);
 
@@ -251,6 +289,13 @@ static void remove_outliers_toggled (KMeansControls *controls)
                                    gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(controls->remove_outliers)));
 }
 
+static void
+minibatch_toggled(KMeansControls *controls)
+{
+    gwy_table_hscale_set_sensitive(controls->batch_size,
+                                   gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(controls->minibatch)));
+}
+
 /* XXX: Duplicate with volume_kmedians.c */
 static GwyBrick*
 normalize_brick(GwyBrick *brick, GwyDataField *intfield)
@@ -328,6 +373,8 @@ kmeans_values_update(KMeansControls *controls,
     args->normalize = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(controls->normalize));
     args->remove_outliers = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(controls->remove_outliers));
     args->outliers_threshold = gtk_adjustment_get_value(GTK_ADJUSTMENT(controls->outliers_threshold));
+    args->minibatch = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(controls->minibatch));
+    args->batch_size = gwy_adjustment_get_int(GTK_ADJUSTMENT(controls->batch_size));
 }
 
 static void
@@ -345,6 +392,10 @@ kmeans_dialog_update(KMeansControls *controls,
                                  args->remove_outliers);
     gtk_adjustment_set_value(GTK_ADJUSTMENT(controls->outliers_threshold),
                              args->outliers_threshold);
+    gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(controls->minibatch),
+                                 args->minibatch);
+    gtk_adjustment_set_value(GTK_ADJUSTMENT(controls->batch_size),
+                             args->batch_size);
 }
 
 static void
@@ -356,17 +407,20 @@ volume_kmeans_do(GwyContainer *container, KMeansArgs *args)
     GwyGraphModel *gmodel;
     GwyDataLine *calibration = NULL;
     GwySIUnit *siunit;
+    GwyContainer *meta;
     const GwyRGBA *rgba;
     gint id;
     gchar *description;
     GRand *rand;
+    GTimer *timer;
+    ClusterState state;
     const gdouble *data;
-    gdouble *centers, *oldcenters, *sum, *data1, *xdata, *ydata;
-    gdouble *variance, *errordata;
-    gdouble min, dist, xreal, yreal, zreal, xoffset, yoffset, zoffset;
+    gdouble *centers, *newcenters = NULL, *data1, *xdata, *ydata;
+    gdouble *variance = NULL, *errordata, *dist = NULL;
+    gdouble xreal, yreal, zreal, xoffset, yoffset, zoffset, time;
     gdouble epsilon = args->epsilon;
-    gint xres, yres, zres, i, j, l, c, newid;
-    gint *npix;
+    gint xres, yres, zres, i, c, newid;
+    guint n;
     gint k = args->k;
     gint iterations = 0;
     gint max_iterations = args->max_iterations;
@@ -387,6 +441,7 @@ volume_kmeans_do(GwyContainer *container, KMeansArgs *args)
     xoffset = gwy_brick_get_xoffset(brick);
     yoffset = gwy_brick_get_yoffset(brick);
     zoffset = gwy_brick_get_zoffset(brick);
+    n = xres*yres;
 
     dfield = gwy_data_field_new(xres, yres, xreal, yreal, TRUE);
     gwy_data_field_set_xoffset(dfield, xoffset);
@@ -401,103 +456,58 @@ volume_kmeans_do(GwyContainer *container, KMeansArgs *args)
 
     gwy_app_wait_start(gwy_app_find_window_for_volume(container, id),
                        _("Initializing..."));
+    timer = g_timer_new();
 
+    /* All the clustering works with whole z-lines. */
     if (normalize) {
         normalized = normalize_brick(brick, intmap);
-        data = gwy_brick_get_data_const(normalized);
+        data = gwy_brick_get_data_zmajor(normalized);
     }
     else {
-        data = gwy_brick_get_data_const(brick);
+        data = gwy_brick_get_data_zmajor(brick);
     }
 
-    centers = g_new(gdouble, zres*k);
-    oldcenters = g_new(gdouble, zres*k);
-    sum = g_new(gdouble, zres*k);
-    npix = g_new(gint, k);
+    cluster_state_init(&state, data, n, zres, k);
+    centers = state.centers;
+    newcenters = g_new(gdouble, zres*k);
+    dist = g_new(gdouble, n);
     variance = g_new(gdouble, k);
     data1 = gwy_data_field_get_data(dfield);
 
     rand = g_rand_new();
-    for (c = 0; c < k; c++) {
-        i = g_rand_int_range(rand, 0, xres);
-        j = g_rand_int_range(rand, 0, yres);
-        for (l = 0; l < zres; l++) {
-            *(centers + c * zres + l)
-                             = *(data + l * xres * yres + j * xres + i);
-        };
-    };
-    g_rand_free(rand);
+    cluster_seed_plusplus(&state, rand);
 
     if (!gwy_app_wait_set_message(_("K-means iteration...")))
         cancelled = TRUE;
 
-    while (!converged && !cancelled) {
-        if (!gwy_app_wait_set_fraction((gdouble)iterations/max_iterations)) {
-            cancelled = TRUE;
-            break;
-        }
-
-        /* pixels belong to cluster with min distance */
-        for (j = 0; j < yres; j++)
-            for (i = 0; i < xres; i++) {
-                *(data1 + j * xres + i) = 0;
-                min = G_MAXDOUBLE;
-                for (c = 0; c < k; c++) {
-                    dist = 0;
-                    for (l = 0; l < zres; l++) {
-                        *(oldcenters + c * zres + l)
-                                            = *(centers + c * zres + l);
-                        dist
-                            += (*(data + l * xres * yres + j * xres + i)
-                              - *(centers + c * zres + l))
-                             * (*(data + l * xres * yres + j * xres + i)
-                              - *(centers + c * zres + l));
-                    }
-                    if (dist < min) {
-                        min = dist;
-                        *(data1 + j * xres + i) = c;
-                    }
-                }
+    if (args->minibatch && !cancelled) {
+        cancelled = !kmeans_minibatch(&state, rand, args->batch_size,
+                                      max_iterations, epsilon, &iterations);
+    }
+    else {
+        while (!converged && !cancelled) {
+            if (!gwy_app_wait_set_fraction((gdouble)iterations
+                                           /max_iterations)) {
+                cancelled = TRUE;
+                break;
             }
 
-        /* new center coordinates as average of pixels */
-        for (c = 0; c < k; c++) {
-            *(npix + c) = 0;
-            for (l = 0; l < zres; l++) {
-                *(sum + c * zres + l) = 0;
-            }
-        }
-        for (i = 0; i < xres; i++) {
-            for (j = 0; j < yres; j++) {
-                c = (gint)(*(data1 + j * xres + i));
-                *(npix + c) += 1;
-                for (l = 0; l < zres; l++) {
-                    *(sum + c * zres + l)
-                            += *(data + l * xres * yres + j * xres + i);
-                }
-            }
-        }
-        for (c = 0; c < k; c++)
-            for (l = 0; l < zres; l++) {
-                *(centers + c * zres + l) = (*(npix + c) > 0) ?
-                     *(sum + c * zres + l)/(gdouble)(*(npix + c)) : 0.0;
-        }
+            /* pixels belong to cluster with min distance */
+            cluster_assign(&state);
 
-        converged = TRUE;
-        for (c = 0; c < k; c++) {
-            for (l = 0; l < zres; l++)
-                if (fabs(*(oldcenters + c * zres + l)
-                               - *(centers + c * zres + l)) > epsilon) {
-                    converged = FALSE;
-                    break;
-                }
-        }
-        if (iterations == max_iterations) {
-            converged = TRUE;
-            break;
+            /* new center coordinates as average of pixels */
+            kmeans_update_centers(&state, NULL, NULL, 0.0, newcenters);
+            converged = !cluster_centers_moved(centers, newcenters, k, zres,
+                                               epsilon);
+            cluster_move_centers(&state, newcenters);
+            if (iterations == max_iterations) {
+                converged = TRUE;
+                break;
+            }
+            iterations++;
         }
-        iterations++;
     }
+    g_rand_free(rand);
 
     if (cancelled) {
         gwy_app_wait_finish();
@@ -508,105 +518,25 @@ volume_kmeans_do(GwyContainer *container, KMeansArgs *args)
     if (args->remove_outliers) {
         converged = FALSE;
         while (!converged && !cancelled) {
-            if (!gwy_app_wait_set_fraction((gdouble)iterations/max_iterations)) {
+            if (!gwy_app_wait_set_fraction((gdouble)iterations
+                                           /max_iterations)) {
                 cancelled = TRUE;
                 break;
             }
 
             /* pixels belong to cluster with min distance */
-            for (j = 0; j < yres; j++)
-                for (i = 0; i < xres; i++) {
-                    *(data1 + j * xres + i) = 0;
-                    min = G_MAXDOUBLE;
-                    for (c = 0; c < k; c++) {
-                        dist = 0;
-                        for (l = 0; l < zres; l++) {
-                            *(oldcenters + c * zres + l)
-                                            = *(centers + c * zres + l);
-                            dist
-                            += (*(data + l * xres * yres + j * xres + i)
-                                            - *(centers + c * zres + l))
-                             * (*(data + l * xres * yres + j * xres + i)
-                                           - *(centers + c * zres + l));
-                        }
-                        if (dist < min) {
-                            min = dist;
-                            *(data1 + j * xres + i) = c;
-                        }
-                    }
-                }
+            cluster_assign(&state);
+            cluster_own_distances(&state, dist);
 
             /* variance calculation */
-            for (c = 0; c < k; c++) {
-                *(npix + c) = 0;
-                *(variance + c) = 0.0;
-            }
-
-            for (i = 0; i < xres; i++) {
-                for (j = 0; j < yres; j++) {
-                    c = (gint)(*(data1 + j * xres + i));
-                    *(npix + c) += 1;
-                    dist = 0;
-                    for (l = 0; l < zres; l++) {
-                        dist
-                            += (*(data + l * xres * yres + j * xres + i)
-                                            - *(centers + c * zres + l))
-                             * (*(data + l * xres * yres + j * xres + i)
-                                           - *(centers + c * zres + l));
-                    }
-                    *(variance + c) += dist;
-                }
-            }
-
-            for (c = 0; c < k; c++) {
-                if (*(npix + c) > 0) {
-                    *(variance + c) /= *(npix+c);
-                    *(variance + c) = sqrt(*(variance + c));
-                }
-            }
+            kmeans_cluster_rms(&state, dist, variance);
 
             /* new center coordinates as average of pixels */
-            for (c = 0; c < k; c++) {
-                *(npix + c) = 0;
-                for (l = 0; l < zres; l++) {
-                    *(sum + c * zres + l) = 0;
-                }
-            }
-            for (i = 0; i < xres; i++) {
-                for (j = 0; j < yres; j++) {
-                    c = (gint)(*(data1 + j * xres + i));
-                    dist = 0;
-                    for (l = 0; l < zres; l++) {
-                        dist
-                            += (*(data + l * xres * yres + j * xres + i)
-                                            - *(centers + c * zres + l))
-                             * (*(data + l * xres * yres + j * xres + i)
-                                           - *(centers + c * zres + l));
-                    }
-                    if (sqrt(dist) < args->outliers_threshold * (*(variance + c))) {
-                        *(npix + c) += 1;
-                        for (l = 0; l < zres; l++) {
-                            *(sum + c * zres + l)
-                            += *(data + l * xres * yres + j * xres + i);
-                        }
-                    }
-                }
-            }
-            for (c = 0; c < k; c++)
-                for (l = 0; l < zres; l++) {
-                    *(centers + c * zres + l) = (*(npix + c) > 0) ?
-                         *(sum + c * zres + l)/(gdouble)(*(npix + c)) : 0.0;
-            }
-
-            converged = TRUE;
-            for (c = 0; c < k; c++) {
-                for (l = 0; l < zres; l++)
-                    if (fabs(*(oldcenters + c * zres + l)
-                                   - *(centers + c * zres + l)) > epsilon) {
-                        converged = FALSE;
-                        break;
-                    }
-            }
+            kmeans_update_centers(&state, dist, variance,
+                                  args->outliers_threshold, newcenters);
+            converged = !cluster_centers_moved(centers, newcenters, k, zres,
+                                               epsilon);
+            cluster_move_centers(&state, newcenters);
             if (iterations == max_iterations) {
                 converged = TRUE;
                 break;
@@ -615,7 +545,15 @@ volume_kmeans_do(GwyContainer *container, KMeansArgs *args)
         }
     }
 
+    if (!cancelled) {
+        /* Make the assignment consistent with the final centres. */
+        cluster_assign(&state);
+        cluster_own_distances(&state, dist);
+    }
+
     gwy_app_wait_finish();
+    time = g_timer_elapsed(timer, NULL);
+    gwy_debug("k-means: %d iterations, %g s", iterations, time);
     if (cancelled)
         goto fail;
 
@@ -628,18 +566,9 @@ volume_kmeans_do(GwyContainer *container, KMeansArgs *args)
     }
     errordata = gwy_data_field_get_data(errormap);
 
-    for (i = 0; i < xres; i++) {
-        for (j = 0; j < yres; j++) {
-            dist = 0.0;
-            c = (gint)(*(data1 + j * xres + i));
-            for (l = 0; l < zres; l++) {
-                dist += (*(data + l * xres * yres + j * xres + i)
-                         - *(centers + c * zres + l))
-                    * (*(data + l * xres * yres + j * xres + i)
-                       - *(centers + c * zres + l));
-            }
-            *(errordata + j * xres + i) = sqrt(dist);
-        }
+    for (i = 0; i < n; i++) {
+        data1[i] = state.assignment[i];
+        errordata[i] = dist[i];
     }
 
     gwy_data_field_add(dfield, 1.0);
@@ -650,6 +579,20 @@ volume_kmeans_do(GwyContainer *container, KMeansArgs *args)
     gwy_app_set_data_field_title(container, newid,
                                  g_strdup_printf(_("K-means cluster of %s"),
                                                  description));
+    meta = gwy_container_new();
+    gwy_container_set_string_by_name(meta, "Method",
+                                     args->minibatch
+                                     ? g_strdup_printf("Mini-batch k-means, "
+                                                       "batch size %d",
+                                                       args->batch_size)
+                                     : g_strdup("K-means"));
+    gwy_container_set_string_by_name(meta, "Iterations",
+                                     g_strdup_printf("%d", iterations));
+    gwy_container_set_string_by_name(meta, "Computation time",
+                                     g_strdup_printf("%.3f s", time));
+    gwy_container_set_object(container,
+                             gwy_app_get_data_meta_key_for_id(newid), meta);
+    g_object_unref(meta);
     gwy_app_channel_log_add(container, -1, newid, "volume::kmeans",
                             NULL);
 
@@ -719,15 +662,185 @@ volume_kmeans_do(GwyContainer *container, KMeansArgs *args)
     gwy_app_volume_log_add_volume(container, id, id);
 
 fail:
+    /* The normalised brick is freed together with its z-major copy.  The
+     * document brick stays open, so free the copy made for it. */
+    if (!normalized)
+        gwy_brick_invalidate(brick);
+    g_timer_destroy(timer);
     gwy_object_unref(errormap);
     gwy_object_unref(intmap);
     gwy_object_unref(dfield);
     gwy_object_unref(normalized);
+    cluster_state_free(&state);
     g_free(variance);
+    g_free(dist);
+    g_free(newcenters);
+}
+
+/* Calculates new centres as averages of their points.  If @dist is given,
+ * only points closer to the centre than @threshold times the cluster rms
+ * distance @variance are used.  Empty clusters keep their previous centres. */
+static void
+kmeans_update_centers(const ClusterState *state,
+                      const gdouble *dist, const gdouble *variance,
+                      gdouble threshold, gdouble *newcenters)
+{
+    const gdouble *data = state->data;
+    const guint *assignment = state->assignment;
+    guint n = state->n, dim = state->dim, k = state->k;
+    guint *npix = g_new0(guint, k);
+    guint c, l;
+
+    gwy_clear(newcenters, (gsize)k*dim);
+#ifdef _OPENMP
+#pragma omp parallel if(gwy_omp_use_threads((gsize)n*dim)) \
+            default(none) \
+            shared(data,assignment,dist,variance,threshold,newcenters,npix) \
+            shared(n,dim,k)
+#endif
+    {
+        guint ifrom = gwy_omp_chunk_start(n), ito = gwy_omp_chunk_end(n);
+        gdouble *sum = newcenters, *s;
+        guint *cnt = npix;
+        const gdouble *x;
+        guint i, cc, j;
+
+        if (gwy_omp_num_threads() > 1) {
+            sum = g_new0(gdouble, (gsize)k*dim);
+            cnt = g_new0(guint, k);
+        }
+
+        for (i = ifrom; i < ito; i++) {
+            cc = assignment[i];
+            if (dist && !(dist[i] < threshold*variance[cc]))
+                continue;
+            x = data + (gsize)i*dim;
+            s = sum + (gsize)cc*dim;
+            for (j = 0; j < dim; j++)
+                s[j] += x[j];
+            cnt[cc]++;
+        }
+
+        if (sum != newcenters) {
+#ifdef _OPENMP
+#pragma omp critical
+#endif
+            {
+                for (j = 0; j < k*dim; j++)
+                    newcenters[j] += sum[j];
+                for (cc = 0; cc < k; cc++)
+                    npix[cc] += cnt[cc];
+            }
+            g_free(sum);
+            g_free(cnt);
+        }
+    }
+
+    for (c = 0; c < k; c++) {
+        for (l = 0; l < dim; l++) {
+            newcenters[c*dim + l] = (npix[c] > 0)
+                                    ? newcenters[c*dim + l]/npix[c]
+                                    : state->centers[c*dim + l];
+        }
+    }
+    g_free(npix);
+}
+
+static void
+kmeans_cluster_rms(const ClusterState *state, const gdouble *dist,
+                   gdouble *variance)
+{
+    guint *npix = g_new0(guint, state->k);
+    guint i, c;
+
+    gwy_clear(variance, state->k);
+    for (i = 0; i < state->n; i++) {
+        c = state->assignment[i];
+        npix[c]++;
+        variance[c] += dist[i]*dist[i];
+    }
+    for (c = 0; c < state->k; c++) {
+        if (npix[c] > 0)
+            variance[c] = sqrt(variance[c]/npix[c]);
+    }
     g_free(npix);
-    g_free(sum);
+}
+
+/* Mini-batch k-means.  Each iteration moves the centres towards points of a
+ * random sample, with the step decreasing as the centres accumulate points.
+ * It touches only a small fraction of the data per iteration, so it is much
+ * faster for large maps, at the expense of slightly worse clustering. */
+static gboolean
+kmeans_minibatch(ClusterState *state, GRand *rng, gint batch_size,
+                 gint max_iterations, gdouble epsilon, gint *iterations)
+{
+    const gdouble *data = state->data, *x;
+    gdouble *centers = state->centers, *oldcenters, *center;
+    guint n = state->n, dim = state->dim, k = state->k;
+    guint b = MIN((guint)batch_size, n);
+    guint *batch, *bassign, *counts;
+    gboolean ok = TRUE;
+    gdouble eta;
+    guint i, j, c;
+    gint it;
+
+    batch = g_new(guint, b);
+    bassign = g_new(guint, b);
+    counts = g_new0(guint, k);
+    oldcenters = g_new(gdouble, (gsize)k*dim);
+
+    for (it = 0; it < max_iterations; it++) {
+        if (!gwy_app_wait_set_fraction((gdouble)it/max_iterations)) {
+            ok = FALSE;
+            break;
+        }
+
+        for (i = 0; i < b; i++)
+            batch[i] = g_rand_int_range(rng, 0, n);
+
+#ifdef _OPENMP
+#pragma omp parallel if(gwy_omp_use_threads((gsize)b*k*dim)) \
+            default(none) \
+            shared(data,centers,batch,bassign,b,k,dim)
+#endif
+        {
+            guint ifrom = gwy_omp_chunk_start(b), ito = gwy_omp_chunk_end(b);
+            guint ii;
+            gdouble d1, d2;
+
+            for (ii = ifrom; ii < ito; ii++) {
+                bassign[ii] = cluster_nearest(data + (gsize)batch[ii]*dim,
+                                              centers, k, dim, &d1, &d2);
+            }
+        }
+
+        memcpy(oldcenters, centers, (gsize)k*dim*sizeof(gdouble));
+        for (i = 0; i < b; i++) {
+            c = bassign[i];
+            counts[c]++;
+            eta = 1.0/counts[c];
+            x = data + (gsize)batch[i]*dim;
+            center = centers + (gsize)c*dim;
+            for (j = 0; j < dim; j++)
+                center[j] += eta*(x[j] - center[j]);
+        }
+
+        if (!cluster_centers_moved(oldcenters, centers, k, dim, epsilon)) {
+            it++;
+            break;
+        }
+    }
+
+    *iterations = it;
+    /* The centres were moved without updating the bounds. */
+    state->have_bounds = FALSE;
+
     g_free(oldcenters);
-    g_free(centers);
+    g_free(counts);
+    g_free(bassign);
+    g_free(batch);
+
+    return ok;
 }
 
 static const gchar epsilon_key[]         = "/module/kmeans/epsilon";
@@ -736,6 +849,8 @@ static const gchar max_iterations_key[]  = "/module/kmeans/max_iterations";
 static const gchar normalize_key[]       = "/module/kmeans/normalize";
 static const gchar remove_outliers_key[] = "/module/kmeans/remove_outliers";
 static const gchar outliers_threshold_key[] = "/module/kmeans/outliers_threshold";
+static const gchar minibatch_key[]       = "/module/kmeans/minibatch";
+static const gchar batch_size_key[]      = "/module/kmeans/batch_size";
 
 static void
 kmeans_sanitize_args(KMeansArgs *args)
@@ -746,6 +861,8 @@ kmeans_sanitize_args(KMeansArgs *args)
     args->normalize = !!args->normalize;
     args->remove_outliers = !!args->remove_outliers;
     args->outliers_threshold = CLAMP(args->outliers_threshold, 1.0, 10.0);
+    args->minibatch = !!args->minibatch;
+    args->batch_size = CLAMP(args->batch_size, 100, 1000000);
 }
 
 static void
@@ -766,6 +883,10 @@ kmeans_load_args(GwyContainer *container,
                                       &args->remove_outliers);
     gwy_container_gis_double_by_name(container, outliers_threshold_key,
                                      &args->outliers_threshold);
+    gwy_container_gis_boolean_by_name(container, minibatch_key,
+                                      &args->minibatch);
+    gwy_container_gis_int32_by_name(container, batch_size_key,
+                                    &args->batch_size);
 
     kmeans_sanitize_args(args);
 }
@@ -785,6 +906,10 @@ kmeans_save_args(GwyContainer *container,
                                       args->remove_outliers);
     gwy_container_set_double_by_name(container, outliers_threshold_key,
                                      args->outliers_threshold);
+    gwy_container_set_boolean_by_name(container, minibatch_key,
+                                      args->minibatch);
+    gwy_container_set_int32_by_name(container, batch_size_key,
+                                    args->batch_size);
 }
 
 /* vim: set cin et ts=4 sw=4 cino=>1s,e0,n0,f0,{0,}0,^0,\:1s,=0,g1s,h0,t0,+1s,c3,(0,u0 : */
@@ -35,6 +35,7 @@
 #include <libgwydgets/gwydgets.h>
 #include <libgwymodule/gwymodule-volume.h>
 #include <app/gwyapp.h>
+#include "clustering.h"
 
 #define KMEDIANS_RUN_MODES (GWY_RUN_IMMEDIATE | GWY_RUN_INTERACTIVE)
 
@@ -70,6 +71,11 @@ static GwyBrick* normalize_brick       (GwyBrick *brick,
                                         GwyDataField *intfield);
 static void      volume_kmedians_do    (GwyContainer *data,
                                         KMediansArgs *args);
+static void      kmedians_update_centers(const ClusterState *state,
+                                         const gdouble *data,
+                                         guint *order,
+                                         guint *cstart,
+                                         gdouble *newcenters);
 static void      kmedians_load_args    (GwyContainer *container,
                                         KMediansArgs *args);
 static void      kmedians_save_args    (GwyContainer *container,
@@ -87,7 +93,7 @@ static GwyModuleInfo module_info = {
     &module_register,
     N_("Calculates K-medians clustering on volume data."),
     "Daniil Bratashov <dn2010@gmail.com> & Evgeniy Ryabov <k1u2r3ka@mail.ru>",
-    "1.1",
+    "1.2",
     "David Nečas (Yeti) & Petr Klapetek & Daniil Bratashov & Evgeniy Ryabov",
     "2014",
 };
@@ -318,17 +324,21 @@ volume_kmedians_do(GwyContainer *container, KMediansArgs *args)
     GwyGraphModel *gmodel;
     GwyDataLine *calibration = NULL;
     GwySIUnit *siunit;
+    GwyContainer *meta;
     const GwyRGBA *rgba;
     gint id;
     gchar *description;
     GRand *rand;
-    const gdouble *data;
-    gdouble *centers, *oldcenters, *plane, *data1, *xdata, *ydata;
-    gdouble *errordata;
-    gdouble min, dist, xreal, yreal, zreal, xoffset, yoffset, zoffset;
+    GTimer *timer;
+    ClusterState state;
+    const gdouble *data, *zdata;
+    gdouble *centers, *newcenters = NULL, *data1, *xdata, *ydata;
+    gdouble *errordata, *dist = NULL;
+    gdouble xreal, yreal, zreal, xoffset, yoffset, zoffset, time;
     gdouble epsilon = args->epsilon;
-    gint xres, yres, zres, i, j, l, c, newid;
-    gint *npix;
+    gint xres, yres, zres, i, c, newid;
+    guint *order = NULL, *cstart = NULL;
+    guint n;
     gint k = args->k;
     gint iterations = 0;
     gint max_iterations = args->max_iterations;
@@ -349,6 +359,7 @@ volume_kmedians_do(GwyContainer *container, KMediansArgs *args)
     xoffset = gwy_brick_get_xoffset(brick);
     yoffset = gwy_brick_get_yoffset(brick);
     zoffset = gwy_brick_get_zoffset(brick);
+    n = xres*yres;
 
     dfield = gwy_data_field_new(xres, yres, xreal, yreal, TRUE);
     gwy_data_field_set_xoffset(dfield, xoffset);
@@ -363,30 +374,25 @@ volume_kmedians_do(GwyContainer *container, KMediansArgs *args)
 
     gwy_app_wait_start(gwy_app_find_window_for_volume(container, id),
                        _("Initializing..."));
+    timer = g_timer_new();
 
-    if (normalize) {
+    if (normalize)
         normalized = normalize_brick(brick, intmap);
-        data = gwy_brick_get_data_const(normalized);
-    }
-    else {
-        data = gwy_brick_get_data_const(brick);
-    }
-
-    centers = g_new(gdouble, zres*k);
-    oldcenters = g_new(gdouble, zres*k);
-    plane = g_new(gdouble, xres * yres * k);
-    npix = g_new(gint, k);
+    /* Distances are calculated from whole z-lines, medians are calculated
+     * level by level.  Use the efficient data layout for each. */
+    data = gwy_brick_get_data_const(normalize ? normalized : brick);
+    zdata = gwy_brick_get_data_zmajor(normalize ? normalized : brick);
+
+    cluster_state_init(&state, zdata, n, zres, k);
+    centers = state.centers;
+    newcenters = g_new(gdouble, zres*k);
+    order = g_new(guint, n);
+    cstart = g_new(guint, k+1);
+    dist = g_new(gdouble, n);
     data1 = gwy_data_field_get_data(dfield);
 
     rand = g_rand_new();
-    for (c = 0; c < k; c++) {
-        i = g_rand_int_range(rand, 0, xres);
-        j = g_rand_int_range(rand, 0, yres);
-        for (l = 0; l < zres; l++) {
-            *(centers + c * zres + l)
-                             = *(data + l * xres * yres + j * xres + i);
-        };
-    };
+    cluster_seed_plusplus(&state, rand);
     g_rand_free(rand);
 
     if (!gwy_app_wait_set_message(_("K-medians iteration...")))
@@ -399,67 +405,30 @@ volume_kmedians_do(GwyContainer *container, KMediansArgs *args)
         }
 
         /* pixels belong to cluster with min distance */
-        for (j = 0; j < yres; j++)
-            for (i = 0; i < xres; i++) {
-                *(data1 + j * xres + i) = 0;
-                min = G_MAXDOUBLE;
-                for (c = 0; c < k; c++) {
-                    dist = 0;
-                    for (l = 0; l < zres; l++) {
-                        *(oldcenters + c * zres + l)
-                                            = *(centers + c * zres + l);
-                        dist
-                            += (*(data + l * xres * yres + j * xres + i)
-                              - *(centers + c * zres + l))
-                             * (*(data + l * xres * yres + j * xres + i)
-                              - *(centers + c * zres + l));
-                    }
-                    if (dist < min) {
-                        min = dist;
-                        *(data1 + j * xres + i) = c;
-                    }
-                }
-            }
+        cluster_assign(&state);
 
         /* We're calculating median per one coordinate of all pixels
          * that belongs to same cluster and use it as this coordinate
          * position for cluster center */
-        for (l = 0; l < zres; l++) {
-            for (c = 0; c < k; c++) {
-                *(npix + c) = 0;
-            }
-
-            for (j = 0; j < yres; j++) {
-                for (i = 0; i < xres; i++) {
-                    c = (gint)(*(data1 + j * xres + i));
-                    (*(npix + c))++;
-                    *(plane + c * xres * yres + *(npix + c) - 1)
-                             = *(data + l * xres * yres + j * xres + i);
-                }
-            }
-            for (c = 0; c < k; c++) {
-                gwy_math_sort(*(npix + c), plane + c * xres * yres);
-                *(centers + c * zres + l)
-                         = *(plane + c * xres * yres + *(npix + c) / 2);
-            }
-        }
-
-        converged = TRUE;
-        for (c = 0; c < k; c++) {
-            for (l = 0; l < zres; l++)
-                if (fabs(*(oldcenters + c * zres + l)
-                               - *(centers + c * zres + l)) > epsilon) {
-                    converged = FALSE;
-                    break;
-                }
-        }
+        kmedians_update_centers(&state, data, order, cstart, newcenters);
+        converged = !cluster_centers_moved(centers, newcenters, k, zres,
+                                           epsilon);
+        cluster_move_centers(&state, newcenters);
         if (iterations == max_iterations) {
             converged = TRUE;
         }
         iterations++;
     }
 
+    if (!cancelled) {
+        /* Make the assignment consistent with the final centres. */
+        cluster_assign(&state);
+        cluster_own_distances(&state, dist);
+    }
+
     gwy_app_wait_finish();
+    time = g_timer_elapsed(timer, NULL);
+    gwy_debug("k-medians: %d iterations, %g s", iterations, time);
     if (cancelled)
         goto fail;
 
@@ -472,18 +441,9 @@ volume_kmedians_do(GwyContainer *container, KMediansArgs *args)
     }
     errordata = gwy_data_field_get_data(errormap);
 
-    for (i = 0; i < xres; i++) {
-        for (j = 0; j < yres; j++) {
-            dist = 0.0;
-            c = (gint)(*(data1 + j * xres + i));
-            for (l = 0; l < zres; l++) {
-                dist += (*(data + l * xres * yres + j * xres + i)
-                         - *(centers + c * zres + l))
-                    * (*(data + l * xres * yres + j * xres + i)
-                       - *(centers + c * zres + l));
-            }
-            *(errordata + j * xres + i) = sqrt(dist);
-        }
+    for (i = 0; i < n; i++) {
+        data1[i] = state.assignment[i];
+        errordata[i] = dist[i];
     }
 
     gwy_data_field_add(dfield, 1.0);
@@ -494,6 +454,15 @@ volume_kmedians_do(GwyContainer *container, KMediansArgs *args)
     gwy_app_set_data_field_title(container, newid,
                                  g_strdup_printf(_("K-medians cluster of %s"),
                                                  description));
+    meta = gwy_container_new();
+    gwy_container_set_string_by_name(meta, "Method", g_strdup("K-medians"));
+    gwy_container_set_string_by_name(meta, "Iterations",
+                                     g_strdup_printf("%d", iterations));
+    gwy_container_set_string_by_name(meta, "Computation time",
+                                     g_strdup_printf("%.3f s", time));
+    gwy_container_set_object(container,
+                             gwy_app_get_data_meta_key_for_id(newid), meta);
+    g_object_unref(meta);
     gwy_app_channel_log_add(container, -1, newid, "volume::kmedians",
                             NULL);
 
@@ -563,14 +532,74 @@ volume_kmedians_do(GwyContainer *container, KMediansArgs *args)
     gwy_app_volume_log_add_volume(container, id, id);
 
 fail:
+    /* Clustering read the z-major copy of the document brick only when it
+     * was not normalised.  Free it; nothing else here needs it. */
+    if (!normalized)
+        gwy_brick_invalidate(brick);
+    g_timer_destroy(timer);
     gwy_object_unref(errormap);
     gwy_object_unref(intmap);
     gwy_object_unref(dfield);
     gwy_object_unref(normalized);
-    g_free(npix);
-    g_free(plane);
-    g_free(oldcenters);
-    g_free(centers);
+    cluster_state_free(&state);
+    g_free(dist);
+    g_free(cstart);
+    g_free(order);
+    g_free(newcenters);
+}
+
+/* Calculates new centres as coordinate-wise medians of their points.  Pixel
+ * indices are first sorted by cluster so that each level can be then
+ * processed independently, reading @data in the plane-by-plane layout. */
+static void
+kmedians_update_centers(const ClusterState *state, const gdouble *data,
+                        guint *order, guint *cstart, gdouble *newcenters)
+{
+    const guint *assignment = state->assignment;
+    const gdouble *centers = state->centers;
+    guint n = state->n, dim = state->dim, k = state->k;
+    guint i, c;
+
+    gwy_clear(cstart, k+1);
+    for (i = 0; i < n; i++)
+        cstart[assignment[i]+1]++;
+    for (c = 0; c < k; c++)
+        cstart[c+1] += cstart[c];
+    for (i = 0; i < n; i++)
+        order[cstart[assignment[i]]++] = i;
+    /* Now cstart[c] is the end of block c; shift it back. */
+    for (c = k; c; c--)
+        cstart[c] = cstart[c-1];
+    cstart[0] = 0;
+
+#ifdef _OPENMP
+#pragma omp parallel if(gwy_omp_use_threads((gsize)n*dim)) \
+            default(none) \
+            shared(data,centers,order,cstart,newcenters,n,dim,k)
+#endif
+    {
+        guint lfrom = gwy_omp_chunk_start(dim), lto = gwy_omp_chunk_end(dim);
+        gdouble *buf = g_new(gdouble, n);
+        const gdouble *plane;
+        guint l, cc, j, m;
+
+        for (l = lfrom; l < lto; l++) {
+            plane = data + (gsize)l*n;
+            for (cc = 0; cc < k; cc++) {
+                m = cstart[cc+1] - cstart[cc];
+                /* Keep empty clusters where they were. */
+                if (!m) {
+                    newcenters[cc*dim + l] = centers[cc*dim + l];
+                    continue;
+                }
+                for (j = 0; j < m; j++)
+                    buf[j] = plane[order[cstart[cc] + j]];
+                newcenters[cc*dim + l] = gwy_math_median(m, buf);
+            }
+        }
+
+        g_free(buf);
+    }
 }
 
 static const gchar epsilon_key[]        = "/module/kmedians/epsilon";
@@ -42,9 +42,6 @@
 
 enum {
     PREVIEW_SIZE = 360,
-    /* 16 is good for current processors; increasing it to 32 might not
-     * hurt in the future. */
-    BLOCK_SIZE = 16,
 };
 
 enum {
@@ -95,9 +92,9 @@ typedef struct {
     GwyBrick *brick;
     const gdouble *db;
     GwyDataLine *dline;
-    gdouble *buf;
     guint npts;
     guint npixels;
+    guint zres;
     guint k;
 } LineStatIter;
 
@@ -239,6 +236,9 @@ line_stat(GwyContainer *data, GwyRunType run)
     if (line_stat_dialog(&args, data, id))
         line_stat_do(&args, data, id);
 
+    /* The dialogue preview and the calculation used the z-major copy.  The
+     * brick remains in the file after the module finishes, so free it. */
+    gwy_brick_invalidate(brick);
     line_stat_save_args(gwy_app_settings_get(), &args);
 }
 
@@ -629,8 +629,8 @@ line_stat_iter_init(LineStatIter *iter, GwyBrick *brick,
     iter->brick = brick;
     iter->npts = zto - zfrom;
     iter->npixels = brick->xres * brick->yres;
-    iter->db = gwy_brick_get_data_const(brick) + zfrom*iter->npixels;
-    iter->buf = g_new(gdouble, iter->npixels * iter->npts);
+    iter->zres = brick->zres;
+    iter->db = gwy_brick_get_data_zmajor(brick) + zfrom;
     iter->dline = gwy_data_line_new(1, 1.0, FALSE);
     iter->k = (guint)(-1);
     /* Sets up line properties. */
@@ -640,30 +640,16 @@ line_stat_iter_init(LineStatIter *iter, GwyBrick *brick,
 static void
 line_stat_iter_next(LineStatIter *iter)
 {
-    guint blocksize, npts, npixels, kk, m;
-
-    npts = iter->npts;
-    npixels = iter->npixels;
     iter->k++;
-    g_return_if_fail(iter->k < npixels);
-
-    kk = iter->k % BLOCK_SIZE;
-    if (!kk) {
-        blocksize = MIN(BLOCK_SIZE, npixels - iter->k);
-        for (m = 0; m < npts; m++) {
-            const gdouble *db = iter->db + m*npixels + iter->k;
-            for (kk = 0; kk < blocksize; kk++)
-                iter->buf[kk*npts + m] = db[kk];
-        }
-        kk = 0;
-    }
-    memcpy(iter->dline->data, iter->buf + kk*npts, npts * sizeof(gdouble));
+    g_return_if_fail(iter->k < iter->npixels);
+
+    memcpy(iter->dline->data, iter->db + (gsize)iter->k*iter->zres,
+           iter->npts * sizeof(gdouble));
 }
 
 static void
 line_stat_iter_free(LineStatIter *iter)
 {
-    g_free(iter->buf);
     gwy_object_unref(iter->dline);
 }
 
@@ -698,6 +684,39 @@ get_data_line_slope(GwyDataLine *dataline)
     return b*gwy_data_line_get_res(dataline)/gwy_data_line_get_real(dataline);
 }
 
+static gboolean
+extract_summary_image_simple(GwyBrick *brick, GwyDataField *dfield,
+                             GwyLineStatQuantity quantity,
+                             gint zfrom, gint zto)
+{
+    gint xres = brick->xres, yres = brick->yres, depth = zto - zfrom;
+    GwyDataField *minfield;
+
+    if (quantity == GWY_LINE_STAT_MEAN)
+        gwy_brick_stats_plane(brick, 0, 0, zfrom, xres, yres, depth,
+                              NULL, dfield, NULL, NULL, NULL, NULL, NULL);
+    else if (quantity == GWY_LINE_STAT_RMS)
+        gwy_brick_stats_plane(brick, 0, 0, zfrom, xres, yres, depth,
+                              NULL, NULL, dfield, NULL, NULL, NULL, NULL);
+    else if (quantity == GWY_LINE_STAT_MINIMUM)
+        gwy_brick_stats_plane(brick, 0, 0, zfrom, xres, yres, depth,
+                              NULL, NULL, NULL, dfield, NULL, NULL, NULL);
+    else if (quantity == GWY_LINE_STAT_MAXIMUM)
+        gwy_brick_stats_plane(brick, 0, 0, zfrom, xres, yres, depth,
+                              NULL, NULL, NULL, NULL, dfield, NULL, NULL);
+    else if (quantity == GWY_LINE_STAT_RANGE) {
+        minfield = gwy_data_field_new_alike(dfield, FALSE);
+        gwy_brick_stats_plane(brick, 0, 0, zfrom, xres, yres, depth,
+                              NULL, NULL, NULL, minfield, dfield, NULL, NULL);
+        gwy_data_field_subtract_fields(dfield, dfield, minfield);
+        g_object_unref(minfield);
+    }
+    else
+        return FALSE;
+
+    return TRUE;
+}
+
 static void
 extract_summary_image(const LineStatArgs *args, GwyDataField *dfield)
 {
@@ -755,15 +774,21 @@ extract_summary_image(const LineStatArgs *args, GwyDataField *dfield)
         return;
     }
 
-    /* Use an iterator interface to formally process data profile by profle,
-     * but physically extract them from the brick by larger blocks, gaining a
-     * speedup about 3 from the much improved memory access pattern. */
-    line_stat_iter_init(&iter, brick, zfrom, zto);
-    for (i = 0; i < xres*yres; i++) {
-        line_stat_iter_next(&iter);
-        dfield->data[i] = lsfunc(iter.dline);
+    /* Simple quantities are calculated directly from the brick in a single
+     * parallel pass. */
+    if (zto <= zfrom
+        || !extract_summary_image_simple(brick, dfield, quantity, zfrom, zto)) {
+        /* Use an iterator interface to formally process data profile by
+         * profle, but physically take them from the z-contiguous transposed
+         * brick data, which are kept for subsequent recalculations until
+         * the module finishes. */
+        line_stat_iter_init(&iter, brick, zfrom, zto);
+        for (i = 0; i < xres*yres; i++) {
+            line_stat_iter_next(&iter);
+            dfield->data[i] = lsfunc(iter.dline);
+        }
+        line_stat_iter_free(&iter);
     }
-    line_stat_iter_free(&iter);
 
     imgunit = gwy_data_field_get_si_unit_z(dfield);
     wunit = gwy_brick_get_si_unit_z(brick);
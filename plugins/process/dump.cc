@@ -19,6 +19,8 @@ DataField::DataField(unsigned long int xres_, unsigned long int yres_)
     data = new double [xres*yres];
     xreal = 0.0;
     yreal = 0.0;
+    xoffset = 0.0;
+    yoffset = 0.0;
     xyunits = string("");
     zunits = string("");
 }
@@ -31,6 +33,8 @@ DataField::DataField(const DataField &dfield)
     memcpy(data, dfield.data, xres*yres*sizeof(double));
     xreal = dfield.xreal;
     yreal = dfield.yreal;
+    xoffset = dfield.xoffset;
+    yoffset = dfield.yoffset;
     xyunits = string(dfield.xyunits);
     zunits = string(dfield.zunits);
 }
@@ -40,6 +44,124 @@ DataField::~DataField()
     delete [] data;
 }
 
+/***************** Binary dump helpers **********************/
+static const char binary_magic[] = "GWYBDUMP";
+static const unsigned long int binary_magic_size = sizeof(binary_magic) - 1;
+
+enum {
+    BINARY_END        = 0,
+    BINARY_STRING     = 1,
+    BINARY_DATA_FIELD = 2,
+};
+
+static bool
+host_is_little_endian()
+{
+    const unsigned int one = 1;
+    return *(const unsigned char*)&one == 1;
+}
+
+/* Swap byte order of 8-byte items in place (on big-endian hosts). */
+static void
+swap_doubles(double *data, unsigned long int n)
+{
+    unsigned char *p = (unsigned char*)data;
+
+    for (unsigned long int i = 0; i < n; i++, p += 8) {
+        for (int j = 0; j < 4; j++) {
+            unsigned char c = p[j];
+            p[j] = p[7-j];
+            p[7-j] = c;
+        }
+    }
+}
+
+static unsigned long int
+padded(unsigned long int n)
+{
+    return (n + 7) & ~7UL;
+}
+
+static bool
+get_uint32(istream &fh, unsigned long int &value)
+{
+    unsigned char b[4];
+
+    if (!fh.read((char*)b, 4))
+        return false;
+    value = b[0] | (b[1] << 8) | (b[2] << 16) | ((unsigned long int)b[3] << 24);
+    return true;
+}
+
+static bool
+get_double(istream &fh, double &value)
+{
+    if (!fh.read((char*)&value, sizeof(double)))
+        return false;
+    if (!host_is_little_endian())
+        swap_doubles(&value, 1);
+    return true;
+}
+
+static bool
+get_padded_string(istream &fh, unsigned long int len, string &str)
+{
+    unsigned long int size = padded(len);
+    char *buf = new char[size + 1];
+    bool ok = !!fh.read(buf, size);
+
+    if (ok)
+        str.assign(buf, len);
+    delete [] buf;
+    return ok;
+}
+
+static void
+put_uint32(ostream &fh, unsigned long int value)
+{
+    unsigned char b[4];
+
+    b[0] = value & 0xff;
+    b[1] = (value >> 8) & 0xff;
+    b[2] = (value >> 16) & 0xff;
+    b[3] = (value >> 24) & 0xff;
+    fh.write((const char*)b, 4);
+}
+
+static void
+put_double(ostream &fh, double value)
+{
+    if (!host_is_little_endian())
+        swap_doubles(&value, 1);
+    fh.write((const char*)&value, sizeof(double));
+}
+
+static void
+put_padded_string(ostream &fh, const string &str)
+{
+    static const char zeros[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+
+    fh.write(str.data(), str.size());
+    fh.write(zeros, padded(str.size()) - str.size());
+}
+
+static void
+put_item_header(ostream &fh, unsigned long int type, const string &key)
+{
+    put_uint32(fh, type);
+    put_uint32(fh, key.size());
+    put_padded_string(fh, key);
+}
+
+static void
+put_string_item(ostream &fh, const string &key, const string &value)
+{
+    put_item_header(fh, BINARY_STRING, key);
+    put_uint32(fh, value.size());
+    put_uint32(fh, 0);
+    put_padded_string(fh, value);
+}
+
 /***************** Dump **********************/
 bool
 Dump::read(const char *filename)
@@ -54,6 +176,18 @@ Dump::read(const char *filename)
     if (!fh)
         return false;
 
+    /* Recognise the binary format by its magic header. */
+    {
+        char magic[sizeof(binary_magic)];
+
+        binary = (fh.read(magic, binary_magic_size)
+                  && memcmp(magic, binary_magic, binary_magic_size) == 0);
+        if (binary)
+            return read_binary(fh);
+        fh.clear();
+        fh.seekg(0);
+    }
+
     int lineno = 0;
     const unsigned long int buf_len = 4096;
     char line_buf[buf_len];
@@ -171,12 +305,134 @@ Dump::read(const char *filename)
     }
 }
 
+bool
+Dump::read_binary(istream &fh)
+{
+    typedef pair<string,DataField> DataValue;
+    unsigned long int version, reserved, type, len, xres, yres;
+
+    if (!get_uint32(fh, version) || !get_uint32(fh, reserved)
+        || version != 1) {
+        cerr << "Unsupported binary dump version" << endl;
+        return false;
+    }
+
+    while (true) {
+        string key;
+
+        if (!get_uint32(fh, type) || !get_uint32(fh, len)
+            || !get_padded_string(fh, len, key))
+            break;
+
+        if (type == BINARY_END)
+            return true;
+
+        if (type == BINARY_STRING) {
+            string value;
+
+            if (!get_uint32(fh, len) || !get_uint32(fh, reserved)
+                || !get_padded_string(fh, len, value))
+                break;
+            meta[key] = value;
+            continue;
+        }
+
+        if (type != BINARY_DATA_FIELD) {
+            cerr << "Unknown binary dump item type " << type << endl;
+            meta.clear();
+            data.clear();
+            return false;
+        }
+
+        if (!get_uint32(fh, xres) || !get_uint32(fh, yres))
+            break;
+        DataField dfield = DataField(xres, yres);
+        if (!get_double(fh, dfield.xreal) || !get_double(fh, dfield.yreal)
+            || !get_double(fh, dfield.xoffset)
+            || !get_double(fh, dfield.yoffset))
+            break;
+        if (!fh.read((char*)dfield.data, xres*yres*sizeof(double)))
+            break;
+        if (!host_is_little_endian())
+            swap_doubles(dfield.data, xres*yres);
+
+        map<string,string>::iterator iter;
+        if ((iter = meta.find(key + "/unit-xy")) != meta.end()) {
+            dfield.xyunits = iter->second;
+            meta.erase(iter);
+        }
+        if ((iter = meta.find(key + "/unit-z")) != meta.end()) {
+            dfield.zunits = iter->second;
+            meta.erase(iter);
+        }
+        data.erase(key);
+        data.insert(DataValue(key, dfield));
+    }
+
+    cerr << "Truncated binary dump" << endl;
+    meta.clear();
+    data.clear();
+    return false;
+}
+
+bool
+Dump::write_binary(ostream &fh)
+{
+    fh.write(binary_magic, binary_magic_size);
+    put_uint32(fh, 1);
+    put_uint32(fh, 0);
+
+    for (map<string,string>::iterator iter = meta.begin();
+         iter != meta.end();
+         iter++)
+        put_string_item(fh, iter->first, iter->second);
+
+    for (map<string,DataField>::iterator iter = data.begin();
+         iter != data.end();
+         iter++) {
+        const DataField &dfield = iter->second;
+        unsigned long int n = dfield.xres * dfield.yres;
+
+        if (dfield.xyunits.size())
+            put_string_item(fh, iter->first + "/unit-xy", dfield.xyunits);
+        if (dfield.zunits.size())
+            put_string_item(fh, iter->first + "/unit-z", dfield.zunits);
+
+        put_item_header(fh, BINARY_DATA_FIELD, iter->first);
+        put_uint32(fh, dfield.xres);
+        put_uint32(fh, dfield.yres);
+        put_double(fh, dfield.xreal);
+        put_double(fh, dfield.yreal);
+        put_double(fh, dfield.xoffset);
+        put_double(fh, dfield.yoffset);
+        if (host_is_little_endian())
+            fh.write((const char*)dfield.data, n*sizeof(double));
+        else {
+            double *d = new double [n];
+
+            memcpy(d, dfield.data, n*sizeof(double));
+            swap_doubles(d, n);
+            fh.write((const char*)d, n*sizeof(double));
+            delete [] d;
+        }
+    }
+    put_item_header(fh, BINARY_END, string(""));
+
+    return fh.good();
+}
+
 bool
 Dump::write(const char *filename)
 {
     ofstream fh(filename, ifstream::out | ifstream::binary);
     if (!fh)
         return false;
+
+    if (binary) {
+        bool ok = write_binary(fh);
+        fh.close();
+        return ok;
+    }
     {
         for (map<string,string>::iterator iter = meta.begin();
              iter != meta.end();
@@ -17,6 +17,8 @@ class DataField {
     int yres;        /* y resolution (in pixels) */
     double xreal;    /* x real size (in xyunits) */
     double yreal;    /* y real size (in xyunits) */
+    double xoffset;  /* x offset (in xyunits), only in binary dumps */
+    double yoffset;  /* y offset (in xyunits), only in binary dumps */
     double *data;    /* data itself (in zunits) */
     std::string xyunits;  /* base lateral SI units */
     std::string zunits;   /* base value SI units */
@@ -32,14 +34,24 @@ class DataField {
  * separate hash tables (the other possibility is to (a) include/implement
  * (b) become dependent on a RTTI libray):
  * data is a hash table type for data fields (DataField's),
- * meta is a hash table type for string metadata. */
+ * meta is a hash table type for string metadata.
+ *
+ * Both text and binary dumps are read; write() uses the format of the last
+ * read() unless binary is changed.  Plug-ins receive binary dumps only if
+ * they ask for them during registration, see plugin-helper.hh. */
 class Dump {
     public:
     std::map<std::string,DataField>    data;    /* data fields */
     std::map<std::string,std::string>  meta;    /* string metadata */
+    bool binary;                                /* use binary dump format */
 
+    Dump() : binary(false) {}
     bool read(const char *filename);   /* read a dump file, returns success */
     bool write(const char *filename);  /* write a dump file, returns success */
+
+    private:
+    bool read_binary(std::istream &fh);
+    bool write_binary(std::ostream &fh);
 };
 
 #endif
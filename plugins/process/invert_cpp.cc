@@ -38,6 +38,7 @@ action_register(char *args[])
     cout << "invert_cpp" << endl;
     cout << "/_Test/Value Invert (C++)" << endl;
     cout << "noninteractive with_defaults" << endl;
+    register_binary_dump(cout);
     return true;
 }
 
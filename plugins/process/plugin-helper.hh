@@ -22,6 +22,15 @@ class PluginAction {
                                                 && name.compare(argv[1]) == 0; }
 };
 
+/* Advertise that the plug-in understands binary dumps.  Call it from the
+ * "register" action after printing the run modes (or file operations for
+ * file plug-ins); Dump then reads and writes whatever format it gets. */
+static void
+register_binary_dump(std::ostream &out)
+{
+    out << "binary" << std::endl;
+}
+
 /* Find action and run it */
 static bool
 run_action(int nactions, PluginAction *actions,
@@ -0,0 +1,639 @@
+/*
+ *  @(#) $Id$
+ *  Copyright (C) 2016 David Necas (Yeti).
+ *  E-mail: yeti@gwyddion.net.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * Micro-benchmarks of libgwyprocess functions.
+ *
+ * All inputs are generated from a fixed random seed so runs on different
+ * machines and builds process exactly the same data.  Each function is run
+ * once to warm up and then the requested number of times, restoring the
+ * input data before each run (restoration is not timed).  The results are
+ * written as JSON, with minimum and median times in seconds and the peak
+ * resident set size of the process after the case, in kilobytes.
+ */
+
+#include "config.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef HAVE_SYS_RESOURCE_H
+#include <sys/time.h>
+#include <sys/resource.h>
+#endif
+#include <libgwyddion/gwymacros.h>
+#include <libgwyddion/gwyddion.h>
+#include <libgwyddion/gwyomp.h>
+#include <libprocess/gwyprocess.h>
+#include <libprocess/tip.h>
+
+#define PROGRAM_NAME "gwyddion-bench"
+
+enum {
+    TIP_HALF_SIZE = 10,
+    KERNEL_SIZE = 16,
+    NDH = 1000,
+    /* The kernel and the tip must fit into the image comfortably. */
+    MIN_SIZE = 2*KERNEL_SIZE,
+};
+
+typedef struct {
+    GwyDataField *source;
+    GwyDataField *field;
+    GwyDataField *result;
+    GwyDataField *result2;
+    GwyDataField *acf;
+    GwyDataField *mask;
+    GwyDataField *kernel;
+    GwyDataField *tip;
+    GwyDataLine *line;
+    gint *grains;
+    gint ngrains;
+} BenchData;
+
+typedef void (*BenchFunc)(BenchData *data);
+
+typedef struct {
+    const gchar *name;
+    const gchar *group;
+    BenchFunc func;
+} BenchCase;
+
+typedef struct {
+    gchar *sizes;
+    gchar *threads;
+    gchar *filter;
+    gchar *output;
+    gint repeat;
+    gint seed;
+    gboolean list;
+    gboolean quiet;
+} Options;
+
+static void
+bench_filter_gaussian(BenchData *data)
+{
+    gwy_data_field_filter_gaussian(data->field, 3.0);
+}
+
+static void
+bench_filter_mean(BenchData *data)
+{
+    gwy_data_field_filter_mean(data->field, 9);
+}
+
+static void
+bench_filter_median(BenchData *data)
+{
+    gwy_data_field_filter_median(data->field, 5);
+}
+
+static void
+bench_filter_sobel(BenchData *data)
+{
+    gwy_data_field_filter_sobel_total(data->field);
+}
+
+static void
+bench_stats(BenchData *data)
+{
+    gdouble avg, ra, rms, skew, kurtosis;
+
+    gwy_data_field_get_stats(data->field, &avg, &ra, &rms, &skew, &kurtosis);
+}
+
+static void
+bench_median(BenchData *data)
+{
+    gwy_data_field_get_median(data->field);
+}
+
+static void
+bench_height_distribution(BenchData *data)
+{
+    gwy_data_field_dh(data->field, data->line, NDH);
+}
+
+static void
+bench_fft(BenchData *data)
+{
+    gwy_data_field_2dfft(data->field, NULL, data->result, data->result2,
+                         GWY_WINDOWING_HANN, GWY_TRANSFORM_DIRECTION_FORWARD,
+                         GWY_INTERPOLATION_LINEAR, FALSE, 0);
+}
+
+static void
+bench_acf(BenchData *data)
+{
+    gwy_data_field_2dacf(data->field, data->acf);
+}
+
+static void
+bench_correlate(BenchData *data)
+{
+    gwy_data_field_correlate(data->field, data->kernel, data->result,
+                             GWY_CORRELATION_FFT);
+}
+
+static void
+bench_grains_mark(BenchData *data)
+{
+    gwy_data_field_grains_mark_height(data->field, data->result, 50.0, FALSE);
+}
+
+static void
+bench_grains_number(BenchData *data)
+{
+    gwy_data_field_number_grains(data->mask, data->grains);
+}
+
+static void
+bench_grains_values(BenchData *data)
+{
+    gdouble *values;
+
+    values = gwy_data_field_grains_get_values(data->field, NULL,
+                                              data->ngrains, data->grains,
+                                              GWY_GRAIN_VALUE_MEAN);
+    g_free(values);
+}
+
+static void
+bench_level_plane(BenchData *data)
+{
+    gdouble a, bx, by;
+
+    gwy_data_field_fit_plane(data->field, &a, &bx, &by);
+    gwy_data_field_plane_level(data->field, a, bx, by);
+}
+
+static void
+bench_level_polynom(BenchData *data)
+{
+    gdouble *coeffs;
+
+    coeffs = gwy_data_field_fit_polynom(data->field, 3, 3, NULL);
+    gwy_data_field_subtract_polynom(data->field, 3, 3, coeffs);
+    g_free(coeffs);
+}
+
+static void
+bench_resample(BenchData *data)
+{
+    GwyDataField *resampled;
+    gint xres = gwy_data_field_get_xres(data->field);
+    gint yres = gwy_data_field_get_yres(data->field);
+
+    resampled = gwy_data_field_new_resampled(data->field, 3*xres/2, 3*yres/2,
+                                             GWY_INTERPOLATION_BSPLINE);
+    g_object_unref(resampled);
+}
+
+static void
+bench_rotate(BenchData *data)
+{
+    gwy_data_field_rotate(data->field, G_PI/6.0, GWY_INTERPOLATION_LINEAR);
+}
+
+static void
+bench_tip_dilation(BenchData *data)
+{
+    gwy_tip_dilation(data->tip, data->field, data->result, NULL, NULL);
+}
+
+static void
+bench_tip_erosion(BenchData *data)
+{
+    gwy_tip_erosion(data->tip, data->field, data->result, NULL, NULL);
+}
+
+static const BenchCase cases[] = {
+    { "filter_gaussian",     "filters",       bench_filter_gaussian,     },
+    { "filter_mean",         "filters",       bench_filter_mean,         },
+    { "filter_median",       "filters",       bench_filter_median,       },
+    { "filter_sobel",        "filters",       bench_filter_sobel,        },
+    { "stats",               "stats",         bench_stats,               },
+    { "median",              "stats",         bench_median,              },
+    { "height_distribution", "stats",         bench_height_distribution, },
+    { "fft",                 "fft",           bench_fft,                 },
+    { "acf",                 "correlation",   bench_acf,                 },
+    { "correlate",           "correlation",   bench_correlate,           },
+    { "grains_mark",         "grains",        bench_grains_mark,         },
+    { "grains_number",       "grains",        bench_grains_number,       },
+    { "grains_values",       "grains",        bench_grains_values,       },
+    { "level_plane",         "level",         bench_level_plane,         },
+    { "level_polynom",       "level",         bench_level_polynom,       },
+    { "resample",            "interpolation", bench_resample,            },
+    { "rotate",              "interpolation", bench_rotate,              },
+    { "tip_dilation",        "tip",           bench_tip_dilation,        },
+    { "tip_erosion",         "tip",           bench_tip_erosion,         },
+};
+
+static void
+die(const gchar *reason, ...)
+{
+    va_list ap;
+
+    va_start(ap, reason);
+    fprintf(stderr, "%s: Aborting. %s\n",
+            PROGRAM_NAME, g_strdup_vprintf(reason, ap));
+    va_end(ap);
+    exit(EXIT_FAILURE);
+}
+
+/* Parses a comma-separated list of positive integers. */
+static GArray*
+parse_uint_list(const gchar *str, const gchar *what)
+{
+    GArray *array = g_array_new(FALSE, FALSE, sizeof(guint));
+    gchar **items;
+    gchar *end;
+    guint i, value;
+
+    items = g_strsplit(str, ",", 0);
+    for (i = 0; items[i]; i++) {
+        value = strtol(items[i], &end, 10);
+        if (*end || !*items[i] || (gint)value <= 0)
+            die("Invalid %s '%s'.", what, items[i]);
+        g_array_append_val(array, value);
+    }
+    g_strfreev(items);
+    if (!array->len)
+        die("No %s given.", what);
+
+    return array;
+}
+
+static gboolean
+case_is_selected(const BenchCase *bcase, gchar **filter)
+{
+    guint i;
+
+    if (!filter)
+        return TRUE;
+
+    for (i = 0; filter[i]; i++) {
+        if (gwy_strequal(filter[i], bcase->name)
+            || gwy_strequal(filter[i], bcase->group))
+            return TRUE;
+    }
+    return FALSE;
+}
+
+static glong
+get_peak_rss(void)
+{
+#ifdef HAVE_SYS_RESOURCE_H
+    struct rusage usage;
+
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+#ifdef __APPLE__
+        /* Darwin reports bytes, everyone else kilobytes. */
+        return usage.ru_maxrss/1024;
+#else
+        return usage.ru_maxrss;
+#endif
+    }
+#endif
+    return -1;
+}
+
+static void
+set_nthreads(guint nthreads)
+{
+    gwy_threads_set_enabled(nthreads > 1);
+#ifdef _OPENMP
+    omp_set_num_threads(nthreads);
+#endif
+}
+
+/* Smooth random surface with correlation length of a few pixels, so that the
+ * number of grains and other features grows with the image area. */
+static GwyDataField*
+create_surface(guint size, guint seed)
+{
+    GwyRandGenSet *rngset;
+    GwyDataField *dfield;
+    gdouble *d;
+    guint i;
+
+    dfield = gwy_data_field_new(size, size, size*1e-8, size*1e-8, FALSE);
+    gwy_si_unit_set_from_string(gwy_data_field_get_si_unit_xy(dfield), "m");
+    gwy_si_unit_set_from_string(gwy_data_field_get_si_unit_z(dfield), "m");
+
+    rngset = gwy_rand_gen_set_new(1);
+    gwy_rand_gen_set_init(rngset, seed);
+    d = gwy_data_field_get_data(dfield);
+    for (i = 0; i < size*size; i++)
+        d[i] = gwy_rand_gen_set_gaussian(rngset, 0, 1e-8);
+    gwy_rand_gen_set_free(rngset);
+
+    gwy_data_field_filter_gaussian(dfield, 4.0);
+    gwy_data_field_invalidate(dfield);
+
+    return dfield;
+}
+
+/* Parabolic tip with the same pixel size as @surface. */
+static GwyDataField*
+create_tip(GwyDataField *surface)
+{
+    GwyDataField *tip;
+    gdouble dx = gwy_data_field_get_xmeasure(surface);
+    gdouble radius = 5.0*dx, x, y;
+    guint res = 2*TIP_HALF_SIZE + 1, i, j;
+    gdouble *d;
+
+    tip = gwy_data_field_new(res, res, res*dx, res*dx, FALSE);
+    gwy_si_unit_set_from_string(gwy_data_field_get_si_unit_xy(tip), "m");
+    gwy_si_unit_set_from_string(gwy_data_field_get_si_unit_z(tip), "m");
+    d = gwy_data_field_get_data(tip);
+    for (i = 0; i < res; i++) {
+        y = ((gint)i - TIP_HALF_SIZE)*dx;
+        for (j = 0; j < res; j++) {
+            x = ((gint)j - TIP_HALF_SIZE)*dx;
+            d[i*res + j] = -(x*x + y*y)/(2.0*radius);
+        }
+    }
+    gwy_data_field_add(tip, -gwy_data_field_get_min(tip));
+
+    return tip;
+}
+
+static void
+bench_data_init(BenchData *data, guint size, guint seed)
+{
+    gwy_clear(data, 1);
+    data->source = create_surface(size, seed);
+    data->field = gwy_data_field_new_alike(data->source, FALSE);
+    data->result = gwy_data_field_new_alike(data->source, FALSE);
+    data->result2 = gwy_data_field_new_alike(data->source, FALSE);
+    data->acf = gwy_data_field_new_alike(data->source, FALSE);
+    data->mask = gwy_data_field_new_alike(data->source, FALSE);
+    data->kernel = gwy_data_field_area_extract(data->source, size/4, size/4,
+                                               KERNEL_SIZE, KERNEL_SIZE);
+    data->tip = create_tip(data->source);
+    data->line = gwy_data_line_new(NDH, 1.0, FALSE);
+    gwy_data_field_grains_mark_height(data->source, data->mask, 50.0, FALSE);
+    data->grains = g_new0(gint, size*size);
+    data->ngrains = gwy_data_field_number_grains(data->mask, data->grains);
+}
+
+static void
+bench_data_free(BenchData *data)
+{
+    g_object_unref(data->source);
+    g_object_unref(data->field);
+    g_object_unref(data->result);
+    g_object_unref(data->result2);
+    g_object_unref(data->acf);
+    g_object_unref(data->mask);
+    g_object_unref(data->kernel);
+    g_object_unref(data->tip);
+    g_object_unref(data->line);
+    g_free(data->grains);
+}
+
+/* Runs the case @repeat times after one warm-up run and returns the sorted
+ * run times in @times. */
+static void
+run_case(const BenchCase *bcase, BenchData *data, guint repeat,
+         gdouble *times)
+{
+    GTimer *timer = g_timer_new();
+    guint i;
+
+    for (i = 0; i <= repeat; i++) {
+        gwy_data_field_copy(data->source, data->field, FALSE);
+        gwy_data_field_invalidate(data->field);
+        g_timer_start(timer);
+        bcase->func(data);
+        g_timer_stop(timer);
+        if (i)
+            times[i-1] = g_timer_elapsed(timer, NULL);
+    }
+    g_timer_destroy(timer);
+    gwy_math_sort(repeat, times);
+}
+
+static void
+print_rss(FILE *fh, glong rss)
+{
+    if (rss >= 0)
+        fprintf(fh, "%ld", rss);
+    else
+        fputs("null", fh);
+}
+
+static const GOptionEntry entries[] = {
+    {
+        "sizes", 's', 0, G_OPTION_ARG_STRING, NULL,
+        "Comma-separated list of image sizes (default 256,1024,2048)", "LIST",
+    },
+    {
+        "threads", 't', 0, G_OPTION_ARG_STRING, NULL,
+        "Comma-separated list of thread counts (default 1 and all processors)",
+        "LIST",
+    },
+    {
+        "filter", 'f', 0, G_OPTION_ARG_STRING, NULL,
+        "Comma-separated list of benchmark names or groups to run", "LIST",
+    },
+    {
+        "repeat", 'r', 0, G_OPTION_ARG_INT, NULL,
+        "Number of timed runs of each benchmark (default 5)", "N",
+    },
+    {
+        "seed", 0, 0, G_OPTION_ARG_INT, NULL,
+        "Random seed for input data generation (default 42)", "SEED",
+    },
+    {
+        "output", 'o', 0, G_OPTION_ARG_FILENAME, NULL,
+        "Write the JSON results to FILE instead of standard output", "FILE",
+    },
+    {
+        "list", 'l', 0, G_OPTION_ARG_NONE, NULL,
+        "List available benchmarks and exit", NULL,
+    },
+    {
+        "quiet", 'q', 0, G_OPTION_ARG_NONE, NULL,
+        "Do not print progress to standard error", NULL,
+    },
+    { NULL, 0, 0, 0, NULL, NULL, NULL, },
+};
+
+static void
+parse_options(Options *options, int *argc, char ***argv)
+{
+    GOptionEntry myentries[G_N_ELEMENTS(entries)];
+    GOptionContext *context;
+    GError *error = NULL;
+
+    memcpy(myentries, entries, sizeof(entries));
+    myentries[0].arg_data = &options->sizes;
+    myentries[1].arg_data = &options->threads;
+    myentries[2].arg_data = &options->filter;
+    myentries[3].arg_data = &options->repeat;
+    myentries[4].arg_data = &options->seed;
+    myentries[5].arg_data = &options->output;
+    myentries[6].arg_data = &options->list;
+    myentries[7].arg_data = &options->quiet;
+
+    context = g_option_context_new("- benchmark data processing functions");
+    g_option_context_add_main_entries(context, myentries, NULL);
+    if (!g_option_context_parse(context, argc, argv, &error))
+        die("%s", error->message);
+    g_option_context_free(context);
+
+    if (*argc > 1)
+        die("Unexpected argument '%s'.", (*argv)[1]);
+    if (options->repeat <= 0)
+        die("The number of runs must be positive.");
+}
+
+int
+main(int argc, char *argv[])
+{
+    Options options = {
+        NULL, NULL, NULL, NULL, 5, 42, FALSE, FALSE,
+    };
+    GArray *sizes, *threads;
+    gchar **filter = NULL;
+    gdouble *times;
+    BenchData data;
+    FILE *fh = stdout;
+    gboolean first = TRUE;
+    guint i, j, k, size, nthreads, maxthreads = 1;
+    glong rss;
+
+    parse_options(&options, &argc, &argv);
+
+    if (options.list) {
+        for (i = 0; i < G_N_ELEMENTS(cases); i++)
+            printf("%-16s %s\n", cases[i].group, cases[i].name);
+        return 0;
+    }
+
+    gwy_process_type_init();
+
+#ifdef _OPENMP
+    maxthreads = omp_get_num_procs();
+#endif
+    sizes = parse_uint_list(options.sizes ? options.sizes : "256,1024,2048",
+                            "size");
+    for (i = 0; i < sizes->len; i++) {
+        if (g_array_index(sizes, guint, i) < MIN_SIZE)
+            die("Image size %u is too small, --sizes values must be "
+                "at least %u.", g_array_index(sizes, guint, i), MIN_SIZE);
+    }
+    if (options.threads)
+        threads = parse_uint_list(options.threads, "thread count");
+    else {
+        threads = g_array_new(FALSE, FALSE, sizeof(guint));
+        nthreads = 1;
+        g_array_append_val(threads, nthreads);
+        if (maxthreads > 1)
+            g_array_append_val(threads, maxthreads);
+    }
+#ifndef _OPENMP
+    for (i = 0; i < threads->len; i++) {
+        if (g_array_index(threads, guint, i) > 1) {
+            g_printerr("%s: Built without OpenMP, thread count %u skipped.\n",
+                       PROGRAM_NAME, g_array_index(threads, guint, i));
+            g_array_remove_index(threads, i--);
+        }
+    }
+    if (!threads->len)
+        die("No usable thread counts.");
+#endif
+    if (options.filter)
+        filter = g_strsplit(options.filter, ",", 0);
+
+    if (options.output && !(fh = fopen(options.output, "w")))
+        die("Cannot open '%s' for writing.", options.output);
+
+    fprintf(fh, "{\n");
+    fprintf(fh, "  \"program\": \"%s\",\n", PROGRAM_NAME);
+    fprintf(fh, "  \"version\": \"%s\",\n", gwy_version_string());
+#ifdef _OPENMP
+    fprintf(fh, "  \"openmp\": true,\n");
+#else
+    fprintf(fh, "  \"openmp\": false,\n");
+#endif
+    fprintf(fh, "  \"processors\": %u,\n", maxthreads);
+    fprintf(fh, "  \"seed\": %d,\n", options.seed);
+    fprintf(fh, "  \"repeat\": %d,\n", options.repeat);
+    fprintf(fh, "  \"results\": [");
+
+    times = g_new(gdouble, options.repeat);
+    for (i = 0; i < sizes->len; i++) {
+        size = g_array_index(sizes, guint, i);
+        set_nthreads(1);
+        bench_data_init(&data, size, options.seed);
+        for (j = 0; j < G_N_ELEMENTS(cases); j++) {
+            if (!case_is_selected(cases + j, filter))
+                continue;
+            for (k = 0; k < threads->len; k++) {
+                nthreads = g_array_index(threads, guint, k);
+                if (!options.quiet)
+                    g_printerr("%-20s size %5u, threads %2u ... ",
+                               cases[j].name, size, nthreads);
+                set_nthreads(nthreads);
+                run_case(cases + j, &data, options.repeat, times);
+                rss = get_peak_rss();
+                if (!options.quiet)
+                    g_printerr("%.6f s\n", times[0]);
+
+                fprintf(fh, "%s\n    {", first ? "" : ",");
+                fprintf(fh, "\"name\": \"%s\", \"group\": \"%s\", ",
+                        cases[j].name, cases[j].group);
+                fprintf(fh, "\"size\": %u, \"threads\": %u, ",
+                        size, nthreads);
+                fprintf(fh, "\"min\": %.9g, \"median\": %.9g, ",
+                        times[0],
+                        0.5*(times[(options.repeat - 1)/2]
+                             + times[options.repeat/2]));
+                fprintf(fh, "\"peak_rss_kib\": ");
+                print_rss(fh, rss);
+                fprintf(fh, "}");
+                first = FALSE;
+            }
+        }
+        bench_data_free(&data);
+    }
+    g_free(times);
+
+    fprintf(fh, "\n  ],\n");
+    fprintf(fh, "  \"peak_rss_kib\": ");
+    print_rss(fh, get_peak_rss());
+    fprintf(fh, "\n}\n");
+
+    if (fh != stdout)
+        fclose(fh);
+
+    g_strfreev(filter);
+    g_array_free(sizes, TRUE);
+    g_array_free(threads, TRUE);
+
+    return 0;
+}
+
+/* vim: set cin et ts=4 sw=4 cino=>1s,e0,n0,f0,{0,}0,^0,\:1s,=0,g1s,h0,t0,+1s,c3,(0,u0 : */